@@ -0,0 +1,499 @@
+/**
+ * Lightmap path tracer, the GPU side of gpu_baker.h. Every function mirrors
+ * the CPU baker (BakeEngine::SampleTexel, PathIntegrator, RayTracer and the
+ * Sobol Sampler) and draws sample dimensions in the same order, so both
+ * trace the same paths up to floating point differences.
+ */
+
+struct Params {
+	// Range of the texel list this dispatch covers
+	texelOffset: u32,
+	texelCount: u32,
+	// Samples added to every texel, continuing its sequence, unless it reaches its target first
+	sampleCount: u32,
+	maxBounces: u32,
+	// Lights the alias table picks from; 0 without lights
+	lightCount: u32,
+	punctualCount: u32,
+	epsilon: f32,
+	// Atlas page size, for the resolve pass
+	width: u32,
+	skyColor: vec3f,
+	height: u32,
+	padding0: u32,
+	padding1: u32,
+	padding2: u32,
+	padding3: u32,
+};
+
+// Layouts match gpu_scene.h
+struct Node {
+	lo: vec3f,
+	first: u32,
+	hi: vec3f,
+	count: u32,
+};
+
+struct Triangle {
+	v0: vec3f,
+	id: u32,
+	edge1: vec3f,
+	material: u32,
+	edge2: vec3f,
+	padding: u32,
+};
+
+struct Material {
+	albedo: vec4f,
+	emission: vec4f,
+};
+
+struct Light {
+	position: vec3f,
+	kind: u32,
+	direction: vec3f,
+	intensity: f32,
+	color: vec3f,
+	cosInnerAngle: f32,
+	cosOuterAngle: f32,
+	pmf: f32,
+	aliasThreshold: f32,
+	aliasIndex: u32,
+};
+
+struct EmissiveTriangle {
+	v0: vec3f,
+	area: f32,
+	v1: vec3f,
+	padding0: u32,
+	v2: vec3f,
+	padding1: u32,
+	normal: vec3f,
+	padding2: u32,
+	radiance: vec3f,
+	padding3: u32,
+};
+
+struct Texel {
+	position: vec3f,
+	index: u32,
+	normal: vec3f,
+	seed: u32,
+};
+
+struct Accumulator {
+	irradianceSum: vec3f,
+	luminanceSquaredSum: f32,
+	sampleCount: u32,
+	sampleTarget: u32,
+	padding0: u32,
+	padding1: u32,
+};
+
+@group(0) @binding(0) var<uniform> params: Params;
+@group(0) @binding(1) var<storage, read> nodes: array<Node>;
+@group(0) @binding(2) var<storage, read> triangles: array<Triangle>;
+@group(0) @binding(3) var<storage, read> materials: array<Material>;
+@group(0) @binding(4) var<storage, read> lights: array<Light>;
+@group(0) @binding(5) var<storage, read> emissiveTriangles: array<EmissiveTriangle>;
+@group(0) @binding(6) var<storage, read> lightOfTriangle: array<u32>;
+@group(0) @binding(7) var<storage, read> texels: array<Texel>;
+@group(0) @binding(8) var<storage, read_write> accumulators: array<Accumulator>;
+// Texel means, written by the resolve pass
+@group(0) @binding(9) var lightmap: texture_storage_2d_array<rgba16float, write>;
+
+const PI = 3.14159265358979323846;
+const INV_PI = 0.318309886183790671538;
+const FLT_MAX = 3.40282347e38;
+const NO_HIT = 0xFFFFFFFFu;
+const NO_LIGHT = 0xFFFFFFFFu;
+const EMISSIVE_LIGHT = 2u;
+const SPOT_LIGHT = 1u;
+// Must match kGpuStackSize in gpu_scene.h
+const STACK_SIZE = 64u;
+const RUSSIAN_ROULETTE_DEPTH = 2u;
+// Shadow rays towards area lights stop this fraction short so they do not hit the light itself
+const SHADOW_RAY_SHORTENING = 1e-4;
+// Barycentrics may dip this far below zero, so rays through shared edges do not slip between triangles
+const EDGE_TOLERANCE = -1.1920929e-7;
+
+// ---------------------------------------------------------------------------
+// Sampler: Owen-scrambled Sobol pairs, as Sampler::NextSobolPair
+
+// 64-bit integers as (low, high) words; WGSL has no u64
+fn mul32x32(a: u32, b: u32) -> vec2u {
+	let a0 = a & 0xFFFFu;
+	let a1 = a >> 16u;
+	let b0 = b & 0xFFFFu;
+	let b1 = b >> 16u;
+	let p00 = a0 * b0;
+	let p01 = a0 * b1;
+	let p10 = a1 * b0;
+	let p11 = a1 * b1;
+	let middle = (p00 >> 16u) + (p01 & 0xFFFFu) + (p10 & 0xFFFFu);
+	return vec2u((p00 & 0xFFFFu) | (middle << 16u), p11 + (p01 >> 16u) + (p10 >> 16u) + (middle >> 16u));
+}
+
+fn mul64(a: vec2u, b: vec2u) -> vec2u {
+	let low = mul32x32(a.x, b.x);
+	return vec2u(low.x, low.y + a.x * b.y + a.y * b.x);
+}
+
+fn add64(a: vec2u, b: vec2u) -> vec2u {
+	let low = a.x + b.x;
+	return vec2u(low, a.y + b.y + select(0u, 1u, low < a.x));
+}
+
+// Right shift by 0 < n < 32
+fn shiftRight64(a: vec2u, n: u32) -> vec2u {
+	return vec2u((a.x >> n) | (a.y << (32u - n)), a.y >> n);
+}
+
+// Random::Mix (splitmix64 finalizer)
+fn mix64(value: vec2u) -> vec2u {
+	var x = add64(value, vec2u(0x7F4A7C15u, 0x9E3779B9u));
+	x = mul64(x ^ shiftRight64(x, 30u), vec2u(0x1CE4E5B9u, 0xBF58476Du));
+	x = mul64(x ^ shiftRight64(x, 27u), vec2u(0x133111EBu, 0x94D049BBu));
+	return x ^ shiftRight64(x, 31u);
+}
+
+fn hashCombine(seed: u32, value: u32) -> u32 {
+	return mix64(vec2u(value, seed)).x;
+}
+
+fn laineKarrasPermutation(value: u32, seed: u32) -> u32 {
+	var x = value + seed;
+	x ^= x * 0x6C50B47Cu;
+	x ^= x * 0xB82F1E52u;
+	x ^= x * 0xC7AFE638u;
+	x ^= x * 0x8D22F6E6u;
+	return x;
+}
+
+fn nestedUniformScramble(x: u32, seed: u32) -> u32 {
+	return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+fn sobolDimension1(index: u32) -> u32 {
+	var result = 0u;
+	var v = 0x80000000u;
+	var i = index;
+	while (i != 0u) {
+		if ((i & 1u) != 0u) {
+			result ^= v;
+		}
+		i >>= 1u;
+		v ^= v >> 1u;
+	}
+	return result;
+}
+
+fn toUnitFloat(x: u32) -> f32 {
+	return f32(x >> 8u) * (1.0 / 16777216.0);
+}
+
+struct SamplerState {
+	seed: u32,
+	sampleIndex: u32,
+	dimension: u32,
+};
+
+fn next2D(state: ptr<function, SamplerState>) -> vec2f {
+	let pairSeed = hashCombine((*state).seed, (*state).dimension);
+	(*state).dimension += 1u;
+	let index = nestedUniformScramble((*state).sampleIndex, pairSeed);
+	let u = nestedUniformScramble(reverseBits(index), hashCombine(pairSeed, 0u));
+	let v = nestedUniformScramble(sobolDimension1(index), hashCombine(pairSeed, 1u));
+	return vec2f(toUnitFloat(u), toUnitFloat(v));
+}
+
+fn next1D(state: ptr<function, SamplerState>) -> f32 {
+	return next2D(state).x;
+}
+
+// ---------------------------------------------------------------------------
+// Ray tracing over the flattened bvh::v2 hierarchy
+
+struct Hit {
+	// Index into `triangles` (leaf order), NO_HIT on a miss
+	triangle: u32,
+	distance: f32,
+};
+
+// Entry distance into a box, FLT_MAX when the ray misses it within [0, maxDistance]
+fn intersectBox(node: Node, origin: vec3f, inverseDirection: vec3f, maxDistance: f32) -> f32 {
+	let t0 = (node.lo - origin) * inverseDirection;
+	let t1 = (node.hi - origin) * inverseDirection;
+	let tNear = min(t0, t1);
+	let tFar = max(t0, t1);
+	let entry = max(max(tNear.x, tNear.y), max(tNear.z, 0.0));
+	let exit = min(min(tFar.x, tFar.y), min(tFar.z, maxDistance));
+	return select(FLT_MAX, entry, entry <= exit);
+}
+
+// Möller-Trumbore with bvh::v2's edge tolerance; the hit distance in [0, maxDistance], or -1
+fn intersectTriangle(triangle: Triangle, origin: vec3f, direction: vec3f, maxDistance: f32) -> f32 {
+	let p = cross(direction, triangle.edge2);
+	let determinant = dot(triangle.edge1, p);
+	if (determinant == 0.0) {
+		return -1.0;
+	}
+	let inverseDeterminant = 1.0 / determinant;
+	let s = origin - triangle.v0;
+	let u = dot(s, p) * inverseDeterminant;
+	let q = cross(s, triangle.edge1);
+	let v = dot(direction, q) * inverseDeterminant;
+	let t = dot(triangle.edge2, q) * inverseDeterminant;
+	if (u < EDGE_TOLERANCE || v < EDGE_TOLERANCE || 1.0 - u - v < EDGE_TOLERANCE || t < 0.0 || t > maxDistance) {
+		return -1.0;
+	}
+	return t;
+}
+
+// Closest hit, or with `anyHit` the first one found
+fn traceRay(origin: vec3f, direction: vec3f, maxDistance: f32, anyHit: bool) -> Hit {
+	var hit = Hit(NO_HIT, maxDistance);
+	// Division by zero is not defined in WGSL, so flat components get a tiny stand-in
+	let safeDirection = select(direction, vec3f(1e-20), abs(direction) < vec3f(1e-20));
+	let inverseDirection = 1.0 / safeDirection;
+	if (intersectBox(nodes[0], origin, inverseDirection, maxDistance) == FLT_MAX) {
+		return hit;
+	}
+
+	var stack: array<u32, STACK_SIZE>;
+	var stackSize = 0u;
+	var current = 0u;
+	loop {
+		let node = nodes[current];
+		if (node.count > 0u) {
+			for (var i = node.first; i < node.first + node.count; i++) {
+				let t = intersectTriangle(triangles[i], origin, direction, hit.distance);
+				if (t >= 0.0) {
+					hit = Hit(i, t);
+					if (anyHit) {
+						return hit;
+					}
+				}
+			}
+		}
+		else {
+			let left = intersectBox(nodes[node.first], origin, inverseDirection, hit.distance);
+			let right = intersectBox(nodes[node.first + 1u], origin, inverseDirection, hit.distance);
+			if (left != FLT_MAX && right != FLT_MAX) {
+				// Nearer child first, the other one later; BuildGpuBakeScene refuses
+				// hierarchies deep enough for the guard to drop a child
+				if (stackSize < STACK_SIZE) {
+					stack[stackSize] = select(node.first, node.first + 1u, left <= right);
+					stackSize++;
+				}
+				current = select(node.first + 1u, node.first, left <= right);
+				continue;
+			}
+			if (left != FLT_MAX) {
+				current = node.first;
+				continue;
+			}
+			if (right != FLT_MAX) {
+				current = node.first + 1u;
+				continue;
+			}
+		}
+		if (stackSize == 0u) {
+			break;
+		}
+		stackSize--;
+		current = stack[stackSize];
+	}
+	return hit;
+}
+
+fn occluded(origin: vec3f, direction: vec3f, maxDistance: f32) -> bool {
+	return traceRay(origin, direction, maxDistance, true).triangle != NO_HIT;
+}
+
+// ---------------------------------------------------------------------------
+// Path integrator
+
+fn powerHeuristic(pdf: f32, otherPdf: f32) -> f32 {
+	let a = pdf * pdf;
+	let b = otherPdf * otherPdf;
+	return select(0.0, a / (a + b), a + b > 0.0);
+}
+
+// Duff et al. 2017, with copysign's handling of -0
+fn sampleCosineHemisphere(n: vec3f, u: vec2f) -> vec3f {
+	let sign = select(1.0, -1.0, (bitcast<u32>(n.z) & 0x80000000u) != 0u);
+	let a = -1.0 / (sign + n.z);
+	let b = n.x * n.y * a;
+	let tangent = vec3f(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	let bitangent = vec3f(b, sign + n.y * n.y * a, -n.y);
+	let r = sqrt(u.x);
+	let phi = 2.0 * PI * u.y;
+	return tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + n * sqrt(max(0.0, 1.0 - u.x));
+}
+
+fn spotFalloff(light: Light, toSurface: vec3f) -> f32 {
+	if (light.kind != SPOT_LIGHT) {
+		return 1.0;
+	}
+	let cosAngle = dot(toSurface, light.direction);
+	if (light.cosInnerAngle <= light.cosOuterAngle) {
+		return select(0.0, 1.0, cosAngle >= light.cosOuterAngle);
+	}
+	let t = clamp((cosAngle - light.cosOuterAngle) / (light.cosInnerAngle - light.cosOuterAngle), 0.0, 1.0);
+	return t * t * (3.0 - 2.0 * t);
+}
+
+fn irradianceFromLight(light: Light, origin: vec3f, normal: vec3f) -> vec3f {
+	let toLight = light.position - origin;
+	let distanceSquared = dot(toLight, toLight);
+	let distance = sqrt(distanceSquared);
+	let direction = toLight / distance;
+	let cosTheta = dot(normal, direction);
+	if (cosTheta <= 0.0) {
+		return vec3f(0.0);
+	}
+	let falloff = spotFalloff(light, -direction);
+	if (falloff <= 0.0 || occluded(origin, direction, distance)) {
+		return vec3f(0.0);
+	}
+	return light.color * (light.intensity * falloff * cosTheta / distanceSquared);
+}
+
+fn emissiveIrradiance(triangle: EmissiveTriangle, pmf: f32, origin: vec3f, normal: vec3f, state: ptr<function, SamplerState>) -> vec3f {
+	let u = next2D(state);
+	let su = sqrt(u.x);
+	let b1 = u.y * su;
+	let point = triangle.v0 * (1.0 - su) + triangle.v1 * b1 + triangle.v2 * (su - b1);
+	let toLight = point - origin;
+	let distanceSquared = dot(toLight, toLight);
+	let distance = sqrt(distanceSquared);
+	let direction = toLight / distance;
+	let cosTheta = dot(normal, direction);
+	let cosLight = -dot(triangle.normal, direction);
+	if (cosTheta <= 0.0 || cosLight <= 0.0) {
+		return vec3f(0.0);
+	}
+	if (occluded(origin, direction, distance * (1.0 - SHADOW_RAY_SHORTENING))) {
+		return vec3f(0.0);
+	}
+	let lightPdf = pmf * distanceSquared / (triangle.area * cosLight);
+	let weight = powerHeuristic(lightPdf, cosTheta * INV_PI);
+	return triangle.radiance * (cosTheta * weight / lightPdf);
+}
+
+// One light picked from the alias table, as PathIntegrator::DirectIrradiance
+fn directIrradiance(position: vec3f, normal: vec3f, state: ptr<function, SamplerState>) -> vec3f {
+	let origin = position + normal * params.epsilon;
+	let u = min(next1D(state), 0.99999994);
+	if (params.lightCount == 0u) {
+		return vec3f(0.0);
+	}
+	let scaled = u * f32(params.lightCount);
+	let bin = min(u32(scaled), params.lightCount - 1u);
+	let index = select(lights[bin].aliasIndex, bin, scaled - f32(bin) < lights[bin].aliasThreshold);
+	let light = lights[index];
+	if (light.pmf <= 0.0) {
+		return vec3f(0.0);
+	}
+	if (light.kind != EMISSIVE_LIGHT) {
+		return irradianceFromLight(light, origin, normal) / light.pmf;
+	}
+	return emissiveIrradiance(emissiveTriangles[index - params.punctualCount], light.pmf, origin, normal, state);
+}
+
+// PathIntegrator::Radiance after a cosine-sampled first ray from a texel that sampled lights
+fn radiance(startOrigin: vec3f, startNormal: vec3f, startDirection: vec3f, state: ptr<function, SamplerState>) -> vec3f {
+	var origin = startOrigin;
+	var normal = startNormal;
+	var direction = startDirection;
+	var result = vec3f(0.0);
+	var throughput = vec3f(1.0);
+	for (var bounce = 0u; ; bounce++) {
+		let hit = traceRay(origin, direction, FLT_MAX, false);
+		if (hit.triangle == NO_HIT) {
+			result += throughput * params.skyColor;
+			break;
+		}
+
+		let triangle = triangles[hit.triangle];
+		var surfaceNormal = cross(triangle.edge1, triangle.edge2);
+		let normalLength = length(surfaceNormal);
+		surfaceNormal = select(-direction, surfaceNormal / normalLength, normalLength > 0.0);
+		surfaceNormal = select(surfaceNormal, -surfaceNormal, dot(surfaceNormal, direction) > 0.0);
+		let surfacePosition = origin + direction * hit.distance;
+		let material = materials[triangle.material];
+
+		let lightIndex = lightOfTriangle[triangle.id];
+		if (lightIndex != NO_LIGHT) {
+			let emissive = emissiveTriangles[lightIndex - params.punctualCount];
+			let cosLight = -dot(emissive.normal, direction);
+			if (cosLight > 0.0) {
+				let lightPdf = lights[lightIndex].pmf * hit.distance * hit.distance / (emissive.area * cosLight);
+				let weight = powerHeuristic(dot(normal, direction) * INV_PI, lightPdf);
+				result += throughput * material.emission.rgb * weight;
+			}
+		}
+		if (bounce >= params.maxBounces) {
+			break;
+		}
+		result += throughput * material.albedo.rgb * INV_PI * directIrradiance(surfacePosition, surfaceNormal, state);
+
+		throughput *= material.albedo.rgb;
+		if (bounce >= RUSSIAN_ROULETTE_DEPTH) {
+			let survival = min(0.95, max(throughput.x, max(throughput.y, throughput.z)));
+			if (next1D(state) >= survival) {
+				break;
+			}
+			throughput /= survival;
+		}
+
+		origin = surfacePosition + surfaceNormal * params.epsilon;
+		normal = surfaceNormal;
+		direction = sampleCosineHemisphere(surfaceNormal, next2D(state));
+	}
+	return result;
+}
+
+fn sampleTexel(texel: Texel, sampleIndex: u32) -> vec3f {
+	var state = SamplerState(texel.seed, sampleIndex, 0u);
+	let direct = directIrradiance(texel.position, texel.normal, &state);
+	let origin = texel.position + texel.normal * params.epsilon;
+	let direction = sampleCosineHemisphere(texel.normal, next2D(&state));
+	return direct + PI * radiance(origin, texel.normal, direction, &state);
+}
+
+@compute @workgroup_size(64)
+fn bake(@builtin(global_invocation_id) id: vec3u) {
+	if (id.x >= params.texelCount) {
+		return;
+	}
+	let slot = params.texelOffset + id.x;
+	let texel = texels[slot];
+	var accumulator = accumulators[slot];
+	let sampleEnd = min(accumulator.sampleCount + params.sampleCount, accumulator.sampleTarget);
+	for (var s = accumulator.sampleCount; s < sampleEnd; s++) {
+		let irradiance = sampleTexel(texel, s);
+		let luminance = dot(irradiance, vec3f(0.2126, 0.7152, 0.0722));
+		accumulator.irradianceSum += irradiance;
+		accumulator.luminanceSquaredSum += luminance * luminance;
+		accumulator.sampleCount += 1u;
+	}
+	accumulators[slot] = accumulator;
+}
+
+@compute @workgroup_size(64)
+fn resolve(@builtin(global_invocation_id) id: vec3u) {
+	if (id.x >= params.texelCount) {
+		return;
+	}
+	let slot = params.texelOffset + id.x;
+	let accumulator = accumulators[slot];
+	let pageTexels = params.width * params.height;
+	let index = texels[slot].index;
+	let page = index / pageTexels;
+	let x = index % params.width;
+	let y = (index % pageTexels) / params.width;
+	let mean = accumulator.irradianceSum / f32(max(accumulator.sampleCount, 1u));
+	textureStore(lightmap, vec2u(x, y), page, vec4f(mean, 1.0));
+}
@@ -1,11 +1,15 @@
 struct VertexInput {
 	@location(0) position: vec3f,
 	@location(1) color: vec3f,
+	@location(2) lightmapUV: vec2f,
 };
 
 struct VertexOutput {
 	@builtin(position) position: vec4f,
 	@location(0) color: vec3f,
+	@location(1) lightmapUV: vec2f,
+	// The lightmap is baked in object space, so shading normals are too
+	@location(2) objectPosition: vec3f,
 };
 
 /**
@@ -17,22 +21,104 @@ struct MyUniforms {
     modelMatrix: mat4x4f,
     color: vec4f,
     time: f32,
+    // Sky and sun radiance on SH (rgb), see prt_lightmap.h
+    lightSh: array<vec4f, 9>,
+    // Time-of-day basis layers to blend (x, y), the weight of y (z) and 1 while the cycle plays (w)
+    timeOfDay: vec4f,
+    cycleSunColor: vec4f,
+    cycleSkyColor: vec4f,
 };
 
 // Instead of the simple uTime variable, our uniform variable is a struct
 @group(0) @binding(0) var<uniform> uMyUniforms: MyUniforms;
 
+// Baked irradiance (rgb) and its luminance L1 directionality, see directional_lightmap.h
+@group(0) @binding(1) var lightmapTexture: texture_2d<f32>;
+@group(0) @binding(2) var directionalTexture: texture_2d<f32>;
+@group(0) @binding(3) var lightmapSampler: sampler;
+// PRT transfer of the distant lighting, one layer per SH coefficient
+@group(0) @binding(4) var transferTexture: texture_2d_array<f32>;
+// Time-of-day bases: unit white sun per keyframe, then unit white sky, see time_of_day.h
+@group(0) @binding(5) var timeOfDayTexture: texture_2d_array<f32>;
+
+const PI = 3.14159265358979323846;
+
+/**
+ * Irradiance for normal `n` relative to its average over all normals, from
+ * L1 SH given as band 1 / band 0. Mirrors EvaluateL1Irradiance in the baker.
+ */
+fn evaluateL1Irradiance(band1: vec3f, n: vec3f) -> f32 {
+	let len = min(length(band1), 1.0);
+	if (len < 1e-6) {
+		return 1.0;
+	}
+	let q = 0.5 * (1.0 + dot(band1, n) / length(band1));
+	let p = 1.0 + 2.0 * len;
+	let a = (1.0 - len) / (1.0 + len);
+	return a + (1.0 - a) * (p + 1.0) * pow(max(q, 0.0), p);
+}
+
+/**
+ * Baked irradiance bent towards the shading normal `n`: two fetches.
+ */
+fn bakedIrradiance(uv: vec2f, n: vec3f) -> vec3f {
+	let irradiance = textureSample(lightmapTexture, lightmapSampler, uv).rgb;
+	let directional = textureSample(directionalTexture, lightmapSampler, uv);
+	let band1 = directional.xyz * 2.0 - 1.0;
+	return irradiance * evaluateL1Irradiance(band1, n) / max(directional.w * 4.0, 1e-3);
+}
+
+/**
+ * Irradiance from the sky and sun: the transfer dotted with their SH
+ * projection. Mirrors PrtLightmap::EvaluateIrradiance in the baker.
+ */
+fn relitIrradiance(uv: vec2f) -> vec3f {
+	var irradiance = vec3f(0.0);
+	for (var i = 0u; i < textureNumLayers(transferTexture); i++) {
+		irradiance += textureSample(transferTexture, lightmapSampler, uv, i).rgb * uMyUniforms.lightSh[i].rgb;
+	}
+	return max(irradiance, vec3f(0.0));
+}
+
+/**
+ * Irradiance from the sky and sun of the time-of-day cycle: the two sun
+ * keyframe bases around the hour, blended, plus the sky basis. Mirrors
+ * TimeOfDayLightmaps::Blend in the baker.
+ */
+fn timeOfDayIrradiance(uv: vec2f) -> vec3f {
+	let blend = uMyUniforms.timeOfDay;
+	let first = textureSample(timeOfDayTexture, lightmapSampler, uv, u32(blend.x)).rgb;
+	let second = textureSample(timeOfDayTexture, lightmapSampler, uv, u32(blend.y)).rgb;
+	let sky = textureSample(timeOfDayTexture, lightmapSampler, uv, textureNumLayers(timeOfDayTexture) - 1u).rgb;
+	return mix(first, second, blend.z) * uMyUniforms.cycleSunColor.rgb + sky * uMyUniforms.cycleSkyColor.rgb;
+}
+
 @vertex
 fn vs_main(in: VertexInput) -> VertexOutput {
 	var out: VertexOutput;
 	out.position = uMyUniforms.projectionMatrix * uMyUniforms.viewMatrix * uMyUniforms.modelMatrix * vec4f(in.position, 1.0);
 	out.color = in.color;
+	out.lightmapUV = in.lightmapUV;
+	out.objectPosition = in.position;
 	return out;
 }
 
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4f {
-	let color = in.color * uMyUniforms.color.rgb;
+	// No normal maps yet: the face normal stands in for the shading normal. Its sign from the
+	// derivatives is arbitrary; the preview mesh is closed and baked on its outside, which is
+	// the side in view, so it is turned to the camera.
+	let faceNormal = normalize(cross(dpdx(in.objectPosition), dpdy(in.objectPosition)));
+	let modelView = uMyUniforms.viewMatrix * uMyUniforms.modelMatrix;
+	let viewPosition = (modelView * vec4f(in.objectPosition, 1.0)).xyz;
+	let viewNormal = (modelView * vec4f(faceNormal, 0.0)).xyz;
+	let normal = select(-faceNormal, faceNormal, dot(viewNormal, viewPosition) < 0.0);
+	let albedo = in.color * uMyUniforms.color.rgb;
+	var distant = relitIrradiance(in.lightmapUV);
+	if (uMyUniforms.timeOfDay.w > 0.5) {
+		distant = timeOfDayIrradiance(in.lightmapUV);
+	}
+	let color = albedo / PI * (bakedIrradiance(in.lightmapUV, normal) + distant);
 	// Gamma-correction
 	// let corrected_color = pow(color, vec3f(2.2));
 	return vec4f(color, uMyUniforms.color.a);
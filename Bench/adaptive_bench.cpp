@@ -0,0 +1,101 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/sampling.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Relative luminance error of the texel at the given quantile, so dim texels count as much as lit ones.
+        double GetTexelErrorQuantile(const Lightmap& lightmap, const Lightmap& reference, double quantile)
+        {
+            std::vector<double> errors;
+            for (size_t i = 0; i < reference.texels.size(); ++i)
+            {
+                double expected = Luminance(glm::vec3(reference.texels[i]));
+                if (reference.texels[i].w > 0.0f && expected > 0.0)
+                    errors.push_back(std::abs(Luminance(glm::vec3(lightmap.texels[i])) - expected) / expected);
+            }
+            if (errors.empty())
+                return 0.0;
+            size_t index = std::min(errors.size() - 1, static_cast<size_t>(quantile * static_cast<double>(errors.size())));
+            std::nth_element(errors.begin(), errors.begin() + static_cast<std::ptrdiff_t>(index), errors.end());
+            return errors[index];
+        }
+    }
+
+    /**
+     * Bench adaptive [referenceSamples=4096]: fixed sample counts against
+     * convergence-driven passes on an open yard with a low shelter, where
+     * the open ground converges long before the texels under the roof.
+     * Reports samples, time, the relative error of the whole lightmap and
+     * the per-texel relative error that 50% and 95% of the texels stay
+     * under, against a fixed-count reference.
+     */
+    int RunAdaptiveBench(int argc, char** argv)
+    {
+        uint32_t referenceSamples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 4096;
+
+        // A sunlit yard under a bright sky, which converges in a few samples, with a low
+        // shelter whose underside only sees light bounced in from the sides.
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -15.0f, -0.1f, -15.0f }, { 15.0f, 0.0f, 15.0f }));
+        scene.meshes.push_back(MakeBox({ -3.0f, 0.8f, -3.0f }, { 3.0f, 1.0f, 3.0f }));
+        for (float x : { -2.8f, 2.6f })
+            for (float z : { -2.8f, 2.6f })
+                scene.meshes.push_back(MakeBox({ x, 0.0f, z }, { x + 0.2f, 0.8f, z + 0.2f }));
+        scene.meshes.push_back(MakeSphere({ 0.0f, 0.3f, 0.0f }, 0.3f, 16));
+        scene.materials = { Material{} };
+        scene.skyColor = glm::vec3(0.6f, 0.7f, 0.9f);
+        const float sunDistance = 1000.0f;
+        Light sun;
+        sun.position = glm::normalize(glm::vec3(0.4f, 1.0f, 0.3f)) * sunDistance;
+        sun.intensity = 3.0f * sunDistance * sunDistance;
+        scene.lights.push_back(sun);
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 3.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        auto bake = [&](uint32_t minSamples, uint32_t maxSamples, float errorThreshold, BakeStats& stats) {
+            BakeSettings settings;
+            settings.minSamples = minSamples;
+            settings.maxSamples = maxSamples;
+            settings.errorThreshold = errorThreshold;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            stats = engine.Bake();
+            return engine.GetLightmap();
+        };
+        BakeStats stats;
+        Lightmap reference = bake(referenceSamples, referenceSamples, 0.0f, stats);
+        std::printf("%zu covered texels, reference %u samples each in %.1f s\n", stats.coveredTexels, referenceSamples, stats.seconds);
+
+        std::printf("  mode       setting    samples   seconds  rel error  texel p50  texel p95\n");
+        for (uint32_t samples : { 32u, 64u, 128u, 256u })
+        {
+            Lightmap lightmap = bake(samples, samples, 0.0f, stats);
+            std::printf("  fixed      %7u %10llu %9.2f  %9.4f  %9.4f  %9.4f\n", samples, static_cast<unsigned long long>(stats.samples), stats.seconds,
+                        GetRelativeError(lightmap, reference), GetTexelErrorQuantile(lightmap, reference, 0.5),
+                        GetTexelErrorQuantile(lightmap, reference, 0.95));
+        }
+        for (float threshold : { 0.08f, 0.05f, 0.03f, 0.02f })
+        {
+            Lightmap lightmap = bake(16, 1024, threshold, stats);
+            std::printf("  adaptive   %7.2f %10llu %9.2f  %9.4f  %9.4f  %9.4f\n", threshold, static_cast<unsigned long long>(stats.samples), stats.seconds,
+                        GetRelativeError(lightmap, reference), GetTexelErrorQuantile(lightmap, reference, 0.5),
+                        GetTexelErrorQuantile(lightmap, reference, 0.95));
+        }
+        return 0;
+    }
+}
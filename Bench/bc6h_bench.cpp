@@ -0,0 +1,144 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/bc6h_encoder.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // DDS with a DX10 header holding DXGI_FORMAT_BC6H_UF16, pages stacked vertically.
+        bool WriteDds(const std::filesystem::path& path, const Bc6hLightmap& compressed)
+        {
+            uint32_t header[31] = {};
+            header[0] = 124;
+            header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000; // caps, height, width, pixel format, linear size
+            header[2] = compressed.height * compressed.atlasCount;
+            header[3] = compressed.width;
+            header[4] = static_cast<uint32_t>(compressed.blocks.size());
+            header[18] = 32;
+            header[19] = 0x4; // four character code
+            std::memcpy(&header[20], "DX10", 4);
+            header[26] = 0x1000; // texture
+            const uint32_t dx10[5] = { 95, 3, 0, 1, 0 }; // BC6H_UF16, 2D texture, one array slice
+            std::ofstream file(path, std::ios::binary);
+            file.write("DDS ", 4);
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(dx10), sizeof(dx10));
+            file.write(reinterpret_cast<const char*>(compressed.blocks.data()), static_cast<std::streamsize>(compressed.blocks.size()));
+            return static_cast<bool>(file);
+        }
+
+        // The encoder's own decode of `compressed` as rows of float RGB, in the DDS layout.
+        bool WriteDecoded(const std::filesystem::path& path, const Bc6hLightmap& compressed)
+        {
+            uint32_t rows = compressed.height * compressed.atlasCount;
+            std::vector<float> pixels(static_cast<size_t>(compressed.width) * rows * 3);
+            glm::vec3 texels[16];
+            for (uint32_t blockY = 0; blockY < compressed.GetBlocksY() * compressed.atlasCount; ++blockY)
+            {
+                for (uint32_t blockX = 0; blockX < compressed.GetBlocksX(); ++blockX)
+                {
+                    if (!DecodeBc6hBlock(&compressed.blocks[(static_cast<size_t>(blockY) * compressed.GetBlocksX() + blockX) * 16], texels))
+                        return false;
+                    for (uint32_t i = 0; i < 16; ++i)
+                    {
+                        uint32_t x = blockX * 4 + i % 4;
+                        uint32_t y = blockY * 4 + i / 4;
+                        if (x < compressed.width && y < rows)
+                            std::memcpy(&pixels[(static_cast<size_t>(y) * compressed.width + x) * 3], &texels[i], sizeof(glm::vec3));
+                    }
+                }
+            }
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size() * sizeof(float)));
+            return static_cast<bool>(file);
+        }
+    }
+
+    /**
+     * Bench bc6h [texelsPerUnit=4] [outputDirectory]: BC6H compression time
+     * and PSNR of a baked floor with boxes and point lights, per quality.
+     * With an output directory, also writes bc6h_<quality>.dds and the
+     * encoder's own decode of it, bc6h_<quality>.bin, for an independent
+     * decoder to compare against (see Tools/check_bc6h.py); that lightmap is
+     * scaled to a largest channel of 1 so 8-bit decoders see it unclamped.
+     */
+    int RunBc6hBench(int argc, char** argv)
+    {
+        AtlasOptions options;
+        options.texelsPerUnit = argc > 0 ? static_cast<float>(std::atof(argv[0])) : 4.0f;
+        std::filesystem::path outputDirectory = argc > 1 ? argv[1] : "";
+
+        Scene scene;
+        scene.materials = { Material{} };
+        scene.skyColor = glm::vec3(0.2f, 0.3f, 0.5f);
+        scene.meshes.push_back(MakeBox({ -20.0f, -0.1f, -20.0f }, { 20.0f, 0.0f, 20.0f }));
+        for (int i = 0; i < 6; ++i)
+        {
+            float x = -12.0f + 5.0f * static_cast<float>(i);
+            scene.meshes.push_back(MakeBox({ x - 1.0f, 0.0f, -1.0f }, { x + 1.0f, 1.0f + 0.5f * static_cast<float>(i), 1.0f }));
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            Light light;
+            light.position = glm::vec3(-10.0f + 7.0f * static_cast<float>(i), 2.5f, 3.0f);
+            light.intensity = 3.0f;
+            scene.lights.push_back(light);
+        }
+
+        bvh::v2::ThreadPool threadPool;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+        BakeSettings settings;
+        settings.minSamples = 64;
+        settings.maxSamples = 512;
+        settings.maxBounces = 2;
+        settings.errorThreshold = 0.01f;
+        BakeEngine engine(scene, texels, settings, threadPool);
+        engine.Bake();
+        Lightmap lightmap = engine.GetLightmap();
+        std::printf("%ux%u x%u atlas, RGBA16F %.2f MB\n", lightmap.width, lightmap.height, lightmap.atlasCount, static_cast<double>(lightmap.texels.size()) * 8.0 / 1e6);
+
+        Lightmap normalized = lightmap;
+        float largest = 0.0f;
+        for (const glm::vec4& texel : lightmap.texels)
+            largest = std::max(largest, std::max(texel.x, std::max(texel.y, texel.z)));
+        for (glm::vec4& texel : normalized.texels)
+            texel = glm::vec4(glm::vec3(texel) / std::max(largest, 1e-6f), texel.w);
+
+        for (Bc6hQuality quality : { Bc6hQuality::Fast, Bc6hQuality::High })
+        {
+            const char* name = quality == Bc6hQuality::Fast ? "fast" : "high";
+            Bc6hSettings bc6hSettings;
+            bc6hSettings.quality = quality;
+            Bc6hEncoder encoder(bc6hSettings);
+            BenchTimer timer;
+            Bc6hLightmap compressed = encoder.Encode(lightmap, threadPool);
+            double milliseconds = timer.GetMilliseconds();
+            const Bc6hStats& stats = encoder.GetStats();
+            std::printf("%s: %zu blocks (%zu two-region), %.0f ms (%.2f Mtexel/s), %.2f MB, PSNR %.2f dB\n", name, stats.blocks, stats.twoRegionBlocks,
+                        milliseconds, static_cast<double>(lightmap.texels.size()) / milliseconds / 1e3, static_cast<double>(compressed.blocks.size()) / 1e6, stats.psnr);
+            if (outputDirectory.empty())
+                continue;
+
+            compressed = encoder.Encode(normalized, threadPool);
+            std::filesystem::path stem = outputDirectory / (std::string("bc6h_") + name);
+            if (!WriteDds(stem.string() + ".dds", compressed) || !WriteDecoded(stem.string() + ".bin", compressed))
+            {
+                std::fprintf(stderr, "Could not write %s.dds\n", stem.string().c_str());
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
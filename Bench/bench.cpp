@@ -0,0 +1,88 @@
+#include "bench.h"
+
+#include <cmath>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    Mesh MakeBox(const glm::vec3& lower, const glm::vec3& upper, bool inward)
+    {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; ++i)
+            corners[i] = glm::vec3(i & 1 ? upper.x : lower.x, i & 2 ? upper.y : lower.y, i & 4 ? upper.z : lower.z);
+        // Counter-clockwise seen from outside.
+        const int faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+
+        Mesh mesh;
+        for (const auto& face : faces)
+        {
+            uint32_t base = static_cast<uint32_t>(mesh.positions.size());
+            glm::vec3 normal = glm::normalize(glm::cross(corners[face[1]] - corners[face[0]], corners[face[2]] - corners[face[0]]));
+            for (int k = 0; k < 4; ++k)
+            {
+                mesh.positions.push_back(corners[face[k]]);
+                mesh.normals.push_back(inward ? -normal : normal);
+            }
+            if (inward)
+                mesh.indices.insert(mesh.indices.end(), { base, base + 2, base + 1, base, base + 3, base + 2 });
+            else
+                mesh.indices.insert(mesh.indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+        }
+        return mesh;
+    }
+
+    Mesh MakeSphere(const glm::vec3& center, float radius, uint32_t segments)
+    {
+        Mesh mesh;
+        uint32_t sectors = segments * 2;
+        for (uint32_t i = 0; i <= segments; ++i)
+        {
+            for (uint32_t j = 0; j <= sectors; ++j)
+            {
+                float theta = kPi * static_cast<float>(i) / static_cast<float>(segments);
+                float phi = kPi * static_cast<float>(j) / static_cast<float>(segments);
+                glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                mesh.positions.push_back(center + normal * radius);
+                mesh.normals.push_back(normal);
+            }
+        }
+        uint32_t row = sectors + 1;
+        for (uint32_t i = 0; i < segments; ++i)
+        {
+            for (uint32_t j = 0; j < sectors; ++j)
+            {
+                uint32_t a = i * row + j;
+                mesh.indices.insert(mesh.indices.end(), { a, a + row, a + 1, a + 1, a + row, a + row + 1 });
+            }
+        }
+        return mesh;
+    }
+
+    double GetRelativeError(const Lightmap& lightmap, const Lightmap& reference, const std::vector<uint8_t>& mask)
+    {
+        double error = 0.0;
+        double total = 0.0;
+        for (size_t i = 0; i < reference.texels.size(); ++i)
+        {
+            if (reference.texels[i].w <= 0.0f || (!mask.empty() && !mask[i]))
+                continue;
+            error += glm::length(glm::vec3(lightmap.texels[i] - reference.texels[i]));
+            total += glm::length(glm::vec3(reference.texels[i]));
+        }
+        return total > 0.0 ? error / total : 0.0;
+    }
+
+    double GetBias(const Lightmap& lightmap, const Lightmap& reference, const std::vector<uint8_t>& mask)
+    {
+        double sum = 0.0;
+        double referenceSum = 0.0;
+        for (size_t i = 0; i < reference.texels.size(); ++i)
+        {
+            if (reference.texels[i].w <= 0.0f || (!mask.empty() && !mask[i]))
+                continue;
+            sum += Luminance(glm::vec3(lightmap.texels[i]));
+            referenceSum += Luminance(glm::vec3(reference.texels[i]));
+        }
+        return referenceSum > 0.0 ? sum / referenceSum - 1.0 : 0.0;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Scene/scene.h"
+#include "Bake/lightmap.h"
+
+namespace LightChef
+{
+    /**
+     * Scenes and measurements shared by the benchmarks of the Bench
+     * executable. Each benchmark is a Run*Bench() function that takes the
+     * arguments after its name and prints a table; they are meant to be
+     * run on a quiet machine with the Release build.
+     */
+    class BenchTimer
+    {
+    public:
+        double GetMilliseconds() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count(); }
+
+    private:
+        std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    };
+
+    // Axis-aligned box, facing out, or in for a room.
+    Mesh MakeBox(const glm::vec3& lower, const glm::vec3& upper, bool inward = false);
+    // UV sphere with `segments` rings and twice as many sectors.
+    Mesh MakeSphere(const glm::vec3& center, float radius, uint32_t segments);
+
+    // Relative L1 error of `lightmap` against `reference` over texels the reference covers and `mask` keeps (all when empty).
+    double GetRelativeError(const Lightmap& lightmap, const Lightmap& reference, const std::vector<uint8_t>& mask = {});
+    // Mean luminance of `lightmap` over `reference`'s minus one, over the same texels.
+    double GetBias(const Lightmap& lightmap, const Lightmap& reference, const std::vector<uint8_t>& mask = {});
+
+    int RunRasterizerBench(int argc, char** argv);
+    int RunAdaptiveBench(int argc, char** argv);
+    int RunLightSamplerBench(int argc, char** argv);
+    int RunSamplerBench(int argc, char** argv);
+    int RunBc6hBench(int argc, char** argv);
+    int RunWavefrontBench(int argc, char** argv);
+    int RunGuidingBench(int argc, char** argv);
+    int RunDenoiseBench(int argc, char** argv);
+    int RunSeamsBench(int argc, char** argv);
+    int RunProbesBench(int argc, char** argv);
+    int RunIncrementalBench(int argc, char** argv);
+    int RunHybridBench(int argc, char** argv);
+    int RunRadianceCacheBench(int argc, char** argv);
+    int RunReservoirsBench(int argc, char** argv);
+}
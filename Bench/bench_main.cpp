@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <cstring>
+#include "bench.h"
+
+namespace
+{
+    struct Benchmark
+    {
+        const char* name;
+        const char* description;
+        int (*run)(int argc, char** argv);
+    };
+
+    const Benchmark kBenchmarks[] = {
+        { "rasterizer", "atlas generation and texel rasterization throughput", LightChef::RunRasterizerBench },
+        { "adaptive", "fixed sample counts against convergence-driven passes at equal error", LightChef::RunAdaptiveBench },
+        { "lights", "noise and cost of one light sample per point, per sampling mode", LightChef::RunLightSamplerBench },
+        { "sampler", "convergence of the random, Sobol and blue-noise samplers", LightChef::RunSamplerBench },
+        { "bc6h", "BC6H compression time and PSNR, optionally writing DDS files", LightChef::RunBc6hBench },
+        { "wavefront", "per-path against wavefront bakes, and packet against scalar shadow rays", LightChef::RunWavefrontBench },
+        { "guiding", "equal-time error of unguided and guided bakes of a window-lit room", LightChef::RunGuidingBench },
+        { "denoise", "raw against denoised error per sample count, and the filter's cost", LightChef::RunDenoiseBench },
+        { "seams", "bilinear mismatch across UV seams before and after dilation and stitching", LightChef::RunSeamsBench },
+        { "probes", "memory, bake time and error of dense and sparse probe volumes", LightChef::RunProbesBench },
+        { "incremental", "per-light-group rebakes after recoloring and moving lights, against full bakes", LightChef::RunIncrementalBench },
+        { "hybrid", "CPU bakes sharing their tile queue with simulated devices of various speeds", LightChef::RunHybridBench },
+        { "cache", "cost and error of multi-bounce bakes with and without the radiance cache", LightChef::RunRadianceCacheBench },
+        { "reservoirs", "equal-time direct light error with and without reservoirs, per light sampler", LightChef::RunReservoirsBench },
+    };
+}
+
+/**
+ * Bench <benchmark> [arguments]: runs one of the baker's benchmarks, or
+ * lists them.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc >= 2)
+    {
+        for (const Benchmark& benchmark : kBenchmarks)
+        {
+            if (std::strcmp(argv[1], benchmark.name) == 0)
+                return benchmark.run(argc - 2, argv + 2);
+        }
+        std::fprintf(stderr, "Unknown benchmark: %s\n", argv[1]);
+    }
+    std::printf("Usage: Bench <benchmark> [arguments]\n");
+    for (const Benchmark& benchmark : kBenchmarks)
+        std::printf("  %-12s %s\n", benchmark.name, benchmark.description);
+    return argc >= 2 ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/denoiser.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    /**
+     * Bench denoise [referenceSamples=2048]: error of fixed-count bakes of
+     * a small room lit by a point light, before and after the A-Trous
+     * denoiser, against a fixed-count reference. The last column is the
+     * smallest raw sample count that the denoised bake is at least as
+     * accurate as, so the sample savings can be read off directly.
+     */
+    int RunDenoiseBench(int argc, char** argv)
+    {
+        uint32_t referenceSamples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 2048;
+
+        // A closed room with a crate and a ball: soft indirect light everywhere, and contact
+        // shadows and creases the edge-stopping has to keep.
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -2.0f, 0.0f, -2.0f }, { 2.0f, 3.0f, 2.0f }, true));
+        scene.meshes.push_back(MakeBox({ -0.5f, 0.0f, -0.5f }, { 0.5f, 1.0f, 0.5f }));
+        scene.meshes.push_back(MakeSphere({ 1.0f, 1.5f, 1.0f }, 0.4f, 12));
+        scene.meshes[1].materialIndex = 1;
+        scene.materials = { Material{}, Material{ glm::vec3(0.8f, 0.2f, 0.2f), glm::vec3(0.0f) } };
+        Light light;
+        light.position = glm::vec3(0.0f, 2.5f, 0.0f);
+        light.intensity = 5.0f;
+        scene.lights.push_back(light);
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 8.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        auto bake = [&](uint32_t samples, std::vector<float>& variance, BakeStats& stats) {
+            BakeSettings settings;
+            settings.minSamples = samples;
+            settings.maxSamples = samples;
+            settings.errorThreshold = 0.0f;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            stats = engine.Bake();
+            variance = engine.GetLuminanceVariance();
+            return engine.GetLightmap();
+        };
+        std::vector<float> variance;
+        BakeStats stats;
+        Lightmap reference = bake(referenceSamples, variance, stats);
+        std::printf("%zu covered texels, reference %u samples each in %.1f s\n", stats.coveredTexels, referenceSamples, stats.seconds);
+
+        const uint32_t sampleCounts[] = { 8, 16, 32, 64, 128, 256 };
+        double rawErrors[std::size(sampleCounts)];
+        double denoisedErrors[std::size(sampleCounts)];
+        double bakeSeconds[std::size(sampleCounts)];
+        double denoiseMilliseconds[std::size(sampleCounts)];
+        for (size_t i = 0; i < std::size(sampleCounts); ++i)
+        {
+            Lightmap lightmap = bake(sampleCounts[i], variance, stats);
+            bakeSeconds[i] = stats.seconds;
+            rawErrors[i] = GetRelativeError(lightmap, reference);
+            BenchTimer timer;
+            Denoiser().Denoise(lightmap, variance, texels, scene, threadPool);
+            denoiseMilliseconds[i] = timer.GetMilliseconds();
+            denoisedErrors[i] = GetRelativeError(lightmap, reference);
+        }
+
+        std::printf("  samples   seconds  raw error  denoised  denoise ms  matches raw\n");
+        for (size_t i = 0; i < std::size(sampleCounts); ++i)
+        {
+            // Raw sample counts past the table are out of reach; show them as ">".
+            size_t match = 0;
+            while (match < std::size(sampleCounts) && rawErrors[match] > denoisedErrors[i])
+                match++;
+            std::printf("  %7u %9.2f  %9.4f  %8.4f  %10.1f  ", sampleCounts[i], bakeSeconds[i], rawErrors[i], denoisedErrors[i],
+                        denoiseMilliseconds[i]);
+            if (match < std::size(sampleCounts))
+                std::printf("%11u\n", sampleCounts[match]);
+            else
+                std::printf("%10s%u\n", ">", sampleCounts[std::size(sampleCounts) - 1]);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // An 8x3x8 room lit through a window in the +x wall by a distant sun and a bright sky.
+        Scene MakeWindowLitRoom()
+        {
+            Scene scene;
+            scene.meshes.push_back(MakeBox({ -4.0f, -0.1f, -4.0f }, { 4.0f, 0.0f, 4.0f }));
+            scene.meshes.push_back(MakeBox({ -4.0f, 3.0f, -4.0f }, { 4.0f, 3.1f, 4.0f }));
+            scene.meshes.push_back(MakeBox({ -4.1f, 0.0f, -4.0f }, { -4.0f, 3.0f, 4.0f }));
+            scene.meshes.push_back(MakeBox({ -4.0f, 0.0f, -4.1f }, { 4.0f, 3.0f, -4.0f }));
+            scene.meshes.push_back(MakeBox({ -4.0f, 0.0f, 4.0f }, { 4.0f, 3.0f, 4.1f }));
+            scene.meshes.push_back(MakeBox({ 4.0f, 0.0f, -4.0f }, { 4.1f, 3.0f, -0.6f }));
+            scene.meshes.push_back(MakeBox({ 4.0f, 0.0f, 0.6f }, { 4.1f, 3.0f, 4.0f }));
+            scene.meshes.push_back(MakeBox({ 4.0f, 0.0f, -0.6f }, { 4.1f, 1.2f, 0.6f }));
+            scene.meshes.push_back(MakeBox({ 4.0f, 2.2f, -0.6f }, { 4.1f, 3.0f, 0.6f }));
+            scene.meshes.push_back(MakeBox({ -1.0f, 0.0f, -1.0f }, { 0.0f, 0.8f, 1.0f }));
+            scene.meshes.back().materialIndex = 1;
+            scene.materials = { Material{ glm::vec3(0.75f), glm::vec3(0.0f) }, Material{ glm::vec3(0.7f, 0.4f, 0.3f), glm::vec3(0.0f) } };
+            const float sunDistance = 2000.0f;
+            Light sun;
+            sun.position = glm::normalize(glm::vec3(1.0f, 0.5f, 0.1f)) * sunDistance;
+            sun.intensity = 3.0f * sunDistance * sunDistance;
+            scene.lights.push_back(sun);
+            scene.skyColor = glm::vec3(4.0f, 4.5f, 5.0f);
+            return scene;
+        }
+    }
+
+    /**
+     * Bench guiding [seconds=3] [referenceSamples=2048]: equal-time error
+     * of unguided and guided bakes of a window-lit room, whose light
+     * mostly arrives through bounces off the sunlit floor patch, against a
+     * blue-noise reference. Only texels inside the room are measured.
+     */
+    int RunGuidingBench(int argc, char** argv)
+    {
+        double seconds = argc > 0 ? std::max(std::atof(argv[0]), 0.1) : 3.0;
+        uint32_t referenceSamples = argc > 1 ? static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1)) : 2048;
+
+        Scene scene = MakeWindowLitRoom();
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 3.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+        std::vector<uint8_t> inside(texels.texels.size(), 0);
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+        {
+            glm::vec3 position = texels.texels[i].position;
+            inside[i] = glm::all(glm::greaterThan(position, glm::vec3(-4.001f, -0.001f, -4.001f))) &&
+                        glm::all(glm::lessThan(position, glm::vec3(4.001f, 3.001f, 4.001f)));
+        }
+
+        BakeSettings settings;
+        settings.maxBounces = 3;
+        settings.minSamples = referenceSamples;
+        settings.maxSamples = referenceSamples;
+        settings.sampler = SamplerType::BlueNoise;
+        Lightmap reference;
+        {
+            BenchTimer timer;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            engine.Bake();
+            reference = engine.GetLightmap();
+            std::printf("reference: %zu texels, %u samples each, %.1f s\n", texels.texels.size(), referenceSamples, timer.GetMilliseconds() / 1000.0);
+        }
+
+        struct Config
+        {
+            const char* name;
+            bool guided;
+            float guidedFraction;
+        };
+        const Config configs[] = { { "unguided", false, 0.0f }, { "guided 0.5", true, 0.5f }, { "guided 0.7", true, 0.7f } };
+        std::printf("  config       seconds     samples  rel error      bias\n");
+        for (const Config& config : configs)
+        {
+            // Uniform passes without a convergence test, so only the time budget ends the bake.
+            settings.minSamples = 16;
+            settings.samplesPerPass = 16;
+            settings.maxSamples = 1u << 20;
+            settings.errorThreshold = -1.0f;
+            settings.sampler = SamplerType::Sobol;
+            settings.guiding.enabled = config.guided;
+            settings.guiding.guidedFraction = config.guidedFraction;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            BenchTimer timer;
+            for (double checkpoint : { seconds / 3.0, seconds })
+            {
+                while (timer.GetMilliseconds() < checkpoint * 1000.0 && engine.RunPass())
+                {
+                }
+                Lightmap lightmap = engine.GetLightmap();
+                std::printf("  %-10s %9.2f %11llu  %9.4f  %+8.4f\n", config.name, timer.GetMilliseconds() / 1000.0,
+                            static_cast<unsigned long long>(engine.GetStats().samples), GetRelativeError(lightmap, reference, inside),
+                            GetBias(lightmap, reference, inside));
+            }
+            if (config.guided)
+            {
+                PathGuideStats stats = engine.GetPathGuideStats();
+                std::printf("  %-10s %u cells, %u guiding, %.2f MB\n", "", stats.cells, stats.guidingCells, static_cast<double>(stats.memoryBytes) / 1e6);
+            }
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,117 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <thread>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        /**
+         * Stands in for a GPU of a given throughput: it sleeps as long as the
+         * samples it is handed would take at `samplesPerSecond`, and hands
+         * back the texels of a finished bake of the same settings, which is
+         * what a device continuing the same sample sequences produces. Only
+         * valid for single-pass bakes, whose every target is the final count.
+         */
+        class SimulatedDevice : public BakeDevice
+        {
+        public:
+            SimulatedDevice(std::span<const TexelAccumulator> finished, double samplesPerSecond)
+                : m_finished(finished)
+                , m_samplesPerSecond(samplesPerSecond)
+            {
+            }
+
+            bool BakeTexels(std::span<const uint32_t> texelIndices, std::span<const uint32_t> sampleTargets,
+                            std::span<TexelAccumulator> accumulators) override
+            {
+                uint64_t samples = 0;
+                for (size_t i = 0; i < texelIndices.size(); ++i)
+                {
+                    samples += sampleTargets[i] - accumulators[i].sampleCount;
+                    accumulators[i] = m_finished[texelIndices[i]];
+                }
+                std::this_thread::sleep_for(std::chrono::duration<double>(static_cast<double>(samples) / m_samplesPerSecond));
+                return true;
+            }
+
+        private:
+            std::span<const TexelAccumulator> m_finished;
+            double m_samplesPerSecond;
+        };
+    }
+
+    /**
+     * Bench hybrid [samples=256]: one fixed-count pass over a lit street,
+     * on the CPU alone and shared with simulated devices of 0.5 to 10 times
+     * the CPU's throughput. The device costs no CPU time, so the ideal
+     * time is the CPU time over (1 + ratio). Reports the time, the device's
+     * share of the samples and its batches, and the texels whose
+     * accumulators differ from the CPU-only bake, which should be none.
+     * This measures the shared tile queue and batch sizing only; the real
+     * GPU baker is checked against the CPU by Baker --gpu-check.
+     */
+    int RunHybridBench(int argc, char** argv)
+    {
+        uint32_t samples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 256;
+
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -20.0f, -0.1f, -20.0f }, { 20.0f, 0.0f, 20.0f }));
+        for (int i = 0; i < 6; ++i)
+        {
+            scene.meshes.push_back(MakeBox({ -12.0f + i * 5.0f, 0.0f, -1.0f }, { -10.0f + i * 5.0f, 1.0f + i * 0.5f, 1.0f }));
+            scene.meshes.back().materialIndex = i % 2;
+        }
+        scene.materials = { Material{ glm::vec3(0.7f, 0.6f, 0.5f), glm::vec3(0.0f) }, Material{ glm::vec3(0.5f, 0.7f, 0.6f), glm::vec3(0.0f) } };
+        scene.skyColor = glm::vec3(0.2f, 0.25f, 0.3f);
+        for (int i = 0; i < 4; ++i)
+        {
+            Light lamp;
+            lamp.position = glm::vec3(-10.0f + i * 7.0f, 2.5f, 3.0f);
+            lamp.intensity = 3.0f;
+            scene.lights.push_back(lamp);
+        }
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 2.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        BakeSettings settings;
+        settings.minSamples = samples;
+        settings.maxSamples = samples;
+        BakeEngine reference(scene, texels, settings, threadPool);
+        BakeStats referenceStats = reference.Bake();
+        double cpuRate = static_cast<double>(referenceStats.samples) / referenceStats.seconds;
+        std::printf("%zu covered texels, CPU alone %llu samples in %.2f s (%.3g samples/s)\n", referenceStats.coveredTexels,
+                    static_cast<unsigned long long>(referenceStats.samples), referenceStats.seconds, cpuRate);
+
+        std::printf("  device  seconds    ideal  speedup  device share  batches  texels differ\n");
+        for (double ratio : { 0.5, 1.0, 3.0, 10.0 })
+        {
+            SimulatedDevice device(reference.GetAccumulators(), ratio * cpuRate);
+            BakeEngine engine(scene, texels, settings, threadPool);
+            engine.SetDevice(&device);
+            BakeStats stats = engine.Bake();
+            size_t differ = 0;
+            for (size_t i = 0; i < texels.texels.size(); ++i)
+                if (std::memcmp(&engine.GetAccumulators()[i], &reference.GetAccumulators()[i], sizeof(TexelAccumulator)) != 0)
+                    differ++;
+            std::printf("  %5.1fx  %7.2f  %7.2f  %6.2fx  %11.1f%%  %7u  %13zu\n", ratio, stats.seconds, referenceStats.seconds / (1.0 + ratio),
+                        referenceStats.seconds / stats.seconds, 100.0 * static_cast<double>(stats.deviceSamples) / static_cast<double>(stats.samples),
+                        stats.deviceBatches, differ);
+        }
+        return 0;
+    }
+}
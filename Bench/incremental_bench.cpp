@@ -0,0 +1,102 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/incremental_bake.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    /**
+     * Bench incremental [samples=64]: a street of crates lit by four lamps,
+     * an emissive panel and the sky, baked once per light group. Then
+     * recolors a lamp, the panel and the sky, and moves one lamp. Each edit
+     * is timed and compared against a full bake of the edited scene at the
+     * same sample count; "stale" is the error of not updating at all.
+     */
+    int RunIncrementalBench(int argc, char** argv)
+    {
+        uint32_t samples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 64;
+
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -20.0f, -0.1f, -20.0f }, { 20.0f, 0.0f, 20.0f }));
+        for (int i = 0; i < 6; ++i)
+            scene.meshes.push_back(MakeBox({ -15.0f + i * 6.0f, 0.0f, -1.0f }, { -13.0f + i * 6.0f, 2.0f, 1.0f }));
+        Mesh panel;
+        panel.positions = { { -0.5f, 3.0f, -0.5f }, { 0.5f, 3.0f, -0.5f }, { 0.5f, 3.0f, 0.5f }, { -0.5f, 3.0f, 0.5f } };
+        panel.indices = { 0, 2, 1, 0, 3, 2 };
+        panel.materialIndex = 1;
+        scene.meshes.push_back(panel);
+        scene.materials = { Material{}, Material{ glm::vec3(0.0f), glm::vec3(5.0f) } };
+        scene.skyColor = glm::vec3(0.2f, 0.3f, 0.5f);
+        for (int i = 0; i < 4; ++i)
+        {
+            Light lamp;
+            lamp.position = glm::vec3(-15.0f + i * 10.0f, 1.5f, 3.0f);
+            lamp.intensity = 2.0f;
+            lamp.color = glm::vec3(1.0f, 0.8f, 0.6f);
+            scene.lights.push_back(lamp);
+        }
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 4.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        BakeSettings settings;
+        settings.minSamples = samples;
+        settings.maxSamples = samples;
+        settings.errorThreshold = 0.0f;
+        settings.maxBounces = 2;
+        double fullSeconds = 0.0;
+        auto bakeFull = [&](const Scene& edited) {
+            BakeEngine engine(edited, texels, settings, threadPool);
+            fullSeconds = engine.Bake().seconds;
+            return engine.GetLightmap();
+        };
+
+        IncrementalBakeSettings incrementalSettings;
+        incrementalSettings.bake = settings;
+        incrementalSettings.influenceIrradiance = 2e-2f;
+        IncrementalBaker baker(scene, texels, incrementalSettings, threadPool);
+        IncrementalBakeStats stats = baker.Bake();
+        Lightmap reference = bakeFull(scene);
+        std::printf("%zu groups, %zu covered texels at %u samples\n", baker.GetGroups().size(), stats.texelsTraced / baker.GetGroups().size(), samples);
+        std::printf("  edit         seconds  full bake  texels traced  rel error   stale\n");
+        std::printf("  initial     %8.3f  %9.2f  %13zu  %9.4f       -\n", stats.seconds, fullSeconds, stats.texelsTraced,
+                    GetRelativeError(baker.GetLightmap(), reference));
+
+        // Recolor a lamp, the panel and the sky: no rays at all.
+        Scene recolored = scene;
+        recolored.lights[1].color = glm::vec3(0.2f, 0.4f, 1.0f);
+        recolored.lights[1].intensity = 5.0f;
+        recolored.materials[1].emission = glm::vec3(8.0f, 2.0f, 1.0f);
+        recolored.skyColor = glm::vec3(0.4f);
+        Lightmap stale = baker.GetLightmap();
+        BenchTimer timer;
+        baker.SetLightEmission(1, recolored.lights[1].color, recolored.lights[1].intensity);
+        baker.SetMaterialEmission(1, recolored.materials[1].emission);
+        baker.SetSkyEmission(recolored.skyColor, 1.0f);
+        Lightmap lightmap = baker.GetLightmap();
+        double recolorSeconds = timer.GetMilliseconds() / 1000.0;
+        reference = bakeFull(recolored);
+        std::printf("  recolor     %8.3f  %9.2f  %13u  %9.4f  %6.4f\n", recolorSeconds, fullSeconds, 0u, GetRelativeError(lightmap, reference),
+                    GetRelativeError(stale, reference));
+
+        // Move a lamp along the street: only texels in its influence spheres are retraced.
+        Scene moved = recolored;
+        moved.lights[2].position += glm::vec3(1.5f, 0.0f, -1.0f);
+        stale = baker.GetLightmap();
+        stats = baker.UpdateLight(2, moved.lights[2]);
+        reference = bakeFull(moved);
+        std::printf("  move light  %8.3f  %9.2f  %13zu  %9.4f  %6.4f\n", stats.seconds, fullSeconds, stats.texelsTraced,
+                    GetRelativeError(baker.GetLightmap(), reference), GetRelativeError(stale, reference));
+        return 0;
+    }
+}
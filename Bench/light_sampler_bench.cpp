@@ -0,0 +1,134 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "Bake/light_sampler.h"
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Keeps timed loops from being optimised away.
+        volatile float g_sink = 0.0f;
+
+        // Unshadowed irradiance from `light` at a floor point, as the bake would see it.
+        float GetIrradiance(const Light& light, const glm::vec3& position, const glm::vec3& normal)
+        {
+            glm::vec3 toLight = light.position - position;
+            float distanceSquared = glm::dot(toLight, toLight);
+            glm::vec3 direction = toLight / std::sqrt(distanceSquared);
+            float cosTheta = glm::dot(normal, direction);
+            if (cosTheta <= 0.0f)
+                return 0.0f;
+            float falloff = 1.0f;
+            if (light.type == Light::Type::Spot)
+            {
+                float t = glm::clamp((glm::dot(-direction, light.direction) - light.cosOuterAngle) / (light.cosInnerAngle - light.cosOuterAngle), 0.0f, 1.0f);
+                falloff = t * t * (3.0f - 2.0f * t);
+            }
+            return light.intensity * falloff * cosTheta / distanceSquared;
+        }
+
+        const char* GetModeName(LightSamplingMode mode)
+        {
+            switch (mode)
+            {
+            case LightSamplingMode::Uniform: return "uniform";
+            case LightSamplingMode::Power: return "power";
+            default: return "bvh";
+            }
+        }
+    }
+
+    /**
+     * Bench lights [points=200] [samples=64]: noise of one light sample per
+     * shading point against the exact sum over all lights, for each
+     * sampling mode and 16 to 65536 lights over a 100x100 floor (a third of
+     * them spots), and the cost of a sample. Also checks that GetPmf()
+     * agrees with Sample().
+     */
+    int RunLightSamplerBench(int argc, char** argv)
+    {
+        int pointCount = argc > 0 ? std::max(std::atoi(argv[0]), 1) : 200;
+        int samplesPerPoint = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 64;
+        const glm::vec3 normal(0.0f, 1.0f, 0.0f);
+
+        std::printf("relative RMSE at one light sample per point, and cost per sample\n");
+        std::printf("  lights    mode      rmse    build ms   us/sample  max pmf error\n");
+        for (uint32_t lightCount : { 16u, 256u, 4096u, 65536u })
+        {
+            Random random(7);
+            std::vector<Light> lights;
+            std::vector<LightBounds> bounds;
+            for (uint32_t i = 0; i < lightCount; ++i)
+            {
+                Light light;
+                light.position = glm::vec3(random.NextFloat() * 100.0f - 50.0f, 0.5f + random.NextFloat() * 3.0f, random.NextFloat() * 100.0f - 50.0f);
+                light.intensity = 0.5f + random.NextFloat() * 2.0f;
+                if (i % 3 == 0)
+                {
+                    light.type = Light::Type::Spot;
+                    light.direction = glm::normalize(glm::vec3(random.NextFloat() - 0.5f, -1.0f, random.NextFloat() - 0.5f));
+                    light.cosInnerAngle = 0.9f;
+                    light.cosOuterAngle = 0.7f;
+                }
+                lights.push_back(light);
+                bounds.push_back(LightBounds::FromLight(light));
+            }
+
+            for (LightSamplingMode mode : { LightSamplingMode::Uniform, LightSamplingMode::Power, LightSamplingMode::Bvh })
+            {
+                BenchTimer buildTimer;
+                LightSampler sampler(bounds, mode);
+                double buildMilliseconds = buildTimer.GetMilliseconds();
+
+                double squaredError = 0.0;
+                double referenceSum = 0.0;
+                double maxPmfError = 0.0;
+                for (int p = 0; p < pointCount; ++p)
+                {
+                    Random pointRandom(static_cast<uint64_t>(p), 1);
+                    glm::vec3 position(pointRandom.NextFloat() * 100.0f - 50.0f, 0.0f, pointRandom.NextFloat() * 100.0f - 50.0f);
+                    double reference = 0.0;
+                    for (const Light& light : lights)
+                        reference += GetIrradiance(light, position, normal);
+                    referenceSum += reference;
+                    for (int s = 0; s < samplesPerPoint; ++s)
+                    {
+                        uint32_t light;
+                        float pmf;
+                        double estimate = 0.0;
+                        if (sampler.Sample(position, normal, pointRandom.NextFloat(), light, pmf))
+                        {
+                            estimate = GetIrradiance(lights[light], position, normal) / pmf;
+                            maxPmfError = std::max(maxPmfError, static_cast<double>(std::abs(sampler.GetPmf(position, normal, light) - pmf) / pmf));
+                        }
+                        squaredError += (estimate - reference) * (estimate - reference);
+                    }
+                }
+                double rmse = std::sqrt(squaredError / (pointCount * samplesPerPoint)) / (referenceSum / pointCount);
+
+                // Sampling alone, away from the reference loop.
+                int timedSamples = pointCount * samplesPerPoint;
+                float sink = 0.0f;
+                BenchTimer timer;
+                for (int s = 0; s < timedSamples; ++s)
+                {
+                    Random sampleRandom(static_cast<uint64_t>(s), 3);
+                    glm::vec3 position(sampleRandom.NextFloat() * 100.0f - 50.0f, 0.0f, sampleRandom.NextFloat() * 100.0f - 50.0f);
+                    uint32_t light;
+                    float pmf;
+                    if (sampler.Sample(position, normal, sampleRandom.NextFloat(), light, pmf))
+                        sink += pmf;
+                }
+                double microseconds = timer.GetMilliseconds() * 1e3 / timedSamples;
+                g_sink = sink;
+                std::printf("  %6u    %-7s  %6.2f  %9.1f  %10.3f  %.2g\n", lightCount, GetModeName(mode), rmse, buildMilliseconds, microseconds, maxPmfError);
+            }
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,121 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/light_set.h"
+#include "Bake/path_integrator.h"
+#include "Bake/probe_volume.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampler.h"
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        size_t GetVolumeBytes(const ProbeVolume& volume)
+        {
+            return (volume.indirection.size() + volume.subgrids.size()) * sizeof(uint32_t) + 3 * volume.atlas[0].size() * sizeof(glm::vec4) +
+                   volume.validity.size();
+        }
+    }
+
+    /**
+     * Bench probes [referenceSamples=4096]: an open yard with a few
+     * buildings, baked into probe volumes of one to four brick levels; one
+     * level places the finest bricks everywhere, like a dense grid. Reports
+     * bricks per level (finest first), probes, indirection entries, memory
+     * and bake time, and the irradiance error at random points in the air
+     * against path-traced references.
+     */
+    int RunProbesBench(int argc, char** argv)
+    {
+        uint32_t referenceSamples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 4096;
+
+        // An open yard with a few buildings under sun and sky: most of the volume is air.
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -20.0f, -0.5f, -20.0f }, { 20.0f, 0.0f, 20.0f }));
+        const glm::vec3 buildings[][2] = { { { -12.0f, 0.0f, -12.0f }, { -6.0f, 10.0f, -6.0f } },
+                                           { { 4.0f, 0.0f, -10.0f }, { 8.0f, 4.0f, -2.0f } },
+                                           { { -4.0f, 0.0f, 6.0f }, { 2.0f, 6.0f, 9.0f } } };
+        for (const auto& [lower, upper] : buildings)
+            scene.meshes.push_back(MakeBox(lower, upper));
+        scene.materials = { Material{} };
+        scene.skyColor = glm::vec3(0.6f, 0.7f, 0.9f);
+        const float sunDistance = 1000.0f;
+        Light sun;
+        sun.position = glm::normalize(glm::vec3(0.4f, 1.0f, 0.3f)) * sunDistance;
+        sun.intensity = 3.0f * sunDistance * sunDistance;
+        scene.lights.push_back(sun);
+
+        bvh::v2::ThreadPool threadPool;
+        RayTracer tracer(scene, threadPool);
+        LightSet lights(scene, LightSamplingMode::Bvh, threadPool);
+        PathIntegrator integrator(tracer, lights);
+
+        Random random(7);
+        std::vector<std::pair<glm::vec3, glm::vec3>> points;
+        while (points.size() < 200)
+        {
+            glm::vec3 position(random.NextFloat() * 39.0f - 19.5f, random.NextFloat() * 9.5f + 0.25f, random.NextFloat() * 39.0f - 19.5f);
+            bool inside = false;
+            for (const auto& [lower, upper] : buildings)
+                inside = inside || (glm::all(glm::greaterThan(position, lower - 0.25f)) && glm::all(glm::lessThan(position, upper + 0.25f)));
+            if (!inside)
+                points.emplace_back(position, SampleUniformSphere(random.NextFloat(), random.NextFloat()));
+        }
+
+        BenchTimer timer;
+        std::vector<glm::vec3> references(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            const auto& [position, normal] = points[i];
+            glm::vec3 sum(0.0f);
+            for (uint32_t s = 0; s < referenceSamples; ++s)
+            {
+                Sampler sampler(SamplerType::Random, i, s, 0, 0, nullptr);
+                glm::vec3 lightDirection;
+                sum += integrator.DirectIrradiance(position, normal, sampler, lightDirection);
+                glm::vec2 u = sampler.Next2D();
+                sum += kPi * integrator.Radiance(position, normal, SampleCosineHemisphere(normal, u.x, u.y), 2, true, sampler);
+            }
+            references[i] = sum / static_cast<float>(referenceSamples);
+        }
+        std::printf("%zu reference points, %u samples each in %.1f s\n", points.size(), referenceSamples, timer.GetMilliseconds() / 1000.0);
+
+        std::printf("  levels  bricks/level        probes  culled  indirection  subgrid      MiB   seconds  rel rmse\n");
+        for (uint32_t levels : { 1u, 2u, 3u, 4u })
+        {
+            ProbeVolumeSettings settings;
+            settings.samplesPerProbe = 64;
+            settings.levelCount = levels;
+            ProbeVolumeBaker baker(settings);
+            ProbeVolume volume = baker.Bake(integrator, threadPool);
+            const ProbeVolumeStats& stats = baker.GetStats();
+
+            double squaredError = 0.0;
+            double sum = 0.0;
+            size_t count = 0;
+            for (size_t i = 0; i < points.size(); ++i)
+            {
+                glm::vec3 difference = volume.EvaluateIrradiance(points[i].first, points[i].second) - references[i];
+                squaredError += glm::dot(difference, difference) / 3.0;
+                sum += Luminance(references[i]);
+                count++;
+            }
+
+            char bricks[32] = "";
+            int length = 0;
+            for (uint32_t levelBricks : stats.bricksPerLevel)
+                length += std::snprintf(bricks + length, sizeof(bricks) - static_cast<size_t>(length), "%s%u", length ? "/" : "", levelBricks);
+            std::printf("  %6u  %-16s %9zu  %6zu  %11zu  %7zu  %7.2f  %8.2f  %8.4f\n", levels, bricks, stats.probeCount, stats.culledProbes,
+                        volume.indirection.size(), volume.subgrids.size(), GetVolumeBytes(volume) / (1024.0 * 1024.0), stats.seconds,
+                        std::sqrt(squaredError / static_cast<double>(count)) / (sum / static_cast<double>(count)));
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    /**
+     * Bench cache [maxBounces=3] [referenceSamples=2048]: fixed-count bakes
+     * of a room lit through a slot in its ceiling, where most light arrives
+     * after several bounces, without the radiance cache and with cells of
+     * 0.25 and 0.5 units. The cache keeps the texel's own light sample and
+     * first bounce, so its savings are the bounces past the first. Reports
+     * time, error and bias against an uncached reference, and the cache's
+     * hit rate and cells.
+     */
+    int RunRadianceCacheBench(int argc, char** argv)
+    {
+        uint32_t maxBounces = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 3;
+        uint32_t referenceSamples = argc > 1 ? static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1)) : 2048;
+
+        // A 10x4x10 room with a slot in the ceiling and four crates: the lamp above the slot only
+        // reaches a strip of the floor, and everything else is lit by what bounces off it.
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -5.0f, -0.1f, -5.0f }, { 5.0f, 0.0f, 5.0f }));
+        scene.meshes.push_back(MakeBox({ -5.1f, 0.0f, -5.0f }, { -5.0f, 4.0f, 5.0f }));
+        scene.meshes.push_back(MakeBox({ 5.0f, 0.0f, -5.0f }, { 5.1f, 4.0f, 5.0f }));
+        scene.meshes.push_back(MakeBox({ -5.0f, 0.0f, -5.1f }, { 5.0f, 4.0f, -5.0f }));
+        scene.meshes.push_back(MakeBox({ -5.0f, 0.0f, 5.0f }, { 5.0f, 4.0f, 5.1f }));
+        scene.meshes.push_back(MakeBox({ -5.0f, 4.0f, -5.0f }, { 5.0f, 4.1f, 1.0f }));
+        scene.meshes.push_back(MakeBox({ -5.0f, 4.0f, 2.0f }, { 5.0f, 4.1f, 5.0f }));
+        for (int i = 0; i < 4; ++i)
+        {
+            float x = -4.0f + 2.2f * static_cast<float>(i);
+            scene.meshes.push_back(MakeBox({ x, 0.0f, -2.0f }, { x + 1.0f, 1.0f + 0.6f * static_cast<float>(i), -1.0f }));
+            scene.meshes.back().materialIndex = 1;
+        }
+        scene.materials = { Material{ glm::vec3(0.75f), glm::vec3(0.0f) }, Material{ glm::vec3(0.7f, 0.4f, 0.3f), glm::vec3(0.0f) } };
+        Light lamp;
+        lamp.position = glm::vec3(0.0f, 8.0f, 1.5f);
+        lamp.intensity = 60.0f;
+        scene.lights.push_back(lamp);
+        scene.skyColor = glm::vec3(0.3f, 0.35f, 0.45f);
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 3.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        auto bake = [&](uint32_t samples, float cellSize, BakeStats& stats, RadianceCacheStats& cacheStats) {
+            BakeSettings settings;
+            settings.minSamples = samples;
+            settings.maxSamples = samples;
+            settings.errorThreshold = 0.0f;
+            settings.maxBounces = maxBounces;
+            settings.radianceCache.cellSize = cellSize;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            stats = engine.Bake();
+            cacheStats = engine.GetRadianceCacheStats();
+            return engine.GetLightmap();
+        };
+        BakeStats stats;
+        RadianceCacheStats cacheStats;
+        Lightmap reference = bake(referenceSamples, 0.0f, stats, cacheStats);
+        std::printf("%zu covered texels, %u bounces, reference %u samples each in %.1f s\n", stats.coveredTexels, maxBounces, referenceSamples,
+                    stats.seconds);
+
+        std::printf("  cell  samples   seconds  rel error     bias  hit rate    cells\n");
+        for (float cellSize : { 0.0f, 0.25f, 0.5f })
+        {
+            for (uint32_t samples : { 64u, 128u, 256u })
+            {
+                Lightmap lightmap = bake(samples, cellSize, stats, cacheStats);
+                std::printf("  %4.2f  %7u  %8.2f  %9.4f  %+7.4f  %8.3f  %7u\n", cellSize, samples, stats.seconds, GetRelativeError(lightmap, reference),
+                            GetBias(lightmap, reference), cacheStats.GetHitRate(), cacheStats.cells);
+            }
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    /**
+     * Bench rasterizer [texelsPerUnit=64] [spheres=4] [repeats=3]: rasterizes
+     * the atlas of a row of unit spheres on 4096-texel pages and reports the
+     * best time, and how far texel positions stray from the spheres.
+     */
+    int RunRasterizerBench(int argc, char** argv)
+    {
+        float texelsPerUnit = argc > 0 ? static_cast<float>(std::atof(argv[0])) : 64.0f;
+        int sphereCount = argc > 1 ? std::atoi(argv[1]) : 4;
+        int repeats = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 3;
+
+        Scene scene;
+        for (int i = 0; i < sphereCount; ++i)
+            scene.meshes.push_back(MakeSphere(glm::vec3(3.0f * static_cast<float>(i), 0.0f, 0.0f), 1.0f, 32));
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = texelsPerUnit;
+        options.maxAtlasSize = 4096;
+        BenchTimer atlasTimer;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        double atlasMilliseconds = atlasTimer.GetMilliseconds();
+
+        TexelBuffer texels;
+        double best = 0.0;
+        for (int r = 0; r < repeats; ++r)
+        {
+            BenchTimer timer;
+            texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+            double milliseconds = timer.GetMilliseconds();
+            best = r == 0 ? milliseconds : std::min(best, milliseconds);
+        }
+
+        size_t covered = 0;
+        size_t full = 0;
+        double maxRadialError = 0.0;
+        uint32_t trianglesPerSphere = scene.meshes[0].GetTriangleCount();
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+        {
+            if (!texels.IsCovered(i))
+                continue;
+            const TexelRecord& texel = texels.texels[i];
+            covered++;
+            full += texel.coverage >= 1.0f;
+            glm::vec3 center(3.0f * static_cast<float>(texel.triangleId / trianglesPerSphere), 0.0f, 0.0f);
+            maxRadialError = std::max(maxRadialError, static_cast<double>(std::abs(glm::length(texel.position - center) - 1.0f)));
+        }
+
+        size_t pageTexels = texels.texels.size();
+        std::printf("%d spheres at %.0f texels/unit: %u page(s) of %ux%u, %zu texels\n", sphereCount, texelsPerUnit, texels.atlasCount,
+                    texels.width, texels.height, pageTexels);
+        std::printf("  atlas       %8.1f ms\n", atlasMilliseconds);
+        std::printf("  rasterize   %8.1f ms, %.1f Mtexel/s (best of %d)\n", best, static_cast<double>(pageTexels) / best / 1e3, repeats);
+        std::printf("  covered     %zu texels, %zu fully\n", covered, full);
+        std::printf("  max radial error %.5f\n", maxRadialError);
+        return 0;
+    }
+}
@@ -0,0 +1,132 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/sampler.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    /**
+     * Bench reservoirs [seconds=3] [referenceSamples=4096]: equal-time
+     * error of the direct light in a pillared hall lit by 1500 small lamps
+     * and 100 glowing cubes, with one light sample per texel sample and
+     * with reservoirs, over the uniform and power light samplers.
+     * Reservoirs are ignored under the light BVH, whose one sample is
+     * shown for comparison. The reference uses the light BVH.
+     */
+    int RunReservoirsBench(int argc, char** argv)
+    {
+        double seconds = argc > 0 ? std::max(std::atof(argv[0]), 0.1) : 3.0;
+        uint32_t referenceSamples = argc > 1 ? static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1)) : 4096;
+
+        // A closed 16x5x16 hall with a grid of pillars; every point sees only some of the lights.
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -8.0f, -0.2f, -8.0f }, { 8.0f, 0.0f, 8.0f }));
+        scene.meshes.push_back(MakeBox({ -8.0f, 5.0f, -8.0f }, { 8.0f, 5.2f, 8.0f }));
+        scene.meshes.push_back(MakeBox({ -8.2f, 0.0f, -8.0f }, { -8.0f, 5.0f, 8.0f }));
+        scene.meshes.push_back(MakeBox({ 8.0f, 0.0f, -8.0f }, { 8.2f, 5.0f, 8.0f }));
+        scene.meshes.push_back(MakeBox({ -8.0f, 0.0f, -8.2f }, { 8.0f, 5.0f, -8.0f }));
+        scene.meshes.push_back(MakeBox({ -8.0f, 0.0f, 8.0f }, { 8.0f, 5.0f, 8.2f }));
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                glm::vec3 center(-6.0f + 4.0f * static_cast<float>(i), 0.0f, -6.0f + 4.0f * static_cast<float>(j));
+                scene.meshes.push_back(MakeBox(center - glm::vec3(0.3f, 0.0f, 0.3f), center + glm::vec3(0.3f, 5.0f, 0.3f)));
+            }
+        }
+        scene.materials = { Material{ glm::vec3(0.7f), glm::vec3(0.0f) } };
+        Random random(7);
+        for (int i = 0; i < 100; ++i)
+        {
+            glm::vec3 center(random.NextFloat() * 15.0f - 7.5f, 0.3f + random.NextFloat() * 4.4f, random.NextFloat() * 15.0f - 7.5f);
+            glm::vec3 color(random.NextFloat(), random.NextFloat(), random.NextFloat());
+            float strength = random.NextFloat();
+            scene.materials.push_back(Material{ glm::vec3(0.5f), color * (20.0f + 200.0f * strength * strength) });
+            scene.meshes.push_back(MakeBox(center - 0.05f, center + 0.05f));
+            scene.meshes.back().materialIndex = static_cast<uint32_t>(scene.materials.size() - 1);
+        }
+        // Mostly dim lamps and a few bright ones, so power alone says little about who lights a point.
+        for (int i = 0; i < 1500; ++i)
+        {
+            Light lamp;
+            lamp.position = glm::vec3(random.NextFloat() * 15.6f - 7.8f, 0.2f + random.NextFloat() * 4.6f, random.NextFloat() * 15.6f - 7.8f);
+            lamp.color = glm::vec3(0.3f) + glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 0.7f;
+            float strength = random.NextFloat();
+            lamp.intensity = 0.2f + 4.0f * strength * strength * strength;
+            scene.lights.push_back(lamp);
+        }
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 2.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+        BakeSettings settings;
+        settings.maxBounces = 0;
+        settings.minSamples = referenceSamples;
+        settings.maxSamples = referenceSamples;
+        settings.sampler = SamplerType::BlueNoise;
+        Lightmap reference;
+        {
+            BenchTimer timer;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            BakeStats stats = engine.Bake();
+            reference = engine.GetLightmap();
+            std::printf("reference: %zu covered texels, %zu lamps, %zu glowing cubes, %u samples each, %.1f s\n", stats.coveredTexels,
+                        scene.lights.size(), scene.materials.size() - 1, referenceSamples, timer.GetMilliseconds() / 1000.0);
+        }
+
+        struct Config
+        {
+            const char* name;
+            LightSamplingMode lightSampling;
+            uint32_t candidates;
+            uint32_t neighbours;
+        };
+        const Config configs[] = { { "uniform", LightSamplingMode::Uniform, 0, 0 }, { "uniform 8+4", LightSamplingMode::Uniform, 8, 4 },
+                                   { "power", LightSamplingMode::Power, 0, 0 },     { "power 8", LightSamplingMode::Power, 8, 0 },
+                                   { "power 8+4", LightSamplingMode::Power, 8, 4 }, { "bvh", LightSamplingMode::Bvh, 0, 0 } };
+        std::printf("  config         seconds     samples  rel error      bias\n");
+        for (const Config& config : configs)
+        {
+            // Uniform passes without a convergence test, so only the time budget ends the bake.
+            settings.minSamples = 4;
+            settings.samplesPerPass = 4;
+            settings.maxSamples = 1u << 20;
+            settings.errorThreshold = -1.0f;
+            settings.sampler = SamplerType::Sobol;
+            settings.lightSampling = config.lightSampling;
+            settings.directReservoirs.enabled = config.candidates > 0;
+            settings.directReservoirs.candidates = config.candidates;
+            settings.directReservoirs.neighbours = config.neighbours;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            BenchTimer timer;
+            for (double checkpoint : { seconds / 3.0, seconds })
+            {
+                while (timer.GetMilliseconds() < checkpoint * 1000.0 && engine.RunPass())
+                {
+                }
+                Lightmap lightmap = engine.GetLightmap();
+                std::printf("  %-12s %9.2f %11llu  %9.4f  %+8.4f\n", config.name, timer.GetMilliseconds() / 1000.0,
+                            static_cast<unsigned long long>(engine.GetStats().samples), GetRelativeError(lightmap, reference),
+                            GetBias(lightmap, reference));
+            }
+            if (config.candidates > 0)
+            {
+                DirectReservoirStats stats = engine.GetDirectReservoirStats();
+                std::printf("  %-12s %.2f merged per estimate, %.1f%% reused, %.2f MB\n", "",
+                            static_cast<double>(stats.merged) / static_cast<double>(std::max<uint64_t>(stats.estimates, 1)),
+                            100.0 * static_cast<double>(stats.reused) / static_cast<double>(std::max<uint64_t>(stats.estimates, 1)),
+                            static_cast<double>(stats.memoryBytes) / 1e6);
+            }
+        }
+        return 0;
+    }
+}
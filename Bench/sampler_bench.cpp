@@ -0,0 +1,132 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+#include "Utility/hdr_image.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        Lightmap BakeFixed(const Scene& scene, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool, uint32_t samples, SamplerType sampler, uint32_t maxBounces)
+        {
+            BakeSettings settings;
+            settings.minSamples = samples;
+            settings.maxSamples = samples;
+            settings.sampler = sampler;
+            settings.maxBounces = maxBounces;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            engine.Bake();
+            return engine.GetLightmap();
+        }
+
+        // Equirectangular sky brightening towards the zenith, with a small bright sun.
+        HdrImage MakeSky()
+        {
+            HdrImage sky;
+            sky.width = 256;
+            sky.height = 128;
+            sky.pixels.resize(static_cast<size_t>(sky.width) * sky.height);
+            for (uint32_t y = 0; y < sky.height; ++y)
+            {
+                for (uint32_t x = 0; x < sky.width; ++x)
+                {
+                    float up = 1.0f - (static_cast<float>(y) + 0.5f) / static_cast<float>(sky.height);
+                    glm::vec3 color = glm::mix(glm::vec3(0.9f, 0.8f, 0.7f), glm::vec3(0.3f, 0.5f, 1.0f), up);
+                    if (x / 4 == 10 && y / 4 == 8)
+                        color = glm::vec3(2000.0f, 1800.0f, 1500.0f);
+                    sky.pixels[static_cast<size_t>(y) * sky.width + x] = color;
+                }
+            }
+            return sky;
+        }
+
+        const char* GetSamplerName(SamplerType sampler)
+        {
+            switch (sampler)
+            {
+            case SamplerType::Random: return "random";
+            case SamplerType::Sobol: return "sobol";
+            default: return "blue noise";
+            }
+        }
+    }
+
+    /**
+     * Bench sampler [referenceSamples=4096]: relative error of fixed sample
+     * counts against a random-sampled reference, per sampler, in a room lit
+     * by an area light with one bounce and on a box under an HDR sky with
+     * direct light only.
+     */
+    int RunSamplerBench(int argc, char** argv)
+    {
+        uint32_t referenceSamples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 4096;
+
+        bvh::v2::ThreadPool threadPool;
+        std::filesystem::path skyPath = std::filesystem::temp_directory_path() / "lightchef_bench_sky.hdr";
+        if (!SaveHdr(skyPath, MakeSky()))
+        {
+            std::fprintf(stderr, "Could not write %s\n", skyPath.string().c_str());
+            return 1;
+        }
+
+        {
+            BenchTimer timer;
+            BlueNoiseTile tile(64, 1);
+            std::printf("blue noise tile: %.1f ms\n", timer.GetMilliseconds());
+        }
+        for (int sceneIndex = 0; sceneIndex < 2; ++sceneIndex)
+        {
+            Scene scene;
+            AtlasOptions options;
+            uint32_t maxBounces = 0;
+            if (sceneIndex == 0)
+            {
+                scene.meshes.push_back(MakeBox({ -2.0f, 0.0f, -2.0f }, { 2.0f, 3.0f, 2.0f }, true));
+                scene.meshes.push_back(MakeBox({ -0.5f, 0.0f, -0.5f }, { 0.5f, 1.0f, 0.5f }));
+                Mesh lamp;
+                lamp.positions = { { -0.3f, 2.99f, -0.3f }, { 0.3f, 2.99f, -0.3f }, { 0.3f, 2.99f, 0.3f }, { -0.3f, 2.99f, 0.3f } };
+                lamp.indices = { 0, 1, 2, 0, 2, 3 };
+                lamp.materialIndex = 1;
+                scene.meshes.push_back(lamp);
+                scene.materials = { Material{}, Material{ glm::vec3(0.0f), glm::vec3(20.0f) } };
+                options.texelsPerUnit = 6.0f;
+                maxBounces = 1;
+            }
+            else
+            {
+                scene.meshes.push_back(MakeBox({ -3.0f, -0.1f, -3.0f }, { 3.0f, 0.0f, 3.0f }));
+                scene.meshes.push_back(MakeBox({ -0.5f, 0.0f, -0.5f }, { 0.5f, 1.0f, 0.5f }));
+                scene.materials = { Material{} };
+                scene.environmentMap = skyPath;
+                options.texelsPerUnit = 4.0f;
+            }
+            LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+            TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+            Lightmap reference = BakeFixed(scene, texels, threadPool, referenceSamples, SamplerType::Random, maxBounces);
+
+            std::printf("%s, %zu texels: relative error and seconds\n", sceneIndex == 0 ? "area-lit room, one bounce" : "sky-lit box, direct", texels.texels.size());
+            std::printf("  samples  %-17s %-17s %s\n", GetSamplerName(SamplerType::Random), GetSamplerName(SamplerType::Sobol), GetSamplerName(SamplerType::BlueNoise));
+            for (uint32_t samples : { 4u, 16u, 64u, 256u })
+            {
+                std::printf("  %7u", samples);
+                for (SamplerType sampler : { SamplerType::Random, SamplerType::Sobol, SamplerType::BlueNoise })
+                {
+                    BenchTimer timer;
+                    Lightmap lightmap = BakeFixed(scene, texels, threadPool, samples, sampler, maxBounces);
+                    std::printf("  %.4f %9.2fs", GetRelativeError(lightmap, reference), timer.GetMilliseconds() / 1000.0);
+                }
+                std::printf("\n");
+            }
+        }
+        std::filesystem::remove(skyPath);
+        return 0;
+    }
+}
@@ -0,0 +1,105 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/sampling.h"
+#include "Bake/seam_stitcher.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Bilinear lookup with texel centers at (i + 0.5) / size, clamped to the page like the preview's sampler.
+        glm::vec3 SampleBilinear(const Lightmap& lightmap, uint32_t atlas, const glm::vec2& uv)
+        {
+            float px = uv.x * lightmap.width - 0.5f;
+            float py = uv.y * lightmap.height - 0.5f;
+            int x0 = static_cast<int>(std::floor(px));
+            int y0 = static_cast<int>(std::floor(py));
+            float tx = px - static_cast<float>(x0);
+            float ty = py - static_cast<float>(y0);
+            auto at = [&](int x, int y) {
+                x = std::clamp(x, 0, static_cast<int>(lightmap.width) - 1);
+                y = std::clamp(y, 0, static_cast<int>(lightmap.height) - 1);
+                return glm::vec3(lightmap.texels[lightmap.GetIndex(atlas, x, y)]);
+            };
+            return glm::mix(glm::mix(at(x0, y0), at(x0 + 1, y0), tx), glm::mix(at(x0, y0 + 1), at(x0 + 1, y0 + 1), tx), ty);
+        }
+
+        // Mean luminance difference between the two sides of every seam, over their mean luminance.
+        double GetSeamMismatch(const Lightmap& lightmap, const SeamStitcher& stitcher)
+        {
+            constexpr int kPointsPerSeam = 8;
+            double difference = 0.0;
+            double sum = 0.0;
+            for (const SeamStitcher::Seam& seam : stitcher.GetSeams())
+            {
+                for (int k = 0; k < kPointsPerSeam; ++k)
+                {
+                    float t = (k + 0.5f) / kPointsPerSeam;
+                    double a = Luminance(SampleBilinear(lightmap, seam.atlasIndex[0], glm::mix(seam.uv[0][0], seam.uv[0][1], t)));
+                    double b = Luminance(SampleBilinear(lightmap, seam.atlasIndex[1], glm::mix(seam.uv[1][0], seam.uv[1][1], t)));
+                    difference += std::abs(a - b);
+                    sum += 0.5 * (a + b);
+                }
+            }
+            return sum > 0.0 ? difference / sum : 0.0;
+        }
+    }
+
+    /**
+     * Bench seams [samples=256]: bilinear mismatch across the UV seams of a
+     * room with a crate and a ball, as baked, after dilation and after
+     * stitching, with the time each step takes and how far stitching moves
+     * the baked texels (relative to the dilated lightmap).
+     */
+    int RunSeamsBench(int argc, char** argv)
+    {
+        uint32_t samples = argc > 0 ? static_cast<uint32_t>(std::max(std::atoi(argv[0]), 1)) : 256;
+
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -2.0f, 0.0f, -2.0f }, { 2.0f, 3.0f, 2.0f }, true));
+        scene.meshes.push_back(MakeBox({ -0.5f, 0.0f, -0.5f }, { 0.5f, 1.0f, 0.5f }));
+        scene.meshes.push_back(MakeSphere({ 1.0f, 1.5f, 1.0f }, 0.4f, 24));
+        scene.materials = { Material{} };
+        Light light;
+        light.position = glm::vec3(0.0f, 2.5f, 0.0f);
+        light.intensity = 5.0f;
+        scene.lights.push_back(light);
+
+        bvh::v2::ThreadPool threadPool;
+        AtlasOptions options;
+        options.texelsPerUnit = 16.0f;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+        BakeSettings settings;
+        settings.minSamples = samples;
+        settings.maxSamples = samples;
+        BakeEngine engine(scene, texels, settings, threadPool);
+        BakeStats stats = engine.Bake();
+        Lightmap lightmap = engine.GetLightmap();
+
+        BenchTimer timer;
+        SeamStitcher stitcher(scene, atlas);
+        std::printf("%zu charts, %zu seams found in %.1f ms, %zu covered texels at %u samples\n", atlas.charts.size(), stitcher.GetSeams().size(),
+                    timer.GetMilliseconds(), stats.coveredTexels, samples);
+
+        std::printf("  step        mismatch        ms\n");
+        std::printf("  baked       %8.4f\n", GetSeamMismatch(lightmap, stitcher));
+        timer = BenchTimer();
+        stitcher.Dilate(lightmap, texels, threadPool);
+        std::printf("  dilated     %8.4f  %8.1f\n", GetSeamMismatch(lightmap, stitcher), timer.GetMilliseconds());
+        Lightmap dilated = lightmap;
+        timer = BenchTimer();
+        stitcher.Stitch(lightmap, threadPool);
+        std::printf("  stitched    %8.4f  %8.1f\n", GetSeamMismatch(lightmap, stitcher), timer.GetMilliseconds());
+        std::printf("baked texels moved by %.4f relative\n", GetRelativeError(lightmap, dilated));
+        return 0;
+    }
+}
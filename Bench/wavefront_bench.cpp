@@ -0,0 +1,162 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/bake_engine.h"
+#include "Bake/content_hash.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampling.h"
+#include "Bake/texel_rasterizer.h"
+#include "Utility/simd.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        RayPacket MakePacket(const glm::vec3 origins[4], const glm::vec3 directions[4], const float maxDistances[4])
+        {
+            alignas(16) float origin[3][4];
+            alignas(16) float direction[3][4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    origin[axis][lane] = origins[lane][axis];
+                    direction[axis][lane] = directions[lane][axis];
+                }
+            }
+            RayPacket packet;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                packet.origin[axis] = Float4::Load(origin[axis]);
+                packet.direction[axis] = Float4::Load(direction[axis]);
+            }
+            packet.maxDistance = Float4::Load(maxDistances);
+            return packet;
+        }
+    }
+
+    /**
+     * Bench wavefront [texelsPerUnit=2] [maxSamples=64]: bakes a floor with
+     * boxes, spheres, an emissive panel and point lights path by path and
+     * with the wavefront integrator, whose accumulators must hash the
+     * same; then checks packet shadow rays against scalar ones on random
+     * rays and times both on coherent shadow rays from a grid to one light.
+     */
+    int RunWavefrontBench(int argc, char** argv)
+    {
+        AtlasOptions options;
+        options.texelsPerUnit = argc > 0 ? static_cast<float>(std::atof(argv[0])) : 2.0f;
+        uint32_t maxSamples = argc > 1 ? static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1)) : 64;
+
+        Scene scene;
+        scene.meshes.push_back(MakeBox({ -20.0f, -0.1f, -20.0f }, { 20.0f, 0.0f, 20.0f }));
+        for (int i = 0; i < 6; ++i)
+        {
+            float x = -12.0f + 5.0f * static_cast<float>(i);
+            scene.meshes.push_back(MakeBox({ x, 0.0f, -1.0f }, { x + 2.0f, 1.0f + 0.5f * static_cast<float>(i), 1.0f }));
+            scene.meshes.back().materialIndex = i % 2;
+        }
+        for (int i = 0; i < 40; ++i)
+        {
+            scene.meshes.push_back(MakeSphere({ -15.0f + 0.8f * static_cast<float>(i), 1.5f, -5.0f + static_cast<float>(i % 5) }, 0.6f, 24));
+            scene.meshes.back().materialIndex = i % 2;
+        }
+        scene.meshes.push_back(MakeBox({ -3.0f, 3.0f, 4.0f }, { 3.0f, 3.2f, 6.0f }));
+        scene.meshes.back().materialIndex = 2;
+        scene.materials = { Material{ glm::vec3(0.7f, 0.6f, 0.5f), glm::vec3(0.0f) }, Material{ glm::vec3(0.5f, 0.7f, 0.6f), glm::vec3(0.0f) },
+                            Material{ glm::vec3(0.8f), glm::vec3(4.0f, 3.0f, 2.0f) } };
+        for (int i = 0; i < 4; ++i)
+        {
+            Light light;
+            light.position = glm::vec3(-10.0f + 7.0f * static_cast<float>(i), 2.5f, 3.0f);
+            light.intensity = 3.0f;
+            if (i == 1)
+            {
+                light.type = Light::Type::Spot;
+                light.cosInnerAngle = 0.9f;
+                light.cosOuterAngle = 0.7f;
+            }
+            scene.lights.push_back(light);
+        }
+        scene.skyColor = glm::vec3(0.2f, 0.25f, 0.3f);
+
+        bvh::v2::ThreadPool threadPool;
+        LightmapAtlas atlas = AtlasGenerator(options).Generate(scene, threadPool);
+        TexelBuffer texels = TexelRasterizer().Rasterize(scene, atlas, threadPool);
+        for (bool wavefront : { false, true })
+        {
+            BakeSettings settings;
+            settings.maxSamples = maxSamples;
+            settings.directional = true;
+            settings.wavefront = wavefront;
+            BakeEngine engine(scene, texels, settings, threadPool);
+            BenchTimer timer;
+            BakeStats stats = engine.Bake();
+            std::span<const TexelAccumulator> accumulators = engine.GetAccumulators();
+            std::printf("%-9s: %u passes, %llu samples, %.0f ms, accumulator hash %016llx\n", wavefront ? "wavefront" : "per-path", stats.passes,
+                        static_cast<unsigned long long>(stats.samples), timer.GetMilliseconds(),
+                        static_cast<unsigned long long>(HashBytes(0, accumulators.data(), accumulators.size_bytes())));
+        }
+
+        RayTracer tracer(scene, threadPool);
+        Random random(7);
+        int mismatches = 0;
+        int occludedRays = 0;
+        const int packetCount = 200000;
+        for (int i = 0; i < packetCount; ++i)
+        {
+            glm::vec3 base(random.NextFloat() * 30.0f - 15.0f, random.NextFloat() * 3.0f, random.NextFloat() * 10.0f - 5.0f);
+            glm::vec3 origins[4];
+            glm::vec3 directions[4];
+            float maxDistances[4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                origins[lane] = base + glm::vec3(random.NextFloat(), random.NextFloat(), random.NextFloat()) * 0.5f;
+                directions[lane] = SampleUniformSphere(random.NextFloat(), random.NextFloat());
+                maxDistances[lane] = random.NextFloat() * 20.0f;
+            }
+            int mask = tracer.Occluded(MakePacket(origins, directions, maxDistances));
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                bool occluded = tracer.Occluded(origins[lane], directions[lane], maxDistances[lane]);
+                occludedRays += occluded;
+                mismatches += occluded != static_cast<bool>(mask >> lane & 1);
+            }
+        }
+        std::printf("packet vs scalar shadow rays: %d mismatches of %d (%d occluded)\n", mismatches, packetCount * 4, occludedRays);
+
+        std::vector<glm::vec3> origins;
+        std::vector<glm::vec3> directions;
+        std::vector<float> maxDistances;
+        const glm::vec3 lightPosition(-3.0f, 2.5f, 3.0f);
+        for (int z = 0; z < 400; ++z)
+        {
+            for (int x = 0; x < 400; ++x)
+            {
+                glm::vec3 origin(-10.0f + 0.05f * static_cast<float>(x), 0.001f, -10.0f + 0.05f * static_cast<float>(z));
+                float distance = glm::length(lightPosition - origin);
+                origins.push_back(origin);
+                directions.push_back((lightPosition - origin) / distance);
+                maxDistances.push_back(distance);
+            }
+        }
+        BenchTimer scalarTimer;
+        int scalarOccluded = 0;
+        for (size_t i = 0; i < origins.size(); ++i)
+            scalarOccluded += tracer.Occluded(origins[i], directions[i], maxDistances[i]);
+        double scalarMilliseconds = scalarTimer.GetMilliseconds();
+        BenchTimer packetTimer;
+        int packetOccluded = 0;
+        for (size_t i = 0; i < origins.size(); i += 4)
+            packetOccluded += std::popcount(static_cast<unsigned>(tracer.Occluded(MakePacket(&origins[i], &directions[i], &maxDistances[i]))));
+        double packetMilliseconds = packetTimer.GetMilliseconds();
+        std::printf("%zu coherent shadow rays: scalar %.1f ms, packets %.1f ms (%d and %d occluded)\n", origins.size(), scalarMilliseconds,
+                    packetMilliseconds, scalarOccluded, packetOccluded);
+        return mismatches == 0 && scalarOccluded == packetOccluded ? 0 : 1;
+    }
+}
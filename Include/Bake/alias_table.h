@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace LightChef
+{
+    /**
+     * Walker/Vose alias table: samples an index proportionally to a set of
+     * non-negative weights in O(1) from a single uniform number.
+     */
+    class AliasTable
+    {
+    public:
+        AliasTable() = default;
+        explicit AliasTable(const std::vector<float>& weights);
+
+        // Returns false when every weight is zero.
+        bool Sample(float u, uint32_t& index, float& pmf) const;
+        float GetPmf(uint32_t index) const { return index < m_pmfs.size() ? m_pmfs[index] : 0.0f; }
+        // Bin layout, for samplers that run elsewhere (the GPU baker).
+        float GetThreshold(uint32_t bin) const { return m_bins[bin].threshold; }
+        uint32_t GetAlias(uint32_t bin) const { return m_bins[bin].alias; }
+
+        size_t GetSize() const { return m_pmfs.size(); }
+        bool IsEmpty() const { return m_totalWeight <= 0.0f; }
+        float GetTotalWeight() const { return m_totalWeight; }
+
+    private:
+        struct Bin
+        {
+            // Probability of keeping this bin's own index instead of its alias.
+            float threshold;
+            uint32_t alias;
+        };
+
+        std::vector<Bin> m_bins;
+        std::vector<float> m_pmfs;
+        float m_totalWeight = 0.0f;
+    };
+}
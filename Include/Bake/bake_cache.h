@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+#include "Scene/scene.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct BakeSettings;
+    struct TexelAccumulator;
+
+    struct BakeCacheStats
+    {
+        uint32_t charts = 0;
+        uint32_t hits = 0;
+        uint32_t stored = 0;
+
+        float GetHitRate() const { return charts > 0 ? static_cast<float>(hits) / charts : 0.0f; }
+    };
+
+    /**
+     * Content-addressed store of baked charts in a local directory (see
+     * BakeSettings::cacheDirectory). A chart's key hashes its texels (world
+     * positions, normals and their layout inside the chart, but not where
+     * the chart sits in the atlas), the triangles, materials and lights in
+     * the grid cells within cacheInfluenceRadius of the chart, the sky, and
+     * the settings that shape a path. Edits further away than the radius
+     * leave a chart's key unchanged, so its cached result is reused as is;
+     * bounce light from further away is the approximation this buys.
+     */
+    class BakeCache
+    {
+    public:
+        // Keys every chart and fills the accumulators of cached charts none of whose texels have samples yet.
+        void Load(const std::filesystem::path& directory, const Scene& scene, const TexelBuffer& texels, const BakeSettings& settings,
+                  std::span<TexelAccumulator> accumulators);
+        // Writes every chart that missed and whose texels all have samples.
+        void Store(std::span<const TexelAccumulator> accumulators);
+
+        const BakeCacheStats& GetStats() const { return m_stats; }
+
+    private:
+        std::filesystem::path GetEntryPath(uint64_t key) const;
+
+        std::filesystem::path m_directory;
+        // Texel indices of every chart, in index order, which is also the entry order.
+        std::vector<std::vector<size_t>> m_chartTexels;
+        std::vector<uint64_t> m_keys;
+        std::vector<uint8_t> m_hits;
+        BakeCacheStats m_stats;
+    };
+}
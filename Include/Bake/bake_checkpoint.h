@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace LightChef
+{
+    constexpr uint32_t kCheckpointMagic = 0x504B434Cu; // "LCKP"
+    constexpr uint32_t kCheckpointVersion = 6;
+    // The texel accumulators start on a cache line after the header.
+    constexpr size_t kCheckpointHeaderSize = 64;
+
+    /**
+     * Start of a bake checkpoint file (see BakeSettings::checkpointPath),
+     * which is followed by one TexelAccumulator per texel.
+     */
+    struct CheckpointHeader
+    {
+        uint32_t magic = kCheckpointMagic;
+        uint32_t version = kCheckpointVersion;
+        // Hash of the texels, scene and settings; the same for every shard of a bake.
+        uint64_t key = 0;
+        uint64_t texelCount = 0;
+        uint32_t shardIndex = 0;
+        uint32_t shardCount = 1;
+        // Progress at the last checkpoint.
+        uint64_t samples = 0;
+        double seconds = 0.0;
+        uint32_t passes = 0;
+        uint32_t checkpoints = 0;
+        // Path guide generation at the last checkpoint; a resumed bake numbers its guide's
+        // generations past it, so no texel sees a sequence scramble twice.
+        uint32_t guideGeneration = 0;
+    };
+    static_assert(sizeof(CheckpointHeader) <= kCheckpointHeaderSize);
+
+    struct ShardMergeStats
+    {
+        uint32_t shards = 0;
+        uint64_t samples = 0;
+        // Texels holding samples from more than one shard.
+        size_t overlappingTexels = 0;
+    };
+
+    /**
+     * Combines the checkpoint files of shards of one bake into `output`, an
+     * unsharded checkpoint. Sums and sample counts add up, so every texel's
+     * mean is weighted by the samples each shard took. An unsharded
+     * BakeEngine over the same texels, scene and settings resumes from the
+     * output, which also finishes the tiles of missing or unfinished shards.
+     * Fails on files from different bakes or repeated shards.
+     */
+    bool MergeShards(const std::vector<std::filesystem::path>& shards, const std::filesystem::path& output, ShardMergeStats& stats);
+}
@@ -0,0 +1,242 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/bake_cache.h"
+#include "Bake/direct_reservoirs.h"
+#include "Bake/light_set.h"
+#include "Bake/lightmap.h"
+#include "Bake/path_guide.h"
+#include "Bake/path_integrator.h"
+#include "Bake/radiance_cache.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampler.h"
+#include "Bake/texel_rasterizer.h"
+#include "Bake/wavefront_integrator.h"
+#include "Utility/exr_writer.h"
+#include "Utility/mapped_file.h"
+
+namespace LightChef
+{
+    struct BakeSettings
+    {
+        // Square tile edge, in texels; tiles are the unit of work handed to threads.
+        uint32_t tileSize = 32;
+        // Samples every covered texel receives in the first pass.
+        uint32_t minSamples = 16;
+        // Samples added per pass to texels that have not converged yet.
+        uint32_t samplesPerPass = 8;
+        uint32_t maxSamples = 1024;
+        // Relative standard error of the texel luminance under which a texel is converged.
+        float errorThreshold = 0.02f;
+        // Global budgets; 0 disables them.
+        double timeBudgetSeconds = 0.0;
+        uint64_t sampleBudget = 0;
+        // Diffuse interreflections traced beyond direct lighting.
+        uint32_t maxBounces = 3;
+        // Ends paths past the first bounce in a world-space irradiance cache shared by all
+        // threads (see RadianceCache); disabled while its cell size is 0. Wavefront tracing
+        // and devices do not use it.
+        RadianceCacheSettings radianceCache;
+        // Learns where light comes from as passes go and samples bounces towards it (see
+        // PathGuide); blue-noise sampling falls back to Sobol with it. Wavefront tracing and
+        // devices do not use it.
+        PathGuideSettings guiding;
+        // Resamples the direct light of texels from several light samples and from their
+        // neighbours' (see DirectReservoirs); path vertices past the texel keep one light
+        // sample. Light BVH sampling, wavefront tracing and devices do not use it.
+        DirectReservoirSettings directReservoirs;
+        // How the one light sampled per shading point is chosen.
+        LightSamplingMode lightSampling = LightSamplingMode::Bvh;
+        // Sample sequence behind every random decision of a path.
+        SamplerType sampler = SamplerType::Sobol;
+        // Experimental: trace each tile's samples stage by stage with a WavefrontIntegrator
+        // instead of one path at a time. The estimates are the same, but on the CPU it is no
+        // faster yet (Bench wavefront): bounce and most shadow rays are too incoherent for the
+        // packets to pay off, and light sampling costs the same either way.
+        bool wavefront = false;
+        // Also accumulate luminance L1 SH for normal-mapped lighting (see GetDirectionalLightmap).
+        bool directional = false;
+        // When set, the accumulators live in this memory-mapped file, which is flushed to disk
+        // every checkpointIntervalSeconds; a bake of the same texels, scene and settings
+        // picks up from it.
+        std::filesystem::path checkpointPath;
+        double checkpointIntervalSeconds = 60.0;
+        // This process bakes every shardCount-th tile, starting at shardIndex. Give each shard
+        // its own checkpointPath and combine the files with MergeShards.
+        uint32_t shardIndex = 0;
+        uint32_t shardCount = 1;
+        // When set, finished charts are stored in and reused from this content-addressed cache
+        // (see BakeCache); scene edits further than the radius from a chart keep its entry.
+        std::filesystem::path cacheDirectory;
+        float cacheInfluenceRadius = 10.0f;
+        // When set, tiles are written to this tiled OpenEXR file as soon as all their texels
+        // have converged, and the rest when Bake() finishes (see TiledExrWriter).
+        std::filesystem::path outputPath;
+    };
+
+    /**
+     * Running sums of one texel's irradiance samples.
+     */
+    struct TexelAccumulator
+    {
+        glm::vec3 irradianceSum{ 0.0f };
+        float luminanceSquaredSum = 0.0f;
+        uint32_t sampleCount = 0;
+        // Luminance L1 SH moments of the incident radiance: band 1 in xyz, band 0 in w.
+        glm::vec4 directionalSum{ 0.0f };
+    };
+
+    struct BakeStats
+    {
+        uint32_t passes = 0;
+        uint64_t samples = 0;
+        size_t coveredTexels = 0;
+        size_t convergedTexels = 0;
+        double seconds = 0.0;
+        // The bake continued from a checkpoint file.
+        bool resumed = false;
+        uint32_t checkpoints = 0;
+        double checkpointSeconds = 0.0;
+        // Share of the samples taken by the attached BakeDevice, and the batches it took them in.
+        uint64_t deviceSamples = 0;
+        uint32_t deviceBatches = 0;
+        double deviceSeconds = 0.0;
+    };
+
+    /**
+     * Another processor that bakes tiles next to the CPU workers, such as
+     * the GPU baker (see GpuBakeDevice). It receives copies of texel
+     * accumulators and must continue each texel's sample sequence from its
+     * sampleCount up to the given target, drawing the same samples as the
+     * CPU would, so the engine can hand any tile to either side.
+     */
+    class BakeDevice
+    {
+    public:
+        virtual ~BakeDevice() = default;
+
+        // Returns false when the device failed; the engine then bakes the texels itself.
+        virtual bool BakeTexels(std::span<const uint32_t> texelIndices, std::span<const uint32_t> sampleTargets,
+                                std::span<TexelAccumulator> accumulators) = 0;
+    };
+
+    /**
+     * Progressive CPU path tracer over the texels of a lightmap atlas.
+     * The bake runs in passes over atlas tiles: the first pass gives every
+     * texel `minSamples`, later passes only revisit texels whose estimated
+     * error is still above the threshold, until they converge or a budget
+     * runs out. Each texel bakes irradiance. A texel's sample sequence
+     * only depends on its sample count, so a bake resumed from a checkpoint
+     * continues every texel exactly where it stopped. With a BakeDevice
+     * attached, a pass's tiles form one queue that the CPU workers take
+     * single tiles from while the device takes batches from the other end,
+     * sized by the throughput both sides have shown so far.
+     */
+    class BakeEngine
+    {
+    public:
+        BakeEngine(const Scene& scene, const TexelBuffer& texels, const BakeSettings& settings, bvh::v2::ThreadPool& threadPool);
+
+        BakeStats Bake();
+
+        // Shares the tiles of every following pass with `device`, or stops sharing for null. Devices
+        // only add irradiance, so a directional bake keeps its tiles on the CPU and returns false.
+        bool SetDevice(BakeDevice* device);
+
+        // Run one pass; returns false once no texel needs more samples or a budget is spent.
+        bool RunPass();
+
+        Lightmap GetLightmap() const;
+        // Band 1 over band 0 of the luminance L1 SH in xyz, the relative irradiance at the
+        // baked normal in w (see EvaluateL1Irradiance); requires BakeSettings::directional.
+        Lightmap GetDirectionalLightmap() const;
+        // Variance of every texel's mean luminance, the noise estimate the denoiser keys on.
+        std::vector<float> GetLuminanceVariance() const;
+        std::span<const TexelAccumulator> GetAccumulators() const { return m_accumulators; }
+        const BakeStats& GetStats() const { return m_stats; }
+        const BakeCacheStats& GetCacheStats() const { return m_cache.GetStats(); }
+        const ExrWriterStats& GetOutputStats() const { return m_output.GetStats(); }
+        const RayTracer& GetRayTracer() const { return m_tracer; }
+        const PathIntegrator& GetIntegrator() const { return m_integrator; }
+        RadianceCacheStats GetRadianceCacheStats() const { return m_radianceCache ? m_radianceCache->GetStats() : RadianceCacheStats(); }
+        PathGuideStats GetPathGuideStats() const { return m_guide ? m_guide->GetStats() : PathGuideStats(); }
+        DirectReservoirStats GetDirectReservoirStats() const { return m_directReservoirs ? m_directReservoirs->GetStats() : DirectReservoirStats(); }
+
+    private:
+        struct Tile
+        {
+            uint32_t atlasIndex;
+            uint32_t x;
+            uint32_t y;
+        };
+        class TileQueue;
+
+        bool NeedsSamples(const TexelAccumulator& accumulator) const;
+        // Samples the current pass adds to the texel, 0 once it has converged.
+        uint32_t GetPassSamples(const TexelAccumulator& accumulator) const;
+        uint64_t GetPassSamples(const Tile& tile) const;
+        bool TileNeedsSamples(const Tile& tile) const;
+        bool IsOverBudget() const;
+        // Maps the accumulators from the checkpoint file, resuming when it matches this bake.
+        bool OpenCheckpoint();
+        // Writes the stats header and flushes the file; `force` ignores the interval.
+        void Checkpoint(bool force);
+        // `worker` is the pool thread, or the thread count for the device feeder.
+        uint64_t BakeTile(const Tile& tile, size_t worker);
+        uint64_t BakeTileWavefront(const Tile& tile, WavefrontIntegrator& integrator);
+        // Takes batches from the back of the queue until it runs dry; runs on its own thread.
+        void FeedDevice(TileQueue& queue, const std::atomic<uint64_t>& cpuSamples, std::chrono::steady_clock::time_point passStart);
+        void BakeOnDevice(std::span<const uint32_t> tiles);
+        // Resolves the tile's irradiance and hands it to the output file, once.
+        void WriteTile(uint32_t tileIndex);
+        glm::vec3 SampleTexel(const TexelRecord& texel, size_t texelIndex, uint32_t x, uint32_t y, uint32_t sampleIndex, glm::vec4& directionalSum) const;
+
+        const Scene& m_scene;
+        const TexelBuffer& m_texels;
+        BakeSettings m_settings;
+        bvh::v2::ThreadPool& m_threadPool;
+        RayTracer m_tracer;
+        LightSet m_lights;
+        PathIntegrator m_integrator;
+        // Only built when BakeSettings::radianceCache has a cell size.
+        std::unique_ptr<RadianceCache> m_radianceCache;
+        // Only built for PathGuideSettings::enabled; trained by every pass, updated between them.
+        std::unique_ptr<PathGuide> m_guide;
+        // Only built for DirectReservoirSettings::enabled; handed on between passes.
+        std::unique_ptr<DirectReservoirs> m_directReservoirs;
+        // Only built for SamplerType::BlueNoise.
+        BlueNoiseTile m_blueNoise;
+        // One per pool thread and one for the device feeder; only built for BakeSettings::wavefront.
+        std::vector<WavefrontIntegrator> m_wavefront;
+        // In m_ownedAccumulators, or in m_checkpointFile after its header.
+        std::span<TexelAccumulator> m_accumulators;
+        std::vector<TexelAccumulator> m_ownedAccumulators;
+        // Tiles holding at least one covered texel, in Morton order per page.
+        std::vector<Tile> m_tiles;
+        BakeStats m_stats;
+        // Samples taken so far, updated by workers so the sample budget holds mid-pass.
+        std::atomic<uint64_t> m_samplesTaken{ 0 };
+        std::chrono::steady_clock::time_point m_start;
+        MappedFile m_checkpointFile;
+        // Hash of the texels, scene and settings that a checkpoint must match.
+        uint64_t m_checkpointKey = 0;
+        std::mutex m_checkpointMutex;
+        std::chrono::steady_clock::time_point m_lastCheckpoint;
+        BakeCache m_cache;
+        TiledExrWriter m_output;
+        // Per entry of m_tiles; a tile is only ever baked by one worker at a time.
+        std::vector<uint8_t> m_tileWritten;
+        BakeDevice* m_device = nullptr;
+        // Samples per second of all CPU workers together in the last pass, 0 before the first.
+        double m_cpuRate = 0.0;
+    };
+}
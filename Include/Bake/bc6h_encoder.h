@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/lightmap.h"
+
+namespace LightChef
+{
+    enum class Bc6hQuality
+    {
+        // One region, endpoints from the principal axis.
+        Fast,
+        // Also refits endpoints by least squares and tries all 32 two-region partitions.
+        High,
+    };
+
+    struct Bc6hSettings
+    {
+        Bc6hQuality quality = Bc6hQuality::Fast;
+    };
+
+    struct Bc6hStats
+    {
+        size_t blocks = 0;
+        size_t twoRegionBlocks = 0;
+        double seconds = 0.0;
+        // Over baked texels, against the largest baked channel value.
+        double psnr = 0.0;
+    };
+
+    /**
+     * Lightmap pages as BC6H_UF16 blocks, 16 bytes per 4x4 texels, rows of
+     * blocks top to bottom and pages one after another; the layout
+     * queue.writeTexture takes for a BC6HRGBUfloat texture.
+     */
+    struct Bc6hLightmap
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        std::vector<uint8_t> blocks;
+
+        uint32_t GetBlocksX() const { return (width + 3) / 4; }
+        uint32_t GetBlocksY() const { return (height + 3) / 4; }
+        size_t GetPageSize() const { return static_cast<size_t>(GetBlocksX()) * GetBlocksY() * 16; }
+    };
+
+    /**
+     * Compresses baked lightmaps to unsigned BC6H, a quarter of the memory
+     * of RGBA16F. Blocks are fitted in the half-float bit domain BC6H
+     * interpolates in, so the error is roughly relative; texels no chart
+     * covers barely weigh in the fit. Index search runs four texels at once
+     * with Float4, and rows of blocks run on the thread pool. The encoder
+     * writes mode 11 (one region, 10-bit endpoints) and mode 1 (two
+     * regions, 10-bit base with 5-bit deltas).
+     */
+    class Bc6hEncoder
+    {
+    public:
+        explicit Bc6hEncoder(const Bc6hSettings& settings = {});
+
+        // Also decodes the result to measure its PSNR (see Bc6hStats).
+        Bc6hLightmap Encode(const Lightmap& lightmap, bvh::v2::ThreadPool& threadPool);
+
+        const Bc6hStats& GetStats() const { return m_stats; }
+
+    private:
+        Bc6hSettings m_settings;
+        Bc6hStats m_stats;
+    };
+
+    /**
+     * Decodes a block in one of the modes Bc6hEncoder writes; returns false
+     * for the other BC6H modes.
+     */
+    bool DecodeBc6hBlock(const uint8_t* block, glm::vec3 texels[16]);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    /**
+     * Folds raw bytes into a 64-bit hash, eight at a time. Meant for cache
+     * and checkpoint keys, not for anything adversarial; hashed types must
+     * not contain padding.
+     */
+    inline uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t offset = 0; offset < size; offset += sizeof(uint64_t))
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + offset, std::min(sizeof(uint64_t), size - offset));
+            hash = Random::Mix(hash ^ word);
+        }
+        return Random::Mix(hash ^ size);
+    }
+
+    template <typename T>
+    uint64_t HashValue(uint64_t hash, const T& value)
+    {
+        return HashBytes(hash, &value, sizeof(T));
+    }
+
+    template <typename T>
+    uint64_t HashVector(uint64_t hash, const std::vector<T>& values)
+    {
+        return HashBytes(hash, values.data(), values.size() * sizeof(T));
+    }
+}
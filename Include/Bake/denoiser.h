@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/lightmap.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct DenoiseSettings
+    {
+        // A-Trous iterations; the tap spacing doubles every iteration (1, 2, 4, ...).
+        uint32_t iterations = 5;
+        // Luminance edge-stopping, in standard deviations of the texel estimate.
+        float luminanceSigma = 4.0f;
+        // Sharpness of the normal edge-stopping; higher keeps creases crisper.
+        float normalSharpness = 64.0f;
+        // Allowed distance off the texel tangent plane, in texel spacings.
+        float planeSigma = 1.0f;
+        float albedoSigma = 0.1f;
+        uint32_t tileSize = 64;
+    };
+
+    /**
+     * Edge-aware A-Trous wavelet filter over baked lightmaps. Taps are
+     * weighted by luminance (scaled by the per-texel variance), normal,
+     * tangent-plane distance and albedo, and never cross chart boundaries.
+     * Four texels of a row are filtered at once with Float4; every
+     * iteration runs over tiles on the thread pool.
+     */
+    class Denoiser
+    {
+    public:
+        explicit Denoiser(const DenoiseSettings& settings = {});
+
+        /**
+         * Filters `lightmap` in place. `variance` holds the variance of every
+         * texel's mean luminance (see BakeEngine::GetLuminanceVariance); an
+         * empty vector falls back to a luminance-relative estimate.
+         */
+        void Denoise(Lightmap& lightmap, const std::vector<float>& variance, const TexelBuffer& texels, const Scene& scene,
+                     bvh::v2::ThreadPool& threadPool) const;
+
+    private:
+        DenoiseSettings m_settings;
+    };
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bake/path_integrator.h"
+#include "Bake/sampler.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct DirectReservoirSettings
+    {
+        // Only used with the cheap light samplers (LightSamplingMode::Power, Uniform); the bake
+        // ignores it under LightSamplingMode::Bvh. The light BVH already picks lights close to in
+        // proportion to their unshadowed irradiance, and each candidate it draws costs about as
+        // much as a shadow ray, so reservoirs there are noisier at equal time than one sample.
+        // Over the cheap samplers they pay off with many lights of uneven power (Bench reservoirs).
+        bool enabled = false;
+        // Light samples resampled into the reservoir of every texel sample.
+        uint32_t candidates = 8;
+        // Reservoirs of neighbouring texels, from the last pass, merged into it.
+        uint32_t neighbours = 4;
+        // How far those neighbours may be, in texels along each axis.
+        uint32_t radius = 4;
+    };
+
+    struct DirectReservoirStats
+    {
+        uint64_t estimates = 0;
+        // Neighbour reservoirs merged into estimates.
+        uint64_t merged = 0;
+        // Estimates whose light sample came from a neighbour.
+        uint64_t reused = 0;
+        size_t memoryBytes = 0;
+    };
+
+    /**
+     * Reservoir resampling of the direct light at lightmap texels (after
+     * Bitterli et al. 2020, "Spatiotemporal Reservoir Resampling for
+     * Real-Time Ray Tracing with Dynamic Direct Lighting"). Every estimate
+     * draws a few candidates from the light set's sampler and keeps one in
+     * proportion to its unshadowed irradiance; it then merges the
+     * reservoirs that texels of the same chart nearby kept last pass and
+     * traces a single shadow ray, whose result takes the MIS weight
+     * SampleDirect() would have given it. Merging uses pairwise MIS, which
+     * is unbiased, so the result converges to what
+     * PathIntegrator::DirectIrradiance() does. Reservoirs are not carried
+     * on from pass to pass: a bake averages its passes, and chained
+     * reservoirs would correlate them until the average stalls. Each
+     * texel's latest reservoir is only written by the thread sampling it;
+     * neighbours read the copy EndPass() takes between passes.
+     */
+    class DirectReservoirs
+    {
+    public:
+        DirectReservoirs(const PathIntegrator& integrator, const TexelBuffer& texels, const DirectReservoirSettings& settings);
+
+        /**
+         * One estimate of the direct irradiance at texel `texelIndex`, at
+         * (`x`, `y`) of its page, like PathIntegrator::DirectIrradiance().
+         * `direction` receives the direction towards the light used.
+         */
+        glm::vec3 Estimate(size_t texelIndex, uint32_t x, uint32_t y, Sampler& sampler, glm::vec3& direction);
+        // Hands the reservoirs of the pass that ended to the next one.
+        void EndPass();
+        DirectReservoirStats GetStats() const;
+
+    private:
+        struct Reservoir
+        {
+            glm::vec3 point{ 0.0f };
+            uint32_t light = LightSet::kNoLight;
+            // Unbiased contribution weight of the light sample, and its target at the texel.
+            float weight = 0.0f;
+            float target = 0.0f;
+            // Candidates behind it; 0 before the texel's first estimate.
+            float count = 0.0f;
+        };
+
+        // A light sample for the texel, unweighted, with the light set's pmf of its light and the pdf of the whole sample.
+        bool SampleCandidate(const TexelRecord& texel, Sampler& sampler, LightSample& sample, float& pmf, float& pdf) const;
+
+        const PathIntegrator& m_integrator;
+        const TexelBuffer& m_texels;
+        DirectReservoirSettings m_settings;
+        // Latest reservoir of every texel, and what it was when the last pass ended.
+        std::vector<Reservoir> m_current;
+        std::vector<Reservoir> m_previous;
+        std::atomic<uint64_t> m_estimates{ 0 };
+        std::atomic<uint64_t> m_merged{ 0 };
+        std::atomic<uint64_t> m_reused{ 0 };
+    };
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bake/lightmap.h"
+
+namespace LightChef
+{
+    /**
+     * Irradiance for `normal` relative to its average over all normals,
+     * from luminance L1 SH given as band 1 divided by band 0. Uses Hazel's
+     * non-linear reconstruction, which never goes negative and is exact for
+     * a single direction; Assets/shader.wgsl mirrors it.
+     */
+    float EvaluateL1Irradiance(const glm::vec3& band1, const glm::vec3& normal);
+
+    /**
+     * Packs a directional lightmap (see BakeEngine::GetDirectionalLightmap)
+     * into RGBA8 pages: rgb = 0.5 + 0.5 * band 1, a = relative irradiance at
+     * the baked normal / 4. Shading multiplies the irradiance lightmap by
+     * EvaluateL1Irradiance(band1, n) / a, so one extra fetch bends the
+     * baked lighting with a normal map. Unbaked texels pack as neutral.
+     */
+    std::vector<uint8_t> PackDirectionalLightmap(const Lightmap& directional);
+}
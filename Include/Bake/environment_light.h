@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Utility/hdr_image.h"
+
+namespace LightChef
+{
+    /**
+     * Equirectangular HDR sky, importance-sampled through piecewise-constant
+     * marginal (per row) and conditional (per column) CDFs weighted by
+     * luminance and sin(theta). +Y is up; the top image row looks straight up.
+     * The CDF tables are cached next to the image as `<image>.cdf` and
+     * rebuilt when the image changes.
+     */
+    class EnvironmentLight
+    {
+    public:
+        EnvironmentLight() = default;
+
+        bool Load(const std::filesystem::path& path, float intensity, bvh::v2::ThreadPool& threadPool);
+        bool IsValid() const { return m_image.width > 0 && m_integral > 0.0f; }
+
+        glm::vec3 Evaluate(const glm::vec3& direction) const;
+        // Samples a direction; `pdf` is per unit solid angle.
+        bool Sample(float u1, float u2, glm::vec3& direction, float& pdf) const;
+        float GetPdf(const glm::vec3& direction) const;
+
+        static std::filesystem::path GetCachePath(const std::filesystem::path& imagePath);
+
+    private:
+        void BuildTables(bvh::v2::ThreadPool& threadPool);
+        bool ReadCache(const std::filesystem::path& path, uint64_t sourceSize, int64_t sourceTime);
+        void WriteCache(const std::filesystem::path& path, uint64_t sourceSize, int64_t sourceTime) const;
+
+        HdrImage m_image;
+        float m_intensity = 1.0f;
+        // Row-major conditional CDFs, width + 1 entries per row, each ending at 1.
+        std::vector<float> m_conditionalCdf;
+        // Integral of every row's density, before normalization.
+        std::vector<float> m_rowIntegrals;
+        // height + 1 entries ending at 1.
+        std::vector<float> m_marginalCdf;
+        float m_integral = 0.0f;
+    };
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+#include <webgpu/webgpu.hpp>
+#include "Bake/bake_engine.h"
+#include "Bake/gpu_scene.h"
+
+namespace LightChef
+{
+    struct GpuBakeSettings
+    {
+        uint32_t samplesPerTexel = 256;
+        // Diffuse interreflections traced beyond direct lighting.
+        uint32_t maxBounces = 3;
+        // Upper bound on the paths of one dispatch. Every dispatch is submitted and waited on
+        // by itself, so none runs long enough for the driver to reset the device (two
+        // seconds by default on Windows).
+        uint32_t pathsPerDispatch = 1u << 18;
+    };
+
+    struct GpuBakeStats
+    {
+        uint32_t dispatches = 0;
+        uint64_t samples = 0;
+        // Wall time of the dispatches, including the waits for the queue.
+        double seconds = 0.0;
+    };
+
+    /**
+     * Path traces lightmap texels with the WGSL port of the CPU integrator
+     * (Assets/lightmap_bake.wgsl) on a WebGPU device. Per-texel sums live in
+     * a storage buffer that every dispatch adds to; Resolve() writes their
+     * means into an RGBA16F storage texture array, one layer per atlas page,
+     * which the renderer can sample as it is. RGBA read-write storage
+     * textures are not core WebGPU, hence the buffer. A texel draws the same
+     * Sobol samples as on the CPU, so for the same sample indices both
+     * backends agree up to floating point differences.
+     */
+    class GpuBaker
+    {
+    public:
+        explicit GpuBaker(wgpu::Device device, const GpuBakeSettings& settings = {});
+        ~GpuBaker();
+        GpuBaker(const GpuBaker&) = delete;
+        GpuBaker& operator=(const GpuBaker&) = delete;
+
+        // Uploads the scene and zeroes the sums; false when the shader does not load.
+        bool Initialize(const GpuBakeScene& scene, uint32_t width, uint32_t height, uint32_t atlasCount, const std::filesystem::path& shaderPath);
+
+        // Adds up to sampleCount samples to texels [firstTexel, firstTexel + texelCount) of the scene's
+        // list, continuing the sequence of each.
+        void Dispatch(uint32_t firstTexel, uint32_t texelCount, uint32_t sampleCount);
+        // Continues texels given by their own records, wherever they are in the scene, up to the
+        // sampleTarget of their sums. Both go up over the first slots of the list, whose sums are lost.
+        bool BakeTexels(std::span<const GpuTexel> texels, std::span<GpuAccumulator> accumulators);
+        // samplesPerTexel samples for every texel.
+        const GpuBakeStats& Bake();
+        void Resolve();
+        // Copies the sums back, in the scene's texel order.
+        bool ReadAccumulators(std::vector<GpuAccumulator>& accumulators);
+
+        uint32_t GetTexelCount() const { return m_texelCount; }
+        wgpu::Texture GetLightmap() const { return m_lightmap; }
+        const GpuBakeStats& GetStats() const { return m_stats; }
+
+    private:
+        struct Params;
+
+        void SubmitBake(uint32_t firstTexel, uint32_t texelCount, uint32_t sampleCount);
+        void Submit(wgpu::ComputePipeline pipeline, const Params& params);
+        // Copies the sums of the list's first slots.
+        bool ReadBack(std::span<GpuAccumulator> accumulators);
+        void WaitForQueue();
+        void Release();
+
+        wgpu::Device m_device;
+        wgpu::Queue m_queue;
+        GpuBakeSettings m_settings;
+        GpuBakeStats m_stats;
+        uint32_t m_texelCount = 0;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_lightCount = 0;
+        uint32_t m_punctualCount = 0;
+        float m_epsilon = 0.0f;
+        glm::vec3 m_skyColor{ 0.0f };
+
+        wgpu::BindGroupLayout m_bindGroupLayout;
+        wgpu::PipelineLayout m_pipelineLayout;
+        wgpu::ComputePipeline m_bakePipeline;
+        wgpu::ComputePipeline m_resolvePipeline;
+        wgpu::BindGroup m_bindGroup;
+        wgpu::Buffer m_params;
+        // Scene buffers in binding order, bindings 1 to 7.
+        std::vector<wgpu::Buffer> m_buffers;
+        wgpu::Buffer m_accumulators;
+        wgpu::Texture m_lightmap;
+        wgpu::TextureView m_lightmapView;
+    };
+
+    /**
+     * Hands BakeEngine tiles to a GpuBaker, for hybrid bakes where the CPU
+     * workers and the GPU share one queue. The baker's scene must come from
+     * the engine's ray tracer and light set (see BuildGpuBakeScene).
+     */
+    class GpuBakeDevice final : public BakeDevice
+    {
+    public:
+        GpuBakeDevice(GpuBaker& baker, const TexelBuffer& texels);
+
+        // The GPU integrator only draws Sobol samples and has no directional moments.
+        static bool Supports(const BakeSettings& settings);
+
+        bool BakeTexels(std::span<const uint32_t> texelIndices, std::span<const uint32_t> sampleTargets,
+                        std::span<TexelAccumulator> accumulators) override;
+
+    private:
+        GpuBaker& m_baker;
+        const TexelBuffer& m_texels;
+        std::vector<GpuTexel> m_batchTexels;
+        std::vector<GpuAccumulator> m_batchAccumulators;
+    };
+}
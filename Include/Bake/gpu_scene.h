@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bake/light_set.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    // Storage buffer records of Assets/lightmap_bake.wgsl; layouts follow WGSL's rules, vec3 aligned to 16 bytes.
+
+    struct GpuTriangle
+    {
+        glm::vec3 v0{ 0.0f };
+        uint32_t triangleId = 0;
+        glm::vec3 edge1{ 0.0f };
+        uint32_t material = 0;
+        glm::vec3 edge2{ 0.0f };
+        uint32_t padding = 0;
+    };
+    static_assert(sizeof(GpuTriangle) == 48);
+
+    struct GpuMaterial
+    {
+        glm::vec4 albedo{ 0.0f };
+        glm::vec4 emission{ 0.0f };
+    };
+    static_assert(sizeof(GpuMaterial) == 32);
+
+    /**
+     * A light of the light set, in its order (punctual lights, then
+     * emissive triangles), with the light's bin of the alias table.
+     */
+    struct GpuLight
+    {
+        static constexpr uint32_t kPoint = 0;
+        static constexpr uint32_t kSpot = 1;
+        static constexpr uint32_t kEmissive = 2;
+
+        glm::vec3 position{ 0.0f };
+        uint32_t type = kPoint;
+        glm::vec3 direction{ 0.0f };
+        float intensity = 0.0f;
+        glm::vec3 color{ 0.0f };
+        float cosInnerAngle = 1.0f;
+        float cosOuterAngle = 0.0f;
+        float pmf = 0.0f;
+        float aliasThreshold = 1.0f;
+        uint32_t aliasIndex = 0;
+    };
+    static_assert(sizeof(GpuLight) == 64);
+
+    struct GpuEmissiveTriangle
+    {
+        glm::vec3 v0{ 0.0f };
+        float area = 0.0f;
+        glm::vec3 v1{ 0.0f };
+        uint32_t padding0 = 0;
+        glm::vec3 v2{ 0.0f };
+        uint32_t padding1 = 0;
+        glm::vec3 normal{ 0.0f };
+        uint32_t padding2 = 0;
+        glm::vec3 radiance{ 0.0f };
+        uint32_t padding3 = 0;
+    };
+    static_assert(sizeof(GpuEmissiveTriangle) == 80);
+
+    struct GpuTexel
+    {
+        glm::vec3 position{ 0.0f };
+        // Index into the texel buffer.
+        uint32_t index = 0;
+        glm::vec3 normal{ 0.0f };
+        // Sobol scramble seed, the one the CPU sampler derives from the index.
+        uint32_t seed = 0;
+    };
+    static_assert(sizeof(GpuTexel) == 32);
+
+    // Same sums as TexelAccumulator, without the directional term.
+    struct GpuAccumulator
+    {
+        glm::vec3 irradianceSum{ 0.0f };
+        float luminanceSquaredSum = 0.0f;
+        // Also the index of the texel's next sample.
+        uint32_t sampleCount = 0;
+        // Dispatches stop adding samples once sampleCount reaches it.
+        uint32_t sampleTarget = ~0u;
+        uint32_t padding[2] = {};
+    };
+    static_assert(sizeof(GpuAccumulator) == 32);
+
+    /**
+     * Everything the GPU baker uploads: the ray tracer's hierarchy, the light
+     * set with its alias table, and the covered texels in index order.
+     */
+    struct GpuBakeScene
+    {
+        std::vector<FlatBvhNode> nodes;
+        std::vector<GpuTriangle> triangles;
+        // Scene materials followed by the default one, which out-of-range indices map to.
+        std::vector<GpuMaterial> materials;
+        std::vector<GpuLight> lights;
+        std::vector<GpuEmissiveTriangle> emissive;
+        // Light index of every scene triangle, LightSet::kNoLight if it does not emit.
+        std::vector<uint32_t> lightOfTriangle;
+        std::vector<GpuTexel> texels;
+        // Lights the alias table can pick, 0 when none has any power.
+        uint32_t lightCount = 0;
+        uint32_t punctualCount = 0;
+        float epsilon = 0.0f;
+        glm::vec3 skyColor{ 0.0f };
+    };
+
+    // Entries of the traversal stack in the shader's traceRay (STACK_SIZE).
+    constexpr uint32_t kGpuStackSize = 64;
+
+    /**
+     * Packs a scene for the GPU baker. Returns false for what the GPU
+     * integrator does not implement: environment maps, the light BVH
+     * (Power and Uniform sampling only), and hierarchies deeper than
+     * kGpuStackSize, whose traversal would overflow the shader's stack.
+     */
+    bool BuildGpuBakeScene(const RayTracer& tracer, const LightSet& lights, const TexelBuffer& texels, GpuBakeScene& scene);
+
+    GpuTexel MakeGpuTexel(const TexelBuffer& texels, size_t index);
+
+    // Inner nodes on the longest path from the root to a leaf, the most a traversal keeps pending.
+    uint32_t GetFlatBvhDepth(const std::vector<FlatBvhNode>& nodes);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/bake_engine.h"
+#include "Bake/lightmap.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct IncrementalBakeSettings
+    {
+        // Settings of every per-group bake; budgets apply to each group separately. outputPath is
+        // ignored, and checkpointPath gets a ".group<index>" suffix per group.
+        BakeSettings bake;
+        // Unoccluded irradiance under which a moved light no longer counts as reaching a texel.
+        float influenceIrradiance = 1e-2f;
+    };
+
+    /**
+     * Emitters whose light is baked into one contribution buffer.
+     */
+    struct LightGroup
+    {
+        enum class Type
+        {
+            // One scene light; `index` is its position in Scene::lights.
+            Punctual,
+            // Every triangle of one emissive material; `index` is the material.
+            Emissive,
+            // The environment map, or the constant sky colour without one.
+            Sky,
+        };
+
+        Type type = Type::Punctual;
+        uint32_t index = 0;
+    };
+
+    struct IncrementalBakeStats
+    {
+        uint32_t groupsBaked = 0;
+        // Covered texels handed to the bake engine, summed over groups.
+        size_t texelsTraced = 0;
+        uint64_t samples = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+     * Lightmap baked as one irradiance buffer per light group, each at unit
+     * emission. Light transport is linear in the emission of every light
+     * and, with Lambertian surfaces, independent per colour channel, so the
+     * lightmap is the sum of the buffers scaled by the current emissions:
+     * changing a colour or intensity costs no rays. Moving a light retraces
+     * its buffer only for texels inside its influence sphere, before or
+     * after the move; bounce light that travels further keeps its previous
+     * value, which influenceIrradiance keeps negligible.
+     */
+    class IncrementalBaker
+    {
+    public:
+        IncrementalBaker(const Scene& scene, const TexelBuffer& texels, const IncrementalBakeSettings& settings, bvh::v2::ThreadPool& threadPool);
+
+        // Bakes every light group from scratch.
+        const IncrementalBakeStats& Bake();
+
+        // Emission edits only rescale a buffer. Material and sky edits return false when
+        // their group was not emitting when the baker was created, since it has no buffer.
+        void SetLightEmission(uint32_t light, const glm::vec3& color, float intensity);
+        bool SetMaterialEmission(uint32_t material, const glm::vec3& emission);
+        bool SetSkyEmission(const glm::vec3& skyColor, float environmentIntensity);
+
+        // Moves, re-aims or reshapes a punctual light; its emission is taken from `moved` too.
+        const IncrementalBakeStats& UpdateLight(uint32_t light, const Light& moved);
+
+        Lightmap GetLightmap() const;
+        const std::vector<LightGroup>& GetGroups() const { return m_groups; }
+        const IncrementalBakeStats& GetStats() const { return m_stats; }
+
+    private:
+        // Bakes `group` for the covered texels of `texels` into its buffer.
+        void BakeGroup(size_t group, const TexelBuffer& texels);
+        glm::vec3 GetEmission(size_t group) const;
+        float GetInfluenceRadius(const Light& light) const;
+
+        // Geometry of the scene; lights, emission and sky are overwritten for each group bake.
+        Scene m_scene;
+        const TexelBuffer& m_texels;
+        IncrementalBakeSettings m_settings;
+        bvh::v2::ThreadPool& m_threadPool;
+
+        // Current emission state that the buffers are scaled by.
+        std::vector<Light> m_lights;
+        std::vector<glm::vec3> m_emission;
+        glm::vec3 m_skyColor{ 0.0f };
+        float m_environmentIntensity = 1.0f;
+
+        std::vector<LightGroup> m_groups;
+        // Per group, irradiance of every texel at unit emission.
+        std::vector<std::vector<glm::vec3>> m_contributions;
+        IncrementalBakeStats m_stats;
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/bbox.h>
+#include "Scene/scene.h"
+#include "Bake/alias_table.h"
+
+namespace LightChef
+{
+    enum class LightSamplingMode
+    {
+        // Uniform over lights; only useful as a baseline.
+        Uniform,
+        // Proportional to light power, independent of the shading point.
+        Power,
+        // Light BVH traversal weighted by distance, orientation and power.
+        Bvh,
+    };
+
+    /**
+     * Spatial and directional extent of one light (Conty Estevez and Kulla
+     * 2018): light leaves `bounds` within angle thetaO of `axis`, and the
+     * emission falls off to zero thetaE further out. Both angles are kept as
+     * cosines so importance evaluation needs no inverse trigonometry.
+     */
+    struct LightBounds
+    {
+        bvh::v2::BBox<float, 3> bounds = bvh::v2::BBox<float, 3>::make_empty();
+        glm::vec3 axis{ 0.0f, 0.0f, 1.0f };
+        float cosThetaO = 1.0f;
+        float cosThetaE = 1.0f;
+        // Emitted flux, in luminance.
+        float power = 0.0f;
+
+        static LightBounds FromLight(const Light& light);
+    };
+
+    /**
+     * Picks one light per shading point. In Bvh mode lights are organized in
+     * a binary hierarchy whose nodes hold merged bounds, orientation cones
+     * and power; sampling descends from the root choosing children by their
+     * estimated contribution, so the cost is logarithmic in the light count.
+     * Power and Uniform modes draw from an alias table.
+     */
+    class LightSampler
+    {
+    public:
+        LightSampler() = default;
+        LightSampler(const std::vector<LightBounds>& lights, LightSamplingMode mode);
+
+        // Returns false when no light can reach the shading point.
+        bool Sample(const glm::vec3& position, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const;
+        float GetPmf(const glm::vec3& position, const glm::vec3& normal, uint32_t light) const;
+
+        size_t GetLightCount() const { return m_lights.size(); }
+        LightSamplingMode GetMode() const { return m_mode; }
+        // Table drawn from in Power and Uniform modes.
+        const AliasTable& GetTable() const { return m_table; }
+
+    private:
+        static constexpr uint32_t kNoNode = 0xFFFFFFFFu;
+
+        struct Node
+        {
+            LightBounds bounds;
+            // Children sit at firstChild and firstChild + 1; leaves hold exactly one light.
+            uint32_t firstChild = kNoNode;
+            uint32_t light = 0;
+            uint32_t parent = kNoNode;
+
+            bool IsLeaf() const { return firstChild == kNoNode; }
+        };
+
+        void Build(uint32_t node, std::vector<uint32_t>& order, size_t begin, size_t end);
+
+        std::vector<LightBounds> m_lights;
+        LightSamplingMode m_mode = LightSamplingMode::Bvh;
+        std::vector<Node> m_nodes;
+        std::vector<uint32_t> m_leafOfLight;
+        AliasTable m_table;
+    };
+}
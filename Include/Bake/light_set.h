@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/environment_light.h"
+#include "Bake/light_sampler.h"
+
+namespace LightChef
+{
+    /**
+     * Triangle of a material with non-zero emission, lit on its front face.
+     */
+    struct EmissiveTriangle
+    {
+        glm::vec3 vertices[3];
+        // Unit front-face normal, following the winding order.
+        glm::vec3 normal{ 0.0f };
+        float area = 0.0f;
+        glm::vec3 radiance{ 0.0f };
+        // Scene-wide index (see Scene::GetTriangleOffsets).
+        uint32_t triangleId = 0;
+    };
+
+    /**
+     * Every light the bake samples: the scene's punctual lights, followed by
+     * the emissive triangles collected from the meshes. Emissive triangles
+     * are weighted by their power (area x pi x radiance), so in Power mode
+     * the sampler is an O(1) alias table over all lights. The environment
+     * map, when the scene has one, sits outside the sampler and is picked
+     * with a fixed probability.
+     */
+    class LightSet
+    {
+    public:
+        static constexpr uint32_t kNoLight = 0xFFFFFFFFu;
+        static constexpr uint32_t kEnvironmentLight = 0xFFFFFFFEu;
+
+        LightSet(const Scene& scene, LightSamplingMode mode, bvh::v2::ThreadPool& threadPool);
+
+        // Picks a light for a shading point; `light` may be kEnvironmentLight.
+        bool Sample(const glm::vec3& position, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const;
+        float GetPmf(const glm::vec3& position, const glm::vec3& normal, uint32_t light) const;
+
+        const LightSampler& GetSampler() const { return m_sampler; }
+        const EnvironmentLight& GetEnvironment() const { return m_environment; }
+        bool HasEnvironment() const { return m_environment.IsValid(); }
+        const std::vector<Light>& GetPunctualLights() const { return m_scene.lights; }
+        const std::vector<EmissiveTriangle>& GetEmissiveTriangles() const { return m_emissive; }
+
+        uint32_t GetPunctualCount() const { return static_cast<uint32_t>(m_scene.lights.size()); }
+        // Light index of an emissive scene triangle, or kNoLight.
+        uint32_t GetEmissiveLight(uint32_t triangleId) const
+        {
+            return triangleId < m_lightOfTriangle.size() ? m_lightOfTriangle[triangleId] : kNoLight;
+        }
+
+    private:
+        const Scene& m_scene;
+        std::vector<EmissiveTriangle> m_emissive;
+        std::vector<uint32_t> m_lightOfTriangle;
+        LightSampler m_sampler;
+        EnvironmentLight m_environment;
+        // Probability of sampling the environment instead of a scene light.
+        float m_environmentProbability = 0.0f;
+    };
+}
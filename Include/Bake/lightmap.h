@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    /**
+     * Baked atlas pages in linear RGB. Alpha is 1 for baked texels and 0 for
+     * texels no chart covers.
+     */
+    struct Lightmap
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        std::vector<glm::vec4> texels;
+
+        size_t GetIndex(uint32_t atlas, uint32_t x, uint32_t y) const
+        {
+            return (static_cast<size_t>(atlas) * height + y) * width + x;
+        }
+    };
+}
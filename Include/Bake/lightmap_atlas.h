@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+
+namespace LightChef
+{
+    struct AtlasOptions
+    {
+        // Lightmap texels per world unit.
+        float texelsPerUnit = 32.0f;
+        // Minimum number of empty texels between two charts.
+        uint32_t padding = 2;
+        // Size of one atlas page; charts that do not fit open a new page.
+        uint32_t maxAtlasSize = 1024;
+        // Triangles whose normal deviates more than this from the chart seed start a new chart.
+        float maxChartAngleDegrees = 60.0f;
+    };
+
+    struct AtlasChart
+    {
+        uint32_t meshIndex = 0;
+        uint32_t atlasIndex = 0;
+        // Texel rectangle of the chart on its page, padding included.
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    /**
+     * Lightmap parameterization of one scene mesh. Vertices are split along
+     * chart seams: `xref[i]` is the source vertex of output vertex `i`.
+     */
+    struct AtlasMesh
+    {
+        std::vector<uint32_t> xref;
+        std::vector<glm::vec2> uvs;
+        std::vector<uint32_t> indices;
+        // Global chart index (into LightmapAtlas::charts) of every triangle.
+        std::vector<uint32_t> triangleCharts;
+    };
+
+    struct LightmapAtlas
+    {
+        // Size shared by every atlas page, in texels.
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        std::vector<AtlasChart> charts;
+        std::vector<AtlasMesh> meshes;
+    };
+
+    /**
+     * Welds vertices by exact position: every vertex maps to one
+     * representative of all vertices at its position, so meshes split at
+     * normal or UV seams in the source index buffer keep their edge
+     * connectivity.
+     */
+    std::vector<uint32_t> WeldPositions(const std::vector<glm::vec3>& positions);
+
+    /**
+     * Builds a second, non-overlapping UV set for every mesh of a scene.
+     * Meshes are segmented into charts by normal and connectivity, each chart
+     * is projected on its seed plane, and charts are packed with a bitmap
+     * rasterizer into one or more atlas pages.
+     */
+    class AtlasGenerator
+    {
+    public:
+        explicit AtlasGenerator(const AtlasOptions& options = {});
+
+        LightmapAtlas Generate(const Scene& scene, bvh::v2::ThreadPool& threadPool) const;
+
+    private:
+        AtlasOptions m_options;
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct PathGuideSettings
+    {
+        bool enabled = false;
+        // Spatial cells along the longest axis of the texels' bounds. Finer grids learn from
+        // fewer paths per cell, which makes for noisier distributions.
+        uint32_t spatialResolution = 8;
+        // Directional bins along each axis of the equal-area sphere parameterisation.
+        uint32_t directionalResolution = 8;
+        // Share of guided bounce directions; the rest are cosine-sampled, which keeps every
+        // direction of the hemisphere covered whatever the guide has learnt.
+        float guidedFraction = 0.5f;
+        // Bounces a cell records before it guides.
+        uint32_t minSamples = 256;
+    };
+
+    struct PathGuideStats
+    {
+        uint32_t cells = 0;
+        uint32_t guidingCells = 0;
+        uint64_t records = 0;
+        // Times the distributions were rebuilt.
+        uint32_t generation = 0;
+        size_t memoryBytes = 0;
+    };
+
+    /**
+     * Learnt distribution of the light arriving at surfaces, for importance
+     * sampling diffuse bounces (after Müller et al. 2017, "Practical Path
+     * Guiding", with a fixed directional histogram in place of the
+     * quadtree). Texels fall into cells of a uniform grid over their
+     * bounds, split by the dominant axis of their normal, and only cells
+     * holding texels get histograms, so memory is fixed when the guide is
+     * built; path vertices find the cell of the texels around them. Each
+     * cell keeps a histogram over world-space directions of
+     * luminance * cos / pdf of the bounces traced from it, an unbiased
+     * estimate of the cosine-weighted incident light per bin whichever
+     * distribution sampled them. Bake threads record into it with
+     * fixed-point atomic adds, which are exact and so independent of
+     * thread order. Update() turns the sums into sampling distributions
+     * between passes, while no thread samples, after 1, 2, 4, 8... passes
+     * like the paper's doubling training iterations.
+     */
+    class PathGuide
+    {
+    public:
+        static constexpr uint32_t kNoCell = ~0u;
+
+        PathGuide(const TexelBuffer& texels, const PathGuideSettings& settings);
+
+        uint32_t GetTexelCell(size_t texelIndex) const { return m_texelCells[texelIndex]; }
+        // The cell of a surface point, kNoCell where no texel is near.
+        uint32_t FindCell(const glm::vec3& position, const glm::vec3& normal) const;
+        // Whether Sample() draws from the learnt distribution of `cell` yet.
+        bool IsGuiding(uint32_t cell) const { return cell != kNoCell && m_guiding[cell]; }
+        /**
+         * A bounce direction over the surface with `normal` from the mixture
+         * of the cell's distribution and cosine sampling, and its pdf. The
+         * direction may point below the surface, where it carries nothing.
+         */
+        glm::vec3 Sample(uint32_t cell, const glm::vec3& normal, glm::vec2 u, float& pdf) const;
+        float GetPdf(uint32_t cell, const glm::vec3& normal, const glm::vec3& direction) const;
+        // Adds one bounce's luminance * cos / pdf; safe from any thread.
+        void Record(uint32_t cell, const glm::vec3& direction, float value);
+        /**
+         * Ends a pass, rebuilding the distributions of every cell with
+         * enough records when the pass count reaches a power of two.
+         * Returns whether it did.
+         */
+        bool Update();
+        // Bumped by every rebuild; samples of one generation see the same distributions.
+        uint32_t GetGeneration() const { return m_generation; }
+        // Continues the numbering from `generation`, for a bake resumed from a checkpoint.
+        void SetGeneration(uint32_t generation) { m_generation = generation; }
+        PathGuideStats GetStats() const;
+
+    private:
+        size_t GetCellKey(const glm::vec3& position, const glm::vec3& normal) const;
+        uint32_t GetBin(const glm::vec3& direction) const;
+        float GetGuidePdf(uint32_t cell, const glm::vec3& direction) const;
+
+        PathGuideSettings m_settings;
+        uint32_t m_binCount;
+        glm::vec3 m_lower;
+        float m_inverseCellSize;
+        glm::uvec3 m_resolution;
+        // Cell of every grid cell and normal axis, kNoCell where no texel is.
+        std::vector<uint32_t> m_cells;
+        std::vector<uint32_t> m_texelCells;
+        // Per cell: m_binCount fixed-point sums, and the records behind them.
+        std::unique_ptr<std::atomic<uint64_t>[]> m_training;
+        std::unique_ptr<std::atomic<uint32_t>[]> m_recordCounts;
+        // Per cell: cumulative bin probabilities, valid where m_guiding is set.
+        std::vector<float> m_cdf;
+        std::vector<uint8_t> m_guiding;
+        uint32_t m_cellCount = 0;
+        uint32_t m_passes = 0;
+        uint32_t m_generation = 0;
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Bake/light_set.h"
+#include "Bake/path_guide.h"
+#include "Bake/radiance_cache.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampler.h"
+
+namespace LightChef
+{
+    /**
+     * A light sample before its shadow ray: the irradiance it brings if
+     * nothing blocks the segment from `origin` along `direction`.
+     */
+    struct LightSample
+    {
+        glm::vec3 origin{ 0.0f };
+        glm::vec3 direction{ 0.0f };
+        float maxDistance = 0.0f;
+        glm::vec3 irradiance{ 0.0f };
+        // Index in the light set, LightSet::kNoLight when nothing was picked.
+        uint32_t light = 0;
+        // Point on the light, or the direction for the environment.
+        glm::vec3 point{ 0.0f };
+    };
+
+    /**
+     * Diffuse path tracing with next-event estimation over a light set,
+     * shared by every baker (lightmap texels, probes). Light samples and
+     * bounce rays are combined with the power heuristic.
+     */
+    class PathIntegrator
+    {
+    public:
+        PathIntegrator(const RayTracer& tracer, const LightSet& lights);
+
+        /**
+         * One-sample estimate of the irradiance from every light at
+         * `position`, picking the light with the light set's sampler.
+         * `direction` receives the direction towards the sampled light.
+         */
+        glm::vec3 DirectIrradiance(const glm::vec3& position, const glm::vec3& normal, Sampler& sampler, glm::vec3& direction) const;
+
+        // DirectIrradiance without the shadow ray, for callers that trace them in batches.
+        // Returns false when the sample brings nothing, with nothing left to trace.
+        bool SampleDirect(const glm::vec3& position, const glm::vec3& normal, Sampler& sampler, LightSample& sample) const;
+
+        /**
+         * Irradiance at (`position`, `normal`) from `point` of `light` (a
+         * direction for the environment), per unit of the light's area, or
+         * of solid angle for the environment, before the shadow ray and the
+         * MIS weight SampleDirect() would give it. Returns false when it
+         * brings nothing.
+         */
+        bool EvaluateDirect(const glm::vec3& position, const glm::vec3& normal, uint32_t light, const glm::vec3& point, LightSample& sample) const;
+        // The MIS weight SampleDirect() gives `sample` at a surface with `normal`, where the light set picks its light with `pmf`.
+        float GetDirectWeight(const LightSample& sample, const glm::vec3& normal, float pmf) const;
+
+        // Irradiance at normal incidence from punctual light `light`, zero when shadowed; `direction` points to the light.
+        glm::vec3 PunctualIrradiance(uint32_t light, const glm::vec3& position, glm::vec3& direction) const;
+
+        /**
+         * Radiance arriving at `origin` from `direction`, following up to
+         * `maxBounces` diffuse bounces with next-event estimation. When the
+         * caller also sampled lights at `origin` (a surface with `normal`, and
+         * a cosine-sampled `direction`), emission found by this ray is
+         * MIS-weighted against that; otherwise it counts in full. With a
+         * radiance cache, the path ends at the first vertex at least a cell
+         * away whose cell is ready, or adds its irradiance to that cell.
+         * With a path guide, bounces sample its mixture where a cell guides
+         * and every bounce records what it found. MIS weights keep the
+         * cosine pdf, which still sums to one with light sampling.
+         */
+        glm::vec3 Radiance(glm::vec3 origin, glm::vec3 normal, glm::vec3 direction, uint32_t maxBounces, bool lightSampledAtOrigin,
+                           Sampler& sampler) const;
+
+        const RayTracer& GetRayTracer() const { return m_tracer; }
+        const LightSet& GetLights() const { return m_lights; }
+        // Shares `cache` between every Radiance() call, or stops using one for null.
+        void SetRadianceCache(RadianceCache* cache) { m_cache = cache; }
+        RadianceCache* GetRadianceCache() const { return m_cache; }
+        // Guides and trains on every bounce of Radiance(), or stops for null.
+        void SetPathGuide(PathGuide* guide) { m_guide = guide; }
+        PathGuide* GetPathGuide() const { return m_guide; }
+
+    private:
+        const RayTracer& m_tracer;
+        const LightSet& m_lights;
+        RadianceCache* m_cache = nullptr;
+        PathGuide* m_guide = nullptr;
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/path_integrator.h"
+#include "Bake/sampler.h"
+
+namespace LightChef
+{
+    struct ProbeVolumeSettings
+    {
+        // Edge of the finest bricks, in world units; every coarser level doubles it.
+        float minBrickSize = 1.0f;
+        // Brick levels, finest included; empty space gets bricks of minBrickSize * 2^(levelCount - 1).
+        uint32_t levelCount = 3;
+        // Margin around the scene bounds covered by the volume.
+        float padding = 0.5f;
+        // Uniform sphere directions traced per probe.
+        uint32_t samplesPerProbe = 256;
+        uint32_t maxBounces = 2;
+        // Rays cast to find probes inside geometry, and the share of back-face hits that marks one.
+        uint32_t validityRays = 32;
+        float insideThreshold = 0.25f;
+        SamplerType sampler = SamplerType::Sobol;
+    };
+
+    /**
+     * A cube of kBrickProbes^3 probes spanning one cell of its level, with
+     * probes on the cell faces so trilinear filtering stays inside the brick.
+     */
+    struct ProbeBrick
+    {
+        // Minimum corner, in finest cells.
+        glm::uvec3 cell{ 0 };
+        uint32_t level = 0;
+    };
+
+    /**
+     * Baked irradiance probes on a sparse brick grid. A position maps to its
+     * coarsest cell, whose indirection entry holds a brick index (low bits)
+     * and the brick level (top bits), or, for cells refined further, the
+     * index of a subgrid of finest-cell entries in the same format; only
+     * cells near geometry pay for a subgrid. Bricks are aligned to their
+     * size, so the brick's corner follows from the cell. Brick i sits in the
+     * atlas at brick coordinates (i % x, i / x % y, i / (x * y)) of
+     * atlasBricks.
+     */
+    struct ProbeVolume
+    {
+        static constexpr uint32_t kBrickProbes = 4;
+        static constexpr uint32_t kNoBrick = 0xFFFFFFFFu;
+        static constexpr uint32_t kLevelShift = 28;
+        static constexpr uint32_t kBrickIndexMask = (1u << kLevelShift) - 1;
+        // Level of coarsest-cell entries that hold a subgrid index instead of a brick.
+        static constexpr uint32_t kSubgridLevel = 0xF;
+
+        glm::vec3 origin{ 0.0f };
+        // Edge of the finest cells (and bricks).
+        float cellSize = 1.0f;
+        glm::uvec3 cellCount{ 0 };
+        // Finest cells along the edge of a coarsest cell.
+        uint32_t coarseCells = 1;
+        glm::uvec3 coarseCount{ 0 };
+        // One entry per coarsest cell, x fastest.
+        std::vector<uint32_t> indirection;
+        // coarseCells^3 finest-cell entries per refined coarsest cell, x fastest.
+        std::vector<uint32_t> subgrids;
+        std::vector<ProbeBrick> bricks;
+
+        glm::uvec3 atlasBricks{ 0 };
+        // Irradiance L1 SH (L00, L1-1, L10, L11, already convolved with the
+        // clamped cosine) of red, green and blue: three RGBA 3D textures of
+        // GetAtlasSize() texels, x fastest.
+        std::vector<glm::vec4> atlas[3];
+        // Per atlas texel: 0 for probes found inside geometry, filled from their brick's valid probes.
+        std::vector<uint8_t> validity;
+
+        glm::uvec3 GetAtlasSize() const { return atlasBricks * kBrickProbes; }
+        size_t GetAtlasIndex(uint32_t brick, uint32_t x, uint32_t y, uint32_t z) const;
+        // Brick entry of a finest cell, through its coarsest cell's subgrid when it has one.
+        uint32_t GetEntry(const glm::uvec3& cell) const;
+
+        // Trilinearly filtered irradiance for a surface with `normal` at `position`, as a shader would look it up.
+        glm::vec3 EvaluateIrradiance(const glm::vec3& position, const glm::vec3& normal) const;
+    };
+
+    struct ProbeVolumeStats
+    {
+        // Bricks per level, finest first.
+        std::vector<uint32_t> bricksPerLevel;
+        size_t probeCount = 0;
+        size_t culledProbes = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+     * Places probes on a brick octree that is refined down to the finest
+     * level around geometry and stays coarse in empty space, culls probes
+     * inside geometry by counting back-face hits, and bakes the rest in
+     * parallel with the path integrator.
+     */
+    class ProbeVolumeBaker
+    {
+    public:
+        explicit ProbeVolumeBaker(const ProbeVolumeSettings& settings = {});
+
+        ProbeVolume Bake(const PathIntegrator& integrator, bvh::v2::ThreadPool& threadPool);
+        const ProbeVolumeStats& GetStats() const { return m_stats; }
+
+    private:
+        // Marks finest cells near geometry, in subgrids laid out like ProbeVolume::subgrids;
+        // `coarseSubgrids` gets the subgrid of every coarsest cell, or kNoBrick when none is near.
+        std::vector<uint8_t> BuildOccupancy(const RayTracer& tracer, const ProbeVolume& volume, std::vector<uint32_t>& coarseSubgrids) const;
+        bool IsInsideGeometry(const RayTracer& tracer, const glm::vec3& position, size_t probeIndex) const;
+
+        ProbeVolumeSettings m_settings;
+        ProbeVolumeStats m_stats;
+    };
+}
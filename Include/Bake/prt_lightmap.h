@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/environment_light.h"
+#include "Bake/lightmap.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampler.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    // Real SH up to band 2.
+    constexpr uint32_t kMaxShBands = 3;
+    constexpr uint32_t kMaxShCoefficients = kMaxShBands * kMaxShBands;
+
+    // Basis functions in the usual order (l, m = -l..l), for the first bands * bands coefficients.
+    void EvaluateShBasis(const glm::vec3& direction, uint32_t bands, float basis[kMaxShCoefficients]);
+
+    /**
+     * Distant RGB radiance projected onto SH. Projections of several
+     * lights add up.
+     */
+    struct ShLighting
+    {
+        uint32_t bands = kMaxShBands;
+        std::array<glm::vec3, kMaxShCoefficients> coefficients{};
+
+        ShLighting& operator+=(const ShLighting& other);
+    };
+
+    // A sun: `irradiance` at normal incidence from `direction` (towards the light).
+    ShLighting ProjectDirectionalLight(const glm::vec3& direction, const glm::vec3& irradiance, uint32_t bands = kMaxShBands);
+    // Constant radiance from every direction, like Scene::skyColor.
+    ShLighting ProjectConstantSky(const glm::vec3& radiance, uint32_t bands = kMaxShBands);
+    // Monte Carlo projection of an environment map with its own importance sampling.
+    ShLighting ProjectEnvironment(const EnvironmentLight& environment, uint32_t sampleCount, uint32_t bands = kMaxShBands);
+
+    struct PrtSettings
+    {
+        // SH bands of the transfer vectors: 2 (4 coefficients) or 3 (9).
+        uint32_t bands = 3;
+        uint32_t samplesPerTexel = 256;
+        // Diffuse interreflections folded into the transfer; 0 keeps shadowed direct light only.
+        uint32_t maxBounces = 2;
+        SamplerType sampler = SamplerType::Sobol;
+    };
+
+    struct PrtStats
+    {
+        size_t coveredTexels = 0;
+        uint64_t rays = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+     * Per-texel irradiance transfer for distant lighting (Sloan et al.
+     * 2002, "Precomputed Radiance Transfer"): for lighting with SH
+     * coefficients l_i, a texel's irradiance is sum_i l_i * t_i per colour
+     * channel. The transfer holds the texel's visibility, the clamped
+     * cosine and, with bounces, the albedo-tinted light that reaches it off
+     * other surfaces, so it is RGB even for white light. Relighting costs a
+     * dot product per texel and no rays.
+     */
+    struct PrtLightmap
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        uint32_t bands = kMaxShBands;
+        // GetCoefficientCount() coefficients per texel, in TexelBuffer order.
+        std::vector<glm::vec3> transfer;
+        // 1 for texels a chart covers.
+        std::vector<uint8_t> coverage;
+
+        uint32_t GetCoefficientCount() const { return bands * bands; }
+        glm::vec3 EvaluateIrradiance(size_t texel, const ShLighting& lighting) const;
+        Lightmap Relight(const ShLighting& lighting) const;
+    };
+
+    /**
+     * Bakes PrtLightmap transfer by path tracing from every covered texel
+     * with cosine sampling. Paths bounce off diffuse surfaces without
+     * sampling lights, and each one that leaves the scene adds its
+     * throughput times the SH basis of its escape direction. Punctual and
+     * emissive lights stay in the regular bake (BakeEngine), whose
+     * lightmap the relit one adds to.
+     */
+    class PrtBaker
+    {
+    public:
+        explicit PrtBaker(const PrtSettings& settings = {});
+
+        PrtLightmap Bake(const RayTracer& tracer, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool);
+        const PrtStats& GetStats() const { return m_stats; }
+
+    private:
+        PrtSettings m_settings;
+        PrtStats m_stats;
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    struct RadianceCacheSettings
+    {
+        // Edge of a grid cell in world units; 0 disables the cache.
+        float cellSize = 0.0f;
+        // Cells in the hash table, rounded up to a power of two.
+        uint32_t capacity = 1u << 18;
+        // Paths a cell averages before queries use it.
+        uint32_t minSamples = 16;
+        // Queries of a used cell still trace a full path with probability minSamples / samples,
+        // refining it, until it holds this many.
+        uint32_t maxSamples = 64;
+    };
+
+    struct RadianceCacheStats
+    {
+        uint64_t queries = 0;
+        // Queries answered by a cell rather than a traced path.
+        uint64_t hits = 0;
+        uint64_t samples = 0;
+        uint32_t cells = 0;
+        // Queries that found the table full along their probe sequence.
+        uint64_t overflows = 0;
+
+        float GetHitRate() const { return queries > 0 ? static_cast<float>(hits) / queries : 0.0f; }
+    };
+
+    /**
+     * World-space cache of diffuse irradiance for path vertices past the
+     * first bounce: a hash grid keyed by the cell of the position and a
+     * coarse bin of the normal (see Binder et al. 2019, "Massively Parallel
+     * Path Space Filtering"). Paths that reach a cell with enough samples
+     * end there with its mean; the others trace on and add what they find.
+     * The table is open-addressed with linear probing, and every thread
+     * inserts and adds with atomics, without locks. A reader may see a sum
+     * one sample ahead of its count, which the mean shrugs off. Blurring
+     * irradiance over a cell is the bias this buys, and results depend on
+     * the order threads fill cells in.
+     */
+    class RadianceCache
+    {
+    public:
+        static constexpr uint32_t kNoCell = ~0u;
+
+        explicit RadianceCache(const RadianceCacheSettings& settings);
+
+        float GetCellSize() const { return m_settings.cellSize; }
+        // The cell of a surface point, inserted when new; kNoCell when the table is full.
+        uint32_t FindCell(const glm::vec3& position, const glm::vec3& normal);
+        // Whether the query `u` in [0, 1) may end its path in `cell`, and the cell's mean irradiance if so.
+        bool Lookup(uint32_t cell, float u, glm::vec3& irradiance);
+        void Add(uint32_t cell, const glm::vec3& irradiance);
+        RadianceCacheStats GetStats() const;
+
+    private:
+        struct Cell
+        {
+            // 0 while free.
+            std::atomic<uint64_t> key{ 0 };
+            std::atomic<float> irradianceSum[3] = {};
+            std::atomic<uint32_t> sampleCount{ 0 };
+        };
+
+        RadianceCacheSettings m_settings;
+        float m_inverseCellSize;
+        uint32_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+        std::atomic<uint64_t> m_queries{ 0 };
+        std::atomic<uint64_t> m_hits{ 0 };
+        std::atomic<uint64_t> m_samples{ 0 };
+        std::atomic<uint32_t> m_cellCount{ 0 };
+        std::atomic<uint64_t> m_overflows{ 0 };
+    };
+}
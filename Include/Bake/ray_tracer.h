@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/bvh.h>
+#include <bvh/v2/node.h>
+#include <bvh/v2/tri.h>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Utility/simd.h"
+
+namespace LightChef
+{
+    struct RayHit
+    {
+        // Scene-wide triangle index (see Scene::GetTriangleOffsets).
+        uint32_t triangleId = 0;
+        float distance = 0.0f;
+    };
+
+    struct SurfacePoint
+    {
+        glm::vec3 position{ 0.0f };
+        // Geometric normal, flipped to face the incoming ray.
+        glm::vec3 normal{ 0.0f };
+        uint32_t triangleId = 0;
+        uint32_t materialIndex = 0;
+    };
+
+    /**
+     * Four rays in SoA form, for the packet queries. Lanes outside
+     * `activeMask` are ignored.
+     */
+    struct RayPacket
+    {
+        Float4 origin[3];
+        Float4 direction[3];
+        Float4 maxDistance;
+        int activeMask = 0xF;
+    };
+
+    /**
+     * BVH node laid out for GPU traversal (std430-compatible, 32 bytes).
+     * Inner nodes have `count` 0 and their children at `first` and
+     * `first + 1`; leaves cover `count` triangles from `first` in leaf order.
+     */
+    struct FlatBvhNode
+    {
+        glm::vec3 lo{ 0.0f };
+        uint32_t first = 0;
+        glm::vec3 hi{ 0.0f };
+        uint32_t count = 0;
+    };
+    static_assert(sizeof(FlatBvhNode) == 32);
+
+    /**
+     * Scene triangles in a bvh::v2 hierarchy, with closest-hit and any-hit queries.
+     */
+    class RayTracer
+    {
+    public:
+        RayTracer(const Scene& scene, bvh::v2::ThreadPool& threadPool);
+
+        bool Intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+        bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+        // Any-hit for four rays that walk the hierarchy together; returns the mask of occluded lanes.
+        // Worth it for coherent rays, such as shadow rays from neighbouring points to one light.
+        int Occluded(const RayPacket& packet) const;
+
+        SurfacePoint GetSurface(const glm::vec3& origin, const glm::vec3& direction, const RayHit& hit) const;
+        glm::vec3 GetVertex(uint32_t triangleId, uint32_t corner) const { return m_vertices[triangleId * 3 + corner]; }
+        uint32_t GetMaterialIndex(uint32_t triangleId) const { return m_materials[triangleId]; }
+        uint32_t GetTriangleCount() const { return static_cast<uint32_t>(m_materials.size()); }
+
+        // Offset applied along the normal when spawning rays, scaled to the scene extent.
+        float GetEpsilon() const { return m_epsilon; }
+
+        // The hierarchy with the root first, and the scene-wide id of every triangle in leaf order.
+        std::vector<FlatBvhNode> GetFlatNodes() const;
+        const std::vector<uint32_t>& GetLeafTriangleIds() const { return m_triangleIds; }
+        const Scene& GetScene() const { return m_scene; }
+
+    private:
+        using Node = bvh::v2::Node<float, 3>;
+        using Bvh = bvh::v2::Bvh<Node>;
+        using Triangle = bvh::v2::PrecomputedTri<float>;
+
+        const Scene& m_scene;
+        Bvh m_bvh;
+        // Triangles in BVH leaf order, and their scene-wide ids.
+        std::vector<Triangle> m_triangles;
+        std::vector<uint32_t> m_triangleIds;
+        // Scene-order vertices (three per triangle) and materials.
+        std::vector<glm::vec3> m_vertices;
+        std::vector<uint32_t> m_materials;
+        float m_epsilon = 1e-4f;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    enum class SamplerType
+    {
+        // Independent PCG32 numbers.
+        Random,
+        // Owen-scrambled Sobol, decorrelated per texel.
+        Sobol,
+        // Owen-scrambled Sobol shared by all texels, shifted per texel by a blue-noise tile,
+        // so the remaining error is high frequency across neighbouring texels.
+        BlueNoise,
+    };
+
+    /**
+     * Toroidal blue-noise rank mask made with void-and-cluster (Ulichney
+     * 1993). Values are evenly spread over [0, 1). The tile is built once
+     * and only read afterwards, so threads can share it.
+     */
+    class BlueNoiseTile
+    {
+    public:
+        BlueNoiseTile() = default;
+        BlueNoiseTile(uint32_t size, uint64_t seed);
+
+        float At(uint32_t x, uint32_t y) const { return m_values[(y % m_size) * m_size + x % m_size]; }
+        uint32_t GetSize() const { return m_size; }
+        bool IsEmpty() const { return m_values.empty(); }
+
+    private:
+        uint32_t m_size = 0;
+        std::vector<float> m_values;
+    };
+
+    /**
+     * Sample generator for one path of one texel. A Sampler is created on the
+     * stack for every sample and owns all of its state, so bake threads never
+     * share generator state. Dimensions are drawn in a fixed order along the
+     * path. Sobol samples use the first two Sobol dimensions for each pair of
+     * dimensions, padded with independent index shuffles and nested uniform
+     * (Owen) scrambling via hashing (Burley 2020).
+     */
+    class Sampler
+    {
+    public:
+        // `blueNoise` is required for SamplerType::BlueNoise only.
+        Sampler(SamplerType type, uint64_t texelIndex, uint32_t sampleIndex, uint32_t x, uint32_t y, const BlueNoiseTile* blueNoise);
+
+        float Next1D();
+        glm::vec2 Next2D();
+
+    private:
+        glm::vec2 NextSobolPair();
+        float Shift(float u, uint32_t component) const;
+
+        SamplerType m_type;
+        Random m_random;
+        // Scramble seed: per texel for Sobol, global for BlueNoise.
+        uint32_t m_seed;
+        uint32_t m_sampleIndex;
+        uint32_t m_x;
+        uint32_t m_y;
+        const BlueNoiseTile* m_blueNoise;
+        uint32_t m_dimension = 0;
+    };
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    constexpr float kPi = 3.14159265358979323846f;
+    constexpr float kInvPi = 1.0f / kPi;
+
+    inline float Luminance(const glm::vec3& color)
+    {
+        return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    /**
+     * Veach's power heuristic (beta = 2) weight of a strategy with density
+     * `pdf` against one with density `otherPdf`.
+     */
+    inline float PowerHeuristic(float pdf, float otherPdf)
+    {
+        float a = pdf * pdf;
+        float b = otherPdf * otherPdf;
+        return a + b > 0.0f ? a / (a + b) : 0.0f;
+    }
+
+    /**
+     * Orthonormal tangent frame around a unit normal (Duff et al. 2017).
+     */
+    inline void BuildBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+    {
+        float sign = std::copysign(1.0f, n.z);
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+    }
+
+    /**
+     * Cosine-weighted direction around `n`; the pdf is cos(theta) / pi.
+     */
+    inline glm::vec3 SampleCosineHemisphere(const glm::vec3& n, float u1, float u2)
+    {
+        float r = std::sqrt(u1);
+        float phi = 2.0f * kPi * u2;
+        glm::vec3 tangent, bitangent;
+        BuildBasis(n, tangent, bitangent);
+        return tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - u1));
+    }
+
+    /**
+     * Uniform direction on the unit sphere; the pdf is 1 / (4 pi).
+     */
+    inline glm::vec3 SampleUniformSphere(float u1, float u2)
+    {
+        float z = 1.0f - 2.0f * u1;
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float phi = 2.0f * kPi * u2;
+        return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    /**
+     * Small counter-based PCG32 generator, seeded per texel and sample so
+     * results do not depend on thread scheduling.
+     */
+    class Random
+    {
+    public:
+        explicit Random(uint64_t seed)
+            : m_state(Mix(seed))
+        {
+        }
+
+        Random(uint64_t stream, uint64_t index)
+            : Random(Mix(stream) ^ (index * 0x9E3779B97F4A7C15ull))
+        {
+        }
+
+        uint32_t NextUInt()
+        {
+            uint64_t old = m_state;
+            m_state = old * 6364136223846793005ull + 1442695040888963407ull;
+            uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+            uint32_t rot = static_cast<uint32_t>(old >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+
+        // Uniform float in [0, 1).
+        float NextFloat() { return static_cast<float>(NextUInt() >> 8) * (1.0f / 16777216.0f); }
+
+        static uint64_t Mix(uint64_t x)
+        {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+    private:
+        uint64_t m_state;
+    };
+}
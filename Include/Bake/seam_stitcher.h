@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/lightmap.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct SeamSettings
+    {
+        // Rings of empty texels filled around every chart.
+        uint32_t dilationTexels = 2;
+        // Constraints placed along each seam edge, per texel of edge length.
+        float samplesPerTexel = 2.0f;
+        // Weight of seam agreement against staying close to the baked value.
+        float seamWeight = 4.0f;
+        uint32_t maxIterations = 64;
+    };
+
+    /**
+     * Post-bake fix-ups for bilinear filtering of a packed atlas. Dilation
+     * grows every chart into its gutter so filtering never pulls in unbaked
+     * texels. Stitching finds mesh edges whose two sides map to different
+     * UVs and solves a least-squares problem so bilinear lookups on both
+     * sides of each seam agree; charts connected by seams are solved as
+     * independent groups in parallel, merged with any group whose bilinear
+     * taps reach the same gutter texels.
+     */
+    class SeamStitcher
+    {
+    public:
+        /**
+         * One lightmap-space edge paired with its twin on the other side of a seam.
+         */
+        struct Seam
+        {
+            uint32_t atlasIndex[2];
+            uint32_t chart[2];
+            // Normalized UVs of the shared edge endpoints, same world-space order on both sides.
+            glm::vec2 uv[2][2];
+        };
+
+        SeamStitcher(const Scene& scene, const LightmapAtlas& atlas, const SeamSettings& settings = {});
+
+        void Dilate(Lightmap& lightmap, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool) const;
+        void Stitch(Lightmap& lightmap, bvh::v2::ThreadPool& threadPool) const;
+
+        const std::vector<Seam>& GetSeams() const { return m_seams; }
+
+    private:
+        SeamSettings m_settings;
+        std::vector<Seam> m_seams;
+        // Seams grouped by connected charts: group g is m_seamOrder[m_groupStart[g] .. m_groupStart[g + 1]).
+        std::vector<uint32_t> m_seamOrder;
+        std::vector<uint32_t> m_groupStart;
+    };
+}
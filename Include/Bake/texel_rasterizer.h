@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Scene/scene.h"
+#include "Bake/lightmap_atlas.h"
+
+namespace LightChef
+{
+    /**
+     * World-space sample point of one lightmap texel.
+     */
+    struct TexelRecord
+    {
+        glm::vec3 position{ 0.0f };
+        // Fraction of the texel covered by geometry; 0 marks an empty texel.
+        float coverage = 0.0f;
+        glm::vec3 normal{ 0.0f };
+        // Scene-wide index (see Scene::GetTriangleOffsets) of the dominant triangle.
+        uint32_t triangleId = 0;
+    };
+    static_assert(sizeof(TexelRecord) == 32);
+
+    /**
+     * Texel records of every atlas page, stored page by page in row-major order.
+     */
+    struct TexelBuffer
+    {
+        static constexpr uint32_t kNoChart = 0xFFFFFFFFu;
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        std::vector<TexelRecord> texels;
+        // Atlas chart of every texel, kNoChart for empty texels.
+        std::vector<uint32_t> charts;
+
+        size_t GetIndex(uint32_t atlas, uint32_t x, uint32_t y) const
+        {
+            return (static_cast<size_t>(atlas) * height + y) * width + x;
+        }
+
+        bool IsCovered(size_t index) const { return texels[index].coverage > 0.0f; }
+    };
+
+    /**
+     * Conservative rasterizer over lightmap UV triangles. Triangles are binned
+     * into square tiles which are rasterized in parallel; coverage is estimated
+     * with 4x4 SIMD subsamples, so partially covered edge texels get a sample
+     * point that lies on the triangle.
+     */
+    class TexelRasterizer
+    {
+    public:
+        explicit TexelRasterizer(uint32_t tileSize = 64);
+
+        TexelBuffer Rasterize(const Scene& scene, const LightmapAtlas& atlas, bvh::v2::ThreadPool& threadPool) const;
+
+    private:
+        uint32_t m_tileSize;
+    };
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <bvh/v2/thread_pool.h>
+#include "Bake/lightmap.h"
+#include "Bake/ray_tracer.h"
+#include "Bake/sampler.h"
+#include "Bake/texel_rasterizer.h"
+
+namespace LightChef
+{
+    struct SunKeyframe
+    {
+        // Hours since midnight; keyframes are sorted by it.
+        float hour = 12.0f;
+        // Towards the sun.
+        glm::vec3 direction{ 0.0f, 0.0f, 1.0f };
+    };
+
+    struct TimeOfDaySettings
+    {
+        std::vector<SunKeyframe> keyframes;
+        uint32_t samplesPerTexel = 256;
+        uint32_t maxBounces = 3;
+        SamplerType sampler = SamplerType::Sobol;
+    };
+
+    struct TimeOfDayStats
+    {
+        size_t coveredTexels = 0;
+        // Rays traced, and what one bake per basis would trace for the same paths: each
+        // retraces every path segment, and each sun basis its own shadow rays.
+        uint64_t rays = 0;
+        uint64_t separateRays = 0;
+        double seconds = 0.0;
+        // Size of the basis set and of one lightmap, both as RGBA16F.
+        size_t basisBytes = 0;
+        size_t lightmapBytes = 0;
+    };
+
+    /**
+     * Lightmaps of a day/night cycle as a linear basis: one lightmap per sun
+     * keyframe, each lit by a unit white sun (irradiance 1 at normal
+     * incidence) alone, and one lit by a unit white sky alone. Light
+     * transport is linear, so the lightmap at any hour is the sky basis
+     * times the sky colour plus the sun colour times the sun basis,
+     * interpolated between the keyframes around that hour. Colours and
+     * intensities change freely; only the sun's path is baked in.
+     */
+    struct TimeOfDayLightmaps
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t atlasCount = 0;
+        std::vector<SunKeyframe> keyframes;
+        // Per keyframe, then the sky: irradiance of every texel in TexelBuffer order.
+        std::vector<std::vector<glm::vec3>> bases;
+        // 1 for texels a chart covers.
+        std::vector<uint8_t> coverage;
+
+        uint32_t GetSkyBasis() const { return static_cast<uint32_t>(keyframes.size()); }
+        // The keyframes around `hour` and the weight of the second; the first and last hold outside their range.
+        void GetBlend(float hour, uint32_t& first, uint32_t& second, float& weight) const;
+        Lightmap Blend(float hour, const glm::vec3& sunIrradiance, const glm::vec3& skyRadiance) const;
+    };
+
+    /**
+     * Bakes every basis of TimeOfDayLightmaps in one pass over the texels,
+     * on one BVH. Bases differ in their lights only, so they share paths:
+     * each texel sample traces one cosine-sampled diffuse path, sends a
+     * shadow ray to every keyframe's sun from each vertex, and adds to the
+     * sky basis when it escapes. Suns are directional (delta) lights, so
+     * no path can hit one and next-event estimation needs no MIS. Scene
+     * lights and emitters are not part of the basis; bake them with
+     * BakeEngine and add its lightmap.
+     */
+    class TimeOfDayBaker
+    {
+    public:
+        explicit TimeOfDayBaker(const TimeOfDaySettings& settings);
+
+        TimeOfDayLightmaps Bake(const RayTracer& tracer, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool);
+        const TimeOfDayStats& GetStats() const { return m_stats; }
+
+    private:
+        TimeOfDaySettings m_settings;
+        TimeOfDayStats m_stats;
+    };
+}
@@ -2,6 +2,8 @@
 #include <vector>
 #include <filesystem>
 #include <webgpu/webgpu.hpp>
+#include "Scene/scene.h"
+#include "Bake/lightmap_atlas.h"
 
 class ResourceManager {
 public:
@@ -16,6 +18,40 @@ public:
 		int dimensions
 	);
 
+	/**
+	 * Load a Wavefront OBJ file (and its MTL library) from `path` into
+	 * `scene`, appending one mesh per shape and material. Diffuse colors
+	 * become albedos and `Ke` emission colors become emissive materials.
+	 */
+	static bool loadObjScene(
+		const std::filesystem::path& path,
+		LightChef::Scene& scene
+	);
+
+	/**
+	 * Build a baker mesh from interleaved `pointData` whose first three floats
+	 * per vertex are the position.
+	 */
+	static LightChef::Mesh makeMesh(
+		const std::vector<float>& pointData,
+		const std::vector<uint16_t>& indexData,
+		int stride
+	);
+
+	/**
+	 * Rebuild `pointData` with the seam-split vertices of `atlasMesh`,
+	 * appending the lightmap UV as two extra floats per vertex, and fill
+	 * `indexData` with the triangles over them. Seam splitting adds
+	 * vertices, so the indices are 32-bit even where the source mesh fit
+	 * in 16 bits.
+	 */
+	static void appendLightmapUVs(
+		std::vector<float>& pointData,
+		std::vector<uint32_t>& indexData,
+		int stride,
+		const LightChef::AtlasMesh& atlasMesh
+	);
+
 	/**
 	 * Create a shader module for a given WebGPU `device` from a WGSL shader source
 	 * loaded from file `path`.
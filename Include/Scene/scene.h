@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    /**
+     * Indexed triangle mesh in world space, as consumed by the baker.
+     * `normals` is optional; when empty, face normals are used.
+     */
+    struct Mesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<uint32_t> indices;
+        uint32_t materialIndex = 0;
+
+        uint32_t GetTriangleCount() const { return static_cast<uint32_t>(indices.size() / 3); }
+    };
+
+    /**
+     * Lambertian material; `emission` is outgoing radiance.
+     */
+    struct Material
+    {
+        glm::vec3 albedo{ 0.8f };
+        glm::vec3 emission{ 0.0f };
+    };
+
+    struct Light
+    {
+        enum class Type
+        {
+            Point,
+            Spot,
+        };
+
+        Type type = Type::Point;
+        glm::vec3 position{ 0.0f };
+        // Spot axis, normalized.
+        glm::vec3 direction{ 0.0f, -1.0f, 0.0f };
+        glm::vec3 color{ 1.0f };
+        // Radiant intensity scale (W/sr for a white light).
+        float intensity = 1.0f;
+        // Cosines of the spot cone half-angles: full intensity inside, none outside.
+        float cosInnerAngle = 1.0f;
+        float cosOuterAngle = 0.0f;
+    };
+
+    struct Scene
+    {
+        std::vector<Mesh> meshes;
+        std::vector<Material> materials;
+        std::vector<Light> lights;
+        // Constant radiance of rays that leave the scene, unless an environment map is set.
+        glm::vec3 skyColor{ 0.0f };
+        // Optional equirectangular Radiance HDR sky, scaled by environmentIntensity.
+        std::filesystem::path environmentMap;
+        float environmentIntensity = 1.0f;
+
+        const Material& GetMaterial(uint32_t index) const
+        {
+            static const Material kDefault;
+            return index < materials.size() ? materials[index] : kDefault;
+        }
+
+        /**
+         * Offset of every mesh's first triangle in the scene-wide triangle
+         * numbering used by texel records and the bake BVH.
+         */
+        std::vector<uint32_t> GetTriangleOffsets() const
+        {
+            std::vector<uint32_t> offsets(meshes.size() + 1, 0);
+            for (size_t i = 0; i < meshes.size(); ++i)
+                offsets[i + 1] = offsets[i] + meshes[i].GetTriangleCount();
+            return offsets;
+        }
+    };
+}
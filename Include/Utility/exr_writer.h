@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    struct ExrWriterStats
+    {
+        uint32_t tiles = 0;
+        // Pixel bytes before compression, and tile bytes written.
+        uint64_t rawBytes = 0;
+        uint64_t storedBytes = 0;
+        // Compression time summed over the calling threads.
+        double compressSeconds = 0.0;
+    };
+
+    /**
+     * Streams an RGBA image into a tiled OpenEXR file, one tile at a time
+     * and in any order. Tiles are RLE compressed (OpenEXR's byte split,
+     * delta predictor and run-length coder) on the thread that hands them
+     * over, then appended under a lock, so several threads can write at
+     * once and only their tiles are in memory. The tile offset table at
+     * the front is filled in by Close(), which also writes tiles that were
+     * never handed over as zero. Atlas pages are stacked top to bottom,
+     * each padded to whole tiles.
+     */
+    class TiledExrWriter
+    {
+    public:
+        TiledExrWriter() = default;
+        ~TiledExrWriter();
+        TiledExrWriter(const TiledExrWriter&) = delete;
+        TiledExrWriter& operator=(const TiledExrWriter&) = delete;
+
+        // `halfFloat` stores 16-bit channels, which is enough range and precision for lightmaps.
+        bool Open(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t pageCount, uint32_t tileSize, bool halfFloat = true);
+        // `pixels` holds tileSize x tileSize texels, row by row; those past the page's edges are ignored.
+        bool WriteTile(uint32_t page, uint32_t tileX, uint32_t tileY, const glm::vec4* pixels);
+        bool Close();
+
+        bool IsOpen() const { return m_file.is_open(); }
+        uint32_t GetTileSize() const { return m_tileSize; }
+        const ExrWriterStats& GetStats() const { return m_stats; }
+
+    private:
+        std::vector<char> EncodeTile(uint32_t imageTileY, uint32_t tileX, const glm::vec4* pixels, size_t& rawBytes, double& seconds) const;
+
+        std::ofstream m_file;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_pageCount = 0;
+        uint32_t m_tileSize = 0;
+        bool m_halfFloat = true;
+        uint32_t m_tilesX = 0;
+        // Tile rows per page; the image is m_tilesY * m_pageCount tiles tall.
+        uint32_t m_tilesY = 0;
+        std::streamoff m_tableOffset = 0;
+        std::vector<uint64_t> m_offsets;
+        std::mutex m_mutex;
+        ExrWriterStats m_stats;
+        bool m_failed = false;
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace LightChef
+{
+    /**
+     * Linear RGB float image, stored top row first.
+     */
+    struct HdrImage
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<glm::vec3> pixels;
+
+        const glm::vec3& At(uint32_t x, uint32_t y) const { return pixels[static_cast<size_t>(y) * width + x]; }
+    };
+
+    /**
+     * Reads a Radiance RGBE (.hdr) file, flat or run-length encoded.
+     */
+    bool LoadHdr(const std::filesystem::path& path, HdrImage& image);
+
+    /**
+     * Writes `image` as a run-length encoded Radiance RGBE (.hdr) file.
+     */
+    bool SaveHdr(const std::filesystem::path& path, const HdrImage& image);
+}
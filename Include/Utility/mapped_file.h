@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+
+namespace LightChef
+{
+    /**
+     * Read-write shared mapping of a whole file. Writes through the mapping
+     * reach the page cache immediately, so they survive the process dying;
+     * Flush() makes them survive the machine going down too.
+     */
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Opens or creates `path` and resizes it to `size` bytes; bytes past the old end read as zero.
+        bool Open(const std::filesystem::path& path, size_t size);
+        // Writes dirty pages to disk and waits for them.
+        bool Flush();
+        void Close();
+
+        bool IsOpen() const { return m_data != nullptr; }
+        void* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; }
+
+    private:
+        void* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_file = -1;
+#endif
+    };
+}
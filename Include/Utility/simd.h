@@ -0,0 +1,180 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTCHEF_SIMD_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define LIGHTCHEF_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace LightChef
+{
+    /**
+     * Four-wide float vector mapped onto SSE2 or NEON, with a scalar fallback.
+     * Comparisons return lane masks (all bits set) usable with Select/MoveMask.
+     */
+    struct Float4
+    {
+#if defined(LIGHTCHEF_SIMD_SSE)
+        __m128 v;
+        Float4() = default;
+        Float4(__m128 value) : v(value) {}
+        Float4(float s) : v(_mm_set1_ps(s)) {}
+        Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+        static Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+        void Store(float* p) const { _mm_storeu_ps(p, v); }
+#elif defined(LIGHTCHEF_SIMD_NEON)
+        float32x4_t v;
+        Float4() = default;
+        Float4(float32x4_t value) : v(value) {}
+        Float4(float s) : v(vdupq_n_f32(s)) {}
+        Float4(float a, float b, float c, float d) { const float lanes[4] = { a, b, c, d }; v = vld1q_f32(lanes); }
+        static Float4 Load(const float* p) { return vld1q_f32(p); }
+        void Store(float* p) const { vst1q_f32(p, v); }
+#else
+        float v[4];
+        Float4() = default;
+        Float4(float s) : v{ s, s, s, s } {}
+        Float4(float a, float b, float c, float d) : v{ a, b, c, d } {}
+        static Float4 Load(const float* p) { return Float4(p[0], p[1], p[2], p[3]); }
+        void Store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+#endif
+    };
+
+#if defined(LIGHTCHEF_SIMD_SSE)
+    inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+    inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+    inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+    inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+    inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+    inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+    inline Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+    inline Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline Float4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+    inline Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline Float4 operator>=(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+    inline Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+    inline Float4 Select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+    inline int MoveMask(Float4 mask) { return _mm_movemask_ps(mask.v); }
+#elif defined(LIGHTCHEF_SIMD_NEON)
+    inline Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+    inline Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+    inline Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+    inline Float4 operator/(Float4 a, Float4 b) { return vdivq_f32(a.v, b.v); }
+    inline Float4 Min(Float4 a, Float4 b) { return vminq_f32(a.v, b.v); }
+    inline Float4 Max(Float4 a, Float4 b) { return vmaxq_f32(a.v, b.v); }
+    inline Float4 Sqrt(Float4 a) { return vsqrtq_f32(a.v); }
+    inline Float4 operator<(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+    inline Float4 operator<=(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcleq_f32(a.v, b.v)); }
+    inline Float4 operator>(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)); }
+    inline Float4 operator>=(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)); }
+    inline Float4 operator&(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+    inline Float4 operator|(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+    inline Float4 Select(Float4 mask, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v); }
+    inline int MoveMask(Float4 mask)
+    {
+        uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask.v), 31);
+        return static_cast<int>(vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) |
+                                (vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3));
+    }
+#else
+    namespace Detail
+    {
+        template <typename Op>
+        inline Float4 Map(Float4 a, Float4 b, Op op)
+        {
+            return Float4(op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]));
+        }
+
+        inline float MaskOf(bool value) { return std::bit_cast<float>(value ? 0xFFFFFFFFu : 0u); }
+        inline uint32_t Bits(float value) { return std::bit_cast<uint32_t>(value); }
+    }
+
+    inline Float4 operator+(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x + y; }); }
+    inline Float4 operator-(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x - y; }); }
+    inline Float4 operator*(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x * y; }); }
+    inline Float4 operator/(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x / y; }); }
+    inline Float4 Min(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    inline Float4 Max(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    inline Float4 Sqrt(Float4 a) { return Detail::Map(a, a, [](float x, float) { return std::sqrt(x); }); }
+    inline Float4 operator<(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return Detail::MaskOf(x < y); }); }
+    inline Float4 operator<=(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return Detail::MaskOf(x <= y); }); }
+    inline Float4 operator>(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return Detail::MaskOf(x > y); }); }
+    inline Float4 operator>=(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return Detail::MaskOf(x >= y); }); }
+    inline Float4 operator&(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return std::bit_cast<float>(Detail::Bits(x) & Detail::Bits(y)); }); }
+    inline Float4 operator|(Float4 a, Float4 b) { return Detail::Map(a, b, [](float x, float y) { return std::bit_cast<float>(Detail::Bits(x) | Detail::Bits(y)); }); }
+    inline Float4 Select(Float4 mask, Float4 a, Float4 b)
+    {
+        Float4 out;
+        for (int i = 0; i < 4; ++i)
+            out.v[i] = Detail::Bits(mask.v[i]) ? a.v[i] : b.v[i];
+        return out;
+    }
+    inline int MoveMask(Float4 mask)
+    {
+        int bits = 0;
+        for (int i = 0; i < 4; ++i)
+            bits |= static_cast<int>(Detail::Bits(mask.v[i]) >> 31) << i;
+        return bits;
+    }
+#endif
+
+    inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) { return a * b + c; }
+    inline Float4 Abs(Float4 a) { return Max(a, Float4(0.0f) - a); }
+
+    /**
+     * 2^x for x in [-126, 126], within about 1e-4 relative error: the
+     * integer part goes straight into the exponent bits and the fraction is
+     * a degree-5 polynomial.
+     */
+    inline Float4 Exp2(Float4 x)
+    {
+        x = Min(Max(x, Float4(-126.0f)), Float4(126.0f));
+#if defined(LIGHTCHEF_SIMD_SSE)
+        __m128i truncated = _mm_cvttps_epi32(x.v);
+        __m128 whole = _mm_cvtepi32_ps(truncated);
+        // Truncation rounds negative values up; step back to the floor.
+        __m128 adjust = _mm_cmplt_ps(x.v, whole);
+        truncated = _mm_add_epi32(truncated, _mm_castps_si128(adjust));
+        whole = _mm_sub_ps(whole, _mm_and_ps(adjust, _mm_set1_ps(1.0f)));
+        Float4 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(truncated, _mm_set1_epi32(127)), 23));
+        Float4 f = x - Float4(whole);
+#elif defined(LIGHTCHEF_SIMD_NEON)
+        float32x4_t whole = vrndmq_f32(x.v);
+        int32x4_t exponent = vcvtq_s32_f32(whole);
+        Float4 scale = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(exponent, vdupq_n_s32(127)), 23));
+        Float4 f = x - Float4(whole);
+#else
+        Float4 scale, f;
+        for (int i = 0; i < 4; ++i)
+        {
+            float whole = std::floor(x.v[i]);
+            scale.v[i] = std::ldexp(1.0f, static_cast<int>(whole));
+            f.v[i] = x.v[i] - whole;
+        }
+#endif
+        Float4 p = MulAdd(f, Float4(1.3333558e-3f), Float4(9.6181291e-3f));
+        p = MulAdd(p, f, Float4(5.5504109e-2f));
+        p = MulAdd(p, f, Float4(2.4022651e-1f));
+        p = MulAdd(p, f, Float4(6.9314718e-1f));
+        p = MulAdd(p, f, Float4(1.0f));
+        return p * scale;
+    }
+
+    inline Float4 Exp(Float4 x) { return Exp2(x * Float4(1.44269504f)); }
+
+    /**
+     * Horizontal sum of the four lanes.
+     */
+    inline float ReduceAdd(Float4 a)
+    {
+        float lanes[4];
+        a.Store(lanes);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+}
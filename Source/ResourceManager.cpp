@@ -2,8 +2,14 @@
 #include "ResourceManager.h"
 
 #include <fstream>
+#include <limits>
+#include <map>
 #include <sstream>
 #include <string>
+#include <utility>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "Utility/tiny_obj_loader.h"
 
 using namespace wgpu;
 
@@ -68,6 +74,103 @@ bool ResourceManager::loadGeometry(
 	return true;
 }
 
+bool ResourceManager::loadObjScene(
+	const std::filesystem::path& path,
+	LightChef::Scene& scene
+) {
+	tinyobj::ObjReaderConfig config;
+	config.triangulate = true;
+	config.vertex_color = false;
+	tinyobj::ObjReader reader;
+	if (!reader.ParseFromFile(path.string(), config)) {
+		return false;
+	}
+
+	const tinyobj::attrib_t& attrib = reader.GetAttrib();
+	uint32_t materialOffset = static_cast<uint32_t>(scene.materials.size());
+	for (const tinyobj::material_t& source : reader.GetMaterials()) {
+		LightChef::Material material;
+		material.albedo = glm::vec3(source.diffuse[0], source.diffuse[1], source.diffuse[2]);
+		material.emission = glm::vec3(source.emission[0], source.emission[1], source.emission[2]);
+		scene.materials.push_back(material);
+	}
+	// Faces without a material use the scene's default one.
+	const uint32_t defaultMaterial = std::numeric_limits<uint32_t>::max();
+
+	for (const tinyobj::shape_t& shape : reader.GetShapes()) {
+		// Split the shape by material, since a baker mesh has a single one.
+		std::map<int, std::vector<size_t>> facesByMaterial;
+		for (size_t face = 0; face < shape.mesh.num_face_vertices.size(); ++face) {
+			facesByMaterial[shape.mesh.material_ids[face]].push_back(face);
+		}
+
+		for (const auto& [materialId, faces] : facesByMaterial) {
+			LightChef::Mesh mesh;
+			mesh.materialIndex = materialId < 0 ? defaultMaterial : materialOffset + static_cast<uint32_t>(materialId);
+			bool hasNormals = !attrib.normals.empty();
+			std::map<std::pair<int, int>, uint32_t> vertexMap;
+			for (size_t face : faces) {
+				for (size_t corner = 0; corner < 3; ++corner) {
+					const tinyobj::index_t& index = shape.mesh.indices[face * 3 + corner];
+					hasNormals = hasNormals && index.normal_index >= 0;
+					auto [it, inserted] = vertexMap.try_emplace({ index.vertex_index, index.normal_index }, static_cast<uint32_t>(mesh.positions.size()));
+					if (inserted) {
+						const float* p = &attrib.vertices[3 * static_cast<size_t>(index.vertex_index)];
+						mesh.positions.emplace_back(p[0], p[1], p[2]);
+						if (index.normal_index >= 0) {
+							const float* n = &attrib.normals[3 * static_cast<size_t>(index.normal_index)];
+							mesh.normals.emplace_back(n[0], n[1], n[2]);
+						}
+						else {
+							mesh.normals.emplace_back(0.0f);
+						}
+					}
+					mesh.indices.push_back(it->second);
+				}
+			}
+			if (!hasNormals) {
+				mesh.normals.clear();
+			}
+			scene.meshes.push_back(std::move(mesh));
+		}
+	}
+	return true;
+}
+
+LightChef::Mesh ResourceManager::makeMesh(
+	const std::vector<float>& pointData,
+	const std::vector<uint16_t>& indexData,
+	int stride
+) {
+	LightChef::Mesh mesh;
+	size_t vertexCount = pointData.size() / stride;
+	mesh.positions.reserve(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const float* p = &pointData[i * stride];
+		mesh.positions.emplace_back(p[0], p[1], p[2]);
+	}
+	mesh.indices.assign(indexData.begin(), indexData.end());
+	return mesh;
+}
+
+void ResourceManager::appendLightmapUVs(
+	std::vector<float>& pointData,
+	std::vector<uint32_t>& indexData,
+	int stride,
+	const LightChef::AtlasMesh& atlasMesh
+) {
+	std::vector<float> splitData;
+	splitData.reserve(atlasMesh.xref.size() * (stride + 2));
+	for (size_t i = 0; i < atlasMesh.xref.size(); ++i) {
+		const float* source = &pointData[atlasMesh.xref[i] * stride];
+		splitData.insert(splitData.end(), source, source + stride);
+		splitData.push_back(atlasMesh.uvs[i].x);
+		splitData.push_back(atlasMesh.uvs[i].y);
+	}
+	pointData = std::move(splitData);
+	indexData = atlasMesh.indices;
+}
+
 ShaderModule ResourceManager::loadShaderModule(const std::filesystem::path& path, Device device) {
 	std::ifstream file(path);
 	if (!file.is_open()) {
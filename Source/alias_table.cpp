@@ -0,0 +1,60 @@
+#include "Bake/alias_table.h"
+
+#include <algorithm>
+
+namespace LightChef
+{
+    AliasTable::AliasTable(const std::vector<float>& weights)
+        : m_bins(weights.size())
+        , m_pmfs(weights.size(), 0.0f)
+    {
+        double total = 0.0;
+        for (float weight : weights)
+            total += std::max(0.0f, weight);
+        m_totalWeight = static_cast<float>(total);
+        if (total <= 0.0)
+            return;
+
+        size_t n = weights.size();
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            m_pmfs[i] = static_cast<float>(std::max(0.0f, weights[i]) / total);
+            scaled[i] = std::max(0.0f, weights[i]) / total * n;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            uint32_t s = small.back();
+            small.pop_back();
+            uint32_t l = large.back();
+            m_bins[s] = { static_cast<float>(scaled[s]), l };
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Leftovers are 1 up to rounding.
+        for (uint32_t i : small)
+            m_bins[i] = { 1.0f, i };
+        for (uint32_t i : large)
+            m_bins[i] = { 1.0f, i };
+    }
+
+    bool AliasTable::Sample(float u, uint32_t& index, float& pmf) const
+    {
+        if (IsEmpty())
+            return false;
+        float scaled = u * m_bins.size();
+        uint32_t bin = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(m_bins.size() - 1));
+        // The fractional part is a fresh uniform number for the keep/alias decision.
+        float remainder = scaled - bin;
+        index = remainder < m_bins[bin].threshold ? bin : m_bins[bin].alias;
+        pmf = m_pmfs[index];
+        return true;
+    }
+}
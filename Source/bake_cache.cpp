@@ -0,0 +1,223 @@
+#include "Bake/bake_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include "Bake/bake_engine.h"
+#include "Bake/content_hash.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr char kEntryMagic[4] = { 'L', 'C', 'B', 'C' };
+        constexpr uint32_t kEntryVersion = 4;
+        // Grid coordinates are packed into 21 bits per axis.
+        constexpr int32_t kCellCoordinateMask = (1 << 21) - 1;
+
+        struct EntryHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint64_t key;
+            uint64_t texelCount;
+        };
+
+        uint64_t PackCell(const glm::ivec3& cell)
+        {
+            return (static_cast<uint64_t>(cell.x & kCellCoordinateMask) << 42) | (static_cast<uint64_t>(cell.y & kCellCoordinateMask) << 21) |
+                   static_cast<uint64_t>(cell.z & kCellCoordinateMask);
+        }
+
+        // Sky, environment and the settings that change what a texel converges to.
+        uint64_t GetGlobalHash(const Scene& scene, const BakeSettings& settings)
+        {
+            uint32_t values[] = { kEntryVersion, static_cast<uint32_t>(sizeof(TexelAccumulator)), settings.maxBounces,
+                                  static_cast<uint32_t>(settings.lightSampling), static_cast<uint32_t>(settings.sampler), settings.directional ? 1u : 0u,
+                                  settings.minSamples, settings.samplesPerPass, settings.maxSamples, settings.radianceCache.capacity,
+                                  settings.radianceCache.minSamples, settings.radianceCache.maxSamples, settings.guiding.enabled ? 1u : 0u,
+                                  settings.guiding.spatialResolution, settings.guiding.directionalResolution, settings.guiding.minSamples,
+                                  settings.directReservoirs.enabled ? 1u : 0u, settings.directReservoirs.candidates,
+                                  settings.directReservoirs.neighbours, settings.directReservoirs.radius };
+            uint64_t hash = HashBytes(0, values, sizeof(values));
+            float sky[] = { scene.skyColor.x, scene.skyColor.y, scene.skyColor.z, scene.environmentIntensity, settings.errorThreshold,
+                            settings.cacheInfluenceRadius, settings.radianceCache.cellSize, settings.guiding.guidedFraction };
+            hash = HashBytes(hash, sky, sizeof(sky));
+            if (!scene.environmentMap.empty())
+            {
+                // Like the environment CDF cache, the map is identified by its size and time stamp.
+                std::error_code error;
+                std::string path = scene.environmentMap.string();
+                uint64_t size = std::filesystem::file_size(scene.environmentMap, error);
+                int64_t time = std::filesystem::last_write_time(scene.environmentMap, error).time_since_epoch().count();
+                hash = HashBytes(hash, path.data(), path.size());
+                hash = HashValue(HashValue(hash, size), time);
+            }
+            return hash;
+        }
+    }
+
+    void BakeCache::Load(const std::filesystem::path& directory, const Scene& scene, const TexelBuffer& texels, const BakeSettings& settings,
+                         std::span<TexelAccumulator> accumulators)
+    {
+        m_directory = directory;
+        m_stats = BakeCacheStats();
+        m_chartTexels.clear();
+        for (size_t i = 0; i < texels.charts.size(); ++i)
+        {
+            uint32_t chart = texels.charts[i];
+            if (chart == TexelBuffer::kNoChart || !texels.IsCovered(i))
+                continue;
+            if (chart >= m_chartTexels.size())
+                m_chartTexels.resize(chart + 1);
+            m_chartTexels[chart].push_back(i);
+        }
+
+        // World-anchored grid, so geometry added far away does not shift the cells of unchanged charts.
+        float radius = std::max(settings.cacheInfluenceRadius, 1e-3f);
+        auto cellOf = [&](const glm::vec3& position) { return glm::ivec3(glm::floor(position / radius)); };
+        std::unordered_map<uint64_t, uint64_t> cells;
+        auto insert = [&](const glm::ivec3& lo, const glm::ivec3& hi, uint64_t value) {
+            for (int z = lo.z; z <= hi.z; ++z)
+                for (int y = lo.y; y <= hi.y; ++y)
+                    for (int x = lo.x; x <= hi.x; ++x)
+                    {
+                        uint64_t& cell = cells[PackCell(glm::ivec3(x, y, z))];
+                        cell = Random::Mix(cell ^ value);
+                    }
+        };
+        for (const Mesh& mesh : scene.meshes)
+        {
+            uint64_t material = HashValue(0, scene.GetMaterial(mesh.materialIndex));
+            for (uint32_t t = 0; t < mesh.GetTriangleCount(); ++t)
+            {
+                glm::vec3 vertices[3];
+                for (int k = 0; k < 3; ++k)
+                    vertices[k] = mesh.positions[mesh.indices[t * 3 + k]];
+                glm::vec3 lo = glm::min(vertices[0], glm::min(vertices[1], vertices[2]));
+                glm::vec3 hi = glm::max(vertices[0], glm::max(vertices[1], vertices[2]));
+                insert(cellOf(lo), cellOf(hi), HashBytes(material, vertices, sizeof(vertices)));
+            }
+        }
+        for (const Light& light : scene.lights)
+            insert(cellOf(light.position), cellOf(light.position), HashValue(0, light));
+
+        uint64_t global = GetGlobalHash(scene, settings);
+        m_keys.assign(m_chartTexels.size(), 0);
+        m_hits.assign(m_chartTexels.size(), 0);
+        std::vector<TexelAccumulator> entry;
+        for (size_t chart = 0; chart < m_chartTexels.size(); ++chart)
+        {
+            const std::vector<size_t>& chartTexels = m_chartTexels[chart];
+            if (chartTexels.empty())
+                continue;
+            m_stats.charts++;
+
+            glm::uvec2 corner(texels.width, texels.height);
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(-std::numeric_limits<float>::max());
+            for (size_t index : chartTexels)
+            {
+                corner = glm::min(corner, glm::uvec2(index % texels.width, index / texels.width % texels.height));
+                lo = glm::min(lo, texels.texels[index].position);
+                hi = glm::max(hi, texels.texels[index].position);
+            }
+            uint64_t key = global;
+            for (size_t index : chartTexels)
+            {
+                glm::uvec2 local = glm::uvec2(index % texels.width, index / texels.width % texels.height) - corner;
+                key = HashValue(key, local);
+                // The triangle id is left out: it changes whenever meshes are added before this one.
+                key = HashBytes(key, &texels.texels[index], offsetof(TexelRecord, triangleId));
+            }
+            glm::ivec3 first = cellOf(lo - glm::vec3(radius));
+            glm::ivec3 last = cellOf(hi + glm::vec3(radius));
+            for (int z = first.z; z <= last.z; ++z)
+                for (int y = first.y; y <= last.y; ++y)
+                    for (int x = first.x; x <= last.x; ++x)
+                    {
+                        auto cell = cells.find(PackCell(glm::ivec3(x, y, z)));
+                        key = Random::Mix(key ^ (cell != cells.end() ? cell->second : 0));
+                    }
+            m_keys[chart] = key;
+
+            bool empty = std::all_of(chartTexels.begin(), chartTexels.end(), [&](size_t index) { return accumulators[index].sampleCount == 0; });
+            if (!empty)
+                continue;
+            std::ifstream file(GetEntryPath(key), std::ios::binary);
+            EntryHeader header;
+            if (!file.is_open() || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kEntryMagic, 4) != 0 ||
+                header.version != kEntryVersion || header.key != key || header.texelCount != chartTexels.size())
+                continue;
+            entry.resize(chartTexels.size());
+            if (!file.read(reinterpret_cast<char*>(entry.data()), static_cast<std::streamsize>(entry.size() * sizeof(TexelAccumulator))))
+                continue;
+            for (size_t i = 0; i < chartTexels.size(); ++i)
+                accumulators[chartTexels[i]] = entry[i];
+            m_hits[chart] = 1;
+            m_stats.hits++;
+        }
+    }
+
+    void BakeCache::Store(std::span<const TexelAccumulator> accumulators)
+    {
+        // A missing entry only costs a rebake, so write failures (read-only folders) are ignored.
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+        std::vector<TexelAccumulator> entry;
+        for (size_t chart = 0; chart < m_chartTexels.size(); ++chart)
+        {
+            const std::vector<size_t>& chartTexels = m_chartTexels[chart];
+            if (chartTexels.empty() || m_hits[chart])
+                continue;
+            if (std::any_of(chartTexels.begin(), chartTexels.end(), [&](size_t index) { return accumulators[index].sampleCount == 0; }))
+                continue;
+            entry.clear();
+            for (size_t index : chartTexels)
+                entry.push_back(accumulators[index]);
+
+            // Written under a unique name and renamed, so concurrent bakes never read half an entry.
+            std::filesystem::path path = GetEntryPath(m_keys[chart]);
+            std::filesystem::path temporary = path;
+            temporary += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary);
+                if (!file.is_open())
+                    continue;
+                EntryHeader header;
+                std::memcpy(header.magic, kEntryMagic, 4);
+                header.version = kEntryVersion;
+                header.key = m_keys[chart];
+                header.texelCount = entry.size();
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                file.write(reinterpret_cast<const char*>(entry.data()), static_cast<std::streamsize>(entry.size() * sizeof(TexelAccumulator)));
+                if (!file)
+                {
+                    file.close();
+                    std::filesystem::remove(temporary, error);
+                    continue;
+                }
+            }
+            std::filesystem::rename(temporary, path, error);
+            if (error)
+            {
+                std::filesystem::remove(temporary, error);
+                continue;
+            }
+            m_stats.stored++;
+        }
+    }
+
+    std::filesystem::path BakeCache::GetEntryPath(uint64_t key) const
+    {
+        char name[24];
+        std::snprintf(name, sizeof(name), "%016llx.lcc", static_cast<unsigned long long>(key));
+        return m_directory / name;
+    }
+}
@@ -0,0 +1,86 @@
+#include "Bake/bake_checkpoint.h"
+
+#include <algorithm>
+#include <system_error>
+#include "Bake/bake_engine.h"
+#include "Utility/mapped_file.h"
+
+namespace LightChef
+{
+    bool MergeShards(const std::vector<std::filesystem::path>& shards, const std::filesystem::path& output, ShardMergeStats& stats)
+    {
+        stats = ShardMergeStats();
+        if (shards.empty())
+            return false;
+
+        std::vector<MappedFile> inputs(shards.size());
+        std::vector<uint8_t> seen;
+        CheckpointHeader merged;
+        for (size_t i = 0; i < shards.size(); ++i)
+        {
+            std::error_code error;
+            uintmax_t size = std::filesystem::file_size(shards[i], error);
+            if (error || size < kCheckpointHeaderSize || !inputs[i].Open(shards[i], static_cast<size_t>(size)))
+                return false;
+            const CheckpointHeader& header = *static_cast<const CheckpointHeader*>(inputs[i].GetData());
+            if (header.magic != kCheckpointMagic || header.version != kCheckpointVersion ||
+                size != kCheckpointHeaderSize + header.texelCount * sizeof(TexelAccumulator) || header.shardIndex >= header.shardCount)
+                return false;
+            if (i == 0)
+            {
+                merged.key = header.key;
+                merged.texelCount = header.texelCount;
+                seen.assign(header.shardCount, 0);
+            }
+            else if (header.key != merged.key || header.texelCount != merged.texelCount || header.shardCount != seen.size())
+            {
+                return false;
+            }
+            if (seen[header.shardIndex]++)
+                return false;
+            merged.samples += header.samples;
+            merged.seconds = std::max(merged.seconds, header.seconds);
+            merged.passes = std::max(merged.passes, header.passes);
+            merged.guideGeneration = std::max(merged.guideGeneration, header.guideGeneration);
+        }
+
+        MappedFile target;
+        size_t texelCount = static_cast<size_t>(merged.texelCount);
+        if (!target.Open(output, kCheckpointHeaderSize + texelCount * sizeof(TexelAccumulator)))
+            return false;
+        // The header is cleared first and written last, so an interrupted merge never looks valid.
+        uint8_t* data = static_cast<uint8_t*>(target.GetData());
+        std::fill(data, data + kCheckpointHeaderSize, uint8_t(0));
+        TexelAccumulator* accumulators = reinterpret_cast<TexelAccumulator*>(data + kCheckpointHeaderSize);
+        std::fill(accumulators, accumulators + texelCount, TexelAccumulator());
+        for (const MappedFile& input : inputs)
+        {
+            const TexelAccumulator* source =
+                reinterpret_cast<const TexelAccumulator*>(static_cast<const uint8_t*>(input.GetData()) + kCheckpointHeaderSize);
+            for (size_t texel = 0; texel < texelCount; ++texel)
+            {
+                if (source[texel].sampleCount == 0)
+                    continue;
+                TexelAccumulator& sum = accumulators[texel];
+                if (sum.sampleCount > 0)
+                    stats.overlappingTexels++;
+                sum.irradianceSum += source[texel].irradianceSum;
+                sum.luminanceSquaredSum += source[texel].luminanceSquaredSum;
+                sum.sampleCount += source[texel].sampleCount;
+                sum.directionalSum += source[texel].directionalSum;
+            }
+        }
+        *reinterpret_cast<CheckpointHeader*>(data) = merged;
+        if (!target.Flush())
+        {
+            target.Close();
+            std::error_code error;
+            std::filesystem::remove(output, error);
+            return false;
+        }
+
+        stats.shards = static_cast<uint32_t>(shards.size());
+        stats.samples = merged.samples;
+        return true;
+    }
+}
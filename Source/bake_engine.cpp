@@ -0,0 +1,751 @@
+#include "Bake/bake_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <thread>
+#include "Bake/bake_checkpoint.h"
+#include "Bake/content_hash.h"
+#include "Bake/directional_lightmap.h"
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Luminance below which the relative error is measured against this floor instead.
+        constexpr float kErrorFloor = 1e-3f;
+        constexpr uint32_t kBlueNoiseTileSize = 64;
+        constexpr uint64_t kBlueNoiseSeed = 0x6A09E667F3BCC909ull;
+        // Caps the 1 / cos of grazing samples in the directional moments, whose variance is otherwise
+        // unbounded. Only the direction is affected; the magnitude comes from the irradiance.
+        constexpr float kMinDirectionalCosine = 0.05f;
+        // Device time a batch of tiles aims for: long enough to hide the upload and readback, short
+        // enough that the rate estimate follows the device and the last batch ends with the CPU's.
+        constexpr double kDeviceBatchSeconds = 0.25;
+
+        /**
+         * Everything a texel's samples depend on: the texels, the scene's
+         * geometry and lighting, and the settings that shape a path.
+         * Shards of one bake share it.
+         */
+        uint64_t GetCheckpointKey(const Scene& scene, const TexelBuffer& texels, const BakeSettings& settings)
+        {
+            uint32_t layout[] = { texels.width, texels.height, texels.atlasCount, static_cast<uint32_t>(sizeof(TexelAccumulator)), settings.maxBounces,
+                                  static_cast<uint32_t>(settings.lightSampling), static_cast<uint32_t>(settings.sampler), settings.directional ? 1u : 0u };
+            uint64_t hash = HashBytes(kCheckpointVersion, layout, sizeof(layout));
+            const RadianceCacheSettings& radianceCache = settings.radianceCache;
+            uint32_t radianceCacheValues[] = { radianceCache.capacity, radianceCache.minSamples, radianceCache.maxSamples };
+            hash = HashValue(HashBytes(hash, radianceCacheValues, sizeof(radianceCacheValues)), radianceCache.cellSize);
+            const PathGuideSettings& guiding = settings.guiding;
+            uint32_t guidingValues[] = { guiding.enabled ? 1u : 0u, guiding.spatialResolution, guiding.directionalResolution, guiding.minSamples };
+            hash = HashValue(HashBytes(hash, guidingValues, sizeof(guidingValues)), guiding.guidedFraction);
+            const DirectReservoirSettings& directReservoirs = settings.directReservoirs;
+            uint32_t directReservoirValues[] = { directReservoirs.enabled ? 1u : 0u, directReservoirs.candidates, directReservoirs.neighbours,
+                                                 directReservoirs.radius };
+            hash = HashBytes(hash, directReservoirValues, sizeof(directReservoirValues));
+            hash = HashVector(hash, texels.texels);
+            for (const Mesh& mesh : scene.meshes)
+            {
+                hash = HashVector(hash, mesh.positions);
+                hash = HashVector(hash, mesh.indices);
+                hash = HashBytes(hash, &mesh.materialIndex, sizeof(mesh.materialIndex));
+            }
+            hash = HashVector(hash, scene.materials);
+            hash = HashVector(hash, scene.lights);
+            if (!scene.environmentMap.empty())
+            {
+                // An edited map keeps its path; like BakeCache, the file's size and time stamp tell.
+                std::error_code error;
+                std::string environment = scene.environmentMap.string();
+                uint64_t size = std::filesystem::file_size(scene.environmentMap, error);
+                int64_t time = std::filesystem::last_write_time(scene.environmentMap, error).time_since_epoch().count();
+                hash = HashBytes(hash, environment.data(), environment.size());
+                hash = HashValue(HashValue(hash, size), time);
+            }
+            float sky[] = { scene.skyColor.x, scene.skyColor.y, scene.skyColor.z, scene.environmentIntensity };
+            return HashBytes(hash, sky, sizeof(sky));
+        }
+
+        uint32_t MortonCode(uint32_t x, uint32_t y)
+        {
+            auto spread = [](uint32_t v) {
+                v &= 0xFFFF;
+                v = (v | (v << 8)) & 0x00FF00FF;
+                v = (v | (v << 4)) & 0x0F0F0F0F;
+                v = (v | (v << 2)) & 0x33333333;
+                v = (v | (v << 1)) & 0x55555555;
+                return v;
+            };
+            return spread(x) | (spread(y) << 1);
+        }
+
+        /**
+         * Adds an irradiance sample arriving from `direction` to luminance
+         * L1 SH moments (xyz: band 1, w: band 0) as radiance over pdf.
+         */
+        void AccumulateDirectional(glm::vec4& moments, const glm::vec3& normal, const glm::vec3& direction, const glm::vec3& irradiance)
+        {
+            float cosTheta = glm::dot(normal, direction);
+            float luminance = Luminance(irradiance);
+            if (cosTheta <= 0.0f || luminance <= 0.0f)
+                return;
+            float weight = luminance / std::max(cosTheta, kMinDirectionalCosine);
+            moments += glm::vec4(direction * weight, weight);
+        }
+    }
+
+    /**
+     * The tiles of one pass with the samples each needs. CPU workers pop
+     * single tiles from the front and the device pops batches from the back,
+     * so the two sides only meet where the pass runs out.
+     */
+    class BakeEngine::TileQueue
+    {
+    public:
+        void Push(uint32_t tile, uint64_t samples)
+        {
+            m_tiles.push_back(tile);
+            m_samples.push_back(samples);
+            m_end = m_tiles.size();
+            m_remaining += samples;
+        }
+
+        bool IsEmpty() const { return m_tiles.empty(); }
+
+        bool PopFront(uint32_t& tile)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_begin == m_end)
+                return false;
+            m_remaining -= m_samples[m_begin];
+            tile = m_tiles[m_begin++];
+            return true;
+        }
+
+        /**
+         * Pops a batch worth `batchSeconds` at the device's rate, but no more
+         * than its share of what is left at both rates, so both sides run dry
+         * together. Leaves the batch empty once the CPU would finish the rest
+         * before the device finished one tile. Rates of 0 are not measured
+         * yet and take a single tile.
+         */
+        void PopBack(double deviceRate, double cpuRate, double batchSeconds, std::vector<uint32_t>& batch)
+        {
+            batch.clear();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_begin == m_end)
+                return;
+            uint64_t budget = 0;
+            if (deviceRate > 0.0 && cpuRate > 0.0)
+            {
+                if (m_samples[m_end - 1] / deviceRate > m_remaining / cpuRate)
+                    return;
+                double share = m_remaining * deviceRate / (deviceRate + cpuRate);
+                budget = static_cast<uint64_t>(std::min(deviceRate * batchSeconds, share));
+            }
+            uint64_t taken = 0;
+            do
+            {
+                --m_end;
+                taken += m_samples[m_end];
+                batch.push_back(m_tiles[m_end]);
+            } while (m_end > m_begin && taken + m_samples[m_end - 1] <= budget);
+            m_remaining -= taken;
+        }
+
+    private:
+        std::vector<uint32_t> m_tiles;
+        std::vector<uint64_t> m_samples;
+        std::mutex m_mutex;
+        size_t m_begin = 0;
+        size_t m_end = 0;
+        uint64_t m_remaining = 0;
+    };
+
+    BakeEngine::BakeEngine(const Scene& scene, const TexelBuffer& texels, const BakeSettings& settings, bvh::v2::ThreadPool& threadPool)
+        : m_scene(scene)
+        , m_texels(texels)
+        , m_settings(settings)
+        , m_threadPool(threadPool)
+        , m_tracer(scene, threadPool)
+        , m_lights(scene, settings.lightSampling, threadPool)
+        , m_integrator(m_tracer, m_lights)
+        , m_start(std::chrono::steady_clock::now())
+        , m_lastCheckpoint(m_start)
+    {
+        m_settings.shardCount = std::max(1u, m_settings.shardCount);
+        m_settings.shardIndex = std::min(m_settings.shardIndex, m_settings.shardCount - 1);
+        if (m_settings.checkpointPath.empty() || !OpenCheckpoint())
+        {
+            m_ownedAccumulators.resize(texels.texels.size());
+            m_accumulators = m_ownedAccumulators;
+        }
+
+        uint32_t tileSize = std::max(1u, m_settings.tileSize);
+        m_settings.tileSize = tileSize;
+        uint32_t tilesX = (texels.width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (texels.height + tileSize - 1) / tileSize;
+        for (uint32_t atlas = 0; atlas < texels.atlasCount; ++atlas)
+        {
+            std::vector<std::pair<uint32_t, Tile>> pageTiles;
+            for (uint32_t ty = 0; ty < tilesY; ++ty)
+            {
+                for (uint32_t tx = 0; tx < tilesX; ++tx)
+                {
+                    Tile tile{ atlas, tx * tileSize, ty * tileSize };
+                    bool covered = false;
+                    for (uint32_t y = tile.y; y < std::min(texels.height, tile.y + tileSize) && !covered; ++y)
+                        for (uint32_t x = tile.x; x < std::min(texels.width, tile.x + tileSize) && !covered; ++x)
+                            covered = texels.IsCovered(texels.GetIndex(atlas, x, y));
+                    if (covered)
+                        pageTiles.emplace_back(MortonCode(tx, ty), tile);
+                }
+            }
+            std::sort(pageTiles.begin(), pageTiles.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+            for (const auto& entry : pageTiles)
+                m_tiles.push_back(entry.second);
+        }
+        // Shards take every shardCount-th tile, so each gets a share of every region's cost.
+        if (m_settings.shardCount > 1)
+        {
+            std::vector<Tile> shardTiles;
+            for (size_t i = m_settings.shardIndex; i < m_tiles.size(); i += m_settings.shardCount)
+                shardTiles.push_back(m_tiles[i]);
+            m_tiles.swap(shardTiles);
+        }
+
+        if (m_settings.sampler == SamplerType::BlueNoise)
+            m_blueNoise = BlueNoiseTile(kBlueNoiseTileSize, kBlueNoiseSeed);
+        if (m_settings.radianceCache.cellSize > 0.0f)
+        {
+            m_radianceCache = std::make_unique<RadianceCache>(m_settings.radianceCache);
+            m_integrator.SetRadianceCache(m_radianceCache.get());
+        }
+        if (m_settings.guiding.enabled)
+        {
+            m_guide = std::make_unique<PathGuide>(texels, m_settings.guiding);
+            m_integrator.SetPathGuide(m_guide.get());
+            // The resumed guide starts unlearnt, which makes it a new generation.
+            if (m_stats.resumed)
+                m_guide->SetGeneration(static_cast<const CheckpointHeader*>(m_checkpointFile.GetData())->guideGeneration + 1);
+        }
+        if (m_settings.directReservoirs.enabled && m_settings.lightSampling != LightSamplingMode::Bvh)
+            m_directReservoirs = std::make_unique<DirectReservoirs>(m_integrator, texels, m_settings.directReservoirs);
+        if (m_settings.wavefront)
+            for (size_t i = 0; i <= threadPool.get_thread_count(); ++i)
+                m_wavefront.emplace_back(m_integrator, m_settings.sampler, &m_blueNoise, m_settings.maxBounces);
+
+        for (const Tile& tile : m_tiles)
+            for (uint32_t y = tile.y; y < std::min(texels.height, tile.y + tileSize); ++y)
+                for (uint32_t x = tile.x; x < std::min(texels.width, tile.x + tileSize); ++x)
+                    m_stats.coveredTexels += texels.IsCovered(texels.GetIndex(tile.atlasIndex, x, y)) ? 1 : 0;
+
+        if (!m_settings.cacheDirectory.empty())
+            m_cache.Load(m_settings.cacheDirectory, scene, texels, m_settings, m_accumulators);
+
+        if (!m_settings.outputPath.empty() && m_output.Open(m_settings.outputPath, texels.width, texels.height, texels.atlasCount, tileSize))
+            m_tileWritten.assign(m_tiles.size(), 0);
+    }
+
+    BakeStats BakeEngine::Bake()
+    {
+        while (RunPass())
+        {
+        }
+        if (!m_settings.cacheDirectory.empty())
+            m_cache.Store(m_accumulators);
+        if (m_output.IsOpen())
+        {
+            // Tiles cut short by a budget, or cached and never baked.
+            std::atomic<uint32_t> cursor{ 0 };
+            for (size_t t = 0; t < m_threadPool.get_thread_count(); ++t)
+            {
+                m_threadPool.push([&](size_t) {
+                    for (uint32_t i = cursor++; i < m_tiles.size(); i = cursor++)
+                        WriteTile(i);
+                });
+            }
+            m_threadPool.wait();
+            m_output.Close();
+        }
+        Checkpoint(true);
+        return m_stats;
+    }
+
+    bool BakeEngine::SetDevice(BakeDevice* device)
+    {
+        if (device && m_settings.directional)
+            return false;
+        m_device = device;
+        return true;
+    }
+
+    bool BakeEngine::RunPass()
+    {
+        if (IsOverBudget())
+            return false;
+
+        TileQueue queue;
+        for (uint32_t i = 0; i < m_tiles.size(); ++i)
+            if (uint64_t samples = GetPassSamples(m_tiles[i]))
+                queue.Push(i, samples);
+        if (queue.IsEmpty())
+            return false;
+
+        // Threads pull tiles in Morton order from the front of the queue, so
+        // neighbouring tiles (and their BVH nodes) are baked close in time.
+        auto passStart = std::chrono::steady_clock::now();
+        uint64_t samplesBefore = m_samplesTaken;
+        std::atomic<uint64_t> cpuSamples{ 0 };
+        std::thread deviceThread;
+        if (m_device)
+            deviceThread = std::thread([&] { FeedDevice(queue, cpuSamples, passStart); });
+        for (size_t t = 0; t < m_threadPool.get_thread_count(); ++t)
+        {
+            m_threadPool.push([&](size_t worker) {
+                uint32_t tile;
+                while (queue.PopFront(tile))
+                {
+                    cpuSamples += BakeTile(m_tiles[tile], worker);
+                    // Compressing converged tiles here hides the output behind the rest of the bake.
+                    if (m_output.IsOpen() && !TileNeedsSamples(m_tiles[tile]))
+                        WriteTile(tile);
+                    Checkpoint(false);
+                    if (IsOverBudget())
+                        break;
+                }
+            });
+        }
+        m_threadPool.wait();
+        double cpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - passStart).count();
+        if (cpuSamples > 0 && cpuSeconds > 0.0)
+            m_cpuRate = cpuSamples / cpuSeconds;
+        if (deviceThread.joinable())
+            deviceThread.join();
+        if (m_guide)
+            m_guide->Update();
+        if (m_directReservoirs)
+            m_directReservoirs->EndPass();
+
+        m_stats.passes++;
+        m_stats.samples += m_samplesTaken - samplesBefore;
+        m_stats.convergedTexels = 0;
+        for (const Tile& tile : m_tiles)
+        {
+            for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+            {
+                for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+                {
+                    size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                    if (m_texels.IsCovered(index) && !NeedsSamples(m_accumulators[index]))
+                        m_stats.convergedTexels++;
+                }
+            }
+        }
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        return true;
+    }
+
+    Lightmap BakeEngine::GetLightmap() const
+    {
+        Lightmap lightmap;
+        lightmap.width = m_texels.width;
+        lightmap.height = m_texels.height;
+        lightmap.atlasCount = m_texels.atlasCount;
+        lightmap.texels.resize(m_accumulators.size(), glm::vec4(0.0f));
+        for (size_t i = 0; i < m_accumulators.size(); ++i)
+        {
+            const TexelAccumulator& accumulator = m_accumulators[i];
+            if (m_texels.IsCovered(i) && accumulator.sampleCount > 0)
+                lightmap.texels[i] = glm::vec4(accumulator.irradianceSum / static_cast<float>(accumulator.sampleCount), 1.0f);
+        }
+        return lightmap;
+    }
+
+    Lightmap BakeEngine::GetDirectionalLightmap() const
+    {
+        Lightmap directional;
+        directional.width = m_texels.width;
+        directional.height = m_texels.height;
+        directional.atlasCount = m_texels.atlasCount;
+        directional.texels.resize(m_accumulators.size(), glm::vec4(0.0f));
+        for (size_t i = 0; i < m_accumulators.size(); ++i)
+        {
+            const glm::vec4& moments = m_accumulators[i].directionalSum;
+            if (!m_texels.IsCovered(i))
+                continue;
+            // Unlit texels stay neutral: no band 1, relative irradiance 1.
+            if (moments.w <= 0.0f)
+            {
+                directional.texels[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+                continue;
+            }
+            glm::vec3 band1 = glm::vec3(moments) / moments.w;
+            directional.texels[i] = glm::vec4(band1, EvaluateL1Irradiance(band1, m_texels.texels[i].normal));
+        }
+        return directional;
+    }
+
+    std::vector<float> BakeEngine::GetLuminanceVariance() const
+    {
+        std::vector<float> variance(m_accumulators.size(), 0.0f);
+        for (size_t i = 0; i < m_accumulators.size(); ++i)
+        {
+            const TexelAccumulator& accumulator = m_accumulators[i];
+            uint32_t n = accumulator.sampleCount;
+            if (n < 2)
+                continue;
+            float mean = Luminance(accumulator.irradianceSum) / n;
+            variance[i] = std::max(0.0f, (accumulator.luminanceSquaredSum - mean * mean * n) / (n - 1)) / n;
+        }
+        return variance;
+    }
+
+    bool BakeEngine::NeedsSamples(const TexelAccumulator& accumulator) const
+    {
+        uint32_t n = accumulator.sampleCount;
+        if (n < m_settings.minSamples)
+            return true;
+        if (n >= m_settings.maxSamples || n < 2)
+            return false;
+        float mean = Luminance(accumulator.irradianceSum) / n;
+        float variance = std::max(0.0f, (accumulator.luminanceSquaredSum - mean * mean * n) / (n - 1));
+        float standardError = std::sqrt(variance / n);
+        return standardError > m_settings.errorThreshold * std::max(mean, kErrorFloor);
+    }
+
+    uint32_t BakeEngine::GetPassSamples(const TexelAccumulator& accumulator) const
+    {
+        if (!NeedsSamples(accumulator))
+            return 0;
+        uint32_t count = accumulator.sampleCount < m_settings.minSamples
+            ? m_settings.minSamples - accumulator.sampleCount
+            : m_settings.samplesPerPass;
+        return std::min(count, m_settings.maxSamples - accumulator.sampleCount);
+    }
+
+    uint64_t BakeEngine::GetPassSamples(const Tile& tile) const
+    {
+        uint64_t samples = 0;
+        for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+        {
+            for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+            {
+                size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                if (m_texels.IsCovered(index))
+                    samples += GetPassSamples(m_accumulators[index]);
+            }
+        }
+        return samples;
+    }
+
+    bool BakeEngine::TileNeedsSamples(const Tile& tile) const
+    {
+        for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+        {
+            for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+            {
+                size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                if (m_texels.IsCovered(index) && NeedsSamples(m_accumulators[index]))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool BakeEngine::IsOverBudget() const
+    {
+        if (m_settings.sampleBudget > 0 && m_samplesTaken >= m_settings.sampleBudget)
+            return true;
+        if (m_settings.timeBudgetSeconds > 0.0)
+        {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            return elapsed >= m_settings.timeBudgetSeconds;
+        }
+        return false;
+    }
+
+    bool BakeEngine::OpenCheckpoint()
+    {
+        size_t texelCount = m_texels.texels.size();
+        size_t size = kCheckpointHeaderSize + texelCount * sizeof(TexelAccumulator);
+        std::error_code error;
+        bool sameSize = std::filesystem::file_size(m_settings.checkpointPath, error) == size && !error;
+        if (!m_checkpointFile.Open(m_settings.checkpointPath, size))
+            return false;
+
+        uint8_t* data = static_cast<uint8_t*>(m_checkpointFile.GetData());
+        CheckpointHeader* header = reinterpret_cast<CheckpointHeader*>(data);
+        m_accumulators = std::span<TexelAccumulator>(reinterpret_cast<TexelAccumulator*>(data + kCheckpointHeaderSize), texelCount);
+        m_checkpointKey = GetCheckpointKey(m_scene, m_texels, m_settings);
+        if (sameSize && header->magic == kCheckpointMagic && header->version == kCheckpointVersion && header->key == m_checkpointKey &&
+            header->texelCount == texelCount && header->shardIndex == m_settings.shardIndex && header->shardCount == m_settings.shardCount)
+        {
+            m_stats.resumed = true;
+            m_stats.passes = header->passes;
+            m_stats.samples = header->samples;
+            m_samplesTaken = header->samples;
+            // Budgets keep counting the time spent before the restart.
+            m_start -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(header->seconds));
+            return true;
+        }
+
+        std::fill(m_accumulators.begin(), m_accumulators.end(), TexelAccumulator());
+        CheckpointHeader fresh;
+        fresh.key = m_checkpointKey;
+        fresh.texelCount = texelCount;
+        fresh.shardIndex = m_settings.shardIndex;
+        fresh.shardCount = m_settings.shardCount;
+        *header = fresh;
+        return true;
+    }
+
+    void BakeEngine::Checkpoint(bool force)
+    {
+        if (!m_checkpointFile.IsOpen())
+            return;
+        // Workers check after every tile; whoever finds the interval elapsed writes the checkpoint.
+        std::unique_lock<std::mutex> lock(m_checkpointMutex, std::defer_lock);
+        if (force)
+            lock.lock();
+        else if (!lock.try_lock())
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (!force && std::chrono::duration<double>(now - m_lastCheckpoint).count() < m_settings.checkpointIntervalSeconds)
+            return;
+
+        CheckpointHeader* header = static_cast<CheckpointHeader*>(m_checkpointFile.GetData());
+        header->samples = m_samplesTaken;
+        header->seconds = std::chrono::duration<double>(now - m_start).count();
+        header->passes = m_stats.passes;
+        header->guideGeneration = m_guide ? m_guide->GetGeneration() : 0;
+        header->checkpoints++;
+        m_checkpointFile.Flush();
+        m_lastCheckpoint = std::chrono::steady_clock::now();
+        m_stats.checkpoints++;
+        m_stats.checkpointSeconds += std::chrono::duration<double>(m_lastCheckpoint - now).count();
+    }
+
+    uint64_t BakeEngine::BakeTile(const Tile& tile, size_t worker)
+    {
+        if (!m_wavefront.empty())
+            return BakeTileWavefront(tile, m_wavefront[worker]);
+        uint64_t taken = 0;
+        for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+        {
+            for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+            {
+                size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                if (!m_texels.IsCovered(index))
+                    continue;
+                uint32_t count = GetPassSamples(m_accumulators[index]);
+                if (count == 0)
+                    continue;
+
+                // Accumulate in a copy and store the texel once, so a checkpoint file
+                // never holds sums that disagree with the sample count.
+                TexelAccumulator accumulator = m_accumulators[index];
+                for (uint32_t s = 0; s < count; ++s)
+                {
+                    glm::vec3 irradiance = SampleTexel(m_texels.texels[index], index, x, y, accumulator.sampleCount, accumulator.directionalSum);
+                    float luminance = Luminance(irradiance);
+                    accumulator.irradianceSum += irradiance;
+                    accumulator.luminanceSquaredSum += luminance * luminance;
+                    accumulator.sampleCount++;
+                }
+                m_accumulators[index] = accumulator;
+                taken += count;
+                m_samplesTaken += count;
+            }
+        }
+        return taken;
+    }
+
+    uint64_t BakeEngine::BakeTileWavefront(const Tile& tile, WavefrontIntegrator& integrator)
+    {
+        // The whole tile's pass is one stream of paths, in texel and then sample order.
+        std::vector<PathRequest> requests;
+        for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+        {
+            for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+            {
+                size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                if (!m_texels.IsCovered(index))
+                    continue;
+                uint32_t count = GetPassSamples(m_accumulators[index]);
+                for (uint32_t s = 0; s < count; ++s)
+                    requests.push_back({ static_cast<uint32_t>(index), m_accumulators[index].sampleCount + s, x, y });
+            }
+        }
+        std::vector<PathResult> results(requests.size());
+        integrator.Trace(m_texels, requests, results);
+
+        for (size_t first = 0, last; first < requests.size(); first = last)
+        {
+            uint32_t index = requests[first].texelIndex;
+            for (last = first + 1; last < requests.size() && requests[last].texelIndex == index; ++last)
+                ;
+            const TexelRecord& texel = m_texels.texels[index];
+            TexelAccumulator accumulator = m_accumulators[index];
+            for (size_t i = first; i < last; ++i)
+            {
+                const PathResult& result = results[i];
+                if (m_settings.directional)
+                {
+                    AccumulateDirectional(accumulator.directionalSum, texel.normal, result.lightDirection, result.direct);
+                    AccumulateDirectional(accumulator.directionalSum, texel.normal, result.direction, result.indirect);
+                }
+                glm::vec3 irradiance = result.direct + result.indirect;
+                float luminance = Luminance(irradiance);
+                accumulator.irradianceSum += irradiance;
+                accumulator.luminanceSquaredSum += luminance * luminance;
+                accumulator.sampleCount++;
+            }
+            m_accumulators[index] = accumulator;
+        }
+        m_samplesTaken += requests.size();
+        return requests.size();
+    }
+
+    void BakeEngine::FeedDevice(TileQueue& queue, const std::atomic<uint64_t>& cpuSamples, std::chrono::steady_clock::time_point passStart)
+    {
+        std::vector<uint32_t> batch;
+        while (m_device && !IsOverBudget())
+        {
+            // Until the workers finish a tile this pass, the CPU's rate is the last pass's.
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - passStart).count();
+            double cpuRate = cpuSamples > 0 && elapsed > 0.0 ? cpuSamples / elapsed : m_cpuRate;
+            double deviceRate = m_stats.deviceSeconds > 0.0 ? m_stats.deviceSamples / m_stats.deviceSeconds : 0.0;
+            queue.PopBack(deviceRate, cpuRate, kDeviceBatchSeconds, batch);
+            if (batch.empty())
+                return;
+            BakeOnDevice(batch);
+            Checkpoint(false);
+        }
+    }
+
+    void BakeEngine::BakeOnDevice(std::span<const uint32_t> tiles)
+    {
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> targets;
+        std::vector<TexelAccumulator> accumulators;
+        for (uint32_t tileIndex : tiles)
+        {
+            const Tile& tile = m_tiles[tileIndex];
+            for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + m_settings.tileSize); ++y)
+            {
+                for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + m_settings.tileSize); ++x)
+                {
+                    size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                    if (!m_texels.IsCovered(index))
+                        continue;
+                    uint32_t count = GetPassSamples(m_accumulators[index]);
+                    if (count == 0)
+                        continue;
+                    indices.push_back(static_cast<uint32_t>(index));
+                    targets.push_back(m_accumulators[index].sampleCount + count);
+                    accumulators.push_back(m_accumulators[index]);
+                }
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!m_device->BakeTexels(indices, targets, accumulators))
+        {
+            // A failed device sits out the rest of the bake and its batch goes to the CPU.
+            m_device = nullptr;
+            for (uint32_t tileIndex : tiles)
+                BakeTile(m_tiles[tileIndex], m_threadPool.get_thread_count());
+            return;
+        }
+        m_stats.deviceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t taken = 0;
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            taken += accumulators[i].sampleCount - m_accumulators[indices[i]].sampleCount;
+            m_accumulators[indices[i]] = accumulators[i];
+        }
+        m_samplesTaken += taken;
+        m_stats.deviceSamples += taken;
+        m_stats.deviceBatches++;
+        if (m_output.IsOpen())
+            for (uint32_t tileIndex : tiles)
+                if (!TileNeedsSamples(m_tiles[tileIndex]))
+                    WriteTile(tileIndex);
+    }
+
+    void BakeEngine::WriteTile(uint32_t tileIndex)
+    {
+        if (m_tileWritten[tileIndex])
+            return;
+        m_tileWritten[tileIndex] = 1;
+        const Tile& tile = m_tiles[tileIndex];
+        uint32_t tileSize = m_settings.tileSize;
+        std::vector<glm::vec4> pixels(static_cast<size_t>(tileSize) * tileSize, glm::vec4(0.0f));
+        for (uint32_t y = tile.y; y < std::min(m_texels.height, tile.y + tileSize); ++y)
+        {
+            for (uint32_t x = tile.x; x < std::min(m_texels.width, tile.x + tileSize); ++x)
+            {
+                size_t index = m_texels.GetIndex(tile.atlasIndex, x, y);
+                const TexelAccumulator& accumulator = m_accumulators[index];
+                if (m_texels.IsCovered(index) && accumulator.sampleCount > 0)
+                    pixels[static_cast<size_t>(y - tile.y) * tileSize + (x - tile.x)] =
+                        glm::vec4(accumulator.irradianceSum / static_cast<float>(accumulator.sampleCount), 1.0f);
+            }
+        }
+        m_output.WriteTile(tile.atlasIndex, tile.x / tileSize, tile.y / tileSize, pixels.data());
+    }
+
+    glm::vec3 BakeEngine::SampleTexel(const TexelRecord& texel, size_t texelIndex, uint32_t x, uint32_t y, uint32_t sampleIndex,
+                                      glm::vec4& directionalSum) const
+    {
+        // Each guide generation gets its own scramble: it was learnt from the texel's earlier
+        // samples, and later points of the same sequence are stratified against those. The
+        // blue-noise sequence is shared by every texel, so guiding uses plain Sobol instead.
+        uint64_t sequence = texelIndex;
+        SamplerType samplerType = m_settings.sampler;
+        if (m_guide)
+        {
+            sequence += static_cast<uint64_t>(m_guide->GetGeneration()) << 32;
+            if (samplerType == SamplerType::BlueNoise)
+                samplerType = SamplerType::Sobol;
+        }
+        Sampler sampler(samplerType, sequence, sampleIndex, x, y, &m_blueNoise);
+        glm::vec3 lightDirection;
+        glm::vec3 direct = m_directReservoirs ? m_directReservoirs->Estimate(texelIndex, x, y, sampler, lightDirection)
+                                              : m_integrator.DirectIrradiance(texel.position, texel.normal, sampler, lightDirection);
+
+        // Indirect: cosine sampling turns the irradiance integral into pi * L.
+        glm::vec3 origin = texel.position + texel.normal * m_tracer.GetEpsilon();
+        glm::vec2 u = sampler.Next2D();
+        uint32_t cell = m_guide ? m_guide->GetTexelCell(texelIndex) : PathGuide::kNoCell;
+        glm::vec3 direction;
+        glm::vec3 indirect(0.0f);
+        if (m_guide && m_guide->IsGuiding(cell))
+        {
+            // A guided direction weighs by cos / pdf of the guide's mixture instead.
+            float pdf;
+            direction = m_guide->Sample(cell, texel.normal, u, pdf);
+            float cosine = glm::dot(texel.normal, direction);
+            if (cosine > 0.0f && pdf > 0.0f)
+                indirect = m_integrator.Radiance(origin, texel.normal, direction, m_settings.maxBounces, true, sampler) * (cosine / pdf);
+        }
+        else
+        {
+            direction = SampleCosineHemisphere(texel.normal, u.x, u.y);
+            indirect = kPi * m_integrator.Radiance(origin, texel.normal, direction, m_settings.maxBounces, true, sampler);
+        }
+        if (m_guide)
+            m_guide->Record(cell, direction, Luminance(indirect));
+
+        if (m_settings.directional)
+        {
+            AccumulateDirectional(directionalSum, texel.normal, lightDirection, direct);
+            AccumulateDirectional(directionalSum, texel.normal, direction, indirect);
+        }
+        return direct + indirect;
+    }
+}
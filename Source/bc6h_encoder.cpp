@@ -0,0 +1,620 @@
+#include "Bake/bc6h_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <bvh/v2/executor.h>
+#include <glm/gtc/packing.hpp>
+#include "Utility/simd.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr int kEndpointBits = 10;
+        constexpr int kEndpointMax = (1 << kEndpointBits) - 1;
+        constexpr int kDeltaMin = -16;
+        constexpr int kDeltaMax = 15;
+        // Largest finite half, as bits; also what the largest endpoint decodes to.
+        constexpr int kMaxHalfBits = 0x7BFF;
+        constexpr uint32_t kOneRegionMode = 0x03;
+        constexpr uint32_t kTwoRegionMode = 0x00;
+        // Texels no chart covers only break ties in the endpoint fit.
+        constexpr float kGutterWeight = 1e-3f;
+        constexpr int kRefineIterations = 2;
+        // Blocks whose one-region error is below a squared half-float step per texel skip the partition search.
+        constexpr float kTwoRegionThreshold = 16.0f;
+
+        constexpr int kWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+        constexpr int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        // Two-region partitions: bit i set puts texel i (row-major) in region 1.
+        constexpr uint16_t kPartitions[32] = {
+            0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+            0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+        };
+        // Texel whose index drops its top bit in region 1; region 0's is texel 0.
+        constexpr uint8_t kAnchors[32] = {
+            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+        };
+
+        /**
+         * A 4x4 block as half-float bits per channel, the domain BC6H
+         * interpolates in, plus each texel's fitting weight.
+         */
+        struct Block
+        {
+            alignas(16) float bits[3][16];
+            alignas(16) float weight[16];
+        };
+
+        struct Encoding
+        {
+            float error = std::numeric_limits<float>::max();
+            // -1 for one region.
+            int partition = -1;
+            glm::ivec3 endpoints[2][2];
+            uint8_t indices[16] = {};
+        };
+
+        int Unquantize(int value)
+        {
+            if (value == 0)
+                return 0;
+            if (value == kEndpointMax)
+                return 0xFFFF;
+            return ((value << 16) + 0x8000) >> kEndpointBits;
+        }
+
+        // Interpolates unquantized endpoints and scales the result back to half bits.
+        int Interpolate(int a, int b, int weight)
+        {
+            return (((a * (64 - weight) + b * weight + 32) >> 6) * 31) >> 6;
+        }
+
+        glm::ivec3 Quantize(const glm::vec3& bits)
+        {
+            glm::ivec3 result;
+            for (int c = 0; c < 3; ++c)
+            {
+                float target = std::clamp(bits[c], 0.0f, static_cast<float>(kMaxHalfBits));
+                int guess = std::clamp(static_cast<int>(target * (64.0f / 31.0f) * (1 << kEndpointBits) / 65536.0f), 0, kEndpointMax);
+                // The rounding in Unquantize and Interpolate makes the neighbours worth a look.
+                int best = guess;
+                float bestError = std::numeric_limits<float>::max();
+                for (int candidate = std::max(guess - 1, 0); candidate <= std::min(guess + 1, kEndpointMax); ++candidate)
+                {
+                    float error = std::abs(static_cast<float>(Interpolate(Unquantize(candidate), 0, 0)) - target);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = candidate;
+                    }
+                }
+                result[c] = best;
+            }
+            return result;
+        }
+
+        struct Palette
+        {
+            float bits[3][16];
+            int count;
+        };
+
+        Palette MakePalette(const glm::ivec3& a, const glm::ivec3& b, int count)
+        {
+            Palette palette;
+            palette.count = count;
+            const int* weights = count == 16 ? kWeights4 : kWeights3;
+            for (int c = 0; c < 3; ++c)
+                for (int i = 0; i < count; ++i)
+                    palette.bits[c][i] = static_cast<float>(Interpolate(Unquantize(a[c]), Unquantize(b[c]), weights[i]));
+            return palette;
+        }
+
+        float TexelError(const Block& block, const Palette& palette, int texel, int entry)
+        {
+            float error = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float d = block.bits[c][texel] - palette.bits[c][entry];
+                error += d * d;
+            }
+            return error;
+        }
+
+        /**
+         * Picks the nearest palette entry for the texels in `mask`, four at
+         * a time, and returns their weighted squared error. An `anchor`
+         * texel (or -1) is kept to the lower half of the palette.
+         */
+        float AssignIndices(const Block& block, const float* weights, uint16_t mask, const Palette& palette, int anchor, uint8_t* indices)
+        {
+            float error = 0.0f;
+            for (int group = 0; group < 4; ++group)
+            {
+                if (((mask >> (group * 4)) & 0xF) == 0)
+                    continue;
+                Float4 channels[3];
+                for (int c = 0; c < 3; ++c)
+                    channels[c] = Float4::Load(&block.bits[c][group * 4]);
+                Float4 best(std::numeric_limits<float>::max());
+                Float4 bestIndex(0.0f);
+                for (int entry = 0; entry < palette.count; ++entry)
+                {
+                    Float4 d0 = channels[0] - Float4(palette.bits[0][entry]);
+                    Float4 d1 = channels[1] - Float4(palette.bits[1][entry]);
+                    Float4 d2 = channels[2] - Float4(palette.bits[2][entry]);
+                    Float4 distance = MulAdd(d2, d2, MulAdd(d1, d1, d0 * d0));
+                    Float4 closer = distance < best;
+                    best = Select(closer, distance, best);
+                    bestIndex = Select(closer, Float4(static_cast<float>(entry)), bestIndex);
+                }
+                error += ReduceAdd(best * Float4::Load(&weights[group * 4]));
+                float lanes[4];
+                bestIndex.Store(lanes);
+                for (int lane = 0; lane < 4; ++lane)
+                    if (mask & (1u << (group * 4 + lane)))
+                        indices[group * 4 + lane] = static_cast<uint8_t>(lanes[lane]);
+            }
+            if (anchor >= 0 && indices[anchor] >= palette.count / 2)
+            {
+                float previous = TexelError(block, palette, anchor, indices[anchor]);
+                float best = std::numeric_limits<float>::max();
+                for (int entry = 0; entry < palette.count / 2; ++entry)
+                {
+                    float candidate = TexelError(block, palette, anchor, entry);
+                    if (candidate < best)
+                    {
+                        best = candidate;
+                        indices[anchor] = static_cast<uint8_t>(entry);
+                    }
+                }
+                error += (best - previous) * weights[anchor];
+            }
+            return error;
+        }
+
+        /**
+         * Endpoints spanning the weighted texels along their principal axis.
+         */
+        void FitEndpoints(const Block& block, const float* weights, glm::vec3& low, glm::vec3& high)
+        {
+            Float4 weightSum(0.0f);
+            Float4 sums[3] = { Float4(0.0f), Float4(0.0f), Float4(0.0f) };
+            for (int group = 0; group < 4; ++group)
+            {
+                Float4 weight = Float4::Load(&weights[group * 4]);
+                weightSum = weightSum + weight;
+                for (int c = 0; c < 3; ++c)
+                    sums[c] = MulAdd(weight, Float4::Load(&block.bits[c][group * 4]), sums[c]);
+            }
+            float total = ReduceAdd(weightSum);
+            glm::vec3 mean = glm::vec3(ReduceAdd(sums[0]), ReduceAdd(sums[1]), ReduceAdd(sums[2])) / total;
+
+            Float4 covariance[6] = { Float4(0.0f), Float4(0.0f), Float4(0.0f), Float4(0.0f), Float4(0.0f), Float4(0.0f) };
+            for (int group = 0; group < 4; ++group)
+            {
+                Float4 weight = Float4::Load(&weights[group * 4]);
+                Float4 d[3];
+                for (int c = 0; c < 3; ++c)
+                    d[c] = Float4::Load(&block.bits[c][group * 4]) - Float4(mean[c]);
+                covariance[0] = MulAdd(weight * d[0], d[0], covariance[0]);
+                covariance[1] = MulAdd(weight * d[0], d[1], covariance[1]);
+                covariance[2] = MulAdd(weight * d[0], d[2], covariance[2]);
+                covariance[3] = MulAdd(weight * d[1], d[1], covariance[3]);
+                covariance[4] = MulAdd(weight * d[1], d[2], covariance[4]);
+                covariance[5] = MulAdd(weight * d[2], d[2], covariance[5]);
+            }
+            float c[6];
+            for (int i = 0; i < 6; ++i)
+                c[i] = ReduceAdd(covariance[i]);
+            glm::mat3 matrix(c[0], c[1], c[2], c[1], c[3], c[4], c[2], c[4], c[5]);
+            glm::vec3 axis(1.0f);
+            for (int i = 0; i < 8; ++i)
+            {
+                glm::vec3 next = matrix * axis;
+                float length = glm::length(next);
+                if (length <= 1e-12f)
+                    break;
+                axis = next / length;
+            }
+            axis = glm::normalize(axis);
+
+            Float4 lowest(std::numeric_limits<float>::max());
+            Float4 highest(-std::numeric_limits<float>::max());
+            for (int group = 0; group < 4; ++group)
+            {
+                Float4 t = (Float4::Load(&block.bits[0][group * 4]) - Float4(mean.x)) * Float4(axis.x);
+                t = MulAdd(Float4::Load(&block.bits[1][group * 4]) - Float4(mean.y), Float4(axis.y), t);
+                t = MulAdd(Float4::Load(&block.bits[2][group * 4]) - Float4(mean.z), Float4(axis.z), t);
+                Float4 used = Float4::Load(&weights[group * 4]) > Float4(0.0f);
+                lowest = Min(lowest, Select(used, t, Float4(std::numeric_limits<float>::max())));
+                highest = Max(highest, Select(used, t, Float4(-std::numeric_limits<float>::max())));
+            }
+            float lanes[2][4];
+            lowest.Store(lanes[0]);
+            highest.Store(lanes[1]);
+            float tMin = std::min(std::min(lanes[0][0], lanes[0][1]), std::min(lanes[0][2], lanes[0][3]));
+            float tMax = std::max(std::max(lanes[1][0], lanes[1][1]), std::max(lanes[1][2], lanes[1][3]));
+            low = mean + axis * tMin;
+            high = mean + axis * tMax;
+        }
+
+        /**
+         * Least-squares endpoints for fixed indices; false when the indices
+         * do not pin both endpoints down.
+         */
+        bool RefitEndpoints(const Block& block, const float* weights, uint16_t mask, const uint8_t* indices, int count, glm::vec3& low, glm::vec3& high)
+        {
+            const int* table = count == 16 ? kWeights4 : kWeights3;
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            glm::vec3 ax(0.0f), bx(0.0f);
+            for (int i = 0; i < 16; ++i)
+            {
+                if (!(mask & (1u << i)))
+                    continue;
+                float t = table[indices[i]] / 64.0f;
+                float s = 1.0f - t;
+                glm::vec3 x(block.bits[0][i], block.bits[1][i], block.bits[2][i]);
+                aa += weights[i] * s * s;
+                ab += weights[i] * s * t;
+                bb += weights[i] * t * t;
+                ax += weights[i] * s * x;
+                bx += weights[i] * t * x;
+            }
+            float determinant = aa * bb - ab * ab;
+            if (std::abs(determinant) <= 1e-6f * aa * bb)
+                return false;
+            low = (bb * ax - ab * bx) / determinant;
+            high = (aa * bx - ab * ax) / determinant;
+            return true;
+        }
+
+        /**
+         * Quantized endpoints, indices and error of one region, refined by
+         * least squares as long as that lowers the error.
+         */
+        float EncodeRegion(const Block& block, const float* weights, uint16_t mask, int count, bool refine, glm::ivec3& a, glm::ivec3& b, uint8_t* indices)
+        {
+            glm::vec3 low, high;
+            FitEndpoints(block, weights, low, high);
+            a = Quantize(low);
+            b = Quantize(high);
+            float error = AssignIndices(block, weights, mask, MakePalette(a, b, count), -1, indices);
+            for (int iteration = 0; refine && iteration < kRefineIterations; ++iteration)
+            {
+                if (!RefitEndpoints(block, weights, mask, indices, count, low, high))
+                    break;
+                glm::ivec3 refitA = Quantize(low);
+                glm::ivec3 refitB = Quantize(high);
+                uint8_t refitIndices[16];
+                std::memcpy(refitIndices, indices, sizeof(refitIndices));
+                float refitError = AssignIndices(block, weights, mask, MakePalette(refitA, refitB, count), -1, refitIndices);
+                if (refitError >= error)
+                    break;
+                error = refitError;
+                a = refitA;
+                b = refitB;
+                std::memcpy(indices, refitIndices, sizeof(refitIndices));
+            }
+            return error;
+        }
+
+        // The anchor texel's index has an implicit zero top bit; mirroring the palette keeps the error.
+        void FixAnchor(uint16_t mask, int anchor, int count, glm::ivec3& a, glm::ivec3& b, uint8_t* indices)
+        {
+            if (indices[anchor] < count / 2)
+                return;
+            std::swap(a, b);
+            for (int i = 0; i < 16; ++i)
+                if (mask & (1u << i))
+                    indices[i] = static_cast<uint8_t>(count - 1 - indices[i]);
+        }
+
+        Encoding EncodeOneRegion(const Block& block, bool refine)
+        {
+            Encoding encoding;
+            encoding.error = EncodeRegion(block, block.weight, 0xFFFF, 16, refine, encoding.endpoints[0][0], encoding.endpoints[0][1], encoding.indices);
+            FixAnchor(0xFFFF, 0, 16, encoding.endpoints[0][0], encoding.endpoints[0][1], encoding.indices);
+            return encoding;
+        }
+
+        Encoding EncodeTwoRegions(const Block& block, int partition, bool refine)
+        {
+            Encoding encoding;
+            encoding.partition = partition;
+            uint16_t masks[2] = { static_cast<uint16_t>(~kPartitions[partition]), kPartitions[partition] };
+            int anchors[2] = { 0, kAnchors[partition] };
+            alignas(16) float weights[2][16];
+            for (int region = 0; region < 2; ++region)
+                for (int i = 0; i < 16; ++i)
+                    weights[region][i] = (masks[region] & (1u << i)) ? block.weight[i] : 0.0f;
+
+            encoding.error = 0.0f;
+            for (int region = 0; region < 2; ++region)
+            {
+                glm::ivec3& a = encoding.endpoints[region][0];
+                glm::ivec3& b = encoding.endpoints[region][1];
+                encoding.error += EncodeRegion(block, weights[region], masks[region], 8, refine, a, b, encoding.indices);
+                FixAnchor(masks[region], anchors[region], 8, a, b, encoding.indices);
+            }
+
+            // The other endpoints are stored as 5-bit deltas from the first; clamp those that do not fit.
+            const glm::ivec3 base = encoding.endpoints[0][0];
+            bool clamped = false;
+            for (int endpoint = 1; endpoint < 4; ++endpoint)
+            {
+                glm::ivec3& value = encoding.endpoints[endpoint / 2][endpoint % 2];
+                glm::ivec3 fitted = glm::clamp(value, base + glm::ivec3(kDeltaMin), base + glm::ivec3(kDeltaMax));
+                fitted = glm::clamp(fitted, glm::ivec3(0), glm::ivec3(kEndpointMax));
+                clamped |= fitted != value;
+                value = fitted;
+            }
+            if (clamped)
+            {
+                encoding.error = 0.0f;
+                for (int region = 0; region < 2; ++region)
+                {
+                    Palette palette = MakePalette(encoding.endpoints[region][0], encoding.endpoints[region][1], 8);
+                    encoding.error += AssignIndices(block, weights[region], masks[region], palette, anchors[region], encoding.indices);
+                }
+            }
+            return encoding;
+        }
+
+        class BitWriter
+        {
+        public:
+            void Write(uint32_t value, int count)
+            {
+                for (int i = 0; i < count; ++i, ++m_position)
+                    if ((value >> i) & 1u)
+                        m_bits[m_position >> 6] |= 1ull << (m_position & 63);
+            }
+
+            void Store(uint8_t* block) const { std::memcpy(block, m_bits, 16); }
+
+        private:
+            uint64_t m_bits[2] = {};
+            int m_position = 0;
+        };
+
+        class BitReader
+        {
+        public:
+            explicit BitReader(const uint8_t* block) { std::memcpy(m_bits, block, 16); }
+
+            uint32_t Read(int count)
+            {
+                uint32_t value = 0;
+                for (int i = 0; i < count; ++i, ++m_position)
+                    value |= static_cast<uint32_t>((m_bits[m_position >> 6] >> (m_position & 63)) & 1u) << i;
+                return value;
+            }
+
+        private:
+            uint64_t m_bits[2];
+            int m_position = 0;
+        };
+
+        void Pack(const Encoding& encoding, uint8_t* block)
+        {
+            BitWriter writer;
+            if (encoding.partition < 0)
+            {
+                writer.Write(kOneRegionMode, 5);
+                for (int endpoint = 0; endpoint < 2; ++endpoint)
+                    for (int c = 0; c < 3; ++c)
+                        writer.Write(static_cast<uint32_t>(encoding.endpoints[0][endpoint][c]), kEndpointBits);
+                for (int i = 0; i < 16; ++i)
+                    writer.Write(encoding.indices[i], i == 0 ? 3 : 4);
+                writer.Store(block);
+                return;
+            }
+
+            // Mode 1 scatters the top bits of the deltas between the other fields.
+            const glm::ivec3& w = encoding.endpoints[0][0];
+            glm::uvec3 x = glm::uvec3(encoding.endpoints[0][1] - w) & 31u;
+            glm::uvec3 y = glm::uvec3(encoding.endpoints[1][0] - w) & 31u;
+            glm::uvec3 z = glm::uvec3(encoding.endpoints[1][1] - w) & 31u;
+            writer.Write(kTwoRegionMode, 2);
+            writer.Write(y.g >> 4, 1);
+            writer.Write(y.b >> 4, 1);
+            writer.Write(z.b >> 4, 1);
+            for (int c = 0; c < 3; ++c)
+                writer.Write(static_cast<uint32_t>(w[c]), kEndpointBits);
+            writer.Write(x.r, 5);
+            writer.Write(z.g >> 4, 1);
+            writer.Write(y.g, 4);
+            writer.Write(x.g, 5);
+            writer.Write(z.b, 1);
+            writer.Write(z.g, 4);
+            writer.Write(x.b, 5);
+            writer.Write(z.b >> 1, 1);
+            writer.Write(y.b, 4);
+            writer.Write(y.r, 5);
+            writer.Write(z.b >> 2, 1);
+            writer.Write(z.r, 5);
+            writer.Write(z.b >> 3, 1);
+            writer.Write(static_cast<uint32_t>(encoding.partition), 5);
+            int anchor = kAnchors[encoding.partition];
+            for (int i = 0; i < 16; ++i)
+                writer.Write(encoding.indices[i], i == 0 || i == anchor ? 2 : 3);
+            writer.Store(block);
+        }
+
+        void LoadBlock(const Lightmap& lightmap, uint32_t atlas, uint32_t blockX, uint32_t blockY, Block& block)
+        {
+            bool anyCovered = false;
+            for (int i = 0; i < 16; ++i)
+            {
+                // Blocks overhanging the page edge repeat its last row and column.
+                uint32_t x = std::min(blockX * 4 + i % 4, lightmap.width - 1);
+                uint32_t y = std::min(blockY * 4 + i / 4, lightmap.height - 1);
+                const glm::vec4& texel = lightmap.texels[lightmap.GetIndex(atlas, x, y)];
+                for (int c = 0; c < 3; ++c)
+                {
+                    float value = std::clamp(texel[c], 0.0f, 65504.0f);
+                    block.bits[c][i] = static_cast<float>(glm::packHalf1x16(value == value ? value : 0.0f));
+                }
+                block.weight[i] = texel.w > 0.0f ? 1.0f : kGutterWeight;
+                anyCovered |= texel.w > 0.0f;
+            }
+            if (!anyCovered)
+                std::fill(block.weight, block.weight + 16, 1.0f);
+        }
+    }
+
+    Bc6hEncoder::Bc6hEncoder(const Bc6hSettings& settings)
+        : m_settings(settings)
+    {
+    }
+
+    Bc6hLightmap Bc6hEncoder::Encode(const Lightmap& lightmap, bvh::v2::ThreadPool& threadPool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_stats = Bc6hStats();
+        Bc6hLightmap result;
+        result.width = lightmap.width;
+        result.height = lightmap.height;
+        result.atlasCount = lightmap.atlasCount;
+        if (lightmap.width == 0 || lightmap.height == 0 || lightmap.atlasCount == 0)
+            return result;
+
+        uint32_t blocksX = result.GetBlocksX();
+        uint32_t blockRows = result.GetBlocksY() * lightmap.atlasCount;
+        result.blocks.resize(result.GetPageSize() * lightmap.atlasCount);
+        bool high = m_settings.quality == Bc6hQuality::High;
+        std::vector<uint32_t> twoRegionRows(blockRows, 0);
+        // Squared error and largest value over the baked texels of every row of blocks.
+        std::vector<double> rowErrors(blockRows, 0.0);
+        std::vector<size_t> rowTexels(blockRows, 0);
+        std::vector<float> rowPeaks(blockRows, 0.0f);
+
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        executor.for_each(0, blockRows, [&](size_t begin, size_t end) {
+            Block block;
+            glm::vec3 decoded[16];
+            for (size_t row = begin; row < end; ++row)
+            {
+                uint32_t atlas = static_cast<uint32_t>(row / result.GetBlocksY());
+                uint32_t blockY = static_cast<uint32_t>(row % result.GetBlocksY());
+                for (uint32_t blockX = 0; blockX < blocksX; ++blockX)
+                {
+                    LoadBlock(lightmap, atlas, blockX, blockY, block);
+                    Encoding best = EncodeOneRegion(block, high);
+                    for (int partition = 0; high && best.error > kTwoRegionThreshold && partition < 32; ++partition)
+                    {
+                        Encoding candidate = EncodeTwoRegions(block, partition, true);
+                        if (candidate.error < best.error)
+                            best = candidate;
+                    }
+                    uint8_t* target = &result.blocks[(row * blocksX + blockX) * 16];
+                    Pack(best, target);
+                    twoRegionRows[row] += best.partition >= 0 ? 1 : 0;
+
+                    DecodeBc6hBlock(target, decoded);
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        uint32_t x = blockX * 4 + i % 4;
+                        uint32_t y = blockY * 4 + i / 4;
+                        if (x >= lightmap.width || y >= lightmap.height)
+                            continue;
+                        const glm::vec4& texel = lightmap.texels[lightmap.GetIndex(atlas, x, y)];
+                        if (texel.w <= 0.0f)
+                            continue;
+                        glm::vec3 difference = decoded[i] - glm::vec3(texel);
+                        rowErrors[row] += glm::dot(difference, difference);
+                        rowTexels[row]++;
+                        rowPeaks[row] = std::max(rowPeaks[row], std::max(texel.x, std::max(texel.y, texel.z)));
+                    }
+                }
+            }
+        });
+
+        double error = 0.0;
+        size_t texels = 0;
+        float peak = 0.0f;
+        for (uint32_t row = 0; row < blockRows; ++row)
+        {
+            m_stats.twoRegionBlocks += twoRegionRows[row];
+            error += rowErrors[row];
+            texels += rowTexels[row];
+            peak = std::max(peak, rowPeaks[row]);
+        }
+        m_stats.blocks = static_cast<size_t>(blocksX) * blockRows;
+        double meanSquaredError = texels > 0 ? error / (3.0 * texels) : 0.0;
+        m_stats.psnr = meanSquaredError > 0.0 ? 10.0 * std::log10(static_cast<double>(peak) * peak / meanSquaredError) : 0.0;
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    bool DecodeBc6hBlock(const uint8_t* block, glm::vec3 texels[16])
+    {
+        BitReader reader(block);
+        glm::ivec3 endpoints[2][2];
+        int partition = -1;
+        uint32_t mode = reader.Read(2);
+        if (mode == kTwoRegionMode)
+        {
+            glm::uvec3 w, x, y, z;
+            y.g = reader.Read(1) << 4;
+            y.b = reader.Read(1) << 4;
+            z.b = reader.Read(1) << 4;
+            w.r = reader.Read(kEndpointBits);
+            w.g = reader.Read(kEndpointBits);
+            w.b = reader.Read(kEndpointBits);
+            x.r = reader.Read(5);
+            z.g = reader.Read(1) << 4;
+            y.g |= reader.Read(4);
+            x.g = reader.Read(5);
+            z.b |= reader.Read(1);
+            z.g |= reader.Read(4);
+            x.b = reader.Read(5);
+            z.b |= reader.Read(1) << 1;
+            y.b |= reader.Read(4);
+            y.r = reader.Read(5);
+            z.b |= reader.Read(1) << 2;
+            z.r = reader.Read(5);
+            z.b |= reader.Read(1) << 3;
+            partition = static_cast<int>(reader.Read(5));
+            // Deltas are signed even in the unsigned format; sums wrap to the endpoint precision.
+            auto apply = [&](const glm::uvec3& delta) {
+                glm::ivec3 signedDelta = glm::ivec3(delta ^ 16u) - 16;
+                return (glm::ivec3(w) + signedDelta) & kEndpointMax;
+            };
+            endpoints[0][0] = glm::ivec3(w);
+            endpoints[0][1] = apply(x);
+            endpoints[1][0] = apply(y);
+            endpoints[1][1] = apply(z);
+        }
+        else if ((mode | (reader.Read(3) << 2)) == kOneRegionMode)
+        {
+            for (int endpoint = 0; endpoint < 2; ++endpoint)
+                for (int c = 0; c < 3; ++c)
+                    endpoints[0][endpoint][c] = static_cast<int>(reader.Read(kEndpointBits));
+        }
+        else
+        {
+            return false;
+        }
+
+        int indexBits = partition < 0 ? 4 : 3;
+        int anchor = partition < 0 ? 0 : kAnchors[partition];
+        const int* weights = partition < 0 ? kWeights4 : kWeights3;
+        for (int i = 0; i < 16; ++i)
+        {
+            int index = static_cast<int>(reader.Read(i == 0 || i == anchor ? indexBits - 1 : indexBits));
+            int region = partition < 0 ? 0 : (kPartitions[partition] >> i) & 1;
+            const glm::ivec3& a = endpoints[region][0];
+            const glm::ivec3& b = endpoints[region][1];
+            for (int c = 0; c < 3; ++c)
+                texels[i][c] = glm::unpackHalf1x16(static_cast<uint16_t>(Interpolate(Unquantize(a[c]), Unquantize(b[c]), weights[index])));
+        }
+        return true;
+    }
+}
@@ -0,0 +1,262 @@
+#include "Bake/denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <bvh/v2/executor.h>
+#include "Bake/sampling.h"
+#include "Utility/simd.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // B3-spline taps of the A-Trous kernel.
+        constexpr float kKernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+        // Relative error assumed for every texel when the bake provides no variance.
+        constexpr float kFallbackRelativeError = 0.1f;
+        constexpr float kLuminanceEpsilon = 1e-4f;
+
+        /**
+         * Structure-of-arrays copy of the lightmap and its feature buffers.
+         * Rows are padded on both sides with empty texels (chart -1), so the
+         * four-wide loads of horizontal taps never need bounds checks.
+         */
+        struct Planes
+        {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t pad = 0;
+            uint32_t stride = 0;
+
+            std::vector<float> color[2][3];
+            std::vector<float> variance[2];
+            std::vector<float> normal[3];
+            std::vector<float> position[3];
+            std::vector<float> albedo[3];
+            // Chart index as float, -1 for empty texels; exact for fewer than 2^24 charts.
+            std::vector<float> chart;
+
+            size_t GetIndex(uint32_t atlas, uint32_t x, uint32_t y) const
+            {
+                return (static_cast<size_t>(atlas) * height + y) * stride + pad + x;
+            }
+        };
+
+        Float4 LoadLuminance(const std::vector<float>* color, size_t index)
+        {
+            Float4 luminance = Float4::Load(&color[0][index]) * Float4(0.2126f);
+            luminance = MulAdd(Float4::Load(&color[1][index]), Float4(0.7152f), luminance);
+            return MulAdd(Float4::Load(&color[2][index]), Float4(0.0722f), luminance);
+        }
+
+        Float4 Equal(Float4 a, Float4 b) { return (a >= b) & (a <= b); }
+
+        /**
+         * Mean world-space distance between horizontally adjacent texels of
+         * the same chart.
+         */
+        float EstimateTexelSpacing(const TexelBuffer& texels)
+        {
+            double sum = 0.0;
+            size_t count = 0;
+            for (uint32_t atlas = 0; atlas < texels.atlasCount; ++atlas)
+            {
+                for (uint32_t y = 0; y < texels.height; ++y)
+                {
+                    for (uint32_t x = 0; x + 1 < texels.width; ++x)
+                    {
+                        size_t index = texels.GetIndex(atlas, x, y);
+                        if (!texels.IsCovered(index) || texels.charts[index] != texels.charts[index + 1])
+                            continue;
+                        sum += glm::length(texels.texels[index + 1].position - texels.texels[index].position);
+                        count++;
+                    }
+                }
+            }
+            return count > 0 ? static_cast<float>(sum / count) : 1.0f;
+        }
+    }
+
+    Denoiser::Denoiser(const DenoiseSettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.tileSize = std::max(4u, m_settings.tileSize & ~3u);
+    }
+
+    void Denoiser::Denoise(Lightmap& lightmap, const std::vector<float>& variance, const TexelBuffer& texels, const Scene& scene,
+                           bvh::v2::ThreadPool& threadPool) const
+    {
+        if (m_settings.iterations == 0 || texels.texels.empty())
+            return;
+
+        std::vector<uint32_t> triangleMaterials;
+        for (const Mesh& mesh : scene.meshes)
+            triangleMaterials.insert(triangleMaterials.end(), mesh.GetTriangleCount(), mesh.materialIndex);
+
+        Planes planes;
+        planes.width = texels.width;
+        planes.height = texels.height;
+        // Widest tap offset plus a full vector, so groups overhanging the row end stay inside the padding.
+        planes.pad = (2u << (m_settings.iterations - 1)) + 4;
+        planes.stride = planes.width + 2 * planes.pad;
+        size_t planeSize = static_cast<size_t>(texels.atlasCount) * planes.height * planes.stride;
+        for (int c = 0; c < 3; ++c)
+        {
+            planes.color[0][c].assign(planeSize, 0.0f);
+            planes.color[1][c].assign(planeSize, 0.0f);
+            planes.normal[c].assign(planeSize, 0.0f);
+            planes.position[c].assign(planeSize, 0.0f);
+            planes.albedo[c].assign(planeSize, 0.0f);
+        }
+        planes.variance[0].assign(planeSize, 0.0f);
+        planes.variance[1].assign(planeSize, 0.0f);
+        planes.chart.assign(planeSize, -1.0f);
+
+        for (uint32_t atlas = 0; atlas < texels.atlasCount; ++atlas)
+        {
+            for (uint32_t y = 0; y < texels.height; ++y)
+            {
+                for (uint32_t x = 0; x < texels.width; ++x)
+                {
+                    size_t source = texels.GetIndex(atlas, x, y);
+                    if (!texels.IsCovered(source) || lightmap.texels[source].w <= 0.0f)
+                        continue;
+                    size_t target = planes.GetIndex(atlas, x, y);
+                    const TexelRecord& texel = texels.texels[source];
+                    glm::vec3 color(lightmap.texels[source]);
+                    uint32_t material = texel.triangleId < triangleMaterials.size() ? triangleMaterials[texel.triangleId] : 0;
+                    glm::vec3 albedo = scene.GetMaterial(material).albedo;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        planes.color[0][c][target] = color[c];
+                        planes.normal[c][target] = texel.normal[c];
+                        planes.position[c][target] = texel.position[c];
+                        planes.albedo[c][target] = albedo[c];
+                    }
+                    float relative = kFallbackRelativeError * Luminance(color);
+                    planes.variance[0][target] = variance.empty() ? relative * relative : variance[source];
+                    planes.chart[target] = static_cast<float>(texels.charts[source]);
+                }
+            }
+        }
+
+        float invPlaneSigma = 1.0f / (m_settings.planeSigma * EstimateTexelSpacing(texels));
+        float invAlbedoSigmaSquared = 1.0f / (m_settings.albedoSigma * m_settings.albedoSigma);
+        uint32_t tileSize = m_settings.tileSize;
+        uint32_t tilesX = (planes.width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (planes.height + tileSize - 1) / tileSize;
+        size_t tileCount = static_cast<size_t>(texels.atlasCount) * tilesX * tilesY;
+
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        for (uint32_t iteration = 0; iteration < m_settings.iterations; ++iteration)
+        {
+            const int step = 1 << iteration;
+            const std::vector<float>* source = planes.color[iteration & 1];
+            std::vector<float>* target = planes.color[(iteration + 1) & 1];
+            const std::vector<float>& sourceVariance = planes.variance[iteration & 1];
+            std::vector<float>& targetVariance = planes.variance[(iteration + 1) & 1];
+
+            executor.for_each(0, tileCount, [&](size_t begin, size_t end) {
+                for (size_t tile = begin; tile < end; ++tile)
+                {
+                    uint32_t atlas = static_cast<uint32_t>(tile / (static_cast<size_t>(tilesX) * tilesY));
+                    uint32_t tileX = static_cast<uint32_t>(tile % tilesX) * tileSize;
+                    uint32_t tileY = static_cast<uint32_t>((tile / tilesX) % tilesY) * tileSize;
+                    for (uint32_t y = tileY; y < std::min(planes.height, tileY + tileSize); ++y)
+                    {
+                        for (uint32_t x = tileX; x < std::min(planes.width, tileX + tileSize); x += 4)
+                        {
+                            size_t center = planes.GetIndex(atlas, x, y);
+                            Float4 chart = Float4::Load(&planes.chart[center]);
+                            Float4 centerValid = chart >= Float4(0.0f);
+                            if (MoveMask(centerValid) == 0)
+                            {
+                                for (int c = 0; c < 3; ++c)
+                                    Float4::Load(&source[c][center]).Store(&target[c][center]);
+                                Float4::Load(&sourceVariance[center]).Store(&targetVariance[center]);
+                                continue;
+                            }
+
+                            Float4 n[3], albedo[3];
+                            for (int c = 0; c < 3; ++c)
+                            {
+                                n[c] = Float4::Load(&planes.normal[c][center]);
+                                albedo[c] = Float4::Load(&planes.albedo[c][center]);
+                            }
+                            Float4 planeOffset = Float4::Load(&planes.position[0][center]) * n[0];
+                            planeOffset = MulAdd(Float4::Load(&planes.position[1][center]), n[1], planeOffset);
+                            planeOffset = MulAdd(Float4::Load(&planes.position[2][center]), n[2], planeOffset);
+                            Float4 luminance = LoadLuminance(source, center);
+                            Float4 deviation = Sqrt(Max(Float4::Load(&sourceVariance[center]), Float4(0.0f)));
+                            Float4 invLuminanceScale = Float4(1.0f) / MulAdd(deviation, Float4(m_settings.luminanceSigma), Float4(kLuminanceEpsilon));
+
+                            Float4 sum[3] = { Float4(0.0f), Float4(0.0f), Float4(0.0f) };
+                            Float4 weightSum(0.0f);
+                            Float4 varianceSum(0.0f);
+                            for (int dy = -2; dy <= 2; ++dy)
+                            {
+                                int ty = static_cast<int>(y) + dy * step;
+                                if (ty < 0 || ty >= static_cast<int>(planes.height))
+                                    continue;
+                                for (int dx = -2; dx <= 2; ++dx)
+                                {
+                                    size_t tap = planes.GetIndex(atlas, x, static_cast<uint32_t>(ty)) + dx * step;
+                                    Float4 valid = centerValid & Equal(Float4::Load(&planes.chart[tap]), chart);
+                                    if (MoveMask(valid) == 0)
+                                        continue;
+
+                                    Float4 cosine = Float4::Load(&planes.normal[0][tap]) * n[0];
+                                    cosine = MulAdd(Float4::Load(&planes.normal[1][tap]), n[1], cosine);
+                                    cosine = MulAdd(Float4::Load(&planes.normal[2][tap]), n[2], cosine);
+                                    Float4 tapPlane = Float4::Load(&planes.position[0][tap]) * n[0];
+                                    tapPlane = MulAdd(Float4::Load(&planes.position[1][tap]), n[1], tapPlane);
+                                    tapPlane = MulAdd(Float4::Load(&planes.position[2][tap]), n[2], tapPlane);
+                                    Float4 albedoDistance(0.0f);
+                                    for (int c = 0; c < 3; ++c)
+                                    {
+                                        Float4 d = Float4::Load(&planes.albedo[c][tap]) - albedo[c];
+                                        albedoDistance = MulAdd(d, d, albedoDistance);
+                                    }
+
+                                    Float4 exponent = Abs(LoadLuminance(source, tap) - luminance) * invLuminanceScale;
+                                    exponent = MulAdd(Max(Float4(1.0f) - cosine, Float4(0.0f)), Float4(m_settings.normalSharpness), exponent);
+                                    exponent = MulAdd(Abs(tapPlane - planeOffset), Float4(invPlaneSigma), exponent);
+                                    exponent = MulAdd(albedoDistance, Float4(invAlbedoSigmaSquared), exponent);
+                                    Float4 weight = Exp(Float4(0.0f) - exponent) * Float4(kKernel[dx + 2] * kKernel[dy + 2]);
+                                    weight = Select(valid, weight, Float4(0.0f));
+
+                                    for (int c = 0; c < 3; ++c)
+                                        sum[c] = MulAdd(Float4::Load(&source[c][tap]), weight, sum[c]);
+                                    weightSum = weightSum + weight;
+                                    varianceSum = MulAdd(Float4::Load(&sourceVariance[tap]), weight * weight, varianceSum);
+                                }
+                            }
+
+                            // The center tap always has a positive weight, so valid lanes never divide by zero.
+                            Float4 invWeight = Float4(1.0f) / Select(centerValid, weightSum, Float4(1.0f));
+                            for (int c = 0; c < 3; ++c)
+                                Select(centerValid, sum[c] * invWeight, Float4::Load(&source[c][center])).Store(&target[c][center]);
+                            Select(centerValid, varianceSum * invWeight * invWeight, Float4::Load(&sourceVariance[center])).Store(&targetVariance[center]);
+                        }
+                    }
+                }
+            });
+        }
+
+        const std::vector<float>* result = planes.color[m_settings.iterations & 1];
+        for (uint32_t atlas = 0; atlas < texels.atlasCount; ++atlas)
+        {
+            for (uint32_t y = 0; y < texels.height; ++y)
+            {
+                for (uint32_t x = 0; x < texels.width; ++x)
+                {
+                    size_t index = texels.GetIndex(atlas, x, y);
+                    if (lightmap.texels[index].w <= 0.0f)
+                        continue;
+                    size_t source = planes.GetIndex(atlas, x, y);
+                    lightmap.texels[index] = glm::vec4(result[0][source], result[1][source], result[2][source], lightmap.texels[index].w);
+                }
+            }
+        }
+    }
+}
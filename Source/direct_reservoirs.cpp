@@ -0,0 +1,186 @@
+#include "Bake/direct_reservoirs.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kMaxNeighbours = 16;
+    }
+
+    DirectReservoirs::DirectReservoirs(const PathIntegrator& integrator, const TexelBuffer& texels, const DirectReservoirSettings& settings)
+        : m_integrator(integrator)
+        , m_texels(texels)
+        , m_settings(settings)
+        , m_current(texels.texels.size())
+        , m_previous(texels.texels.size())
+    {
+        m_settings.candidates = std::max(1u, m_settings.candidates);
+        m_settings.neighbours = std::min(m_settings.neighbours, kMaxNeighbours);
+    }
+
+    bool DirectReservoirs::SampleCandidate(const TexelRecord& texel, Sampler& sampler, LightSample& sample, float& pmf, float& pdf) const
+    {
+        float u = sampler.Next1D();
+        glm::vec2 v = sampler.Next2D();
+        const LightSet& lights = m_integrator.GetLights();
+        uint32_t light;
+        if (!lights.Sample(texel.position, texel.normal, u, light, pmf))
+            return false;
+        glm::vec3 point(0.0f);
+        pdf = pmf;
+        if (light == LightSet::kEnvironmentLight)
+        {
+            float directionPdf;
+            if (!lights.GetEnvironment().Sample(v.x, v.y, point, directionPdf))
+                return false;
+            pdf *= directionPdf;
+        }
+        else if (light >= lights.GetPunctualCount())
+        {
+            const EmissiveTriangle& triangle = lights.GetEmissiveTriangles()[light - lights.GetPunctualCount()];
+            float su = std::sqrt(v.x);
+            float b1 = v.y * su;
+            point = triangle.vertices[0] * (1.0f - su) + triangle.vertices[1] * b1 + triangle.vertices[2] * (su - b1);
+            pdf /= triangle.area;
+        }
+        return pdf > 0.0f && m_integrator.EvaluateDirect(texel.position, texel.normal, light, point, sample);
+    }
+
+    glm::vec3 DirectReservoirs::Estimate(size_t texelIndex, uint32_t x, uint32_t y, Sampler& sampler, glm::vec3& direction)
+    {
+        const TexelRecord& texel = m_texels.texels[texelIndex];
+        m_estimates.fetch_add(1, std::memory_order_relaxed);
+        direction = texel.normal;
+
+        // Resampled importance sampling: a candidate's weight is its unshadowed irradiance over
+        // the pdf of drawing it.
+        Reservoir fresh;
+        fresh.count = static_cast<float>(m_settings.candidates);
+        LightSample chosen;
+        float chosenTarget = 0.0f;
+        float chosenPmf = 0.0f;
+        float weightSum = 0.0f;
+        for (uint32_t c = 0; c < m_settings.candidates; ++c)
+        {
+            LightSample candidate;
+            float pmf, pdf;
+            if (!SampleCandidate(texel, sampler, candidate, pmf, pdf))
+            {
+                sampler.Next1D();
+                continue;
+            }
+            float target = Luminance(candidate.irradiance);
+            float w = target / pdf;
+            weightSum += w;
+            if (sampler.Next1D() * weightSum < w)
+            {
+                chosen = candidate;
+                chosenTarget = target;
+                chosenPmf = pmf;
+            }
+        }
+        if (chosenTarget > 0.0f)
+        {
+            fresh.light = chosen.light;
+            fresh.point = chosen.point;
+            fresh.weight = weightSum / (fresh.count * chosenTarget);
+            fresh.target = chosenTarget;
+        }
+        m_current[texelIndex] = fresh;
+
+        // Spatial reuse: the reservoirs a few neighbours kept last pass, each weighing its
+        // sample's target here times its contribution weight and candidate count. Passes of a
+        // bake are averaged, so reservoirs are not chained from one pass into the next, which
+        // would correlate them.
+        size_t sources[kMaxNeighbours];
+        uint32_t sourceCount = 0;
+        uint32_t atlas = static_cast<uint32_t>(texelIndex / (static_cast<size_t>(m_texels.width) * m_texels.height));
+        int span = static_cast<int>(m_settings.radius) * 2 + 1;
+        for (uint32_t n = 0; n < m_settings.neighbours; ++n)
+        {
+            glm::vec2 u = sampler.Next2D();
+            int nx = static_cast<int>(x) + std::min(static_cast<int>(u.x * span), span - 1) - static_cast<int>(m_settings.radius);
+            int ny = static_cast<int>(y) + std::min(static_cast<int>(u.y * span), span - 1) - static_cast<int>(m_settings.radius);
+            if (nx < 0 || ny < 0 || nx >= static_cast<int>(m_texels.width) || ny >= static_cast<int>(m_texels.height))
+                continue;
+            size_t index = m_texels.GetIndex(atlas, static_cast<uint32_t>(nx), static_cast<uint32_t>(ny));
+            if (index == texelIndex || !m_texels.IsCovered(index) || m_texels.charts[index] != m_texels.charts[texelIndex] || m_previous[index].count <= 0.0f ||
+                std::find(sources, sources + sourceCount, index) != sources + sourceCount)
+                continue;
+            sources[sourceCount++] = index;
+        }
+
+        // Pairwise MIS between this texel's reservoir and each neighbour's (Bitterli 2022, ch. 9):
+        // the weights stay sensible when a neighbour's sample was unlikely where it was drawn,
+        // which the 1/Z weights of the paper are not.
+        float k = static_cast<float>(sourceCount);
+        float canonicalWeight = 1.0f;
+        if (sourceCount > 0 && chosenTarget > 0.0f)
+        {
+            canonicalWeight = 0.0f;
+            for (uint32_t s = 0; s < sourceCount; ++s)
+            {
+                const TexelRecord& source = m_texels.texels[sources[s]];
+                LightSample sample;
+                float target = m_integrator.EvaluateDirect(source.position, source.normal, chosen.light, chosen.point, sample) ? Luminance(sample.irradiance) : 0.0f;
+                canonicalWeight += chosenTarget / (k * target + chosenTarget);
+            }
+            canonicalWeight /= k;
+        }
+        float combinedSum = canonicalWeight * weightSum / fresh.count;
+        bool reused = false;
+        for (uint32_t s = 0; s < sourceCount; ++s)
+        {
+            const Reservoir& source = m_previous[sources[s]];
+            LightSample sample;
+            if (source.light == LightSet::kNoLight || !m_integrator.EvaluateDirect(texel.position, texel.normal, source.light, source.point, sample))
+            {
+                sampler.Next1D();
+                continue;
+            }
+            float target = Luminance(sample.irradiance);
+            float w = source.target / (source.target * k + target) * target * source.weight;
+            combinedSum += w;
+            if (sampler.Next1D() * combinedSum < w)
+            {
+                chosen = sample;
+                chosenTarget = target;
+                reused = true;
+            }
+        }
+        m_merged.fetch_add(sourceCount, std::memory_order_relaxed);
+
+        if (combinedSum <= 0.0f || chosenTarget <= 0.0f)
+            return glm::vec3(0.0f);
+        if (reused)
+            m_reused.fetch_add(1, std::memory_order_relaxed);
+
+        direction = chosen.direction;
+        if (m_integrator.GetRayTracer().Occluded(chosen.origin, chosen.direction, chosen.maxDistance))
+            return glm::vec3(0.0f);
+        // Resampling estimates the unweighted irradiance; the MIS weight against bounces that hit
+        // the light goes on the sample that survived it.
+        if (reused)
+            chosenPmf = m_integrator.GetLights().GetPmf(texel.position, texel.normal, chosen.light);
+        return chosen.irradiance * (m_integrator.GetDirectWeight(chosen, texel.normal, chosenPmf) * combinedSum / chosenTarget);
+    }
+
+    void DirectReservoirs::EndPass()
+    {
+        m_previous = m_current;
+    }
+
+    DirectReservoirStats DirectReservoirs::GetStats() const
+    {
+        DirectReservoirStats stats;
+        stats.estimates = m_estimates.load(std::memory_order_relaxed);
+        stats.merged = m_merged.load(std::memory_order_relaxed);
+        stats.reused = m_reused.load(std::memory_order_relaxed);
+        stats.memoryBytes = (m_current.size() + m_previous.size()) * sizeof(Reservoir);
+        return stats;
+    }
+}
@@ -0,0 +1,45 @@
+#include "Bake/directional_lightmap.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace LightChef
+{
+    namespace
+    {
+        // EvaluateL1Irradiance peaks at 4, for a single incident direction.
+        constexpr float kMaxRelativeIrradiance = 4.0f;
+
+        uint8_t ToUnorm8(float value)
+        {
+            return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    float EvaluateL1Irradiance(const glm::vec3& band1, const glm::vec3& normal)
+    {
+        float length = std::min(glm::length(band1), 1.0f);
+        if (length < 1e-6f)
+            return 1.0f;
+        float q = 0.5f * (1.0f + glm::dot(band1, normal) / glm::length(band1));
+        float p = 1.0f + 2.0f * length;
+        float a = (1.0f - length) / (1.0f + length);
+        return a + (1.0f - a) * (p + 1.0f) * std::pow(std::max(q, 0.0f), p);
+    }
+
+    std::vector<uint8_t> PackDirectionalLightmap(const Lightmap& directional)
+    {
+        std::vector<uint8_t> packed(directional.texels.size() * 4);
+        for (size_t i = 0; i < directional.texels.size(); ++i)
+        {
+            glm::vec4 texel = directional.texels[i];
+            if (texel.w <= 0.0f)
+                texel = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            packed[i * 4 + 0] = ToUnorm8(0.5f + 0.5f * texel.x);
+            packed[i * 4 + 1] = ToUnorm8(0.5f + 0.5f * texel.y);
+            packed[i * 4 + 2] = ToUnorm8(0.5f + 0.5f * texel.z);
+            packed[i * 4 + 3] = ToUnorm8(texel.w / kMaxRelativeIrradiance);
+        }
+        return packed;
+    }
+}
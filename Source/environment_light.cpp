@@ -0,0 +1,210 @@
+#include "Bake/environment_light.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <bvh/v2/executor.h>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr char kCacheMagic[4] = { 'L', 'C', 'D', 'F' };
+        constexpr uint32_t kCacheVersion = 1;
+
+        struct CacheHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+        };
+
+        /**
+         * Index of the CDF segment holding `u`, for a CDF that starts at 0 and ends at 1.
+         */
+        uint32_t FindSegment(const float* cdf, uint32_t count, float u)
+        {
+            const float* it = std::upper_bound(cdf, cdf + count + 1, u);
+            return static_cast<uint32_t>(std::clamp<std::ptrdiff_t>(it - cdf - 1, 0, count - 1));
+        }
+    }
+
+    bool EnvironmentLight::Load(const std::filesystem::path& path, float intensity, bvh::v2::ThreadPool& threadPool)
+    {
+        m_intensity = intensity;
+        if (!LoadHdr(path, m_image))
+        {
+            m_image = HdrImage();
+            return false;
+        }
+
+        std::error_code error;
+        uint64_t sourceSize = std::filesystem::file_size(path, error);
+        int64_t sourceTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        std::filesystem::path cachePath = GetCachePath(path);
+        if (!ReadCache(cachePath, sourceSize, sourceTime))
+        {
+            BuildTables(threadPool);
+            WriteCache(cachePath, sourceSize, sourceTime);
+        }
+        return IsValid();
+    }
+
+    std::filesystem::path EnvironmentLight::GetCachePath(const std::filesystem::path& imagePath)
+    {
+        std::filesystem::path cachePath = imagePath;
+        cachePath += ".cdf";
+        return cachePath;
+    }
+
+    glm::vec3 EnvironmentLight::Evaluate(const glm::vec3& direction) const
+    {
+        if (m_image.width == 0)
+            return glm::vec3(0.0f);
+        float theta = std::acos(std::clamp(direction.y, -1.0f, 1.0f));
+        float phi = std::atan2(direction.z, direction.x);
+        if (phi < 0.0f)
+            phi += 2.0f * kPi;
+        uint32_t x = std::min(static_cast<uint32_t>(phi * 0.5f * kInvPi * m_image.width), m_image.width - 1);
+        uint32_t y = std::min(static_cast<uint32_t>(theta * kInvPi * m_image.height), m_image.height - 1);
+        return m_image.At(x, y) * m_intensity;
+    }
+
+    bool EnvironmentLight::Sample(float u1, float u2, glm::vec3& direction, float& pdf) const
+    {
+        if (!IsValid())
+            return false;
+        uint32_t width = m_image.width;
+        uint32_t height = m_image.height;
+
+        uint32_t row = FindSegment(m_marginalCdf.data(), height, u2);
+        float rowStart = m_marginalCdf[row];
+        float rowWidth = m_marginalCdf[row + 1] - rowStart;
+        float v = (row + (rowWidth > 0.0f ? (u2 - rowStart) / rowWidth : 0.5f)) / height;
+
+        const float* cdf = &m_conditionalCdf[static_cast<size_t>(row) * (width + 1)];
+        uint32_t column = FindSegment(cdf, width, u1);
+        float columnWidth = cdf[column + 1] - cdf[column];
+        float u = (column + (columnWidth > 0.0f ? (u1 - cdf[column]) / columnWidth : 0.5f)) / width;
+
+        float theta = v * kPi;
+        float phi = u * 2.0f * kPi;
+        float sinTheta = std::sin(theta);
+        if (sinTheta <= 0.0f)
+            return false;
+        direction = glm::vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+
+        // Density of the pixel in uv, then the equirectangular Jacobian to solid angle.
+        float density = Luminance(m_image.At(column, row)) * std::sin((row + 0.5f) * kPi / height);
+        pdf = density / m_integral / (2.0f * kPi * kPi * sinTheta);
+        return pdf > 0.0f;
+    }
+
+    float EnvironmentLight::GetPdf(const glm::vec3& direction) const
+    {
+        if (!IsValid())
+            return 0.0f;
+        float theta = std::acos(std::clamp(direction.y, -1.0f, 1.0f));
+        float sinTheta = std::sin(theta);
+        if (sinTheta <= 0.0f)
+            return 0.0f;
+        float phi = std::atan2(direction.z, direction.x);
+        if (phi < 0.0f)
+            phi += 2.0f * kPi;
+        uint32_t x = std::min(static_cast<uint32_t>(phi * 0.5f * kInvPi * m_image.width), m_image.width - 1);
+        uint32_t y = std::min(static_cast<uint32_t>(theta * kInvPi * m_image.height), m_image.height - 1);
+        float density = Luminance(m_image.At(x, y)) * std::sin((y + 0.5f) * kPi / m_image.height);
+        return density / m_integral / (2.0f * kPi * kPi * sinTheta);
+    }
+
+    void EnvironmentLight::BuildTables(bvh::v2::ThreadPool& threadPool)
+    {
+        uint32_t width = m_image.width;
+        uint32_t height = m_image.height;
+        m_conditionalCdf.assign(static_cast<size_t>(height) * (width + 1), 0.0f);
+        m_rowIntegrals.assign(height, 0.0f);
+
+        // Rows are independent, so the conditional CDFs are built in parallel.
+        bvh::v2::ParallelExecutor executor(threadPool, 16);
+        executor.for_each(0, height, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+            {
+                float sinTheta = std::sin((y + 0.5f) * kPi / height);
+                float* cdf = &m_conditionalCdf[y * (width + 1)];
+                double sum = 0.0;
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    sum += Luminance(m_image.At(x, static_cast<uint32_t>(y))) * sinTheta / width;
+                    cdf[x + 1] = static_cast<float>(sum);
+                }
+                m_rowIntegrals[y] = static_cast<float>(sum);
+                for (uint32_t x = 1; x <= width; ++x)
+                    cdf[x] = sum > 0.0 ? static_cast<float>(cdf[x] / sum) : static_cast<float>(x) / width;
+                cdf[width] = 1.0f;
+            }
+        });
+
+        m_marginalCdf.assign(height + 1, 0.0f);
+        double sum = 0.0;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            sum += m_rowIntegrals[y] / height;
+            m_marginalCdf[y + 1] = static_cast<float>(sum);
+        }
+        m_integral = static_cast<float>(sum);
+        for (uint32_t y = 1; y <= height; ++y)
+            m_marginalCdf[y] = sum > 0.0 ? static_cast<float>(m_marginalCdf[y] / sum) : static_cast<float>(y) / height;
+        m_marginalCdf[height] = 1.0f;
+    }
+
+    bool EnvironmentLight::ReadCache(const std::filesystem::path& path, uint64_t sourceSize, int64_t sourceTime)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+        CacheHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kCacheMagic, 4) != 0 ||
+            header.version != kCacheVersion || header.width != m_image.width || header.height != m_image.height ||
+            header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+            return false;
+
+        m_conditionalCdf.resize(static_cast<size_t>(header.height) * (header.width + 1));
+        m_rowIntegrals.resize(header.height);
+        m_marginalCdf.resize(header.height + 1);
+        file.read(reinterpret_cast<char*>(m_conditionalCdf.data()), m_conditionalCdf.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(m_rowIntegrals.data()), m_rowIntegrals.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(m_marginalCdf.data()), m_marginalCdf.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(&m_integral), sizeof(float));
+        if (!file)
+        {
+            m_integral = 0.0f;
+            return false;
+        }
+        return true;
+    }
+
+    void EnvironmentLight::WriteCache(const std::filesystem::path& path, uint64_t sourceSize, int64_t sourceTime) const
+    {
+        // A missing cache only costs a rebuild, so write failures (read-only folders) are ignored.
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return;
+        CacheHeader header;
+        std::memcpy(header.magic, kCacheMagic, 4);
+        header.version = kCacheVersion;
+        header.width = m_image.width;
+        header.height = m_image.height;
+        header.sourceSize = sourceSize;
+        header.sourceTime = sourceTime;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_conditionalCdf.data()), m_conditionalCdf.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(m_rowIntegrals.data()), m_rowIntegrals.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(m_marginalCdf.data()), m_marginalCdf.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(&m_integral), sizeof(float));
+    }
+}
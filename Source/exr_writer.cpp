@@ -0,0 +1,239 @@
+#include "Utility/exr_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <glm/gtc/packing.hpp>
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr int32_t kExrMagic = 20000630;
+        // Version 2 with the single-part tiled flag.
+        constexpr int32_t kExrVersion = 2 | 0x200;
+        constexpr uint8_t kRleCompression = 1;
+        constexpr uint8_t kRandomLineOrder = 2;
+        constexpr int32_t kHalfPixels = 1;
+        constexpr int32_t kFloatPixels = 2;
+        // Channels are stored in alphabetical order.
+        constexpr const char* kChannelNames[4] = { "A", "B", "G", "R" };
+        constexpr int kChannelComponents[4] = { 3, 2, 1, 0 };
+        constexpr int kMinRunLength = 3;
+        constexpr int kMaxRunLength = 127;
+
+        template <typename T>
+        void Append(std::vector<char>& out, const T& value)
+        {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        void AppendAttribute(std::vector<char>& out, const char* name, const char* type, const std::vector<char>& value)
+        {
+            out.insert(out.end(), name, name + std::strlen(name) + 1);
+            out.insert(out.end(), type, type + std::strlen(type) + 1);
+            Append(out, static_cast<int32_t>(value.size()));
+            out.insert(out.end(), value.begin(), value.end());
+        }
+
+        /**
+         * OpenEXR's RLE: bytes are split into even and odd halves and delta
+         * coded, then runs of three or more equal bytes become (count - 1,
+         * byte) and everything else negative-count literals.
+         */
+        std::vector<char> CompressRle(const std::vector<char>& raw)
+        {
+            size_t size = raw.size();
+            std::vector<char> split(size);
+            size_t half = (size + 1) / 2;
+            for (size_t i = 0; i < size; ++i)
+                split[(i & 1) ? half + i / 2 : i / 2] = raw[i];
+            int previous = static_cast<unsigned char>(split.empty() ? 0 : split[0]);
+            for (size_t i = 1; i < size; ++i)
+            {
+                int current = static_cast<unsigned char>(split[i]);
+                split[i] = static_cast<char>(current - previous + (128 + 256));
+                previous = current;
+            }
+
+            std::vector<char> packed;
+            packed.reserve(size + size / 64 + 2);
+            const char* end = split.data() + size;
+            const char* runStart = split.data();
+            const char* runEnd = runStart + 1;
+            while (runStart < end)
+            {
+                while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < kMaxRunLength)
+                    ++runEnd;
+                if (runEnd - runStart >= kMinRunLength)
+                {
+                    packed.push_back(static_cast<char>((runEnd - runStart) - 1));
+                    packed.push_back(*runStart);
+                    runStart = runEnd;
+                }
+                else
+                {
+                    while (runEnd < end && ((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2))) &&
+                           runEnd - runStart < kMaxRunLength)
+                        ++runEnd;
+                    packed.push_back(static_cast<char>(runStart - runEnd));
+                    packed.insert(packed.end(), runStart, runEnd);
+                    runStart = runEnd;
+                }
+                ++runEnd;
+            }
+            return packed;
+        }
+    }
+
+    TiledExrWriter::~TiledExrWriter()
+    {
+        Close();
+    }
+
+    bool TiledExrWriter::Open(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t pageCount, uint32_t tileSize, bool halfFloat)
+    {
+        Close();
+        if (width == 0 || height == 0 || pageCount == 0 || tileSize == 0)
+            return false;
+        m_width = width;
+        m_height = height;
+        m_pageCount = pageCount;
+        m_tileSize = tileSize;
+        m_halfFloat = halfFloat;
+        m_tilesX = (width + tileSize - 1) / tileSize;
+        m_tilesY = (height + tileSize - 1) / tileSize;
+        m_offsets.assign(static_cast<size_t>(m_tilesX) * m_tilesY * pageCount, 0);
+        m_stats = ExrWriterStats();
+        m_failed = false;
+
+        std::vector<char> header;
+        Append(header, kExrMagic);
+        Append(header, kExrVersion);
+
+        std::vector<char> channels;
+        for (const char* name : kChannelNames)
+        {
+            channels.insert(channels.end(), name, name + std::strlen(name) + 1);
+            Append(channels, halfFloat ? kHalfPixels : kFloatPixels);
+            // pLinear and three reserved bytes, then x and y sampling.
+            Append(channels, static_cast<uint32_t>(0));
+            Append(channels, static_cast<int32_t>(1));
+            Append(channels, static_cast<int32_t>(1));
+        }
+        channels.push_back(0);
+        AppendAttribute(header, "channels", "chlist", channels);
+        AppendAttribute(header, "compression", "compression", { static_cast<char>(kRleCompression) });
+        std::vector<char> window;
+        for (int32_t value : { 0, 0, static_cast<int32_t>(width) - 1, static_cast<int32_t>(m_tilesY * tileSize * pageCount) - 1 })
+            Append(window, value);
+        AppendAttribute(header, "dataWindow", "box2i", window);
+        AppendAttribute(header, "displayWindow", "box2i", window);
+        AppendAttribute(header, "lineOrder", "lineOrder", { static_cast<char>(kRandomLineOrder) });
+        std::vector<char> one;
+        Append(one, 1.0f);
+        AppendAttribute(header, "pixelAspectRatio", "float", one);
+        std::vector<char> center;
+        Append(center, 0.0f);
+        Append(center, 0.0f);
+        AppendAttribute(header, "screenWindowCenter", "v2f", center);
+        AppendAttribute(header, "screenWindowWidth", "float", one);
+        std::vector<char> tiles;
+        Append(tiles, tileSize);
+        Append(tiles, tileSize);
+        // One level, rounding down.
+        tiles.push_back(0);
+        AppendAttribute(header, "tiles", "tiledesc", tiles);
+        header.push_back(0);
+
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file.is_open())
+            return false;
+        m_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+        m_tableOffset = static_cast<std::streamoff>(header.size());
+        // Placeholder offset table, filled in by Close().
+        std::vector<uint64_t> table(m_offsets.size(), 0);
+        m_file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(uint64_t)));
+        return static_cast<bool>(m_file);
+    }
+
+    bool TiledExrWriter::WriteTile(uint32_t page, uint32_t tileX, uint32_t tileY, const glm::vec4* pixels)
+    {
+        if (!IsOpen() || page >= m_pageCount || tileX >= m_tilesX || tileY >= m_tilesY)
+            return false;
+        uint32_t imageTileY = page * m_tilesY + tileY;
+        size_t rawBytes = 0;
+        double seconds = 0.0;
+        std::vector<char> block = EncodeTile(imageTileY, tileX, pixels, rawBytes, seconds);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t slot = static_cast<size_t>(imageTileY) * m_tilesX + tileX;
+        if (m_offsets[slot] != 0)
+            return false;
+        m_offsets[slot] = static_cast<uint64_t>(m_file.tellp());
+        m_file.write(block.data(), static_cast<std::streamsize>(block.size()));
+        m_stats.tiles++;
+        m_stats.rawBytes += rawBytes;
+        m_stats.storedBytes += block.size();
+        m_stats.compressSeconds += seconds;
+        m_failed |= !m_file;
+        return !m_failed;
+    }
+
+    bool TiledExrWriter::Close()
+    {
+        if (!IsOpen())
+            return false;
+        std::vector<glm::vec4> empty(static_cast<size_t>(m_tileSize) * m_tileSize, glm::vec4(0.0f));
+        for (uint32_t page = 0; page < m_pageCount; ++page)
+            for (uint32_t tileY = 0; tileY < m_tilesY; ++tileY)
+                for (uint32_t tileX = 0; tileX < m_tilesX; ++tileX)
+                    if (m_offsets[(static_cast<size_t>(page) * m_tilesY + tileY) * m_tilesX + tileX] == 0)
+                        WriteTile(page, tileX, tileY, empty.data());
+
+        m_file.seekp(m_tableOffset);
+        m_file.write(reinterpret_cast<const char*>(m_offsets.data()), static_cast<std::streamsize>(m_offsets.size() * sizeof(uint64_t)));
+        bool success = !m_failed && static_cast<bool>(m_file);
+        m_file.close();
+        return success;
+    }
+
+    std::vector<char> TiledExrWriter::EncodeTile(uint32_t imageTileY, uint32_t tileX, const glm::vec4* pixels, size_t& rawBytes, double& seconds) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t columns = std::min(m_tileSize, m_width - tileX * m_tileSize);
+        uint32_t firstRow = (imageTileY % m_tilesY) * m_tileSize;
+        std::vector<char> raw;
+        raw.reserve(static_cast<size_t>(columns) * m_tileSize * 4 * (m_halfFloat ? 2 : 4));
+        for (uint32_t row = 0; row < m_tileSize; ++row)
+        {
+            // Rows that pad the page to whole tiles stay black.
+            bool padding = firstRow + row >= m_height;
+            for (int component : kChannelComponents)
+            {
+                for (uint32_t column = 0; column < columns; ++column)
+                {
+                    float value = padding ? 0.0f : pixels[static_cast<size_t>(row) * m_tileSize + column][component];
+                    if (m_halfFloat)
+                        Append(raw, static_cast<uint16_t>(glm::packHalf1x16(value)));
+                    else
+                        Append(raw, value);
+                }
+            }
+        }
+
+        std::vector<char> packed = CompressRle(raw);
+        // Readers take data as stored whenever it is not smaller than the raw pixels.
+        const std::vector<char>& data = packed.size() < raw.size() ? packed : raw;
+        std::vector<char> block;
+        block.reserve(data.size() + 5 * sizeof(int32_t));
+        for (int32_t value : { static_cast<int32_t>(tileX), static_cast<int32_t>(imageTileY), 0, 0, static_cast<int32_t>(data.size()) })
+            Append(block, value);
+        block.insert(block.end(), data.begin(), data.end());
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        rawBytes = raw.size();
+        return block;
+    }
+}
@@ -0,0 +1,466 @@
+#include "Bake/gpu_baker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "ResourceManager.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kWorkgroupSize = 64;
+        // WebGPU's default maxComputeWorkgroupsPerDimension.
+        constexpr uint32_t kMaxWorkgroups = 65535;
+        constexpr uint32_t kMaxTexelsPerDispatch = kWorkgroupSize * kMaxWorkgroups;
+        constexpr uint32_t kStorageBindings = 7;
+        // Binding 7, the last scene buffer.
+        constexpr size_t kTexelBuffer = kStorageBindings - 1;
+        // Bindings of runtime-sized arrays must hold at least one element, even for empty lists.
+        constexpr size_t kMinBufferSize = 256;
+
+        template <typename T>
+        wgpu::Buffer CreateStorageBuffer(wgpu::Device device, wgpu::Queue queue, const char* label, const std::vector<T>& data)
+        {
+            wgpu::BufferDescriptor bufferDesc;
+            bufferDesc.label = label;
+            bufferDesc.size = std::max(data.size() * sizeof(T), kMinBufferSize);
+            bufferDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+            bufferDesc.mappedAtCreation = false;
+            wgpu::Buffer buffer = device.createBuffer(bufferDesc);
+            if (!data.empty())
+                queue.writeBuffer(buffer, 0, data.data(), data.size() * sizeof(T));
+            return buffer;
+        }
+
+        // Waits a little for the device to progress, without spinning a core that the CPU workers of
+        // a hybrid bake could use: wgpu-native blocks until the queue is idle, Dawn yields after a tick.
+        void WaitForDevice(wgpu::Device device)
+        {
+#if defined(WEBGPU_BACKEND_DAWN)
+            device.tick();
+            std::this_thread::yield();
+#elif defined(WEBGPU_BACKEND_WGPU)
+            device.poll(true);
+#else
+            // The browser makes progress between callbacks on its own.
+            (void)device;
+#endif
+        }
+    }
+
+    // Uniforms of Assets/lightmap_bake.wgsl.
+    struct GpuBaker::Params
+    {
+        uint32_t texelOffset = 0;
+        uint32_t texelCount = 0;
+        uint32_t sampleCount = 0;
+        uint32_t maxBounces = 0;
+        uint32_t lightCount = 0;
+        uint32_t punctualCount = 0;
+        float epsilon = 0.0f;
+        uint32_t width = 0;
+        glm::vec3 skyColor{ 0.0f };
+        uint32_t height = 0;
+        uint32_t padding[4] = {};
+    };
+
+    GpuBaker::GpuBaker(wgpu::Device device, const GpuBakeSettings& settings)
+        : m_device(device)
+        , m_queue(device.getQueue())
+        , m_settings(settings)
+    {
+    }
+
+    GpuBaker::~GpuBaker()
+    {
+        Release();
+        m_queue.release();
+    }
+
+    bool GpuBaker::Initialize(const GpuBakeScene& scene, uint32_t width, uint32_t height, uint32_t atlasCount,
+                              const std::filesystem::path& shaderPath)
+    {
+        Release();
+        m_stats = GpuBakeStats();
+        m_texelCount = static_cast<uint32_t>(scene.texels.size());
+        m_width = width;
+        m_height = height;
+        m_lightCount = scene.lightCount;
+        m_punctualCount = scene.punctualCount;
+        m_epsilon = scene.epsilon;
+        m_skyColor = scene.skyColor;
+
+        wgpu::ShaderModule shaderModule = ResourceManager::loadShaderModule(shaderPath, m_device);
+        if (shaderModule == nullptr)
+            return false;
+
+        std::vector<wgpu::BindGroupLayoutEntry> layoutEntries(kStorageBindings + 3, wgpu::Default);
+        layoutEntries[0].binding = 0;
+        layoutEntries[0].visibility = wgpu::ShaderStage::Compute;
+        layoutEntries[0].buffer.type = wgpu::BufferBindingType::Uniform;
+        layoutEntries[0].buffer.minBindingSize = sizeof(Params);
+        for (uint32_t binding = 1; binding <= kStorageBindings + 1; ++binding)
+        {
+            layoutEntries[binding].binding = binding;
+            layoutEntries[binding].visibility = wgpu::ShaderStage::Compute;
+            layoutEntries[binding].buffer.type = binding <= kStorageBindings ? wgpu::BufferBindingType::ReadOnlyStorage : wgpu::BufferBindingType::Storage;
+        }
+        wgpu::BindGroupLayoutEntry& textureLayout = layoutEntries[kStorageBindings + 2];
+        textureLayout.binding = kStorageBindings + 2;
+        textureLayout.visibility = wgpu::ShaderStage::Compute;
+        textureLayout.storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+        textureLayout.storageTexture.format = wgpu::TextureFormat::RGBA16Float;
+        textureLayout.storageTexture.viewDimension = wgpu::TextureViewDimension::_2DArray;
+
+        wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{};
+        bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(layoutEntries.size());
+        bindGroupLayoutDesc.entries = layoutEntries.data();
+        m_bindGroupLayout = m_device.createBindGroupLayout(bindGroupLayoutDesc);
+
+        wgpu::PipelineLayoutDescriptor layoutDesc{};
+        layoutDesc.bindGroupLayoutCount = 1;
+        layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout*)&m_bindGroupLayout;
+        m_pipelineLayout = m_device.createPipelineLayout(layoutDesc);
+
+        // Both entry points share one layout, so a single bind group serves them.
+        wgpu::ComputePipelineDescriptor pipelineDesc{};
+        pipelineDesc.layout = m_pipelineLayout;
+        pipelineDesc.compute.module = shaderModule;
+        pipelineDesc.compute.constantCount = 0;
+        pipelineDesc.compute.constants = nullptr;
+        pipelineDesc.compute.entryPoint = "bake";
+        m_bakePipeline = m_device.createComputePipeline(pipelineDesc);
+        pipelineDesc.compute.entryPoint = "resolve";
+        m_resolvePipeline = m_device.createComputePipeline(pipelineDesc);
+        shaderModule.release();
+
+        wgpu::BufferDescriptor paramsDesc;
+        paramsDesc.label = "Lightmap bake parameters";
+        paramsDesc.size = sizeof(Params);
+        paramsDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+        paramsDesc.mappedAtCreation = false;
+        m_params = m_device.createBuffer(paramsDesc);
+
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "BVH nodes", scene.nodes));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Bake triangles", scene.triangles));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Bake materials", scene.materials));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Bake lights", scene.lights));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Emissive triangles", scene.emissive));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Light of triangle", scene.lightOfTriangle));
+        m_buffers.push_back(CreateStorageBuffer(m_device, m_queue, "Bake texels", scene.texels));
+        // Empty sums without a target, for Dispatch() to fill.
+        wgpu::BufferDescriptor accumulatorDesc;
+        accumulatorDesc.label = "Texel accumulators";
+        accumulatorDesc.size = std::max(static_cast<size_t>(m_texelCount) * sizeof(GpuAccumulator), kMinBufferSize);
+        accumulatorDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst;
+        accumulatorDesc.mappedAtCreation = false;
+        m_accumulators = m_device.createBuffer(accumulatorDesc);
+        if (m_texelCount > 0)
+        {
+            std::vector<GpuAccumulator> empty(m_texelCount);
+            m_queue.writeBuffer(m_accumulators, 0, empty.data(), empty.size() * sizeof(GpuAccumulator));
+        }
+
+        wgpu::TextureDescriptor textureDesc;
+        textureDesc.label = "GPU baked lightmap";
+        textureDesc.dimension = wgpu::TextureDimension::_2D;
+        textureDesc.format = wgpu::TextureFormat::RGBA16Float;
+        textureDesc.mipLevelCount = 1;
+        textureDesc.sampleCount = 1;
+        textureDesc.size = { std::max(width, 1u), std::max(height, 1u), std::max(atlasCount, 1u) };
+        textureDesc.usage = wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopySrc;
+        textureDesc.viewFormatCount = 0;
+        textureDesc.viewFormats = nullptr;
+        m_lightmap = m_device.createTexture(textureDesc);
+
+        wgpu::TextureViewDescriptor viewDesc;
+        viewDesc.aspect = wgpu::TextureAspect::All;
+        viewDesc.baseArrayLayer = 0;
+        viewDesc.arrayLayerCount = textureDesc.size.depthOrArrayLayers;
+        viewDesc.baseMipLevel = 0;
+        viewDesc.mipLevelCount = 1;
+        viewDesc.dimension = wgpu::TextureViewDimension::_2DArray;
+        viewDesc.format = wgpu::TextureFormat::RGBA16Float;
+        m_lightmapView = m_lightmap.createView(viewDesc);
+
+        std::vector<wgpu::BindGroupEntry> entries(kStorageBindings + 3);
+        entries[0].binding = 0;
+        entries[0].buffer = m_params;
+        entries[0].offset = 0;
+        entries[0].size = sizeof(Params);
+        for (uint32_t binding = 1; binding <= kStorageBindings + 1; ++binding)
+        {
+            wgpu::Buffer buffer = binding <= kStorageBindings ? m_buffers[binding - 1] : m_accumulators;
+            entries[binding].binding = binding;
+            entries[binding].buffer = buffer;
+            entries[binding].offset = 0;
+            entries[binding].size = buffer.getSize();
+        }
+        entries[kStorageBindings + 2].binding = kStorageBindings + 2;
+        entries[kStorageBindings + 2].textureView = m_lightmapView;
+
+        wgpu::BindGroupDescriptor bindGroupDesc{};
+        bindGroupDesc.layout = m_bindGroupLayout;
+        bindGroupDesc.entryCount = static_cast<uint32_t>(entries.size());
+        bindGroupDesc.entries = entries.data();
+        m_bindGroup = m_device.createBindGroup(bindGroupDesc);
+        return true;
+    }
+
+    void GpuBaker::Dispatch(uint32_t firstTexel, uint32_t texelCount, uint32_t sampleCount)
+    {
+        if (!m_bindGroup || texelCount == 0 || sampleCount == 0)
+            return;
+        auto start = std::chrono::steady_clock::now();
+        SubmitBake(firstTexel, texelCount, sampleCount);
+        m_stats.samples += static_cast<uint64_t>(texelCount) * sampleCount;
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool GpuBaker::BakeTexels(std::span<const GpuTexel> texels, std::span<GpuAccumulator> accumulators)
+    {
+        if (!m_bindGroup || m_texelCount == 0 || texels.size() != accumulators.size())
+            return false;
+        auto start = std::chrono::steady_clock::now();
+        // Batches longer than the scene's list go through it in parts.
+        for (size_t first = 0; first < texels.size(); first += m_texelCount)
+        {
+            uint32_t count = static_cast<uint32_t>(std::min<size_t>(m_texelCount, texels.size() - first));
+            std::span<GpuAccumulator> part = accumulators.subspan(first, count);
+            uint32_t sampleCount = 0;
+            uint64_t samplesBefore = 0;
+            for (const GpuAccumulator& accumulator : part)
+            {
+                if (accumulator.sampleTarget > accumulator.sampleCount)
+                    sampleCount = std::max(sampleCount, accumulator.sampleTarget - accumulator.sampleCount);
+                samplesBefore += accumulator.sampleCount;
+            }
+            m_queue.writeBuffer(m_buffers[kTexelBuffer], 0, texels.data() + first, count * sizeof(GpuTexel));
+            m_queue.writeBuffer(m_accumulators, 0, part.data(), count * sizeof(GpuAccumulator));
+            SubmitBake(0, count, sampleCount);
+            if (!ReadBack(part))
+                return false;
+            for (const GpuAccumulator& accumulator : part)
+                m_stats.samples += accumulator.sampleCount;
+            m_stats.samples -= samplesBefore;
+        }
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    const GpuBakeStats& GpuBaker::Bake()
+    {
+        Dispatch(0, m_texelCount, m_settings.samplesPerTexel);
+        return m_stats;
+    }
+
+    void GpuBaker::Resolve()
+    {
+        if (!m_bindGroup)
+            return;
+        Params params;
+        params.width = m_width;
+        params.height = m_height;
+        for (uint32_t texel = 0; texel < m_texelCount; texel += kMaxTexelsPerDispatch)
+        {
+            params.texelOffset = texel;
+            params.texelCount = std::min(kMaxTexelsPerDispatch, m_texelCount - texel);
+            Submit(m_resolvePipeline, params);
+        }
+    }
+
+    bool GpuBaker::ReadAccumulators(std::vector<GpuAccumulator>& accumulators)
+    {
+        if (!m_bindGroup)
+            return false;
+        accumulators.resize(m_texelCount);
+        return ReadBack(accumulators);
+    }
+
+    void GpuBaker::SubmitBake(uint32_t firstTexel, uint32_t texelCount, uint32_t sampleCount)
+    {
+        if (texelCount == 0 || sampleCount == 0)
+            return;
+        uint32_t budget = std::max(m_settings.pathsPerDispatch, 1u);
+        // Several samples per thread when the range is small, a slice of the range otherwise.
+        uint32_t samplesPerDispatch = std::clamp(budget / texelCount, 1u, sampleCount);
+        uint32_t texelsPerDispatch = std::min({ texelCount, std::max(budget / samplesPerDispatch, 1u), kMaxTexelsPerDispatch });
+
+        Params params;
+        params.maxBounces = m_settings.maxBounces;
+        params.lightCount = m_lightCount;
+        params.punctualCount = m_punctualCount;
+        params.epsilon = m_epsilon;
+        params.skyColor = m_skyColor;
+        params.width = m_width;
+        params.height = m_height;
+        for (uint32_t sample = 0; sample < sampleCount; sample += samplesPerDispatch)
+        {
+            for (uint32_t texel = 0; texel < texelCount; texel += texelsPerDispatch)
+            {
+                params.texelOffset = firstTexel + texel;
+                params.texelCount = std::min(texelsPerDispatch, texelCount - texel);
+                params.sampleCount = std::min(samplesPerDispatch, sampleCount - sample);
+                Submit(m_bakePipeline, params);
+            }
+        }
+    }
+
+    bool GpuBaker::ReadBack(std::span<GpuAccumulator> accumulators)
+    {
+        size_t size = accumulators.size() * sizeof(GpuAccumulator);
+        if (size == 0)
+            return true;
+
+        wgpu::BufferDescriptor readbackDesc;
+        readbackDesc.label = "Accumulator readback";
+        readbackDesc.size = size;
+        readbackDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+        readbackDesc.mappedAtCreation = false;
+        wgpu::Buffer readback = m_device.createBuffer(readbackDesc);
+
+        wgpu::CommandEncoderDescriptor encoderDesc = {};
+        encoderDesc.label = "Accumulator readback";
+        wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoderDesc);
+        encoder.copyBufferToBuffer(m_accumulators, 0, readback, 0, size);
+        wgpu::CommandBufferDescriptor commandDesc = {};
+        wgpu::CommandBuffer command = encoder.finish(commandDesc);
+        encoder.release();
+        m_queue.submit(1, &command);
+        command.release();
+
+        bool done = false;
+        bool mapped = false;
+        auto callback = readback.mapAsync(wgpu::MapMode::Read, 0, size, [&](wgpu::BufferMapAsyncStatus status) {
+            mapped = status == wgpu::BufferMapAsyncStatus::Success;
+            done = true;
+        });
+        while (!done)
+            WaitForDevice(m_device);
+        if (mapped)
+        {
+            std::memcpy(accumulators.data(), readback.getConstMappedRange(0, size), size);
+            readback.unmap();
+        }
+        readback.destroy();
+        readback.release();
+        return mapped;
+    }
+
+    void GpuBaker::Submit(wgpu::ComputePipeline pipeline, const Params& params)
+    {
+        static_assert(sizeof(Params) == 64, "Params must match the uniform block of the shader");
+        m_queue.writeBuffer(m_params, 0, &params, sizeof(Params));
+
+        wgpu::CommandEncoderDescriptor encoderDesc = {};
+        encoderDesc.label = "Lightmap bake";
+        wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoderDesc);
+        wgpu::ComputePassDescriptor passDesc = {};
+        passDesc.timestampWrites = nullptr;
+        wgpu::ComputePassEncoder pass = encoder.beginComputePass(passDesc);
+        pass.setPipeline(pipeline);
+        pass.setBindGroup(0, m_bindGroup, 0, nullptr);
+        pass.dispatchWorkgroups((params.texelCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+        pass.end();
+        pass.release();
+
+        wgpu::CommandBufferDescriptor commandDesc = {};
+        commandDesc.label = "Lightmap bake";
+        wgpu::CommandBuffer command = encoder.finish(commandDesc);
+        encoder.release();
+        m_queue.submit(1, &command);
+        command.release();
+        m_stats.dispatches++;
+        WaitForQueue();
+    }
+
+    void GpuBaker::WaitForQueue()
+    {
+        // One dispatch in flight at a time keeps every submission short.
+        bool done = false;
+        auto callback = m_queue.onSubmittedWorkDone([&done](wgpu::QueueWorkDoneStatus) { done = true; });
+        while (!done)
+            WaitForDevice(m_device);
+    }
+
+    void GpuBaker::Release()
+    {
+        if (m_bindGroup)
+            m_bindGroup.release();
+        if (m_lightmapView)
+            m_lightmapView.release();
+        if (m_lightmap)
+        {
+            m_lightmap.destroy();
+            m_lightmap.release();
+        }
+        if (m_accumulators)
+        {
+            m_accumulators.destroy();
+            m_accumulators.release();
+        }
+        for (wgpu::Buffer& buffer : m_buffers)
+        {
+            buffer.destroy();
+            buffer.release();
+        }
+        m_buffers.clear();
+        if (m_params)
+            m_params.release();
+        if (m_resolvePipeline)
+            m_resolvePipeline.release();
+        if (m_bakePipeline)
+            m_bakePipeline.release();
+        if (m_pipelineLayout)
+            m_pipelineLayout.release();
+        if (m_bindGroupLayout)
+            m_bindGroupLayout.release();
+        m_bindGroup = nullptr;
+        m_lightmapView = nullptr;
+        m_lightmap = nullptr;
+        m_accumulators = nullptr;
+        m_params = nullptr;
+        m_resolvePipeline = nullptr;
+        m_bakePipeline = nullptr;
+        m_pipelineLayout = nullptr;
+        m_bindGroupLayout = nullptr;
+    }
+
+    GpuBakeDevice::GpuBakeDevice(GpuBaker& baker, const TexelBuffer& texels)
+        : m_baker(baker)
+        , m_texels(texels)
+    {
+    }
+
+    bool GpuBakeDevice::Supports(const BakeSettings& settings)
+    {
+        return settings.sampler == SamplerType::Sobol && !settings.directional;
+    }
+
+    bool GpuBakeDevice::BakeTexels(std::span<const uint32_t> texelIndices, std::span<const uint32_t> sampleTargets,
+                                   std::span<TexelAccumulator> accumulators)
+    {
+        m_batchTexels.resize(texelIndices.size());
+        m_batchAccumulators.resize(texelIndices.size());
+        for (size_t i = 0; i < texelIndices.size(); ++i)
+        {
+            m_batchTexels[i] = MakeGpuTexel(m_texels, texelIndices[i]);
+            GpuAccumulator& batch = m_batchAccumulators[i];
+            batch.irradianceSum = accumulators[i].irradianceSum;
+            batch.luminanceSquaredSum = accumulators[i].luminanceSquaredSum;
+            batch.sampleCount = accumulators[i].sampleCount;
+            batch.sampleTarget = sampleTargets[i];
+        }
+        if (!m_baker.BakeTexels(m_batchTexels, m_batchAccumulators))
+            return false;
+        for (size_t i = 0; i < texelIndices.size(); ++i)
+        {
+            accumulators[i].irradianceSum = m_batchAccumulators[i].irradianceSum;
+            accumulators[i].luminanceSquaredSum = m_batchAccumulators[i].luminanceSquaredSum;
+            accumulators[i].sampleCount = m_batchAccumulators[i].sampleCount;
+        }
+        return true;
+    }
+}
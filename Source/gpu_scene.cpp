@@ -0,0 +1,117 @@
+#include "Bake/gpu_scene.h"
+
+#include <algorithm>
+#include <utility>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    bool BuildGpuBakeScene(const RayTracer& tracer, const LightSet& lights, const TexelBuffer& texels, GpuBakeScene& scene)
+    {
+        if (lights.HasEnvironment() || lights.GetSampler().GetMode() == LightSamplingMode::Bvh)
+            return false;
+        const Scene& source = tracer.GetScene();
+        scene = GpuBakeScene();
+        scene.epsilon = tracer.GetEpsilon();
+        scene.skyColor = source.skyColor;
+
+        scene.nodes = tracer.GetFlatNodes();
+        if (GetFlatBvhDepth(scene.nodes) > kGpuStackSize)
+            return false;
+        uint32_t defaultMaterial = static_cast<uint32_t>(source.materials.size());
+        for (uint32_t triangleId : tracer.GetLeafTriangleIds())
+        {
+            GpuTriangle triangle;
+            triangle.v0 = tracer.GetVertex(triangleId, 0);
+            triangle.edge1 = tracer.GetVertex(triangleId, 1) - triangle.v0;
+            triangle.edge2 = tracer.GetVertex(triangleId, 2) - triangle.v0;
+            triangle.triangleId = triangleId;
+            triangle.material = std::min(tracer.GetMaterialIndex(triangleId), defaultMaterial);
+            scene.triangles.push_back(triangle);
+        }
+        for (uint32_t i = 0; i <= defaultMaterial; ++i)
+        {
+            const Material& material = source.GetMaterial(i);
+            scene.materials.push_back({ glm::vec4(material.albedo, 0.0f), glm::vec4(material.emission, 0.0f) });
+        }
+
+        const AliasTable& table = lights.GetSampler().GetTable();
+        scene.punctualCount = lights.GetPunctualCount();
+        scene.lightCount = table.IsEmpty() ? 0 : static_cast<uint32_t>(table.GetSize());
+        for (const Light& light : lights.GetPunctualLights())
+        {
+            GpuLight gpu;
+            gpu.type = light.type == Light::Type::Spot ? GpuLight::kSpot : GpuLight::kPoint;
+            gpu.position = light.position;
+            gpu.direction = light.direction;
+            gpu.color = light.color;
+            gpu.intensity = light.intensity;
+            gpu.cosInnerAngle = light.cosInnerAngle;
+            gpu.cosOuterAngle = light.cosOuterAngle;
+            scene.lights.push_back(gpu);
+        }
+        for (const EmissiveTriangle& triangle : lights.GetEmissiveTriangles())
+        {
+            GpuLight gpu;
+            gpu.type = GpuLight::kEmissive;
+            scene.lights.push_back(gpu);
+
+            GpuEmissiveTriangle emissive;
+            emissive.v0 = triangle.vertices[0];
+            emissive.v1 = triangle.vertices[1];
+            emissive.v2 = triangle.vertices[2];
+            emissive.normal = triangle.normal;
+            emissive.area = triangle.area;
+            emissive.radiance = triangle.radiance;
+            scene.emissive.push_back(emissive);
+        }
+        for (uint32_t i = 0; i < scene.lightCount; ++i)
+        {
+            // Power and Uniform pmfs do not depend on the shading point.
+            scene.lights[i].pmf = lights.GetPmf(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), i);
+            scene.lights[i].aliasThreshold = table.GetThreshold(i);
+            scene.lights[i].aliasIndex = table.GetAlias(i);
+        }
+        scene.lightOfTriangle.resize(tracer.GetTriangleCount());
+        for (uint32_t i = 0; i < tracer.GetTriangleCount(); ++i)
+            scene.lightOfTriangle[i] = lights.GetEmissiveLight(i);
+
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+        {
+            if (texels.IsCovered(i))
+                scene.texels.push_back(MakeGpuTexel(texels, i));
+        }
+        return true;
+    }
+
+    GpuTexel MakeGpuTexel(const TexelBuffer& texels, size_t index)
+    {
+        GpuTexel texel;
+        texel.position = texels.texels[index].position;
+        texel.normal = texels.texels[index].normal;
+        texel.index = static_cast<uint32_t>(index);
+        texel.seed = static_cast<uint32_t>(Random::Mix(index));
+        return texel;
+    }
+
+    uint32_t GetFlatBvhDepth(const std::vector<FlatBvhNode>& nodes)
+    {
+        if (nodes.empty())
+            return 0;
+        uint32_t depth = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0u, 0u } };
+        while (!stack.empty())
+        {
+            auto [index, nodeDepth] = stack.back();
+            stack.pop_back();
+            if (nodes[index].count > 0)
+            {
+                depth = std::max(depth, nodeDepth);
+                continue;
+            }
+            stack.push_back({ nodes[index].first, nodeDepth + 1 });
+            stack.push_back({ nodes[index].first + 1, nodeDepth + 1 });
+        }
+        return depth;
+    }
+}
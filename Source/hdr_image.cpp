@@ -0,0 +1,195 @@
+#include "Utility/hdr_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace LightChef
+{
+    namespace
+    {
+        // Scanlines outside this width range cannot use the new-style run-length encoding.
+        constexpr uint32_t kMinRleWidth = 8;
+        constexpr uint32_t kMaxRleWidth = 0x7FFF;
+
+        glm::vec3 DecodeRgbe(const uint8_t rgbe[4])
+        {
+            if (rgbe[3] == 0)
+                return glm::vec3(0.0f);
+            float scale = std::ldexp(1.0f, static_cast<int>(rgbe[3]) - (128 + 8));
+            return glm::vec3(rgbe[0], rgbe[1], rgbe[2]) * scale;
+        }
+
+        void EncodeRgbe(const glm::vec3& color, uint8_t rgbe[4])
+        {
+            float maxComponent = std::max(color.r, std::max(color.g, color.b));
+            if (maxComponent < 1e-32f)
+            {
+                rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+                return;
+            }
+            int exponent;
+            float mantissa = std::frexp(maxComponent, &exponent) * 256.0f / maxComponent;
+            rgbe[0] = static_cast<uint8_t>(std::max(0.0f, color.r) * mantissa);
+            rgbe[1] = static_cast<uint8_t>(std::max(0.0f, color.g) * mantissa);
+            rgbe[2] = static_cast<uint8_t>(std::max(0.0f, color.b) * mantissa);
+            rgbe[3] = static_cast<uint8_t>(exponent + 128);
+        }
+
+        bool ReadScanline(std::istream& file, uint32_t width, std::vector<uint8_t>& scanline)
+        {
+            uint8_t header[4];
+            if (!file.read(reinterpret_cast<char*>(header), 4))
+                return false;
+
+            bool rle = width >= kMinRleWidth && width <= kMaxRleWidth && header[0] == 2 && header[1] == 2 && (header[2] & 0x80) == 0;
+            if (!rle || ((static_cast<uint32_t>(header[2]) << 8) | header[3]) != width)
+            {
+                // Flat scanline; the four bytes already read are the first pixel.
+                std::copy(header, header + 4, scanline.begin());
+                return static_cast<bool>(file.read(reinterpret_cast<char*>(scanline.data() + 4), (static_cast<std::streamsize>(width) - 1) * 4));
+            }
+
+            // Each channel is stored separately as runs (count > 128) and literals.
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                uint32_t x = 0;
+                while (x < width)
+                {
+                    int count = file.get();
+                    if (count == EOF)
+                        return false;
+                    if (count > 128)
+                    {
+                        count -= 128;
+                        int value = file.get();
+                        if (value == EOF || x + count > width)
+                            return false;
+                        for (int i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + channel] = static_cast<uint8_t>(value);
+                    }
+                    else
+                    {
+                        if (count == 0 || x + count > width)
+                            return false;
+                        for (int i = 0; i < count; ++i)
+                        {
+                            int value = file.get();
+                            if (value == EOF)
+                                return false;
+                            scanline[(x++) * 4 + channel] = static_cast<uint8_t>(value);
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+        void WriteChannel(std::ostream& file, const std::vector<uint8_t>& scanline, uint32_t width, uint32_t channel)
+        {
+            auto at = [&](uint32_t x) { return scanline[x * 4 + channel]; };
+            uint32_t x = 0;
+            while (x < width)
+            {
+                // Look for the next run of at least 3 equal bytes.
+                uint32_t runStart = x;
+                uint32_t runLength = 0;
+                while (runStart < width)
+                {
+                    runLength = 1;
+                    while (runStart + runLength < width && runLength < 127 && at(runStart + runLength) == at(runStart))
+                        ++runLength;
+                    if (runLength >= 3)
+                        break;
+                    runStart += runLength;
+                }
+                if (runStart >= width)
+                    runLength = 0;
+
+                while (x < runStart)
+                {
+                    uint32_t literal = std::min(128u, runStart - x);
+                    file.put(static_cast<char>(literal));
+                    for (uint32_t i = 0; i < literal; ++i)
+                        file.put(static_cast<char>(at(x + i)));
+                    x += literal;
+                }
+                if (runLength >= 3)
+                {
+                    file.put(static_cast<char>(128 + runLength));
+                    file.put(static_cast<char>(at(runStart)));
+                    x = runStart + runLength;
+                }
+            }
+        }
+    }
+
+    bool LoadHdr(const std::filesystem::path& path, HdrImage& image)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        std::string line;
+        if (!std::getline(file, line) || line.rfind("#?", 0) != 0)
+            return false;
+        bool rgbe = true;
+        while (std::getline(file, line) && !line.empty())
+        {
+            if (line.rfind("FORMAT=", 0) == 0)
+                rgbe = line == "FORMAT=32-bit_rle_rgbe";
+        }
+        if (!rgbe || !std::getline(file, line))
+            return false;
+
+        // Only the standard top-to-bottom, left-to-right orientation is supported.
+        char yAxis[3] = {};
+        char xAxis[3] = {};
+        unsigned height = 0;
+        unsigned width = 0;
+        if (std::sscanf(line.c_str(), "%2s %u %2s %u", yAxis, &height, xAxis, &width) != 4 || std::string(yAxis) != "-Y" ||
+            std::string(xAxis) != "+X" || width == 0 || height == 0)
+            return false;
+
+        image.width = width;
+        image.height = height;
+        image.pixels.resize(static_cast<size_t>(width) * height);
+        std::vector<uint8_t> scanline(static_cast<size_t>(width) * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            if (!ReadScanline(file, width, scanline))
+                return false;
+            for (uint32_t x = 0; x < width; ++x)
+                image.pixels[static_cast<size_t>(y) * width + x] = DecodeRgbe(&scanline[x * 4]);
+        }
+        return true;
+    }
+
+    bool SaveHdr(const std::filesystem::path& path, const HdrImage& image)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << image.height << " +X " << image.width << "\n";
+        bool rle = image.width >= kMinRleWidth && image.width <= kMaxRleWidth;
+        std::vector<uint8_t> scanline(static_cast<size_t>(image.width) * 4);
+        for (uint32_t y = 0; y < image.height; ++y)
+        {
+            for (uint32_t x = 0; x < image.width; ++x)
+                EncodeRgbe(image.At(x, y), &scanline[x * 4]);
+            if (!rle)
+            {
+                file.write(reinterpret_cast<const char*>(scanline.data()), static_cast<std::streamsize>(scanline.size()));
+                continue;
+            }
+            const char header[4] = { 2, 2, static_cast<char>(image.width >> 8), static_cast<char>(image.width & 0xFF) };
+            file.write(header, 4);
+            for (uint32_t channel = 0; channel < 4; ++channel)
+                WriteChannel(file, scanline, image.width, channel);
+        }
+        return static_cast<bool>(file);
+    }
+}
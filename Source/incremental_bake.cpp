@@ -0,0 +1,195 @@
+#include "Bake/incremental_bake.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+
+namespace LightChef
+{
+    namespace
+    {
+        bool IsEmissive(const glm::vec3& emission)
+        {
+            return glm::any(glm::greaterThan(emission, glm::vec3(0.0f)));
+        }
+    }
+
+    IncrementalBaker::IncrementalBaker(const Scene& scene, const TexelBuffer& texels, const IncrementalBakeSettings& settings,
+                                       bvh::v2::ThreadPool& threadPool)
+        : m_scene(scene)
+        , m_texels(texels)
+        , m_settings(settings)
+        , m_threadPool(threadPool)
+        , m_lights(scene.lights)
+        , m_skyColor(scene.skyColor)
+        , m_environmentIntensity(scene.environmentIntensity)
+    {
+        for (uint32_t light = 0; light < m_lights.size(); ++light)
+            m_groups.push_back({ LightGroup::Type::Punctual, light });
+        for (const Material& material : scene.materials)
+            m_emission.push_back(material.emission);
+        for (uint32_t material = 0; material < m_emission.size(); ++material)
+            if (IsEmissive(m_emission[material]))
+                m_groups.push_back({ LightGroup::Type::Emissive, material });
+        if (!scene.environmentMap.empty() || IsEmissive(scene.skyColor))
+            m_groups.push_back({ LightGroup::Type::Sky, 0 });
+        m_contributions.assign(m_groups.size(), std::vector<glm::vec3>(texels.texels.size(), glm::vec3(0.0f)));
+    }
+
+    const IncrementalBakeStats& IncrementalBaker::Bake()
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_stats = IncrementalBakeStats();
+        for (size_t group = 0; group < m_groups.size(); ++group)
+            BakeGroup(group, m_texels);
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return m_stats;
+    }
+
+    void IncrementalBaker::SetLightEmission(uint32_t light, const glm::vec3& color, float intensity)
+    {
+        m_lights[light].color = color;
+        m_lights[light].intensity = intensity;
+    }
+
+    bool IncrementalBaker::SetMaterialEmission(uint32_t material, const glm::vec3& emission)
+    {
+        bool baked = std::any_of(m_groups.begin(), m_groups.end(), [&](const LightGroup& group) {
+            return group.type == LightGroup::Type::Emissive && group.index == material;
+        });
+        if (!baked && IsEmissive(emission))
+            return false;
+        m_emission[material] = emission;
+        return true;
+    }
+
+    bool IncrementalBaker::SetSkyEmission(const glm::vec3& skyColor, float environmentIntensity)
+    {
+        bool baked = !m_groups.empty() && m_groups.back().type == LightGroup::Type::Sky;
+        if (!baked && (IsEmissive(skyColor) || (!m_scene.environmentMap.empty() && environmentIntensity > 0.0f)))
+            return false;
+        m_skyColor = skyColor;
+        m_environmentIntensity = environmentIntensity;
+        return true;
+    }
+
+    const IncrementalBakeStats& IncrementalBaker::UpdateLight(uint32_t light, const Light& moved)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_stats = IncrementalBakeStats();
+        Light previous = m_lights[light];
+        m_lights[light] = moved;
+
+        // Texels outside both influence spheres got and get next to nothing from this light.
+        float previousRadius = GetInfluenceRadius(previous);
+        float radius = GetInfluenceRadius(moved);
+        TexelBuffer affected = m_texels;
+        for (TexelRecord& texel : affected.texels)
+        {
+            if (texel.coverage <= 0.0f)
+                continue;
+            bool inside = glm::length(texel.position - previous.position) < previousRadius || glm::length(texel.position - moved.position) < radius;
+            if (!inside)
+                texel.coverage = 0.0f;
+        }
+        BakeGroup(light, affected);
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return m_stats;
+    }
+
+    Lightmap IncrementalBaker::GetLightmap() const
+    {
+        Lightmap lightmap;
+        lightmap.width = m_texels.width;
+        lightmap.height = m_texels.height;
+        lightmap.atlasCount = m_texels.atlasCount;
+        lightmap.texels.resize(m_texels.texels.size(), glm::vec4(0.0f));
+        for (size_t i = 0; i < m_texels.texels.size(); ++i)
+            if (m_texels.IsCovered(i))
+                lightmap.texels[i].w = 1.0f;
+        for (size_t group = 0; group < m_groups.size(); ++group)
+        {
+            glm::vec3 emission = GetEmission(group);
+            if (!IsEmissive(emission))
+                continue;
+            const std::vector<glm::vec3>& contribution = m_contributions[group];
+            for (size_t i = 0; i < contribution.size(); ++i)
+                lightmap.texels[i] += glm::vec4(contribution[i] * emission, 0.0f);
+        }
+        return lightmap;
+    }
+
+    void IncrementalBaker::BakeGroup(size_t group, const TexelBuffer& texels)
+    {
+        // Only the group emits, at unit strength; geometry, including dark emitters, stays.
+        const LightGroup& target = m_groups[group];
+        m_scene.lights.clear();
+        for (size_t material = 0; material < m_scene.materials.size(); ++material)
+            m_scene.materials[material].emission = glm::vec3(0.0f);
+        m_scene.skyColor = glm::vec3(0.0f);
+        m_scene.environmentIntensity = 0.0f;
+        std::filesystem::path environmentMap = std::move(m_scene.environmentMap);
+        m_scene.environmentMap.clear();
+        switch (target.type)
+        {
+        case LightGroup::Type::Punctual:
+        {
+            Light light = m_lights[target.index];
+            light.color = glm::vec3(1.0f);
+            light.intensity = 1.0f;
+            m_scene.lights.push_back(light);
+            break;
+        }
+        case LightGroup::Type::Emissive:
+            m_scene.materials[target.index].emission = glm::vec3(1.0f);
+            break;
+        case LightGroup::Type::Sky:
+            if (environmentMap.empty())
+                m_scene.skyColor = glm::vec3(1.0f);
+            m_scene.environmentMap = environmentMap;
+            m_scene.environmentIntensity = 1.0f;
+            break;
+        }
+
+        // The buffers are not lightmaps, so nothing is written out, and every group checkpoints to its own file.
+        BakeSettings settings = m_settings.bake;
+        settings.outputPath.clear();
+        if (!settings.checkpointPath.empty())
+            settings.checkpointPath += ".group" + std::to_string(group);
+        BakeEngine engine(m_scene, texels, settings, m_threadPool);
+        BakeStats stats = engine.Bake();
+        m_scene.environmentMap = std::move(environmentMap);
+
+        Lightmap lightmap = engine.GetLightmap();
+        std::vector<glm::vec3>& contribution = m_contributions[group];
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+            if (texels.IsCovered(i))
+                contribution[i] = glm::vec3(lightmap.texels[i]);
+        m_stats.groupsBaked++;
+        m_stats.texelsTraced += stats.coveredTexels;
+        m_stats.samples += stats.samples;
+    }
+
+    glm::vec3 IncrementalBaker::GetEmission(size_t group) const
+    {
+        const LightGroup& target = m_groups[group];
+        switch (target.type)
+        {
+        case LightGroup::Type::Punctual:
+            return m_lights[target.index].color * m_lights[target.index].intensity;
+        case LightGroup::Type::Emissive:
+            return m_emission[target.index];
+        case LightGroup::Type::Sky:
+            return m_scene.environmentMap.empty() ? m_skyColor : glm::vec3(m_environmentIntensity);
+        }
+        return glm::vec3(0.0f);
+    }
+
+    float IncrementalBaker::GetInfluenceRadius(const Light& light) const
+    {
+        // Irradiance at normal incidence falls off as intensity / d^2.
+        float strongest = light.intensity * std::max(light.color.x, std::max(light.color.y, light.color.z));
+        return std::sqrt(std::max(strongest, 0.0f) / std::max(m_settings.influenceIrradiance, 1e-12f));
+    }
+}
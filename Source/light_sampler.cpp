@@ -0,0 +1,250 @@
+#include "Bake/light_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        glm::vec3 ToGlm(const bvh::v2::Vec<float, 3>& v)
+        {
+            return glm::vec3(v[0], v[1], v[2]);
+        }
+
+        float SafeAcos(float x)
+        {
+            return std::acos(std::clamp(x, -1.0f, 1.0f));
+        }
+
+        // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b.
+        float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+        {
+            return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+        }
+
+        float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+        {
+            return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+        }
+
+        /**
+         * Smallest cone holding both orientation cones.
+         */
+        LightBounds Merge(const LightBounds& l, const LightBounds& r)
+        {
+            LightBounds merged;
+            merged.bounds = l.bounds;
+            merged.bounds.extend(r.bounds);
+            merged.power = l.power + r.power;
+            merged.cosThetaE = std::min(l.cosThetaE, r.cosThetaE);
+
+            const LightBounds& a = l.cosThetaO <= r.cosThetaO ? l : r;
+            const LightBounds& b = l.cosThetaO <= r.cosThetaO ? r : l;
+            float thetaA = SafeAcos(a.cosThetaO);
+            float thetaB = SafeAcos(b.cosThetaO);
+            float thetaD = SafeAcos(glm::dot(a.axis, b.axis));
+            merged.axis = a.axis;
+            merged.cosThetaO = a.cosThetaO;
+            if (thetaA >= kPi || std::min(thetaD + thetaB, kPi) <= thetaA)
+                return merged;
+
+            float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+            if (thetaO >= kPi)
+            {
+                merged.cosThetaO = -1.0f;
+                return merged;
+            }
+            // Rotate a's axis towards b's by the growth of the cone.
+            glm::vec3 ortho = b.axis - a.axis * glm::dot(a.axis, b.axis);
+            float length = glm::length(ortho);
+            if (length > 1e-6f)
+            {
+                float rotation = thetaO - thetaA;
+                merged.axis = glm::normalize(a.axis * std::cos(rotation) + ortho / length * std::sin(rotation));
+            }
+            merged.cosThetaO = std::cos(thetaO);
+            return merged;
+        }
+
+        /**
+         * Conservative estimate of the irradiance a light cluster delivers to
+         * a point with normal `normal`: the angles to the cone and to the
+         * normal are reduced by the angle the cluster's bounding sphere spans.
+         */
+        float Importance(const LightBounds& light, const glm::vec3& position, const glm::vec3& normal)
+        {
+            if (light.power <= 0.0f)
+                return 0.0f;
+            glm::vec3 center = ToGlm(light.bounds.get_center());
+            glm::vec3 diagonal = ToGlm(light.bounds.get_diagonal());
+            float radiusSquared = 0.25f * glm::dot(diagonal, diagonal);
+            glm::vec3 toLight = center - position;
+            float distanceSquared = glm::dot(toLight, toLight);
+            if (distanceSquared <= radiusSquared)
+                return light.power / std::max(radiusSquared, 1e-12f);
+
+            glm::vec3 direction = toLight / std::sqrt(distanceSquared);
+            float sinThetaB = std::sqrt(radiusSquared / distanceSquared);
+            float cosThetaB = std::sqrt(std::max(0.0f, 1.0f - sinThetaB * sinThetaB));
+
+            float cosThetaW = std::clamp(glm::dot(light.axis, -direction), -1.0f, 1.0f);
+            float sinThetaW = std::sqrt(std::max(0.0f, 1.0f - cosThetaW * cosThetaW));
+            float sinThetaO = std::sqrt(std::max(0.0f, 1.0f - light.cosThetaO * light.cosThetaO));
+            float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, light.cosThetaO);
+            float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, light.cosThetaO);
+            float cosThetaPrime = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+            if (cosThetaPrime < light.cosThetaE)
+                return 0.0f;
+
+            float cosThetaI = std::clamp(glm::dot(normal, direction), -1.0f, 1.0f);
+            float sinThetaI = std::sqrt(std::max(0.0f, 1.0f - cosThetaI * cosThetaI));
+            float cosThetaIPrime = CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+            if (cosThetaIPrime <= 0.0f)
+                return 0.0f;
+            return light.power * std::max(cosThetaPrime, 0.0f) * cosThetaIPrime / distanceSquared;
+        }
+    }
+
+    LightBounds LightBounds::FromLight(const Light& light)
+    {
+        LightBounds bounds;
+        bounds.bounds = bvh::v2::BBox<float, 3>(bvh::v2::Vec<float, 3>(light.position.x, light.position.y, light.position.z));
+        float intensity = light.intensity * Luminance(light.color);
+        if (light.type == Light::Type::Spot)
+        {
+            bounds.axis = glm::normalize(light.direction);
+            // Full intensity inside the inner cone, falling off to zero at the outer one.
+            float thetaInner = SafeAcos(light.cosInnerAngle);
+            bounds.cosThetaO = light.cosInnerAngle;
+            bounds.cosThetaE = std::cos(std::max(0.0f, SafeAcos(light.cosOuterAngle) - thetaInner));
+            // Flux of a cone halfway between the inner and outer angles.
+            bounds.power = 2.0f * kPi * (1.0f - 0.5f * (light.cosInnerAngle + light.cosOuterAngle)) * intensity;
+        }
+        else
+        {
+            bounds.cosThetaO = -1.0f;
+            bounds.cosThetaE = 0.0f;
+            bounds.power = 4.0f * kPi * intensity;
+        }
+        return bounds;
+    }
+
+    LightSampler::LightSampler(const std::vector<LightBounds>& lights, LightSamplingMode mode)
+        : m_lights(lights)
+        , m_mode(mode)
+    {
+        if (m_lights.empty())
+            return;
+
+        if (m_mode != LightSamplingMode::Bvh)
+        {
+            std::vector<float> weights(m_lights.size(), 1.0f);
+            if (m_mode == LightSamplingMode::Power)
+                for (size_t i = 0; i < m_lights.size(); ++i)
+                    weights[i] = m_lights[i].power;
+            m_table = AliasTable(weights);
+            return;
+        }
+
+        std::vector<uint32_t> order(m_lights.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        m_nodes.reserve(2 * m_lights.size() - 1);
+        m_nodes.emplace_back();
+        m_leafOfLight.resize(m_lights.size());
+        Build(0, order, 0, order.size());
+    }
+
+    void LightSampler::Build(uint32_t node, std::vector<uint32_t>& order, size_t begin, size_t end)
+    {
+        if (end - begin == 1)
+        {
+            m_nodes[node].bounds = m_lights[order[begin]];
+            m_nodes[node].light = order[begin];
+            m_leafOfLight[order[begin]] = node;
+            return;
+        }
+
+        // Median split on the widest axis of the light centers keeps the tree balanced.
+        auto centroids = bvh::v2::BBox<float, 3>::make_empty();
+        for (size_t i = begin; i < end; ++i)
+            centroids.extend(m_lights[order[i]].bounds.get_center());
+        glm::vec3 extent = ToGlm(centroids.get_diagonal());
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t l, uint32_t r) {
+            return m_lights[l].bounds.get_center()[axis] < m_lights[r].bounds.get_center()[axis];
+        });
+
+        uint32_t firstChild = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+        m_nodes.emplace_back();
+        m_nodes[firstChild].parent = node;
+        m_nodes[firstChild + 1].parent = node;
+        m_nodes[node].firstChild = firstChild;
+        Build(firstChild, order, begin, middle);
+        Build(firstChild + 1, order, middle, end);
+        m_nodes[node].bounds = Merge(m_nodes[firstChild].bounds, m_nodes[firstChild + 1].bounds);
+    }
+
+    bool LightSampler::Sample(const glm::vec3& position, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const
+    {
+        if (m_mode != LightSamplingMode::Bvh)
+            return m_table.Sample(u, light, pmf);
+        if (m_nodes.empty())
+            return false;
+
+        uint32_t node = 0;
+        pmf = 1.0f;
+        while (!m_nodes[node].IsLeaf())
+        {
+            uint32_t first = m_nodes[node].firstChild;
+            float left = Importance(m_nodes[first].bounds, position, normal);
+            float right = Importance(m_nodes[first + 1].bounds, position, normal);
+            if (left + right <= 0.0f)
+                return false;
+            float probability = left / (left + right);
+            // Reuse the remaining range of u for the next level.
+            if (u < probability)
+            {
+                u = std::min(u / probability, 0.99999994f);
+                pmf *= probability;
+                node = first;
+            }
+            else
+            {
+                u = std::min((u - probability) / (1.0f - probability), 0.99999994f);
+                pmf *= 1.0f - probability;
+                node = first + 1;
+            }
+        }
+        light = m_nodes[node].light;
+        return Importance(m_nodes[node].bounds, position, normal) > 0.0f;
+    }
+
+    float LightSampler::GetPmf(const glm::vec3& position, const glm::vec3& normal, uint32_t light) const
+    {
+        if (light >= m_lights.size())
+            return 0.0f;
+        if (m_mode != LightSamplingMode::Bvh)
+            return m_table.GetPmf(light);
+
+        uint32_t node = m_leafOfLight[light];
+        if (Importance(m_nodes[node].bounds, position, normal) <= 0.0f)
+            return 0.0f;
+        float pmf = 1.0f;
+        while (m_nodes[node].parent != kNoNode)
+        {
+            uint32_t first = m_nodes[m_nodes[node].parent].firstChild;
+            float left = Importance(m_nodes[first].bounds, position, normal);
+            float right = Importance(m_nodes[first + 1].bounds, position, normal);
+            if (left + right <= 0.0f)
+                return 0.0f;
+            pmf *= (node == first ? left : right) / (left + right);
+            node = m_nodes[node].parent;
+        }
+        return pmf;
+    }
+}
@@ -0,0 +1,88 @@
+#include "Bake/light_set.h"
+
+#include <algorithm>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Share of light samples given to the environment when the scene also has local lights.
+        constexpr float kEnvironmentShare = 0.5f;
+    }
+
+    LightSet::LightSet(const Scene& scene, LightSamplingMode mode, bvh::v2::ThreadPool& threadPool)
+        : m_scene(scene)
+    {
+        std::vector<LightBounds> bounds;
+        for (const Light& light : scene.lights)
+            bounds.push_back(LightBounds::FromLight(light));
+
+        m_lightOfTriangle.assign(scene.GetTriangleOffsets().back(), kNoLight);
+        uint32_t triangleId = 0;
+        for (const Mesh& mesh : scene.meshes)
+        {
+            const Material& material = scene.GetMaterial(mesh.materialIndex);
+            if (Luminance(material.emission) <= 0.0f)
+            {
+                triangleId += mesh.GetTriangleCount();
+                continue;
+            }
+
+            for (uint32_t t = 0; t < mesh.GetTriangleCount(); ++t, ++triangleId)
+            {
+                EmissiveTriangle triangle;
+                for (int k = 0; k < 3; ++k)
+                    triangle.vertices[k] = mesh.positions[mesh.indices[t * 3 + k]];
+                glm::vec3 cross = glm::cross(triangle.vertices[1] - triangle.vertices[0], triangle.vertices[2] - triangle.vertices[0]);
+                float length = glm::length(cross);
+                if (length <= 0.0f)
+                    continue;
+                triangle.normal = cross / length;
+                triangle.area = 0.5f * length;
+                triangle.radiance = material.emission;
+                triangle.triangleId = triangleId;
+
+                LightBounds light;
+                for (const glm::vec3& v : triangle.vertices)
+                    light.bounds.extend(bvh::v2::Vec<float, 3>(v.x, v.y, v.z));
+                light.axis = triangle.normal;
+                // Emits over the front hemisphere with a cosine falloff.
+                light.cosThetaO = 1.0f;
+                light.cosThetaE = 0.0f;
+                light.power = kPi * triangle.area * Luminance(triangle.radiance);
+                bounds.push_back(light);
+
+                m_lightOfTriangle[triangleId] = GetPunctualCount() + static_cast<uint32_t>(m_emissive.size());
+                m_emissive.push_back(triangle);
+            }
+        }
+
+        m_sampler = LightSampler(bounds, mode);
+
+        if (!scene.environmentMap.empty() && m_environment.Load(scene.environmentMap, scene.environmentIntensity, threadPool))
+            m_environmentProbability = bounds.empty() ? 1.0f : kEnvironmentShare;
+    }
+
+    bool LightSet::Sample(const glm::vec3& position, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const
+    {
+        if (u < m_environmentProbability)
+        {
+            light = kEnvironmentLight;
+            pmf = m_environmentProbability;
+            return true;
+        }
+        float remaining = 1.0f - m_environmentProbability;
+        if (!m_sampler.Sample(position, normal, std::min((u - m_environmentProbability) / remaining, 0.99999994f), light, pmf))
+            return false;
+        pmf *= remaining;
+        return true;
+    }
+
+    float LightSet::GetPmf(const glm::vec3& position, const glm::vec3& normal, uint32_t light) const
+    {
+        if (light == kEnvironmentLight)
+            return m_environmentProbability;
+        return (1.0f - m_environmentProbability) * m_sampler.GetPmf(position, normal, light);
+    }
+}
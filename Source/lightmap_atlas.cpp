@@ -0,0 +1,867 @@
+#include "Bake/lightmap_atlas.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <bvh/v2/executor.h>
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kInvalid = std::numeric_limits<uint32_t>::max();
+        constexpr float kPi = 3.14159265358979323846f;
+        constexpr int kRotationSteps = 16;
+        constexpr float kDegenerateAreaRatio = 1e-6f;
+        constexpr uint32_t kMaxPageFailures = 64;
+
+        /**
+         * One bit per texel, rows padded to whole 64-bit words.
+         */
+        struct Bitmap
+        {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t words = 0;
+            std::vector<uint64_t> bits;
+
+            void Resize(uint32_t w, uint32_t h)
+            {
+                width = w;
+                height = h;
+                words = (w + 63) / 64;
+                bits.assign(static_cast<size_t>(words) * h, 0);
+            }
+
+            bool Get(uint32_t x, uint32_t y) const
+            {
+                return (bits[y * words + (x >> 6)] >> (x & 63)) & 1;
+            }
+
+            void Set(uint32_t x, uint32_t y)
+            {
+                bits[y * words + (x >> 6)] |= uint64_t{1} << (x & 63);
+            }
+        };
+
+        struct ChartBuild
+        {
+            std::vector<uint32_t> triangles;
+            // Chart-local texel coordinates, three per triangle.
+            std::vector<glm::vec2> corners;
+            Bitmap raw;
+            Bitmap padded;
+
+            uint32_t atlasIndex = 0;
+            uint32_t x = 0;
+            uint32_t y = 0;
+            bool rotated = false;
+        };
+
+        struct AtlasPage
+        {
+            Bitmap occupancy;
+            // Longest run of free texels in every row, to reject rows without scanning them.
+            std::vector<uint32_t> freeRuns;
+            uint32_t hintY = 0;
+            uint32_t failures = 0;
+            uint32_t usedWidth = 0;
+            uint32_t usedHeight = 0;
+        };
+
+        uint32_t LongestRun(const Bitmap& bitmap, uint32_t y, bool value, uint32_t* start = nullptr)
+        {
+            uint32_t longest = 0, current = 0;
+            for (uint32_t x = 0; x < bitmap.width; ++x)
+            {
+                current = bitmap.Get(x, y) == value ? current + 1 : 0;
+                if (current > longest)
+                {
+                    longest = current;
+                    if (start)
+                        *start = x + 1 - current;
+                }
+            }
+            return longest;
+        }
+
+        /**
+         * Index of the first bit equal to `value` in [begin, end) of a bitmap row, or `end`.
+         */
+        uint32_t FindBit(const uint64_t* row, uint32_t begin, uint32_t end, bool value)
+        {
+            while (begin < end)
+            {
+                uint32_t offset = begin & 63;
+                uint64_t word = (value ? row[begin >> 6] : ~row[begin >> 6]) >> offset;
+                if (word)
+                    return std::min(end, begin + static_cast<uint32_t>(std::countr_zero(word)));
+                begin += 64 - offset;
+            }
+            return end;
+        }
+
+        Bitmap Rotate(const Bitmap& bitmap)
+        {
+            // (x, y) -> (y, width - 1 - x), matching the UV rotation in RotatePoint.
+            Bitmap rotated;
+            rotated.Resize(bitmap.height, bitmap.width);
+            for (uint32_t y = 0; y < bitmap.height; ++y)
+                for (uint32_t x = 0; x < bitmap.width; ++x)
+                    if (bitmap.Get(x, y))
+                        rotated.Set(y, bitmap.width - 1 - x);
+            return rotated;
+        }
+
+        glm::vec2 RotatePoint(const glm::vec2& p, uint32_t width)
+        {
+            return { p.y, static_cast<float>(width) - p.x };
+        }
+
+        /**
+         * Mark every texel whose square overlaps the triangle (separating axis test).
+         */
+        void RasterizeConservative(std::vector<uint8_t>& grid, uint32_t width, uint32_t height,
+                                   glm::vec2 a, glm::vec2 b, glm::vec2 c)
+        {
+            float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (area == 0.0f)
+            {
+                // Degenerate triangles still reserve the texels under their corners.
+                for (const glm::vec2& p : { a, b, c })
+                {
+                    uint32_t x = std::min(width - 1, static_cast<uint32_t>(std::max(0.0f, p.x)));
+                    uint32_t y = std::min(height - 1, static_cast<uint32_t>(std::max(0.0f, p.y)));
+                    grid[static_cast<size_t>(y) * width + x] = 1;
+                }
+                return;
+            }
+            if (area < 0.0f)
+                std::swap(b, c);
+
+            const glm::vec2 vertices[3] = { a, b, c };
+            glm::vec2 lo = glm::min(a, glm::min(b, c));
+            glm::vec2 hi = glm::max(a, glm::max(b, c));
+            int x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+            int y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+            int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(hi.x)));
+            int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(hi.y)));
+
+            for (int y = y0; y <= y1; ++y)
+            {
+                for (int x = x0; x <= x1; ++x)
+                {
+                    bool overlaps = true;
+                    for (int e = 0; e < 3 && overlaps; ++e)
+                    {
+                        glm::vec2 p = vertices[e];
+                        glm::vec2 q = vertices[(e + 1) % 3];
+                        glm::vec2 n(p.y - q.y, q.x - p.x);
+                        // Box corner furthest along the inward edge normal.
+                        glm::vec2 corner(x + (n.x > 0.0f ? 1.0f : 0.0f), y + (n.y > 0.0f ? 1.0f : 0.0f));
+                        overlaps = glm::dot(n, corner - p) >= 0.0f;
+                    }
+                    if (overlaps)
+                        grid[static_cast<size_t>(y) * width + x] = 1;
+                }
+            }
+        }
+
+        std::vector<uint32_t> BuildAdjacency(const Mesh& mesh, const std::vector<uint32_t>& canonical)
+        {
+            struct Edge
+            {
+                uint64_t key;
+                uint32_t corner;
+            };
+
+            uint32_t triangleCount = mesh.GetTriangleCount();
+            std::vector<Edge> edges(static_cast<size_t>(triangleCount) * 3);
+            for (uint32_t corner = 0; corner < edges.size(); ++corner)
+            {
+                uint32_t t = corner / 3;
+                uint64_t a = canonical[mesh.indices[corner]];
+                uint64_t b = canonical[mesh.indices[t * 3 + (corner + 1) % 3]];
+                edges[corner] = { std::min(a, b) << 32 | std::max(a, b), corner };
+            }
+            std::sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) {
+                return l.key < r.key || (l.key == r.key && l.corner < r.corner);
+            });
+
+            // Only manifold edges (exactly two incident triangles) connect charts.
+            std::vector<uint32_t> adjacency(edges.size(), kInvalid);
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t j = i + 1;
+                while (j < edges.size() && edges[j].key == edges[i].key)
+                    ++j;
+                if (j - i == 2)
+                {
+                    adjacency[edges[i].corner] = edges[i + 1].corner / 3;
+                    adjacency[edges[i + 1].corner] = edges[i].corner / 3;
+                }
+                i = j;
+            }
+            return adjacency;
+        }
+
+        void BuildMasks(ChartBuild& chart, uint32_t padding, uint32_t width, uint32_t height)
+        {
+            std::vector<uint8_t> grid(static_cast<size_t>(width) * height, 0);
+            for (size_t i = 0; i < chart.corners.size(); i += 3)
+                RasterizeConservative(grid, width, height, chart.corners[i], chart.corners[i + 1], chart.corners[i + 2]);
+
+            chart.raw.Resize(width, height);
+            for (uint32_t y = 0; y < height; ++y)
+                for (uint32_t x = 0; x < width; ++x)
+                    if (grid[static_cast<size_t>(y) * width + x])
+                        chart.raw.Set(x, y);
+
+            // Separable box dilation by `padding` texels.
+            std::vector<uint8_t> horizontal(grid.size(), 0);
+            int pad = static_cast<int>(padding);
+            for (int y = 0; y < static_cast<int>(height); ++y)
+                for (int x = 0; x < static_cast<int>(width); ++x)
+                    if (grid[static_cast<size_t>(y) * width + x])
+                        for (int dx = std::max(0, x - pad); dx <= std::min(static_cast<int>(width) - 1, x + pad); ++dx)
+                            horizontal[static_cast<size_t>(y) * width + dx] = 1;
+
+            chart.padded.Resize(width, height);
+            for (int y = 0; y < static_cast<int>(height); ++y)
+                for (int x = 0; x < static_cast<int>(width); ++x)
+                    if (horizontal[static_cast<size_t>(y) * width + x])
+                        for (int dy = std::max(0, y - pad); dy <= std::min(static_cast<int>(height) - 1, y + pad); ++dy)
+                            chart.padded.Set(x, dy);
+        }
+
+        // Axes of the plane a chart with seed `normal` is projected on.
+        void GetChartFrame(const glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent)
+        {
+            glm::vec3 up = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            tangent = glm::normalize(glm::cross(up, normal));
+            bitangent = glm::cross(normal, tangent);
+        }
+
+        /**
+         * Whether the interiors of two 2D triangles overlap, by separating
+         * axes along their edge normals; touching within `tolerance` (shared
+         * edges and vertices of neighbours) does not count.
+         */
+        bool TrianglesOverlap(const glm::vec2* a, const glm::vec2* b, float tolerance)
+        {
+            auto separated = [&](const glm::vec2* edges) {
+                for (int e = 0; e < 3; ++e)
+                {
+                    glm::vec2 axis(edges[e].y - edges[(e + 1) % 3].y, edges[(e + 1) % 3].x - edges[e].x);
+                    float aMin = std::numeric_limits<float>::max(), aMax = -aMin, bMin = aMin, bMax = -aMin;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        aMin = std::min(aMin, glm::dot(axis, a[k]));
+                        aMax = std::max(aMax, glm::dot(axis, a[k]));
+                        bMin = std::min(bMin, glm::dot(axis, b[k]));
+                        bMax = std::max(bMax, glm::dot(axis, b[k]));
+                    }
+                    float margin = tolerance * glm::length(axis);
+                    if (aMax <= bMin + margin || bMax <= aMin + margin)
+                        return true;
+                }
+                return false;
+            };
+            return !separated(a) && !separated(b);
+        }
+
+        /**
+         * Normals within 85 degrees of the seed still let a chart fold over
+         * itself in projection (a ramp curling back over itself, a helix), so
+         * the chart is regrown from its first triangle, leaving out triangles
+         * whose projection overlaps one already taken; those start further
+         * pieces. A chart that does not fold comes back whole.
+         */
+        std::vector<std::vector<uint32_t>> SplitFoldedChart(const Mesh& mesh, const std::vector<uint32_t>& triangles, const glm::vec3& normal,
+                                                            const std::vector<uint32_t>& adjacency, const std::vector<uint8_t>& degenerate)
+        {
+            glm::vec3 tangent, bitangent;
+            GetChartFrame(normal, tangent, bitangent);
+            size_t count = triangles.size();
+            std::vector<glm::vec2> corners(count * 3);
+            std::vector<glm::vec2> lower(count), upper(count);
+            float meanExtent = 0.0f;
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const glm::vec3& p = mesh.positions[mesh.indices[triangles[i] * 3 + k]];
+                    corners[i * 3 + k] = glm::vec2(glm::dot(p, tangent), glm::dot(p, bitangent));
+                }
+                lower[i] = glm::min(corners[i * 3], glm::min(corners[i * 3 + 1], corners[i * 3 + 2]));
+                upper[i] = glm::max(corners[i * 3], glm::max(corners[i * 3 + 1], corners[i * 3 + 2]));
+                meanExtent += glm::max(upper[i].x - lower[i].x, upper[i].y - lower[i].y) / static_cast<float>(count);
+            }
+            std::unordered_map<uint32_t, uint32_t> localIndex;
+            for (size_t i = 0; i < count; ++i)
+                localIndex[triangles[i]] = static_cast<uint32_t>(i);
+
+            // Taken triangles of the current piece, bucketed on a grid of about two triangles per cell.
+            float cellSize = std::max(2.0f * meanExtent, 1e-6f);
+            float tolerance = 1e-4f * meanExtent;
+            std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+            auto forCells = [&](size_t i, auto&& visit) {
+                glm::ivec2 first(glm::floor(lower[i] / cellSize));
+                glm::ivec2 last(glm::floor(upper[i] / cellSize));
+                for (int y = first.y; y <= last.y; ++y)
+                    for (int x = first.x; x <= last.x; ++x)
+                        if (visit(static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y)))
+                            return true;
+                return false;
+            };
+            auto overlapsPiece = [&](size_t i) {
+                return forCells(i, [&](uint64_t cell) {
+                    auto found = grid.find(cell);
+                    if (found == grid.end())
+                        return false;
+                    for (uint32_t j : found->second)
+                        if (TrianglesOverlap(&corners[i * 3], &corners[j * 3], tolerance))
+                            return true;
+                    return false;
+                });
+            };
+
+            std::vector<std::vector<uint32_t>> pieces;
+            std::vector<uint8_t> taken(count, 0);
+            // Per triangle, the piece that last considered it.
+            std::vector<uint32_t> visited(count, kInvalid);
+            std::vector<uint32_t> queue;
+            for (size_t start = 0; start < count; ++start)
+            {
+                if (taken[start] || degenerate[triangles[start]])
+                    continue;
+                uint32_t piece = static_cast<uint32_t>(pieces.size());
+                std::vector<uint32_t>& out = pieces.emplace_back();
+                grid.clear();
+                queue.assign(1, static_cast<uint32_t>(start));
+                visited[start] = piece;
+                while (!queue.empty())
+                {
+                    uint32_t i = queue.back();
+                    queue.pop_back();
+                    bool flat = degenerate[triangles[i]];
+                    if (!flat && overlapsPiece(i))
+                        continue;
+                    taken[i] = 1;
+                    out.push_back(triangles[i]);
+                    // Degenerate triangles have no area to overlap with.
+                    if (!flat)
+                        forCells(i, [&](uint64_t cell) {
+                            grid[cell].push_back(i);
+                            return false;
+                        });
+                    for (uint32_t k = 0; k < 3; ++k)
+                    {
+                        uint32_t neighbor = adjacency[triangles[i] * 3 + k];
+                        auto found = neighbor == kInvalid ? localIndex.end() : localIndex.find(neighbor);
+                        if (found == localIndex.end() || taken[found->second] || visited[found->second] == piece)
+                            continue;
+                        visited[found->second] = piece;
+                        queue.push_back(found->second);
+                    }
+                }
+            }
+            // Degenerate triangles no piece reached ride along with the first one.
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (taken[i])
+                    continue;
+                if (pieces.empty())
+                    pieces.emplace_back();
+                pieces.front().push_back(triangles[i]);
+            }
+            return pieces;
+        }
+
+        /**
+         * Project the chart on the plane of its seed normal, rotate it to the
+         * smallest bounding box and rasterize its packing masks.
+         */
+        void ParameterizeChart(ChartBuild& chart, const Mesh& mesh, const glm::vec3& normal, const AtlasOptions& options)
+        {
+            glm::vec3 tangent, bitangent;
+            GetChartFrame(normal, tangent, bitangent);
+
+            chart.corners.resize(chart.triangles.size() * 3);
+            for (size_t i = 0; i < chart.triangles.size(); ++i)
+            {
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const glm::vec3& p = mesh.positions[mesh.indices[chart.triangles[i] * 3 + k]];
+                    chart.corners[i * 3 + k] = glm::vec2(glm::dot(p, tangent), glm::dot(p, bitangent)) * options.texelsPerUnit;
+                }
+            }
+
+            float bestArea = std::numeric_limits<float>::max();
+            float bestAngle = 0.0f;
+            for (int step = 0; step < kRotationSteps; ++step)
+            {
+                float angle = 0.5f * kPi * step / kRotationSteps;
+                float c = std::cos(angle), s = std::sin(angle);
+                glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+                for (const glm::vec2& p : chart.corners)
+                {
+                    glm::vec2 r(c * p.x - s * p.y, s * p.x + c * p.y);
+                    lo = glm::min(lo, r);
+                    hi = glm::max(hi, r);
+                }
+                float area = (hi.x - lo.x) * (hi.y - lo.y);
+                if (area < bestArea)
+                {
+                    bestArea = area;
+                    bestAngle = angle;
+                }
+            }
+
+            float c = std::cos(bestAngle), s = std::sin(bestAngle);
+            glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+            for (glm::vec2& p : chart.corners)
+            {
+                p = glm::vec2(c * p.x - s * p.y, s * p.x + c * p.y);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+
+            // Charts larger than a page are scaled down to fit.
+            float pad = static_cast<float>(options.padding);
+            float maxExtent = static_cast<float>(options.maxAtlasSize) - 2.0f * pad - 2.0f;
+            glm::vec2 extent = hi - lo;
+            float scale = std::min(1.0f, maxExtent / std::max(1e-6f, std::max(extent.x, extent.y)));
+            for (glm::vec2& p : chart.corners)
+                p = (p - lo) * scale + glm::vec2(pad + 0.5f);
+
+            uint32_t width = static_cast<uint32_t>(std::ceil(extent.x * scale)) + 2 * options.padding + 1;
+            uint32_t height = static_cast<uint32_t>(std::ceil(extent.y * scale)) + 2 * options.padding + 1;
+            BuildMasks(chart, options.padding, width, height);
+        }
+
+        std::vector<ChartBuild> SegmentMesh(const Mesh& mesh, const AtlasOptions& options)
+        {
+            uint32_t triangleCount = mesh.GetTriangleCount();
+            std::vector<glm::vec3> normals(triangleCount);
+            std::vector<float> areas(triangleCount);
+            for (uint32_t t = 0; t < triangleCount; ++t)
+            {
+                const glm::vec3& a = mesh.positions[mesh.indices[t * 3 + 0]];
+                const glm::vec3& b = mesh.positions[mesh.indices[t * 3 + 1]];
+                const glm::vec3& c = mesh.positions[mesh.indices[t * 3 + 2]];
+                glm::vec3 n = glm::cross(b - a, c - a);
+                float length = glm::length(n);
+                areas[t] = 0.5f * length;
+                normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+            }
+
+            // Slivers far below the average triangle area have unreliable normals.
+            float meanArea = 0.0f;
+            for (float area : areas)
+                meanArea += area / std::max(1u, triangleCount);
+            std::vector<uint8_t> degenerate(triangleCount);
+            for (uint32_t t = 0; t < triangleCount; ++t)
+                degenerate[t] = areas[t] <= kDegenerateAreaRatio * meanArea;
+
+            std::vector<uint32_t> canonical = WeldPositions(mesh.positions);
+            std::vector<uint32_t> adjacency = BuildAdjacency(mesh, canonical);
+            std::vector<uint32_t> seeds(triangleCount);
+            for (uint32_t t = 0; t < triangleCount; ++t)
+                seeds[t] = t;
+            std::stable_sort(seeds.begin(), seeds.end(), [&](uint32_t l, uint32_t r) { return areas[l] > areas[r]; });
+
+            float cosThreshold = std::cos(std::min(options.maxChartAngleDegrees, 85.0f) * kPi / 180.0f);
+            std::vector<uint32_t> chartOf(triangleCount, kInvalid);
+            std::vector<ChartBuild> charts;
+            std::vector<glm::vec3> seedNormals;
+            std::vector<uint32_t> stack;
+            std::vector<uint32_t> pending;
+            for (uint32_t seed : seeds)
+            {
+                if (chartOf[seed] != kInvalid)
+                    continue;
+
+                // Degenerate triangles have no normal; they join an adjacent chart when there is one.
+                if (degenerate[seed])
+                {
+                    uint32_t joined = kInvalid;
+                    for (uint32_t k = 0; k < 3 && joined == kInvalid; ++k)
+                    {
+                        uint32_t neighbor = adjacency[seed * 3 + k];
+                        if (neighbor != kInvalid)
+                            joined = chartOf[neighbor];
+                    }
+                    if (joined != kInvalid)
+                    {
+                        chartOf[seed] = joined;
+                        charts[joined].triangles.push_back(seed);
+                    }
+                    else
+                    {
+                        pending.push_back(seed);
+                    }
+                    continue;
+                }
+
+                glm::vec3 seedNormal = normals[seed];
+                uint32_t chartIndex = static_cast<uint32_t>(charts.size());
+                ChartBuild& chart = charts.emplace_back();
+                seedNormals.push_back(seedNormal);
+                chartOf[seed] = chartIndex;
+                stack.push_back(seed);
+                while (!stack.empty())
+                {
+                    uint32_t t = stack.back();
+                    stack.pop_back();
+                    chart.triangles.push_back(t);
+                    for (uint32_t k = 0; k < 3; ++k)
+                    {
+                        uint32_t neighbor = adjacency[t * 3 + k];
+                        if (neighbor == kInvalid || chartOf[neighbor] != kInvalid)
+                            continue;
+                        if (!degenerate[neighbor] && glm::dot(normals[neighbor], seedNormal) < cosThreshold)
+                            continue;
+                        chartOf[neighbor] = chartIndex;
+                        stack.push_back(neighbor);
+                    }
+                }
+            }
+
+            // Degenerate triangles around collapsed vertices (e.g. poles) have no
+            // manifold neighbour; attach them to a chart sharing one of their vertices.
+            std::vector<uint32_t> vertexChart(mesh.positions.size(), kInvalid);
+            for (uint32_t t = 0; t < triangleCount; ++t)
+                if (chartOf[t] != kInvalid)
+                    for (uint32_t k = 0; k < 3; ++k)
+                        vertexChart[canonical[mesh.indices[t * 3 + k]]] = chartOf[t];
+            for (uint32_t t : pending)
+            {
+                for (uint32_t k = 0; k < 3 && chartOf[t] == kInvalid; ++k)
+                    chartOf[t] = vertexChart[canonical[mesh.indices[t * 3 + k]]];
+                if (chartOf[t] == kInvalid)
+                {
+                    chartOf[t] = static_cast<uint32_t>(charts.size());
+                    charts.emplace_back();
+                    seedNormals.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+                }
+                charts[chartOf[t]].triangles.push_back(t);
+            }
+
+            // Greedy growth leaves slivers along chart borders; fold small charts
+            // into a neighbour whose seed plane still accepts all their triangles.
+            std::vector<uint32_t> bySize(charts.size());
+            for (uint32_t i = 0; i < bySize.size(); ++i)
+                bySize[i] = i;
+            std::stable_sort(bySize.begin(), bySize.end(), [&](uint32_t l, uint32_t r) {
+                return charts[l].triangles.size() < charts[r].triangles.size();
+            });
+            for (uint32_t source : bySize)
+            {
+                for (uint32_t t : charts[source].triangles)
+                {
+                    uint32_t target = kInvalid;
+                    for (uint32_t k = 0; k < 3 && target == kInvalid; ++k)
+                    {
+                        uint32_t neighbor = adjacency[t * 3 + k];
+                        if (neighbor == kInvalid || chartOf[neighbor] == source)
+                            continue;
+                        uint32_t candidate = chartOf[neighbor];
+                        bool accepts = true;
+                        for (uint32_t u : charts[source].triangles)
+                            accepts = accepts && (degenerate[u] || glm::dot(normals[u], seedNormals[candidate]) >= cosThreshold);
+                        if (accepts)
+                            target = candidate;
+                    }
+                    if (target == kInvalid)
+                        continue;
+                    for (uint32_t u : charts[source].triangles)
+                        chartOf[u] = target;
+                    charts[target].triangles.insert(charts[target].triangles.end(), charts[source].triangles.begin(), charts[source].triangles.end());
+                    charts[source].triangles.clear();
+                    break;
+                }
+            }
+
+            std::vector<ChartBuild> merged;
+            for (size_t i = 0; i < charts.size(); ++i)
+            {
+                if (charts[i].triangles.empty())
+                    continue;
+                for (std::vector<uint32_t>& piece : SplitFoldedChart(mesh, charts[i].triangles, seedNormals[i], adjacency, degenerate))
+                {
+                    ChartBuild& chart = merged.emplace_back();
+                    chart.triangles = std::move(piece);
+                    std::sort(chart.triangles.begin(), chart.triangles.end());
+                    ParameterizeChart(chart, mesh, seedNormals[i], options);
+                }
+            }
+            return merged;
+        }
+
+        bool Fits(const AtlasPage& page, const Bitmap& mask, uint32_t x, uint32_t y)
+        {
+            const Bitmap& atlas = page.occupancy;
+            uint32_t shift = x & 63;
+            for (uint32_t row = 0; row < mask.height; ++row)
+            {
+                const uint64_t* atlasRow = &atlas.bits[(y + row) * atlas.words + (x >> 6)];
+                const uint64_t* maskRow = &mask.bits[row * mask.words];
+                for (uint32_t w = 0; w < mask.words; ++w)
+                {
+                    uint64_t bits = maskRow[w];
+                    if (!bits)
+                        continue;
+                    if (atlasRow[w] & (bits << shift))
+                        return false;
+                    if (shift && (x >> 6) + w + 1 < atlas.words && (atlasRow[w + 1] & (bits >> (64 - shift))))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        void Stamp(AtlasPage& page, const Bitmap& mask, uint32_t x, uint32_t y)
+        {
+            for (uint32_t row = 0; row < mask.height; ++row)
+                for (uint32_t col = 0; col < mask.width; ++col)
+                    if (mask.Get(col, row))
+                        page.occupancy.Set(x + col, y + row);
+            for (uint32_t row = 0; row < mask.height; ++row)
+                page.freeRuns[y + row] = LongestRun(page.occupancy, y + row, false);
+            page.usedWidth = std::max(page.usedWidth, x + mask.width);
+            page.usedHeight = std::max(page.usedHeight, y + mask.height);
+        }
+
+        /**
+         * Bottom-left search for the first position where the padded mask does
+         * not touch any texel already covered on the page.
+         */
+        bool FindPosition(const AtlasPage& page, const Bitmap& mask, uint32_t& outX, uint32_t& outY)
+        {
+            const Bitmap& atlas = page.occupancy;
+            if (mask.width > atlas.width || mask.height > atlas.height)
+                return false;
+
+            // The widest run of the mask must land on free texels; checking it
+            // first lets us hop over occupied runs instead of testing every x.
+            uint32_t widestRow = 0, widestStart = 0, widestRun = 0;
+            for (uint32_t row = 0; row < mask.height; ++row)
+            {
+                uint32_t start = 0;
+                uint32_t run = LongestRun(mask, row, true, &start);
+                if (run > widestRun)
+                {
+                    widestRow = row;
+                    widestStart = start;
+                    widestRun = run;
+                }
+            }
+
+            // Start at the row of the previous placement: charts come sorted by
+            // height, so rows above it are mostly filled. Wrap around to keep the
+            // search exhaustive.
+            uint32_t rows = atlas.height - mask.height + 1;
+            uint32_t startY = std::min(page.hintY, rows - 1);
+            for (uint32_t i = 0; i < rows; ++i)
+            {
+                uint32_t y = (startY + i) % rows;
+                if (page.freeRuns[y + widestRow] < widestRun)
+                    continue;
+
+                const uint64_t* row = &atlas.bits[(y + widestRow) * atlas.words];
+                for (uint32_t x = 0; x + mask.width <= atlas.width;)
+                {
+                    uint32_t begin = x + widestStart;
+                    uint32_t hit = FindBit(row, begin, begin + widestRun, true);
+                    if (hit != begin + widestRun)
+                    {
+                        x = FindBit(row, hit, atlas.width, false) - widestStart;
+                        continue;
+                    }
+                    if (Fits(page, mask, x, y))
+                    {
+                        outX = x;
+                        outY = y;
+                        return true;
+                    }
+                    ++x;
+                }
+            }
+            return false;
+        }
+
+        void PackCharts(std::vector<ChartBuild*>& charts, std::vector<AtlasPage>& pages, uint32_t pageSize)
+        {
+            std::stable_sort(charts.begin(), charts.end(), [](const ChartBuild* l, const ChartBuild* r) {
+                uint32_t lh = std::max(l->padded.width, l->padded.height);
+                uint32_t rh = std::max(r->padded.width, r->padded.height);
+                return lh > rh || (lh == rh && l->padded.width * l->padded.height > r->padded.width * r->padded.height);
+            });
+
+            for (ChartBuild* chart : charts)
+            {
+                Bitmap rotatedPadded = Rotate(chart->padded);
+                bool placed = false;
+                for (uint32_t pageIndex = 0; !placed; ++pageIndex)
+                {
+                    if (pageIndex == pages.size())
+                    {
+                        AtlasPage& page = pages.emplace_back();
+                        page.occupancy.Resize(pageSize, pageSize);
+                        page.freeRuns.assign(pageSize, pageSize);
+                    }
+                    AtlasPage& page = pages[pageIndex];
+                    if (page.failures >= kMaxPageFailures)
+                        continue;
+
+                    uint32_t x = 0, y = 0, rx = 0, ry = 0;
+                    bool fits = FindPosition(page, chart->padded, x, y);
+                    bool rotatedFits = FindPosition(page, rotatedPadded, rx, ry);
+                    if (rotatedFits && (!fits || ry + rotatedPadded.height < y + chart->padded.height))
+                    {
+                        chart->rotated = true;
+                        x = rx;
+                        y = ry;
+                        fits = true;
+                    }
+                    if (!fits)
+                    {
+                        // A page that keeps rejecting charts is full for practical purposes.
+                        ++page.failures;
+                        continue;
+                    }
+
+                    chart->atlasIndex = pageIndex;
+                    chart->x = x;
+                    chart->y = y;
+                    page.hintY = y;
+                    // Stamp the raw coverage: testing padded masks against raw
+                    // coverage keeps `padding` texels between any two charts.
+                    Stamp(page, chart->rotated ? Rotate(chart->raw) : chart->raw, x, y);
+                    placed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> WeldPositions(const std::vector<glm::vec3>& positions)
+    {
+        std::vector<uint32_t> order(positions.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        auto less = [&](uint32_t l, uint32_t r) {
+            const glm::vec3& a = positions[l];
+            const glm::vec3& b = positions[r];
+            if (a.x != b.x) return a.x < b.x;
+            if (a.y != b.y) return a.y < b.y;
+            return a.z < b.z;
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        std::vector<uint32_t> canonical(positions.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            bool same = i > 0 && positions[order[i]] == positions[order[i - 1]];
+            canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+        }
+        return canonical;
+    }
+
+    AtlasGenerator::AtlasGenerator(const AtlasOptions& options)
+        : m_options(options)
+    {
+    }
+
+    LightmapAtlas AtlasGenerator::Generate(const Scene& scene, bvh::v2::ThreadPool& threadPool) const
+    {
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        size_t meshCount = scene.meshes.size();
+
+        std::vector<std::vector<ChartBuild>> meshCharts(meshCount);
+        executor.for_each(0, meshCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                meshCharts[i] = SegmentMesh(scene.meshes[i], m_options);
+        });
+
+        std::vector<ChartBuild*> packOrder;
+        for (std::vector<ChartBuild>& charts : meshCharts)
+            for (ChartBuild& chart : charts)
+                packOrder.push_back(&chart);
+        std::vector<AtlasPage> pages;
+        PackCharts(packOrder, pages, m_options.maxAtlasSize);
+
+        LightmapAtlas atlas;
+        atlas.atlasCount = static_cast<uint32_t>(pages.size());
+        for (const AtlasPage& page : pages)
+        {
+            atlas.width = std::max(atlas.width, page.usedWidth);
+            atlas.height = std::max(atlas.height, page.usedHeight);
+        }
+        // Keep pages block-aligned for compressed formats.
+        atlas.width = (atlas.width + 3) & ~3u;
+        atlas.height = (atlas.height + 3) & ~3u;
+
+        std::vector<uint32_t> chartBase(meshCount, 0);
+        for (size_t i = 0; i < meshCount; ++i)
+        {
+            chartBase[i] = static_cast<uint32_t>(atlas.charts.size());
+            for (const ChartBuild& chart : meshCharts[i])
+            {
+                AtlasChart& out = atlas.charts.emplace_back();
+                out.meshIndex = static_cast<uint32_t>(i);
+                out.atlasIndex = chart.atlasIndex;
+                out.x = chart.x;
+                out.y = chart.y;
+                out.width = chart.rotated ? chart.padded.height : chart.padded.width;
+                out.height = chart.rotated ? chart.padded.width : chart.padded.height;
+            }
+        }
+
+        atlas.meshes.resize(meshCount);
+        glm::vec2 invSize(1.0f / std::max(1u, atlas.width), 1.0f / std::max(1u, atlas.height));
+        executor.for_each(0, meshCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Mesh& mesh = scene.meshes[i];
+                AtlasMesh& out = atlas.meshes[i];
+                out.indices.resize(mesh.indices.size());
+                out.triangleCharts.resize(mesh.GetTriangleCount());
+
+                std::vector<uint32_t> remap(mesh.positions.size(), kInvalid);
+                for (size_t c = 0; c < meshCharts[i].size(); ++c)
+                {
+                    const ChartBuild& chart = meshCharts[i][c];
+                    glm::vec2 origin(static_cast<float>(chart.x), static_cast<float>(chart.y));
+                    for (size_t k = 0; k < chart.triangles.size(); ++k)
+                    {
+                        uint32_t t = chart.triangles[k];
+                        out.triangleCharts[t] = chartBase[i] + static_cast<uint32_t>(c);
+                        for (uint32_t j = 0; j < 3; ++j)
+                        {
+                            uint32_t source = mesh.indices[t * 3 + j];
+                            if (remap[source] == kInvalid)
+                            {
+                                glm::vec2 p = chart.corners[k * 3 + j];
+                                if (chart.rotated)
+                                    p = RotatePoint(p, chart.raw.width);
+                                remap[source] = static_cast<uint32_t>(out.xref.size());
+                                out.xref.push_back(source);
+                                out.uvs.push_back((origin + p) * invSize);
+                            }
+                            out.indices[t * 3 + j] = remap[source];
+                        }
+                    }
+                    // Vertices are split per chart, so forget this chart's mapping.
+                    for (uint32_t t : chart.triangles)
+                        for (uint32_t j = 0; j < 3; ++j)
+                            remap[mesh.indices[t * 3 + j]] = kInvalid;
+                }
+            }
+        });
+        return atlas;
+    }
+}
@@ -9,18 +9,34 @@
 #define GLM_FORCE_LEFT_HANDED
 #include <glm/glm.hpp> // all types inspired from GLSL
 #include <glm/ext.hpp>
+#include <glm/gtc/packing.hpp>
 
 #ifdef __EMSCRIPTEN__
 #  include <emscripten.h>
 #endif // __EMSCRIPTEN__
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <filesystem>
+#include <string>
 #include <vector>
 #include <array>
 
 #include "ResourceManager.h"
 #include "Utility/utility.h"
+#include "Bake/lightmap_atlas.h"
+#include "Bake/texel_rasterizer.h"
+#include "Bake/bake_engine.h"
+#include "Bake/bake_checkpoint.h"
+#include "Bake/denoiser.h"
+#include "Bake/bc6h_encoder.h"
+#include "Bake/gpu_baker.h"
+#include "Bake/directional_lightmap.h"
+#include "Bake/prt_lightmap.h"
+#include "Bake/seam_stitcher.h"
+#include "Bake/time_of_day.h"
+#include "Utility/exr_writer.h"
 using namespace wgpu;
 
 using glm::mat4x4;
@@ -52,6 +68,12 @@ private:
 		vec4 color;
 		float time;
 		float _pad[3];
+		// Sky and sun projected on SH (rgb), which the shader relights the PRT transfer with
+		vec4 lightSh[LightChef::kMaxShCoefficients];
+		// Time-of-day basis layers to blend (x, y), the weight of y (z) and 1 while the cycle plays (w)
+		vec4 timeOfDay;
+		vec4 cycleSunColor;
+		vec4 cycleSkyColor;
 	};
 	// Have the compiler check byte alignment
 	static_assert(sizeof(MyUniforms) % 16 == 0);
@@ -64,6 +86,13 @@ private:
 	RequiredLimits GetRequiredLimits(Adapter adapter) const;
 	void InitializeTextures();
 	void InitializeBuffers();
+	void InitializeLightmapTextures(const LightChef::Lightmap& lightmap, const LightChef::Lightmap& directional);
+	void InitializeTransferTexture(const LightChef::PrtLightmap& prt);
+	// Projects the sky and the sun at the current angles into the uniforms
+	void UpdateLighting();
+	void InitializeTimeOfDayTexture(const LightChef::TimeOfDayLightmaps& lightmaps);
+	// Picks the basis layers and light colours of `hour` for the shader to blend
+	void UpdateTimeOfDay(float hour);
 	void InitializeBindGroups();
 
 private:
@@ -88,9 +117,258 @@ private:
 	uint32_t uniformStride;
 	Texture depthTexture;
 	TextureView depthTextureView;
+	// Set when the device has BC texture compression, so the lightmap goes up as BC6H
+	bool compressedLightmaps = false;
+	Texture lightmapTexture;
+	TextureView lightmapTextureView;
+	Texture directionalTexture;
+	TextureView directionalTextureView;
+	// PRT transfer of the sky and sun, one array layer per SH coefficient
+	Texture transferTexture;
+	TextureView transferTextureView;
+	vec3 skyColor = vec3(0.0f);
+	vec3 sunIrradiance = vec3(0.0f);
+	// Dragging with the left button moves the sun
+	float sunAzimuth = 0.8f;
+	float sunElevation = 0.9f;
+	// Time-of-day bases, one array layer per sun keyframe and one for the sky; T plays the cycle
+	Texture timeOfDayTexture;
+	TextureView timeOfDayTextureView;
+	LightChef::TimeOfDayLightmaps timeOfDay;
+	bool timeOfDayPreview = false;
+	bool timeOfDayKeyDown = false;
+	Sampler lightmapSampler;
 };
 
-int main() {
+LightChef::Mesh MakeQuad(vec3 a, vec3 b, vec3 c, vec3 d, uint32_t materialIndex) {
+	LightChef::Mesh mesh;
+	mesh.positions = { a, b, c, d };
+	mesh.indices = { 0, 1, 2, 0, 2, 3 };
+	mesh.materialIndex = materialIndex;
+	return mesh;
+}
+
+/**
+ * Bakes the pyramid on a floor, lit by a point light, a spot light, an
+ * emissive panel and the sky, with the CPU baker, the GPU baker, and both
+ * sharing the tiles. All draw the same Sobol samples per texel, so they
+ * must agree up to floating point differences that send a few paths elsewhere.
+ */
+int RunGpuCheck(bool forceFallbackAdapter) {
+	Instance instance = wgpuCreateInstance(nullptr);
+	RequestAdapterOptions adapterOpts = {};
+	adapterOpts.compatibleSurface = nullptr;
+	// The fallback adapter is a software rasterizer (lavapipe, WARP, SwiftShader), so this also runs on machines without a GPU
+	adapterOpts.forceFallbackAdapter = forceFallbackAdapter;
+	Adapter adapter = instance.requestAdapter(adapterOpts);
+	instance.release();
+	if (!adapter) {
+		std::cerr << "Could not get an adapter!" << std::endl;
+		return 1;
+	}
+	DeviceDescriptor deviceDesc = {};
+	deviceDesc.label = "Bake device";
+	deviceDesc.requiredFeatureCount = 0;
+	deviceDesc.requiredLimits = nullptr;
+	deviceDesc.defaultQueue.nextInChain = nullptr;
+	deviceDesc.defaultQueue.label = "Bake queue";
+	Device device = adapter.requestDevice(deviceDesc);
+	adapter.release();
+
+	std::vector<float> pointData;
+	std::vector<uint16_t> indexData;
+	if (!ResourceManager::loadGeometry(RESOURCE_DIR "/pyramid.txt", pointData, indexData, 3)) {
+		std::cerr << "Could not load geometry!" << std::endl;
+		return 1;
+	}
+	LightChef::Scene scene;
+	scene.meshes.push_back(ResourceManager::makeMesh(pointData, indexData, 6));
+	scene.meshes.push_back(MakeQuad({ -2.0f, -2.0f, -0.3f }, { 2.0f, -2.0f, -0.3f }, { 2.0f, 2.0f, -0.3f }, { -2.0f, 2.0f, -0.3f }, 1));
+	scene.meshes.push_back(MakeQuad({ 0.6f, -0.2f, 1.2f }, { 0.6f, 0.2f, 1.2f }, { 1.0f, 0.2f, 1.2f }, { 1.0f, -0.2f, 1.2f }, 2));
+	scene.materials = { { vec3(0.8f), vec3(0.0f) }, { vec3(0.6f, 0.5f, 0.4f), vec3(0.0f) }, { vec3(0.8f), vec3(8.0f, 7.0f, 5.0f) } };
+	scene.skyColor = vec3(0.3f, 0.35f, 0.45f);
+	LightChef::Light point;
+	point.position = vec3(0.8f, -0.6f, 1.5f);
+	point.intensity = 3.0f;
+	LightChef::Light spot = point;
+	spot.type = LightChef::Light::Type::Spot;
+	spot.position = vec3(-0.8f, 0.5f, 1.5f);
+	spot.direction = vec3(0.0f, 0.0f, -1.0f);
+	spot.cosInnerAngle = 0.9f;
+	spot.cosOuterAngle = 0.7f;
+	scene.lights = { point, spot };
+
+	bvh::v2::ThreadPool threadPool;
+	LightChef::LightmapAtlas atlas = LightChef::AtlasGenerator().Generate(scene, threadPool);
+	LightChef::TexelBuffer texels = LightChef::TexelRasterizer().Rasterize(scene, atlas, threadPool);
+
+	// The CPU reference takes exactly as many samples per texel, with the light sampling the GPU implements
+	LightChef::BakeSettings bakeSettings;
+	bakeSettings.minSamples = 64;
+	bakeSettings.maxSamples = bakeSettings.minSamples;
+	bakeSettings.lightSampling = LightChef::LightSamplingMode::Power;
+	LightChef::BakeEngine cpuBaker(scene, texels, bakeSettings, threadPool);
+	LightChef::BakeStats cpuStats = cpuBaker.Bake();
+
+	LightChef::LightSet lights(scene, bakeSettings.lightSampling, threadPool);
+	LightChef::GpuBakeScene gpuScene;
+	if (!LightChef::BuildGpuBakeScene(cpuBaker.GetRayTracer(), lights, texels, gpuScene)) {
+		std::cerr << "The GPU baker does not support this scene!" << std::endl;
+		return 1;
+	}
+	LightChef::GpuBakeSettings gpuSettings;
+	gpuSettings.samplesPerTexel = bakeSettings.minSamples;
+	gpuSettings.maxBounces = bakeSettings.maxBounces;
+	LightChef::GpuBaker gpuBaker(device, gpuSettings);
+	if (!gpuBaker.Initialize(gpuScene, texels.width, texels.height, texels.atlasCount, RESOURCE_DIR "/lightmap_bake.wgsl")) {
+		std::cerr << "Could not load the bake shader!" << std::endl;
+		return 1;
+	}
+	LightChef::GpuBakeStats gpuStats = gpuBaker.Bake();
+	std::vector<LightChef::GpuAccumulator> accumulators;
+	if (!gpuBaker.ReadAccumulators(accumulators)) {
+		std::cerr << "Could not read the GPU bake back!" << std::endl;
+		return 1;
+	}
+
+	std::cout << "GPU bake: " << gpuStats.samples << " samples in " << gpuStats.dispatches << " dispatches, " << gpuStats.seconds << "s"
+		<< " (CPU " << cpuStats.seconds << "s)" << std::endl;
+
+	// Compares the means of the GPU's texel list against the CPU reference
+	auto compare = [&](const char* name, const std::vector<vec3>& means) {
+		size_t matching = 0;
+		double cpuLuminance = 0.0;
+		double otherLuminance = 0.0;
+		for (size_t i = 0; i < means.size(); ++i) {
+			const LightChef::TexelAccumulator& reference = cpuBaker.GetAccumulators()[gpuScene.texels[i].index];
+			vec3 cpuMean = reference.irradianceSum / static_cast<float>(std::max(reference.sampleCount, 1u));
+			cpuLuminance += LightChef::Luminance(cpuMean);
+			otherLuminance += LightChef::Luminance(means[i]);
+			if (glm::length(means[i] - cpuMean) <= 0.01f * std::max(glm::length(cpuMean), 1e-3f)) {
+				matching++;
+			}
+		}
+		double meanDifference = std::abs(otherLuminance - cpuLuminance) / std::max(cpuLuminance, 1e-9);
+		std::cout << name << " vs CPU: " << matching << "/" << means.size() << " texels within 1%, mean luminance off by "
+			<< 100.0 * meanDifference << "%" << std::endl;
+		return meanDifference < 0.005 && matching >= means.size() * 95 / 100;
+	};
+	std::vector<vec3> means(accumulators.size());
+	for (size_t i = 0; i < accumulators.size(); ++i) {
+		means[i] = accumulators[i].irradianceSum / static_cast<float>(std::max(accumulators[i].sampleCount, 1u));
+	}
+	bool passed = compare("GPU", means);
+
+	// Once more with the GPU taking batches of tiles next to the CPU workers. The batches reuse the
+	// GPU baker's buffers, whose sums were read back above.
+	LightChef::GpuBakeDevice gpuDevice(gpuBaker, texels);
+	LightChef::BakeEngine hybridBaker(scene, texels, bakeSettings, threadPool);
+	hybridBaker.SetDevice(&gpuDevice);
+	LightChef::BakeStats hybridStats = hybridBaker.Bake();
+	for (size_t i = 0; i < means.size(); ++i) {
+		const LightChef::TexelAccumulator& accumulator = hybridBaker.GetAccumulators()[gpuScene.texels[i].index];
+		means[i] = accumulator.irradianceSum / static_cast<float>(std::max(accumulator.sampleCount, 1u));
+	}
+	std::cout << "Hybrid bake: " << hybridStats.samples << " samples in " << hybridStats.seconds << "s, "
+		<< hybridStats.deviceSamples << " of them in " << hybridStats.deviceBatches << " GPU batches" << std::endl;
+	passed = compare("Hybrid", means) && passed;
+
+	device.release();
+	std::cout << (passed ? "GPU check passed" : "GPU check FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
+
+/**
+ * Writes every page of `lightmap` to the tiled OpenEXR file `path`.
+ */
+bool writeLightmapExr(const LightChef::Lightmap& lightmap, const std::filesystem::path& path, uint32_t tileSize) {
+	LightChef::TiledExrWriter writer;
+	if (!writer.Open(path, lightmap.width, lightmap.height, lightmap.atlasCount, tileSize)) {
+		return false;
+	}
+	std::vector<vec4> pixels(static_cast<size_t>(tileSize) * tileSize);
+	for (uint32_t page = 0; page < lightmap.atlasCount; ++page) {
+		for (uint32_t tileY = 0; tileY * tileSize < lightmap.height; ++tileY) {
+			for (uint32_t tileX = 0; tileX * tileSize < lightmap.width; ++tileX) {
+				std::fill(pixels.begin(), pixels.end(), vec4(0.0f));
+				for (uint32_t y = tileY * tileSize; y < std::min(lightmap.height, (tileY + 1) * tileSize); ++y) {
+					for (uint32_t x = tileX * tileSize; x < std::min(lightmap.width, (tileX + 1) * tileSize); ++x) {
+						pixels[static_cast<size_t>(y - tileY * tileSize) * tileSize + (x - tileX * tileSize)] = lightmap.texels[lightmap.GetIndex(page, x, y)];
+					}
+				}
+				if (!writer.WriteTile(page, tileX, tileY, pixels.data())) {
+					return false;
+				}
+			}
+		}
+	}
+	return writer.Close();
+}
+
+/**
+ * Bakes the OBJ scene at `scenePath` into the tiled OpenEXR file
+ * `outputPath`. Emissive MTL materials (`Ke`) are the only lights: every
+ * triangle that uses one is sampled as an area light. The lightmap is
+ * denoised, dilated and seam-stitched before it is written, so it is held
+ * in memory rather than streamed out tile by tile.
+ */
+int RunObjBake(const std::filesystem::path& scenePath, const std::filesystem::path& outputPath, double seconds) {
+	LightChef::Scene scene;
+	if (!ResourceManager::loadObjScene(scenePath, scene)) {
+		std::cerr << "Could not load " << scenePath << "!" << std::endl;
+		return 1;
+	}
+
+	bvh::v2::ThreadPool threadPool;
+	LightChef::LightmapAtlas atlas = LightChef::AtlasGenerator().Generate(scene, threadPool);
+	LightChef::TexelBuffer texels = LightChef::TexelRasterizer().Rasterize(scene, atlas, threadPool);
+	LightChef::BakeSettings bakeSettings;
+	bakeSettings.timeBudgetSeconds = seconds;
+	LightChef::BakeEngine bakeEngine(scene, texels, bakeSettings, threadPool);
+	std::cout << scenePath.filename().string() << ": " << scene.meshes.size() << " meshes, "
+		<< bakeEngine.GetIntegrator().GetLights().GetEmissiveTriangles().size() << " emissive triangles, "
+		<< atlas.atlasCount << " page(s) of " << atlas.width << "x" << atlas.height << std::endl;
+
+	LightChef::BakeStats bakeStats = bakeEngine.Bake();
+	LightChef::Lightmap lightmap = bakeEngine.GetLightmap();
+	LightChef::Denoiser().Denoise(lightmap, bakeEngine.GetLuminanceVariance(), texels, scene, threadPool);
+	LightChef::SeamStitcher stitcher(scene, atlas);
+	stitcher.Dilate(lightmap, texels, threadPool);
+	stitcher.Stitch(lightmap, threadPool);
+	if (!writeLightmapExr(lightmap, outputPath, bakeSettings.tileSize)) {
+		std::cerr << "Could not write " << outputPath << "!" << std::endl;
+		return 1;
+	}
+	std::cout << "Baked " << bakeStats.samples << " samples in " << bakeStats.seconds << "s, "
+		<< bakeStats.convergedTexels << "/" << bakeStats.coveredTexels << " texels converged, " << stitcher.GetSeams().size() << " seams stitched, written to " << outputPath << std::endl;
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	// Cross-check of the GPU baker against the CPU one: Baker --gpu-check [--software]
+	if (argc >= 2 && std::string(argv[1]) == "--gpu-check") {
+		return RunGpuCheck(argc >= 3 && std::string(argv[2]) == "--software");
+	}
+
+	// Merge tool for sharded bakes: Baker --merge <output> <shard checkpoint>...
+	if (argc >= 4 && std::string(argv[1]) == "--merge") {
+		std::vector<std::filesystem::path> shards(argv + 3, argv + argc);
+		LightChef::ShardMergeStats mergeStats;
+		if (!LightChef::MergeShards(shards, argv[2], mergeStats)) {
+			std::cerr << "Could not merge shards!" << std::endl;
+			return 1;
+		}
+		std::cout << "Merged " << mergeStats.shards << " shard(s): " << mergeStats.samples << " samples, "
+			<< mergeStats.overlappingTexels << " overlapping texels" << std::endl;
+		return 0;
+	}
+
+	// Headless bake of a Wavefront OBJ scene, lit by its emissive materials:
+	// Baker --bake <scene.obj> <output.exr> [seconds]
+	if (argc >= 4 && std::string(argv[1]) == "--bake") {
+		return RunObjBake(argv[2], argv[3], argc >= 5 ? std::stod(argv[4]) : 0.0);
+	}
+
 	Application app;
 
 	if (!app.Initialize()) {
@@ -137,7 +415,13 @@ bool Application::Initialize() {
 	std::cout << "Requesting device..." << std::endl;
 	DeviceDescriptor deviceDesc = {};
 	deviceDesc.label = "My Device";
-	deviceDesc.requiredFeatureCount = 0;
+	// BC6H lightmaps need the BC feature; without it they go up as RGBA16Float
+	std::vector<WGPUFeatureName> requiredFeatures;
+	if (adapter.hasFeature(FeatureName::TextureCompressionBC)) {
+		requiredFeatures.push_back(FeatureName::TextureCompressionBC);
+	}
+	deviceDesc.requiredFeatureCount = requiredFeatures.size();
+	deviceDesc.requiredFeatures = requiredFeatures.data();
 	deviceDesc.requiredLimits = nullptr;
 	deviceDesc.defaultQueue.nextInChain = nullptr;
 	deviceDesc.defaultQueue.label = "The default queue";
@@ -149,6 +433,7 @@ bool Application::Initialize() {
 
 	device = adapter.requestDevice(deviceDesc);
 	std::cout << "Got device: " << device << std::endl;
+	compressedLightmaps = device.hasFeature(FeatureName::TextureCompressionBC);
 
 	// Device error callback
 	// uncapturedErrorCallbackHandle = device.setUncapturedErrorCallback([](ErrorType type, char const* message) {
@@ -195,6 +480,19 @@ void Application::Terminate() {
 	bindGroup.release();
 	layout.release();
 	bindGroupLayout.release();
+	lightmapSampler.release();
+	directionalTextureView.release();
+	directionalTexture.destroy();
+	directionalTexture.release();
+	transferTextureView.release();
+	transferTexture.destroy();
+	transferTexture.release();
+	timeOfDayTextureView.release();
+	timeOfDayTexture.destroy();
+	timeOfDayTexture.release();
+	lightmapTextureView.release();
+	lightmapTexture.destroy();
+	lightmapTexture.release();
 	uniformBuffer.release();
 	pointBuffer.release();
 	indexBuffer.release();
@@ -229,6 +527,30 @@ void Application::MainLoop() {
 	M = glm::translate(M, vec3(0.5, 0.0, 0.0));
 	M = glm::scale(M, vec3(0.3f));
 	queue.writeBuffer(uniformBuffer, offsetof(MyUniforms, modelMatrix), &M, sizeof(MyUniforms::modelMatrix));
+
+	// Relighting is a dot product in the shader, so the sun follows the mouse at no cost
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+		double cursorX, cursorY;
+		glfwGetCursorPos(window, &cursorX, &cursorY);
+		sunAzimuth = 2.0f * PI * static_cast<float>(cursorX) / width;
+		sunElevation = glm::clamp(0.5f * PI * (1.0f - static_cast<float>(cursorY) / height), 0.05f, 0.5f * PI);
+		UpdateLighting();
+	}
+
+	// Blending the bases is as cheap, so the cycle plays a day every 24 seconds
+	bool timeOfDayKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+	if (timeOfDayKey && !timeOfDayKeyDown) {
+		timeOfDayPreview = !timeOfDayPreview;
+		if (!timeOfDayPreview) {
+			vec4 off(0.0f);
+			queue.writeBuffer(uniformBuffer, offsetof(MyUniforms, timeOfDay), &off, sizeof(vec4));
+		}
+	}
+	timeOfDayKeyDown = timeOfDayKey;
+	if (timeOfDayPreview) {
+		UpdateTimeOfDay(std::fmod(time, 24.0f));
+	}
+
 	// Get the next target texture view
 	TextureView targetView = GetNextSurfaceTextureView();
 	if (!targetView) return;
@@ -281,7 +603,7 @@ void Application::MainLoop() {
 	
 	// The second argument must correspond to the choice of uint16_t or uint32_t
 	// we've done when creating the index buffer.
-	renderPass.setIndexBuffer(indexBuffer, IndexFormat::Uint16, 0, indexBuffer.getSize());
+	renderPass.setIndexBuffer(indexBuffer, IndexFormat::Uint32, 0, indexBuffer.getSize());
 
 	// Set binding group here!
 	// dynamicOffset = 0 * uniformStride;
@@ -364,8 +686,8 @@ void Application::InitializePipeline() {
 	// Configure the vertex pipeline
 	// We use one vertex buffer
 	VertexBufferLayout vertexBufferLayout;
-	// We now have 2 attributes
-	std::vector<VertexAttribute> vertexAttribs(2);
+	// We now have 3 attributes
+	std::vector<VertexAttribute> vertexAttribs(3);
 	
 	// Describe the position attribute
 	vertexAttribs[0].shaderLocation = 0; // @location(0)
@@ -376,11 +698,16 @@ void Application::InitializePipeline() {
 	vertexAttribs[1].shaderLocation = 1; // @location(1)
 	vertexAttribs[1].format = VertexFormat::Float32x3; // different type!
 	vertexAttribs[1].offset = 3 * sizeof(float); // non null offset!
+
+	// Describe the lightmap UV attribute produced by the atlas generator
+	vertexAttribs[2].shaderLocation = 2; // @location(2)
+	vertexAttribs[2].format = VertexFormat::Float32x2;
+	vertexAttribs[2].offset = 6 * sizeof(float);
 	
 	vertexBufferLayout.attributeCount = static_cast<uint32_t>(vertexAttribs.size());
 	vertexBufferLayout.attributes = vertexAttribs.data();
 	
-	vertexBufferLayout.arrayStride = 6 * sizeof(float);
+	vertexBufferLayout.arrayStride = 8 * sizeof(float);
 	vertexBufferLayout.stepMode = VertexStepMode::Vertex;
 	
 	pipelineDesc.vertex.bufferCount = 1;
@@ -460,7 +787,8 @@ void Application::InitializePipeline() {
 	pipelineDesc.multisample.alphaToCoverageEnabled = false;
 
 	// Define binding layout (don't forget to = Default)
-	BindGroupLayoutEntry bindingLayout = Default;
+	std::vector<BindGroupLayoutEntry> bindingLayoutEntries(6, Default);
+	BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[0];
 	// The binding index as used in the @binding attribute in the shader
 	bindingLayout.binding = 0;
 	// The stage that needs to access this resource
@@ -470,10 +798,39 @@ void Application::InitializePipeline() {
 	bindingLayout.buffer.minBindingSize = sizeof(MyUniforms);
 	//                                    ^^^^^^^^^^^^^^^^^^ This was 4 * sizeof(float)
 
+	// The baked irradiance and directional lightmaps
+	for (uint32_t binding : { 1u, 2u }) {
+		BindGroupLayoutEntry& textureBindingLayout = bindingLayoutEntries[binding];
+		textureBindingLayout.binding = binding;
+		textureBindingLayout.visibility = ShaderStage::Fragment;
+		textureBindingLayout.texture.sampleType = TextureSampleType::Float;
+		textureBindingLayout.texture.viewDimension = TextureViewDimension::_2D;
+	}
+
+	// And the sampler they share
+	BindGroupLayoutEntry& samplerBindingLayout = bindingLayoutEntries[3];
+	samplerBindingLayout.binding = 3;
+	samplerBindingLayout.visibility = ShaderStage::Fragment;
+	samplerBindingLayout.sampler.type = SamplerBindingType::Filtering;
+
+	// The PRT transfer, one layer per SH coefficient
+	BindGroupLayoutEntry& transferBindingLayout = bindingLayoutEntries[4];
+	transferBindingLayout.binding = 4;
+	transferBindingLayout.visibility = ShaderStage::Fragment;
+	transferBindingLayout.texture.sampleType = TextureSampleType::Float;
+	transferBindingLayout.texture.viewDimension = TextureViewDimension::_2DArray;
+
+	// The time-of-day bases, one layer per sun keyframe and a last one for the sky
+	BindGroupLayoutEntry& timeOfDayBindingLayout = bindingLayoutEntries[5];
+	timeOfDayBindingLayout.binding = 5;
+	timeOfDayBindingLayout.visibility = ShaderStage::Fragment;
+	timeOfDayBindingLayout.texture.sampleType = TextureSampleType::Float;
+	timeOfDayBindingLayout.texture.viewDimension = TextureViewDimension::_2DArray;
+
 	// Create a bind group layout
 	BindGroupLayoutDescriptor bindGroupLayoutDesc{};
-	bindGroupLayoutDesc.entryCount = 1;
-	bindGroupLayoutDesc.entries = &bindingLayout;
+	bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+	bindGroupLayoutDesc.entries = bindingLayoutEntries.data();
 	bindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
 
 	// Create the pipeline layout
@@ -563,8 +920,69 @@ void Application::InitializeBuffers() {
 		exit(1);
 	}
 
+	// Generate the lightmap UV set and append it as a vertex attribute
+	LightChef::Scene scene;
+	scene.meshes.push_back(ResourceManager::makeMesh(pointData, indexData, 6));
+	bvh::v2::ThreadPool threadPool;
+	LightChef::LightmapAtlas atlas = LightChef::AtlasGenerator().Generate(scene, threadPool);
+	std::vector<uint32_t> splitIndexData;
+	ResourceManager::appendLightmapUVs(pointData, splitIndexData, 6, atlas.meshes[0]);
+	std::cout << "Lightmap atlas: " << atlas.charts.size() << " charts, "
+		<< atlas.atlasCount << " page(s) of " << atlas.width << "x" << atlas.height << std::endl;
+
+	// Bake the point light above the tip, with the directional layer so the preview can bend
+	// the baked lighting with a shading normal. The sky and the sun are distant, so they go
+	// through PRT transfer instead and the preview relights them as they move.
+	skyColor = vec3(0.3f, 0.35f, 0.45f);
+	sunIrradiance = vec3(2.0f, 1.8f, 1.5f);
+	LightChef::Light light;
+	light.position = vec3(0.8f, -0.6f, 1.5f);
+	light.intensity = 3.0f;
+	scene.lights.push_back(light);
+	LightChef::TexelBuffer texels = LightChef::TexelRasterizer().Rasterize(scene, atlas, threadPool);
+	LightChef::BakeSettings bakeSettings;
+	bakeSettings.directional = true;
+	bakeSettings.timeBudgetSeconds = 2.0;
+	LightChef::BakeEngine bakeEngine(scene, texels, bakeSettings, threadPool);
+	LightChef::BakeStats bakeStats = bakeEngine.Bake();
+	std::cout << "Lightmap bake: " << bakeStats.samples << " samples in " << bakeStats.seconds << "s, "
+		<< bakeStats.convergedTexels << "/" << bakeStats.coveredTexels << " texels converged" << std::endl;
+	// Two seconds leave visible noise, which the denoiser trades for samples. The gutters are
+	// then filled and the seams stitched, so bilinear filtering neither darkens chart edges nor
+	// shows where charts were cut apart.
+	LightChef::Lightmap lightmap = bakeEngine.GetLightmap();
+	LightChef::Denoiser().Denoise(lightmap, bakeEngine.GetLuminanceVariance(), texels, scene, threadPool);
+	LightChef::SeamStitcher stitcher(scene, atlas);
+	stitcher.Dilate(lightmap, texels, threadPool);
+	stitcher.Stitch(lightmap, threadPool);
+	std::cout << "Lightmap seams: " << stitcher.GetSeams().size() << " stitched" << std::endl;
+	InitializeLightmapTextures(lightmap, bakeEngine.GetDirectionalLightmap());
+
+	LightChef::PrtBaker prtBaker;
+	LightChef::PrtLightmap prt = prtBaker.Bake(bakeEngine.GetRayTracer(), texels, threadPool);
+	std::cout << "PRT transfer: " << prt.GetCoefficientCount() << " SH coefficients for " << prtBaker.GetStats().coveredTexels
+		<< " texels in " << prtBaker.GetStats().seconds << "s" << std::endl;
+	InitializeTransferTexture(prt);
+
+	// The same sky and sun over a day: a sun keyframe every two hours from 6 to 18, sharing
+	// the BVH and texels of the bake above
+	LightChef::TimeOfDaySettings timeOfDaySettings;
+	for (float hour = 6.0f; hour <= 18.0f; hour += 2.0f) {
+		float azimuth = PI * (hour - 6.0f) / 12.0f;
+		float elevation = 0.05f + 1.1f * std::sin(azimuth);
+		timeOfDaySettings.keyframes.push_back({ hour, vec3(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation)) });
+	}
+	LightChef::TimeOfDayBaker timeOfDayBaker(timeOfDaySettings);
+	timeOfDay = timeOfDayBaker.Bake(bakeEngine.GetRayTracer(), texels, threadPool);
+	const LightChef::TimeOfDayStats& timeOfDayStats = timeOfDayBaker.GetStats();
+	std::cout << "Time-of-day bases: " << timeOfDay.bases.size() << " for " << timeOfDayStats.coveredTexels << " texels in "
+		<< timeOfDayStats.seconds << "s, " << timeOfDayStats.rays << " rays where one bake per basis would trace "
+		<< timeOfDayStats.separateRays << ", " << timeOfDayStats.basisBytes / 1024 << " KiB where hourly lightmaps would take "
+		<< 24 * timeOfDayStats.lightmapBytes / 1024 << " KiB" << std::endl;
+	InitializeTimeOfDayTexture(timeOfDay);
+
 	// We now store the index count rather than the vertex count
-	indexCount = static_cast<uint32_t>(indexData.size());
+	indexCount = static_cast<uint32_t>(splitIndexData.size());
 	
 	// Create vertex buffer
 	BufferDescriptor bufferDesc;
@@ -578,12 +996,11 @@ void Application::InitializeBuffers() {
 
 	// Create index buffer
 	// (we reuse the bufferDesc initialized for the pointBuffer)
-	bufferDesc.size = indexData.size() * sizeof(uint16_t);
-	bufferDesc.size = (bufferDesc.size + 3) & ~3; // round up to the next multiple of 4
+	bufferDesc.size = splitIndexData.size() * sizeof(uint32_t);
 	bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Index;
 	indexBuffer = device.createBuffer(bufferDesc);
 
-	queue.writeBuffer(indexBuffer, 0, indexData.data(), bufferDesc.size);
+	queue.writeBuffer(indexBuffer, 0, splitIndexData.data(), bufferDesc.size);
 
 	SupportedLimits supportedLimits;
 	device.getLimits(&supportedLimits);
@@ -621,7 +1038,9 @@ void Application::InitializeBuffers() {
 
 	uniforms.time = 1.0f;
 	uniforms.color = { 0.0f, 1.0f, 0.4f, 1.0f };
+	uniforms.timeOfDay = vec4(0.0f);
 	queue.writeBuffer(uniformBuffer, 0, &uniforms, sizeof(MyUniforms));
+	UpdateLighting();
 
 	// Upload second value
 	// uniforms.time = -1.0f;
@@ -629,9 +1048,211 @@ void Application::InitializeBuffers() {
 	// queue.writeBuffer(uniformBuffer, uniformStride, &uniforms, sizeof(MyUniforms));
 }
 
+void Application::InitializeLightmapTextures(const LightChef::Lightmap& lightmap, const LightChef::Lightmap& directional) {
+	// The preview only shows the first atlas page
+	size_t pageTexels = static_cast<size_t>(lightmap.width) * lightmap.height;
+
+	TextureDescriptor textureDesc;
+	textureDesc.dimension = TextureDimension::_2D;
+	textureDesc.format = compressedLightmaps ? TextureFormat::BC6HRGBUfloat : TextureFormat::RGBA16Float;
+	textureDesc.mipLevelCount = 1;
+	textureDesc.sampleCount = 1;
+	textureDesc.size = { lightmap.width, lightmap.height, 1 };
+	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+	textureDesc.viewFormatCount = 0;
+	textureDesc.viewFormats = nullptr;
+	lightmapTexture = device.createTexture(textureDesc);
+
+	ImageCopyTexture destination;
+	destination.texture = lightmapTexture;
+	destination.mipLevel = 0;
+	destination.origin = { 0, 0, 0 };
+	destination.aspect = TextureAspect::All;
+
+	TextureDataLayout source;
+	source.offset = 0;
+	if (compressedLightmaps) {
+		// Atlas pages are block-aligned, so the blocks upload as they are: one row of blocks per 4 texel rows
+		bvh::v2::ThreadPool threadPool;
+		LightChef::Bc6hEncoder encoder;
+		LightChef::Bc6hLightmap compressed = encoder.Encode(lightmap, threadPool);
+		const LightChef::Bc6hStats& stats = encoder.GetStats();
+		std::cout << "Lightmap BC6H: " << stats.blocks << " blocks in " << stats.seconds << "s, PSNR " << stats.psnr << " dB" << std::endl;
+		source.bytesPerRow = 16 * compressed.GetBlocksX();
+		source.rowsPerImage = compressed.GetBlocksY();
+		queue.writeTexture(destination, compressed.blocks.data(), compressed.GetPageSize(), source, textureDesc.size);
+	}
+	else {
+		// Irradiance is HDR, so it goes up as half floats
+		std::vector<uint16_t> halfTexels(pageTexels * 4);
+		for (size_t i = 0; i < pageTexels * 4; ++i) {
+			halfTexels[i] = glm::packHalf1x16(lightmap.texels[i / 4][i % 4]);
+		}
+		source.bytesPerRow = 4 * sizeof(uint16_t) * lightmap.width;
+		source.rowsPerImage = lightmap.height;
+		queue.writeTexture(destination, halfTexels.data(), halfTexels.size() * sizeof(uint16_t), source, textureDesc.size);
+	}
+
+	// The directional layer is normalized, so 8 bits per channel are enough
+	textureDesc.format = TextureFormat::RGBA8Unorm;
+	directionalTexture = device.createTexture(textureDesc);
+	std::vector<uint8_t> packedTexels = LightChef::PackDirectionalLightmap(directional);
+	destination.texture = directionalTexture;
+	source.bytesPerRow = 4 * lightmap.width;
+	source.rowsPerImage = lightmap.height;
+	queue.writeTexture(destination, packedTexels.data(), pageTexels * 4, source, textureDesc.size);
+
+	TextureViewDescriptor textureViewDesc;
+	textureViewDesc.aspect = TextureAspect::All;
+	textureViewDesc.baseArrayLayer = 0;
+	textureViewDesc.arrayLayerCount = 1;
+	textureViewDesc.baseMipLevel = 0;
+	textureViewDesc.mipLevelCount = 1;
+	textureViewDesc.dimension = TextureViewDimension::_2D;
+	textureViewDesc.format = compressedLightmaps ? TextureFormat::BC6HRGBUfloat : TextureFormat::RGBA16Float;
+	lightmapTextureView = lightmapTexture.createView(textureViewDesc);
+	textureViewDesc.format = TextureFormat::RGBA8Unorm;
+	directionalTextureView = directionalTexture.createView(textureViewDesc);
+
+	SamplerDescriptor samplerDesc;
+	samplerDesc.addressModeU = AddressMode::ClampToEdge;
+	samplerDesc.addressModeV = AddressMode::ClampToEdge;
+	samplerDesc.addressModeW = AddressMode::ClampToEdge;
+	samplerDesc.magFilter = FilterMode::Linear;
+	samplerDesc.minFilter = FilterMode::Linear;
+	samplerDesc.mipmapFilter = MipmapFilterMode::Nearest;
+	samplerDesc.lodMinClamp = 0.0f;
+	samplerDesc.lodMaxClamp = 1.0f;
+	samplerDesc.compare = CompareFunction::Undefined;
+	samplerDesc.maxAnisotropy = 1;
+	lightmapSampler = device.createSampler(samplerDesc);
+}
+
+void Application::InitializeTransferTexture(const LightChef::PrtLightmap& prt) {
+	// Transfer coefficients are signed, so they go up as half floats rather than BC6H
+	uint32_t layers = prt.GetCoefficientCount();
+	TextureDescriptor textureDesc;
+	textureDesc.dimension = TextureDimension::_2D;
+	textureDesc.format = TextureFormat::RGBA16Float;
+	textureDesc.mipLevelCount = 1;
+	textureDesc.sampleCount = 1;
+	textureDesc.size = { prt.width, prt.height, layers };
+	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+	textureDesc.viewFormatCount = 0;
+	textureDesc.viewFormats = nullptr;
+	transferTexture = device.createTexture(textureDesc);
+
+	// The preview only shows the first atlas page; layer i holds coefficient i of every texel
+	size_t pageTexels = static_cast<size_t>(prt.width) * prt.height;
+	std::vector<uint16_t> halfTexels(pageTexels * 4 * layers, 0);
+	for (uint32_t layer = 0; layer < layers; ++layer) {
+		for (size_t i = 0; i < pageTexels; ++i) {
+			const vec3& coefficient = prt.transfer[i * layers + layer];
+			uint16_t* texel = &halfTexels[(layer * pageTexels + i) * 4];
+			for (int c = 0; c < 3; ++c) {
+				texel[c] = glm::packHalf1x16(coefficient[c]);
+			}
+		}
+	}
+	ImageCopyTexture destination;
+	destination.texture = transferTexture;
+	destination.mipLevel = 0;
+	destination.origin = { 0, 0, 0 };
+	destination.aspect = TextureAspect::All;
+	TextureDataLayout source;
+	source.offset = 0;
+	source.bytesPerRow = 4 * sizeof(uint16_t) * prt.width;
+	source.rowsPerImage = prt.height;
+	queue.writeTexture(destination, halfTexels.data(), halfTexels.size() * sizeof(uint16_t), source, textureDesc.size);
+
+	TextureViewDescriptor textureViewDesc;
+	textureViewDesc.aspect = TextureAspect::All;
+	textureViewDesc.baseArrayLayer = 0;
+	textureViewDesc.arrayLayerCount = layers;
+	textureViewDesc.baseMipLevel = 0;
+	textureViewDesc.mipLevelCount = 1;
+	textureViewDesc.dimension = TextureViewDimension::_2DArray;
+	textureViewDesc.format = TextureFormat::RGBA16Float;
+	transferTextureView = transferTexture.createView(textureViewDesc);
+}
+
+void Application::UpdateLighting() {
+	vec3 sunDirection(std::cos(sunElevation) * std::cos(sunAzimuth), std::cos(sunElevation) * std::sin(sunAzimuth), std::sin(sunElevation));
+	LightChef::ShLighting lighting = LightChef::ProjectConstantSky(skyColor);
+	lighting += LightChef::ProjectDirectionalLight(sunDirection, sunIrradiance);
+	std::array<vec4, LightChef::kMaxShCoefficients> lightSh;
+	for (uint32_t i = 0; i < LightChef::kMaxShCoefficients; ++i) {
+		lightSh[i] = vec4(lighting.coefficients[i], 0.0f);
+	}
+	queue.writeBuffer(uniformBuffer, offsetof(MyUniforms, lightSh), lightSh.data(), sizeof(MyUniforms::lightSh));
+}
+
+void Application::InitializeTimeOfDayTexture(const LightChef::TimeOfDayLightmaps& lightmaps) {
+	uint32_t layers = static_cast<uint32_t>(lightmaps.bases.size());
+	TextureDescriptor textureDesc;
+	textureDesc.dimension = TextureDimension::_2D;
+	textureDesc.format = TextureFormat::RGBA16Float;
+	textureDesc.mipLevelCount = 1;
+	textureDesc.sampleCount = 1;
+	textureDesc.size = { lightmaps.width, lightmaps.height, layers };
+	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+	textureDesc.viewFormatCount = 0;
+	textureDesc.viewFormats = nullptr;
+	timeOfDayTexture = device.createTexture(textureDesc);
+
+	// First atlas page of every basis, as for the transfer
+	size_t pageTexels = static_cast<size_t>(lightmaps.width) * lightmaps.height;
+	std::vector<uint16_t> halfTexels(pageTexels * 4 * layers, 0);
+	for (uint32_t layer = 0; layer < layers; ++layer) {
+		for (size_t i = 0; i < pageTexels; ++i) {
+			const vec3& irradiance = lightmaps.bases[layer][i];
+			uint16_t* texel = &halfTexels[(layer * pageTexels + i) * 4];
+			for (int c = 0; c < 3; ++c) {
+				texel[c] = glm::packHalf1x16(irradiance[c]);
+			}
+		}
+	}
+	ImageCopyTexture destination;
+	destination.texture = timeOfDayTexture;
+	destination.mipLevel = 0;
+	destination.origin = { 0, 0, 0 };
+	destination.aspect = TextureAspect::All;
+	TextureDataLayout source;
+	source.offset = 0;
+	source.bytesPerRow = 4 * sizeof(uint16_t) * lightmaps.width;
+	source.rowsPerImage = lightmaps.height;
+	queue.writeTexture(destination, halfTexels.data(), halfTexels.size() * sizeof(uint16_t), source, textureDesc.size);
+
+	TextureViewDescriptor textureViewDesc;
+	textureViewDesc.aspect = TextureAspect::All;
+	textureViewDesc.baseArrayLayer = 0;
+	textureViewDesc.arrayLayerCount = layers;
+	textureViewDesc.baseMipLevel = 0;
+	textureViewDesc.mipLevelCount = 1;
+	textureViewDesc.dimension = TextureViewDimension::_2DArray;
+	textureViewDesc.format = TextureFormat::RGBA16Float;
+	timeOfDayTextureView = timeOfDayTexture.createView(textureViewDesc);
+}
+
+void Application::UpdateTimeOfDay(float hour) {
+	uint32_t first, second;
+	float weight;
+	timeOfDay.GetBlend(hour, first, second, weight);
+	// Dim and redden the sun towards the horizon; it sets at 6 and 18 and the sky fades with it
+	float daylight = glm::clamp(std::sin(PI * (hour - 6.0f) / 12.0f), 0.0f, 1.0f);
+	vec4 uniforms[3] = {
+		vec4(static_cast<float>(first), static_cast<float>(second), weight, 1.0f),
+		vec4(sunIrradiance * vec3(1.0f, 0.4f + 0.6f * daylight, 0.2f + 0.8f * daylight) * std::sqrt(daylight), 0.0f),
+		vec4(skyColor * (0.05f + 0.95f * daylight), 0.0f),
+	};
+	queue.writeBuffer(uniformBuffer, offsetof(MyUniforms, timeOfDay), uniforms, sizeof(uniforms));
+}
+
 void Application::InitializeBindGroups() {
+	std::vector<BindGroupEntry> bindings(6);
+
 	// Create a binding
-	BindGroupEntry binding{};
+	BindGroupEntry& binding = bindings[0];
 	// The index of the binding (the entries in bindGroupDesc can be in any order)
 	binding.binding = 0;
 	// The buffer it is actually bound to
@@ -643,11 +1264,22 @@ void Application::InitializeBindGroups() {
 	binding.size = sizeof(MyUniforms);
 	//             ^^^^^^^^^^^^^^^^^^ This was 4 * sizeof(float)
 
+	bindings[1].binding = 1;
+	bindings[1].textureView = lightmapTextureView;
+	bindings[2].binding = 2;
+	bindings[2].textureView = directionalTextureView;
+	bindings[3].binding = 3;
+	bindings[3].sampler = lightmapSampler;
+	bindings[4].binding = 4;
+	bindings[4].textureView = transferTextureView;
+	bindings[5].binding = 5;
+	bindings[5].textureView = timeOfDayTextureView;
+
 	// A bind group contains one or multiple bindings
 	BindGroupDescriptor bindGroupDesc{};
 	bindGroupDesc.layout = bindGroupLayout;
 	// There must be as many bindings as declared in the layout!
-	bindGroupDesc.entryCount = 1;
-	bindGroupDesc.entries = &binding;
+	bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+	bindGroupDesc.entries = bindings.data();
 	bindGroup = device.createBindGroup(bindGroupDesc);
 }
@@ -0,0 +1,113 @@
+#include "Utility/mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace LightChef
+{
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::Open(const std::filesystem::path& path, size_t size)
+    {
+        Close();
+        if (size == 0)
+            return false;
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        m_file = file;
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            Close();
+            return false;
+        }
+        m_mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (!m_mapping)
+        {
+            Close();
+            return false;
+        }
+        m_data = MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
+        if (!m_data)
+        {
+            Close();
+            return false;
+        }
+        m_size = size;
+        return true;
+    }
+
+    bool MappedFile::Flush()
+    {
+        return m_data && FlushViewOfFile(m_data, 0) && FlushFileBuffers(m_file);
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = nullptr;
+        m_size = 0;
+    }
+#else
+    bool MappedFile::Open(const std::filesystem::path& path, size_t size)
+    {
+        Close();
+        if (size == 0)
+            return false;
+        m_file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (m_file < 0)
+            return false;
+        if (ftruncate(m_file, static_cast<off_t>(size)) != 0)
+        {
+            Close();
+            return false;
+        }
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+        if (data == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+        m_data = data;
+        m_size = size;
+        return true;
+    }
+
+    bool MappedFile::Flush()
+    {
+        return m_data && msync(m_data, m_size, MS_SYNC) == 0;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_file >= 0)
+            close(m_file);
+        m_data = nullptr;
+        m_file = -1;
+        m_size = 0;
+    }
+#endif
+}
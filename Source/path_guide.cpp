@@ -0,0 +1,193 @@
+#include "Bake/path_guide.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Fixed-point scale of recorded values; a record is at most luminance * 2 pi / (1 - guidedFraction).
+        constexpr double kFixedPointScale = 65536.0;
+        constexpr double kMaxRecord = 1ull << 40;
+
+        uint32_t GetDominantAxis(const glm::vec3& normal)
+        {
+            glm::vec3 a = glm::abs(normal);
+            uint32_t axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+            return axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+        }
+    }
+
+    PathGuide::PathGuide(const TexelBuffer& texels, const PathGuideSettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.spatialResolution = std::max(1u, m_settings.spatialResolution);
+        m_settings.directionalResolution = std::max(1u, m_settings.directionalResolution);
+        m_settings.guidedFraction = std::clamp(m_settings.guidedFraction, 0.0f, 0.95f);
+        m_binCount = m_settings.directionalResolution * m_settings.directionalResolution;
+        m_texelCells.assign(texels.texels.size(), kNoCell);
+
+        glm::vec3 lower(std::numeric_limits<float>::max());
+        glm::vec3 upper(-std::numeric_limits<float>::max());
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+        {
+            if (!texels.IsCovered(i))
+                continue;
+            lower = glm::min(lower, texels.texels[i].position);
+            upper = glm::max(upper, texels.texels[i].position);
+        }
+        glm::vec3 extent = glm::max(upper - lower, glm::vec3(0.0f));
+        float cellSize = std::max(std::max(extent.x, std::max(extent.y, extent.z)) / static_cast<float>(m_settings.spatialResolution), 1e-6f);
+        m_lower = lower;
+        m_inverseCellSize = 1.0f / cellSize;
+        m_resolution = glm::clamp(glm::uvec3(glm::ceil(extent / cellSize)), glm::uvec3(1), glm::uvec3(m_settings.spatialResolution));
+
+        // Cells are numbered in texel order, so the numbering does not depend on anything else.
+        m_cells.assign(static_cast<size_t>(m_resolution.x) * m_resolution.y * m_resolution.z * 6, kNoCell);
+        for (size_t i = 0; i < texels.texels.size(); ++i)
+        {
+            if (!texels.IsCovered(i))
+                continue;
+            uint32_t& cell = m_cells[GetCellKey(texels.texels[i].position, texels.texels[i].normal)];
+            if (cell == kNoCell)
+                cell = m_cellCount++;
+            m_texelCells[i] = cell;
+        }
+
+        size_t bins = static_cast<size_t>(m_cellCount) * m_binCount;
+        m_training = std::make_unique<std::atomic<uint64_t>[]>(bins);
+        m_recordCounts = std::make_unique<std::atomic<uint32_t>[]>(m_cellCount);
+        m_cdf.assign(bins, 0.0f);
+        m_guiding.assign(m_cellCount, 0);
+    }
+
+    size_t PathGuide::GetCellKey(const glm::vec3& position, const glm::vec3& normal) const
+    {
+        glm::uvec3 c = glm::min(glm::uvec3(glm::max((position - m_lower) * m_inverseCellSize, glm::vec3(0.0f))), m_resolution - 1u);
+        return ((static_cast<size_t>(c.z) * m_resolution.y + c.y) * m_resolution.x + c.x) * 6 + GetDominantAxis(normal);
+    }
+
+    uint32_t PathGuide::FindCell(const glm::vec3& position, const glm::vec3& normal) const
+    {
+        // Half a cell of slack around the bounds keeps surfaces right at their edge.
+        glm::vec3 c = (position - m_lower) * m_inverseCellSize;
+        if (glm::any(glm::lessThan(c, glm::vec3(-0.5f))) || glm::any(glm::greaterThan(c, glm::vec3(m_resolution) + 0.5f)))
+            return kNoCell;
+        return m_cells[GetCellKey(position, normal)];
+    }
+
+    uint32_t PathGuide::GetBin(const glm::vec3& direction) const
+    {
+        // Equal-area cylindrical map: cos theta and phi, both uniform over the sphere.
+        float r = static_cast<float>(m_settings.directionalResolution);
+        float phi = std::atan2(direction.y, direction.x);
+        if (phi < 0.0f)
+            phi += 2.0f * kPi;
+        uint32_t i = std::min(static_cast<uint32_t>((direction.z * 0.5f + 0.5f) * r), m_settings.directionalResolution - 1);
+        uint32_t j = std::min(static_cast<uint32_t>(phi * (0.5f * kInvPi) * r), m_settings.directionalResolution - 1);
+        return i * m_settings.directionalResolution + j;
+    }
+
+    float PathGuide::GetGuidePdf(uint32_t cell, const glm::vec3& direction) const
+    {
+        const float* cdf = &m_cdf[static_cast<size_t>(cell) * m_binCount];
+        uint32_t bin = GetBin(direction);
+        float probability = cdf[bin] - (bin > 0 ? cdf[bin - 1] : 0.0f);
+        return probability * static_cast<float>(m_binCount) * (0.25f * kInvPi);
+    }
+
+    glm::vec3 PathGuide::Sample(uint32_t cell, const glm::vec3& normal, glm::vec2 u, float& pdf) const
+    {
+        float guided = m_settings.guidedFraction;
+        glm::vec3 direction;
+        if (u.x < guided)
+        {
+            // Pick the bin with u.x, then place the direction in it with what is left of u.x and u.y.
+            u.x /= guided;
+            const float* cdf = &m_cdf[static_cast<size_t>(cell) * m_binCount];
+            uint32_t bin = static_cast<uint32_t>(std::upper_bound(cdf, cdf + m_binCount, u.x) - cdf);
+            bin = std::min(bin, m_binCount - 1);
+            float before = bin > 0 ? cdf[bin - 1] : 0.0f;
+            float offset = cdf[bin] > before ? std::min((u.x - before) / (cdf[bin] - before), 0.99999994f) : 0.5f;
+            float r = static_cast<float>(m_settings.directionalResolution);
+            float z = (static_cast<float>(bin / m_settings.directionalResolution) + offset) / r * 2.0f - 1.0f;
+            float phi = (static_cast<float>(bin % m_settings.directionalResolution) + u.y) / r * 2.0f * kPi;
+            float s = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            direction = glm::vec3(s * std::cos(phi), s * std::sin(phi), z);
+        }
+        else
+        {
+            u.x = std::min((u.x - guided) / (1.0f - guided), 0.99999994f);
+            direction = SampleCosineHemisphere(normal, u.x, u.y);
+        }
+        pdf = GetPdf(cell, normal, direction);
+        return direction;
+    }
+
+    float PathGuide::GetPdf(uint32_t cell, const glm::vec3& normal, const glm::vec3& direction) const
+    {
+        float cosine = std::max(glm::dot(normal, direction), 0.0f);
+        return m_settings.guidedFraction * GetGuidePdf(cell, direction) + (1.0f - m_settings.guidedFraction) * cosine * kInvPi;
+    }
+
+    void PathGuide::Record(uint32_t cell, const glm::vec3& direction, float value)
+    {
+        if (cell == kNoCell)
+            return;
+        uint64_t fixedPoint = static_cast<uint64_t>(std::clamp(static_cast<double>(value) * kFixedPointScale, 0.0, kMaxRecord));
+        m_training[static_cast<size_t>(cell) * m_binCount + GetBin(direction)].fetch_add(fixedPoint, std::memory_order_relaxed);
+        m_recordCounts[cell].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool PathGuide::Update()
+    {
+        m_passes++;
+        if ((m_passes & (m_passes - 1)) != 0)
+            return false;
+        bool rebuilt = false;
+        for (uint32_t cell = 0; cell < m_cellCount; ++cell)
+        {
+            if (m_recordCounts[cell].load(std::memory_order_relaxed) < m_settings.minSamples)
+                continue;
+            const std::atomic<uint64_t>* training = &m_training[static_cast<size_t>(cell) * m_binCount];
+            float* cdf = &m_cdf[static_cast<size_t>(cell) * m_binCount];
+            double total = 0.0;
+            for (uint32_t bin = 0; bin < m_binCount; ++bin)
+                total += static_cast<double>(training[bin].load(std::memory_order_relaxed));
+            // A cell in the dark has nothing to guide towards; cosine sampling stays.
+            if (total <= 0.0)
+                continue;
+            double sum = 0.0;
+            for (uint32_t bin = 0; bin < m_binCount; ++bin)
+            {
+                sum += static_cast<double>(training[bin].load(std::memory_order_relaxed));
+                cdf[bin] = static_cast<float>(sum / total);
+            }
+            cdf[m_binCount - 1] = 1.0f;
+            m_guiding[cell] = 1;
+            rebuilt = true;
+        }
+        if (rebuilt)
+            m_generation++;
+        return rebuilt;
+    }
+
+    PathGuideStats PathGuide::GetStats() const
+    {
+        PathGuideStats stats;
+        stats.cells = m_cellCount;
+        stats.generation = m_generation;
+        for (uint32_t cell = 0; cell < m_cellCount; ++cell)
+        {
+            stats.guidingCells += m_guiding[cell];
+            stats.records += m_recordCounts[cell].load(std::memory_order_relaxed);
+        }
+        size_t bins = static_cast<size_t>(m_cellCount) * m_binCount;
+        stats.memoryBytes = bins * (sizeof(uint64_t) + sizeof(float)) + m_cellCount * (sizeof(uint32_t) + sizeof(uint8_t)) +
+                            (m_texelCells.size() + m_cells.size()) * sizeof(uint32_t);
+        return stats;
+    }
+}
@@ -0,0 +1,357 @@
+#include "Bake/path_integrator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kRussianRouletteDepth = 2;
+        // Shadow rays towards area lights stop this fraction short so they do not hit the light itself.
+        constexpr float kShadowRayShortening = 1e-4f;
+        // Guided bounces of one path that record what they find into the guide.
+        constexpr uint32_t kMaxGuidedVertices = 8;
+
+        struct GuidedVertex
+        {
+            uint32_t cell;
+            glm::vec3 direction;
+            // Weight of what the path finds past the vertex in its record, and the record so far.
+            glm::vec3 weight;
+            glm::vec3 value;
+        };
+
+        float SpotFalloff(const Light& light, const glm::vec3& toSurface)
+        {
+            if (light.type != Light::Type::Spot)
+                return 1.0f;
+            float cosAngle = glm::dot(toSurface, light.direction);
+            if (light.cosInnerAngle <= light.cosOuterAngle)
+                return cosAngle >= light.cosOuterAngle ? 1.0f : 0.0f;
+            float t = glm::clamp((cosAngle - light.cosOuterAngle) / (light.cosInnerAngle - light.cosOuterAngle), 0.0f, 1.0f);
+            return t * t * (3.0f - 2.0f * t);
+        }
+
+        /**
+         * Irradiance from one punctual light at `origin`, before the shadow ray.
+         */
+        bool SamplePunctualLight(const Light& light, const glm::vec3& origin, const glm::vec3& normal, LightSample& sample)
+        {
+            glm::vec3 toLight = light.position - origin;
+            float distanceSquared = glm::dot(toLight, toLight);
+            float distance = std::sqrt(distanceSquared);
+            sample.point = light.position;
+            sample.direction = toLight / distance;
+            sample.maxDistance = distance;
+            float cosTheta = glm::dot(normal, sample.direction);
+            if (cosTheta <= 0.0f)
+                return false;
+            float falloff = SpotFalloff(light, -sample.direction);
+            if (falloff <= 0.0f)
+                return false;
+            sample.irradiance = light.color * (light.intensity * falloff * cosTheta / distanceSquared);
+            return true;
+        }
+
+        /**
+         * Irradiance from a uniformly sampled point on an emissive triangle,
+         * MIS-weighted against the cosine sampling that could also hit it.
+         */
+        bool SampleEmissiveTriangle(const EmissiveTriangle& triangle, float pmf, const glm::vec3& origin, const glm::vec3& normal, Sampler& sampler,
+                                    LightSample& sample)
+        {
+            glm::vec2 u = sampler.Next2D();
+            float su = std::sqrt(u.x);
+            float b1 = u.y * su;
+            glm::vec3 point = triangle.vertices[0] * (1.0f - su) + triangle.vertices[1] * b1 + triangle.vertices[2] * (su - b1);
+            sample.point = point;
+            glm::vec3 toLight = point - origin;
+            float distanceSquared = glm::dot(toLight, toLight);
+            float distance = std::sqrt(distanceSquared);
+            sample.direction = toLight / distance;
+            float cosTheta = glm::dot(normal, sample.direction);
+            float cosLight = -glm::dot(triangle.normal, sample.direction);
+            if (cosTheta <= 0.0f || cosLight <= 0.0f)
+                return false;
+            sample.maxDistance = distance * (1.0f - kShadowRayShortening);
+            float lightPdf = pmf * distanceSquared / (triangle.area * cosLight);
+            float weight = PowerHeuristic(lightPdf, cosTheta * kInvPi);
+            sample.irradiance = triangle.radiance * (cosTheta * weight / lightPdf);
+            return true;
+        }
+
+        /**
+         * Irradiance from an importance-sampled sky direction, MIS-weighted
+         * against the cosine sampling of rays that escape the scene.
+         */
+        bool SampleEnvironment(const EnvironmentLight& environment, float pmf, const glm::vec3& normal, Sampler& sampler, LightSample& sample)
+        {
+            float directionPdf;
+            glm::vec2 u = sampler.Next2D();
+            if (!environment.Sample(u.x, u.y, sample.direction, directionPdf))
+                return false;
+            sample.point = sample.direction;
+            float cosTheta = glm::dot(normal, sample.direction);
+            if (cosTheta <= 0.0f)
+                return false;
+            sample.maxDistance = std::numeric_limits<float>::max();
+            float lightPdf = pmf * directionPdf;
+            float weight = PowerHeuristic(lightPdf, cosTheta * kInvPi);
+            sample.irradiance = environment.Evaluate(sample.direction) * (cosTheta * weight / lightPdf);
+            return true;
+        }
+    }
+
+    PathIntegrator::PathIntegrator(const RayTracer& tracer, const LightSet& lights)
+        : m_tracer(tracer)
+        , m_lights(lights)
+    {
+    }
+
+    glm::vec3 PathIntegrator::DirectIrradiance(const glm::vec3& position, const glm::vec3& normal, Sampler& sampler, glm::vec3& direction) const
+    {
+        LightSample sample;
+        bool sampled = SampleDirect(position, normal, sampler, sample);
+        direction = sample.direction;
+        if (!sampled || m_tracer.Occluded(sample.origin, sample.direction, sample.maxDistance))
+            return glm::vec3(0.0f);
+        return sample.irradiance;
+    }
+
+    bool PathIntegrator::SampleDirect(const glm::vec3& position, const glm::vec3& normal, Sampler& sampler, LightSample& sample) const
+    {
+        sample.origin = position + normal * m_tracer.GetEpsilon();
+        sample.direction = normal;
+        sample.light = LightSet::kNoLight;
+        float pmf;
+        if (!m_lights.Sample(sample.origin, normal, sampler.Next1D(), sample.light, pmf) || pmf <= 0.0f)
+            return false;
+        if (sample.light == LightSet::kEnvironmentLight)
+            return SampleEnvironment(m_lights.GetEnvironment(), pmf, normal, sampler, sample);
+        if (sample.light < m_lights.GetPunctualCount())
+        {
+            if (!SamplePunctualLight(m_lights.GetPunctualLights()[sample.light], sample.origin, normal, sample))
+                return false;
+            sample.irradiance /= pmf;
+            return true;
+        }
+        const EmissiveTriangle& triangle = m_lights.GetEmissiveTriangles()[sample.light - m_lights.GetPunctualCount()];
+        return SampleEmissiveTriangle(triangle, pmf, sample.origin, normal, sampler, sample);
+    }
+
+    bool PathIntegrator::EvaluateDirect(const glm::vec3& position, const glm::vec3& normal, uint32_t light, const glm::vec3& point,
+                                        LightSample& sample) const
+    {
+        sample.origin = position + normal * m_tracer.GetEpsilon();
+        sample.light = light;
+        sample.point = point;
+        if (light == LightSet::kEnvironmentLight)
+        {
+            sample.direction = point;
+            float cosTheta = glm::dot(normal, sample.direction);
+            if (cosTheta <= 0.0f)
+                return false;
+            sample.maxDistance = std::numeric_limits<float>::max();
+            sample.irradiance = m_lights.GetEnvironment().Evaluate(sample.direction) * cosTheta;
+            return true;
+        }
+        if (light < m_lights.GetPunctualCount())
+            return SamplePunctualLight(m_lights.GetPunctualLights()[light], sample.origin, normal, sample);
+
+        const EmissiveTriangle& triangle = m_lights.GetEmissiveTriangles()[light - m_lights.GetPunctualCount()];
+        glm::vec3 toLight = point - sample.origin;
+        float distanceSquared = glm::dot(toLight, toLight);
+        float distance = std::sqrt(distanceSquared);
+        sample.direction = toLight / distance;
+        float cosTheta = glm::dot(normal, sample.direction);
+        float cosLight = -glm::dot(triangle.normal, sample.direction);
+        if (cosTheta <= 0.0f || cosLight <= 0.0f)
+            return false;
+        sample.maxDistance = distance * (1.0f - kShadowRayShortening);
+        sample.irradiance = triangle.radiance * (cosTheta * cosLight / distanceSquared);
+        return true;
+    }
+
+    float PathIntegrator::GetDirectWeight(const LightSample& sample, const glm::vec3& normal, float pmf) const
+    {
+        if (sample.light < m_lights.GetPunctualCount())
+            return 1.0f;
+        float cosTheta = glm::dot(normal, sample.direction);
+        float lightPdf = pmf;
+        if (sample.light == LightSet::kEnvironmentLight)
+        {
+            lightPdf *= m_lights.GetEnvironment().GetPdf(sample.direction);
+        }
+        else
+        {
+            const EmissiveTriangle& triangle = m_lights.GetEmissiveTriangles()[sample.light - m_lights.GetPunctualCount()];
+            glm::vec3 toLight = sample.point - sample.origin;
+            lightPdf *= glm::dot(toLight, toLight) / (triangle.area * -glm::dot(triangle.normal, sample.direction));
+        }
+        return PowerHeuristic(lightPdf, cosTheta * kInvPi);
+    }
+
+    glm::vec3 PathIntegrator::PunctualIrradiance(uint32_t light, const glm::vec3& position, glm::vec3& direction) const
+    {
+        const Light& punctual = m_lights.GetPunctualLights()[light];
+        glm::vec3 toLight = punctual.position - position;
+        float distance = glm::length(toLight);
+        glm::vec3 facing = distance > 0.0f ? toLight / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+        LightSample sample;
+        bool sampled = SamplePunctualLight(punctual, position, facing, sample);
+        direction = sample.direction;
+        if (!sampled || m_tracer.Occluded(position, sample.direction, sample.maxDistance))
+            return glm::vec3(0.0f);
+        return sample.irradiance;
+    }
+
+    glm::vec3 PathIntegrator::Radiance(glm::vec3 origin, glm::vec3 normal, glm::vec3 direction, uint32_t maxBounces, bool lightSampledAtOrigin,
+                                       Sampler& sampler) const
+    {
+        const Scene& scene = m_tracer.GetScene();
+        glm::vec3 radiance(0.0f);
+        glm::vec3 throughput(1.0f);
+        // The vertex whose irradiance goes to the cache: what the path gathers past it, with
+        // the weight of later vertices relative to it.
+        uint32_t recordCell = RadianceCache::kNoCell;
+        glm::vec3 recorded(0.0f);
+        glm::vec3 recordThroughput(0.0f);
+        GuidedVertex guided[kMaxGuidedVertices];
+        uint32_t guidedCount = 0;
+        auto gather = [&](const glm::vec3& contribution) {
+            for (uint32_t v = 0; v < guidedCount; ++v)
+                guided[v].value += guided[v].weight * contribution;
+        };
+        for (uint32_t bounce = 0;; ++bounce)
+        {
+            bool misWeighted = bounce > 0 || lightSampledAtOrigin;
+            RayHit hit;
+            if (!m_tracer.Intersect(origin, direction, std::numeric_limits<float>::max(), hit))
+            {
+                if (m_lights.HasEnvironment())
+                {
+                    float weight = 1.0f;
+                    if (misWeighted)
+                    {
+                        float lightPdf = m_lights.GetPmf(origin, normal, LightSet::kEnvironmentLight) * m_lights.GetEnvironment().GetPdf(direction);
+                        weight = PowerHeuristic(glm::dot(normal, direction) * kInvPi, lightPdf);
+                    }
+                    glm::vec3 environment = m_lights.GetEnvironment().Evaluate(direction);
+                    radiance += throughput * environment * weight;
+                    recorded += recordThroughput * environment * weight;
+                    gather(environment * weight);
+                }
+                else
+                {
+                    radiance += throughput * scene.skyColor;
+                    recorded += recordThroughput * scene.skyColor;
+                    gather(scene.skyColor);
+                }
+                break;
+            }
+
+            SurfacePoint surface = m_tracer.GetSurface(origin, direction, hit);
+            const Material& material = scene.GetMaterial(surface.materialIndex);
+            uint32_t light = m_lights.GetEmissiveLight(hit.triangleId);
+            if (light != LightSet::kNoLight)
+            {
+                const EmissiveTriangle& triangle = m_lights.GetEmissiveTriangles()[light - m_lights.GetPunctualCount()];
+                float cosLight = -glm::dot(triangle.normal, direction);
+                if (cosLight > 0.0f)
+                {
+                    float weight = 1.0f;
+                    if (misWeighted)
+                    {
+                        float lightPdf = m_lights.GetPmf(origin, normal, light) * hit.distance * hit.distance / (triangle.area * cosLight);
+                        weight = PowerHeuristic(glm::dot(normal, direction) * kInvPi, lightPdf);
+                    }
+                    radiance += throughput * material.emission * weight;
+                    recorded += recordThroughput * material.emission * weight;
+                    gather(material.emission * weight);
+                }
+            }
+            if (bounce >= maxBounces)
+                break;
+
+            // A cell right next to the previous vertex would blur the contact shadow it sits in.
+            bool recordHere = false;
+            if (m_cache && recordCell == RadianceCache::kNoCell && hit.distance > m_cache->GetCellSize())
+            {
+                uint32_t cell = m_cache->FindCell(surface.position, surface.normal);
+                glm::vec3 cached;
+                if (cell != RadianceCache::kNoCell && m_cache->Lookup(cell, sampler.Next1D(), cached))
+                {
+                    radiance += throughput * material.albedo * kInvPi * cached;
+                    gather(material.albedo * kInvPi * cached);
+                    break;
+                }
+                recordCell = cell;
+                recordHere = cell != RadianceCache::kNoCell;
+            }
+
+            glm::vec3 lightDirection;
+            glm::vec3 direct = DirectIrradiance(surface.position, surface.normal, sampler, lightDirection);
+            radiance += throughput * material.albedo * kInvPi * direct;
+            recorded += recordHere ? direct : recordThroughput * material.albedo * kInvPi * direct;
+            gather(material.albedo * kInvPi * direct);
+
+            // Cosine sampling cancels the Lambertian cos / pi, leaving the albedo.
+            throughput *= material.albedo;
+            // Past the recorded vertex, the cosine sampling of its own irradiance leaves pi.
+            recordThroughput = recordHere ? glm::vec3(kPi) : recordThroughput * material.albedo;
+            for (uint32_t v = 0; v < guidedCount; ++v)
+                guided[v].weight *= material.albedo;
+            if (bounce >= kRussianRouletteDepth)
+            {
+                float survival = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                if (sampler.Next1D() >= survival)
+                    break;
+                throughput /= survival;
+                recordThroughput /= survival;
+                for (uint32_t v = 0; v < guidedCount; ++v)
+                    guided[v].weight /= survival;
+            }
+
+            origin = surface.position + surface.normal * m_tracer.GetEpsilon();
+            normal = surface.normal;
+            glm::vec2 u = sampler.Next2D();
+            if (!m_guide)
+            {
+                direction = SampleCosineHemisphere(surface.normal, u.x, u.y);
+                continue;
+            }
+            uint32_t cell = m_guide->FindCell(surface.position, surface.normal);
+            // What the bounce weighs relative to cosine sampling, and the weight of its own record.
+            float weight = 1.0f;
+            float recordWeight = kPi;
+            if (m_guide->IsGuiding(cell))
+            {
+                float pdf;
+                direction = m_guide->Sample(cell, surface.normal, u, pdf);
+                float cosine = glm::dot(surface.normal, direction);
+                if (cosine <= 0.0f || pdf <= 0.0f)
+                    break;
+                weight = cosine * kInvPi / pdf;
+                recordWeight = cosine / pdf;
+            }
+            else
+            {
+                direction = SampleCosineHemisphere(surface.normal, u.x, u.y);
+            }
+            throughput *= weight;
+            recordThroughput *= weight;
+            for (uint32_t v = 0; v < guidedCount; ++v)
+                guided[v].weight *= weight;
+            if (cell != PathGuide::kNoCell && guidedCount < kMaxGuidedVertices)
+                guided[guidedCount++] = { cell, direction, glm::vec3(recordWeight), glm::vec3(0.0f) };
+        }
+        if (recordCell != RadianceCache::kNoCell)
+            m_cache->Add(recordCell, recorded);
+        for (uint32_t v = 0; v < guidedCount; ++v)
+            m_guide->Record(guided[v].cell, guided[v].direction, Luminance(guided[v].value));
+        return radiance;
+    }
+}
@@ -0,0 +1,390 @@
+#include "Bake/probe_volume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <bvh/v2/executor.h>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // The indirection entry keeps 4 bits for the level, and the last level value marks subgrids.
+        constexpr uint32_t kMaxLevels = ProbeVolume::kSubgridLevel;
+        constexpr float kShY0 = 0.282095f;
+        constexpr float kShY1 = 0.488603f;
+
+        /**
+         * Separating-axis test of a triangle against an axis-aligned box
+         * (Akenine-Moller 2001).
+         */
+        bool TriangleOverlapsBox(const glm::vec3 vertices[3], const glm::vec3& center, const glm::vec3& halfSize)
+        {
+            glm::vec3 v[3] = { vertices[0] - center, vertices[1] - center, vertices[2] - center };
+            glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+            auto separated = [&](const glm::vec3& axis) {
+                float p0 = glm::dot(v[0], axis);
+                float p1 = glm::dot(v[1], axis);
+                float p2 = glm::dot(v[2], axis);
+                float radius = glm::dot(halfSize, glm::abs(axis));
+                return std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius;
+            };
+            for (const glm::vec3& edge : edges)
+            {
+                if (separated(glm::vec3(0.0f, -edge.z, edge.y)) || separated(glm::vec3(edge.z, 0.0f, -edge.x)) ||
+                    separated(glm::vec3(-edge.y, edge.x, 0.0f)))
+                    return false;
+            }
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                glm::vec3 unit(0.0f);
+                unit[axis] = 1.0f;
+                if (separated(unit))
+                    return false;
+            }
+            return !separated(glm::cross(edges[0], edges[1]));
+        }
+
+        constexpr uint32_t kProbesPerBrick = ProbeVolume::kBrickProbes * ProbeVolume::kBrickProbes * ProbeVolume::kBrickProbes;
+
+        glm::uvec3 GetProbeCoordinate(uint32_t local)
+        {
+            return glm::uvec3(local % ProbeVolume::kBrickProbes, local / ProbeVolume::kBrickProbes % ProbeVolume::kBrickProbes,
+                              local / (ProbeVolume::kBrickProbes * ProbeVolume::kBrickProbes));
+        }
+
+        glm::vec4 ShBasis(const glm::vec3& direction)
+        {
+            return glm::vec4(kShY0, kShY1 * direction.y, kShY1 * direction.z, kShY1 * direction.x);
+        }
+
+        size_t GetCoarseIndex(const ProbeVolume& volume, const glm::uvec3& cell)
+        {
+            glm::uvec3 coarse = cell / volume.coarseCells;
+            return (static_cast<size_t>(coarse.z) * volume.coarseCount.y + coarse.y) * volume.coarseCount.x + coarse.x;
+        }
+
+        // Index of a finest cell within its coarsest cell's subgrid.
+        size_t GetSubgridCellIndex(const ProbeVolume& volume, const glm::uvec3& cell)
+        {
+            glm::uvec3 local = cell % volume.coarseCells;
+            return (static_cast<size_t>(local.z) * volume.coarseCells + local.y) * volume.coarseCells + local.x;
+        }
+
+        size_t GetSubgridSize(const ProbeVolume& volume)
+        {
+            return static_cast<size_t>(volume.coarseCells) * volume.coarseCells * volume.coarseCells;
+        }
+    }
+
+    uint32_t ProbeVolume::GetEntry(const glm::uvec3& cell) const
+    {
+        uint32_t entry = indirection[GetCoarseIndex(*this, cell)];
+        if (entry == kNoBrick || entry >> kLevelShift != kSubgridLevel)
+            return entry;
+        return subgrids[(entry & kBrickIndexMask) * GetSubgridSize(*this) + GetSubgridCellIndex(*this, cell)];
+    }
+
+    size_t ProbeVolume::GetAtlasIndex(uint32_t brick, uint32_t x, uint32_t y, uint32_t z) const
+    {
+        glm::uvec3 atlasSize = GetAtlasSize();
+        uint32_t ax = (brick % atlasBricks.x) * kBrickProbes + x;
+        uint32_t ay = (brick / atlasBricks.x % atlasBricks.y) * kBrickProbes + y;
+        uint32_t az = (brick / (atlasBricks.x * atlasBricks.y)) * kBrickProbes + z;
+        return (static_cast<size_t>(az) * atlasSize.y + ay) * atlasSize.x + ax;
+    }
+
+    glm::vec3 ProbeVolume::EvaluateIrradiance(const glm::vec3& position, const glm::vec3& normal) const
+    {
+        if (indirection.empty())
+            return glm::vec3(0.0f);
+        glm::vec3 local = (position - origin) / cellSize;
+        glm::uvec3 cell = glm::uvec3(glm::clamp(glm::floor(local), glm::vec3(0.0f), glm::vec3(cellCount - 1u)));
+        uint32_t entry = GetEntry(cell);
+        if (entry == kNoBrick)
+            return glm::vec3(0.0f);
+        uint32_t brick = entry & kBrickIndexMask;
+        uint32_t level = entry >> kLevelShift;
+        glm::vec3 t = glm::clamp((local - glm::vec3(bricks[brick].cell)) / static_cast<float>(1u << level), 0.0f, 1.0f);
+
+        glm::vec3 f = t * static_cast<float>(kBrickProbes - 1);
+        glm::uvec3 base = glm::min(glm::uvec3(f), glm::uvec3(kBrickProbes - 2));
+        glm::vec3 w = f - glm::vec3(base);
+        glm::vec4 sh[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            glm::uvec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+            glm::vec3 weights = glm::mix(glm::vec3(1.0f) - w, w, glm::vec3(offset));
+            size_t index = GetAtlasIndex(brick, base.x + offset.x, base.y + offset.y, base.z + offset.z);
+            for (int c = 0; c < 3; ++c)
+                sh[c] += atlas[c][index] * (weights.x * weights.y * weights.z);
+        }
+        glm::vec4 basis = ShBasis(normal);
+        return glm::max(glm::vec3(glm::dot(sh[0], basis), glm::dot(sh[1], basis), glm::dot(sh[2], basis)), glm::vec3(0.0f));
+    }
+
+    ProbeVolumeBaker::ProbeVolumeBaker(const ProbeVolumeSettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.levelCount = std::clamp(m_settings.levelCount, 1u, kMaxLevels);
+        m_settings.minBrickSize = std::max(m_settings.minBrickSize, 1e-4f);
+    }
+
+    ProbeVolume ProbeVolumeBaker::Bake(const PathIntegrator& integrator, bvh::v2::ThreadPool& threadPool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const RayTracer& tracer = integrator.GetRayTracer();
+        m_stats = ProbeVolumeStats();
+        m_stats.bricksPerLevel.assign(m_settings.levelCount, 0);
+
+        ProbeVolume volume;
+        glm::vec3 lo(std::numeric_limits<float>::max());
+        glm::vec3 hi(-std::numeric_limits<float>::max());
+        for (uint32_t triangle = 0; triangle < tracer.GetTriangleCount(); ++triangle)
+        {
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                lo = glm::min(lo, tracer.GetVertex(triangle, corner));
+                hi = glm::max(hi, tracer.GetVertex(triangle, corner));
+            }
+        }
+        if (tracer.GetTriangleCount() == 0)
+            return volume;
+
+        // Whole coarsest bricks cover the padded scene bounds.
+        uint32_t coarseCells = 1u << (m_settings.levelCount - 1);
+        float coarseSize = m_settings.minBrickSize * coarseCells;
+        glm::vec3 extent = hi - lo + glm::vec3(2.0f * m_settings.padding);
+        glm::uvec3 coarseCount = glm::max(glm::uvec3(glm::ceil(extent / coarseSize)), glm::uvec3(1u));
+        volume.cellSize = m_settings.minBrickSize;
+        volume.cellCount = coarseCount * coarseCells;
+        volume.coarseCells = coarseCells;
+        volume.coarseCount = coarseCount;
+        volume.origin = (lo + hi) * 0.5f - glm::vec3(coarseCount) * (coarseSize * 0.5f);
+        volume.indirection.assign(static_cast<size_t>(coarseCount.x) * coarseCount.y * coarseCount.z, ProbeVolume::kNoBrick);
+        size_t subgridSize = GetSubgridSize(volume);
+
+        // Refine from the coarsest level down wherever a finest cell near geometry is inside.
+        std::vector<uint32_t> occupancySubgrids;
+        std::vector<uint8_t> occupancy = BuildOccupancy(tracer, volume, occupancySubgrids);
+        auto occupied = [&](const glm::uvec3& cell, uint32_t size) {
+            uint32_t subgrid = occupancySubgrids[GetCoarseIndex(volume, cell)];
+            if (subgrid == ProbeVolume::kNoBrick)
+                return false;
+            const uint8_t* cells = &occupancy[subgrid * subgridSize];
+            for (uint32_t z = cell.z; z < cell.z + size; ++z)
+                for (uint32_t y = cell.y; y < cell.y + size; ++y)
+                    for (uint32_t x = cell.x; x < cell.x + size; ++x)
+                        if (cells[GetSubgridCellIndex(volume, glm::uvec3(x, y, z))])
+                            return true;
+            return false;
+        };
+        std::vector<ProbeBrick> stack;
+        for (uint32_t z = 0; z < coarseCount.z; ++z)
+            for (uint32_t y = 0; y < coarseCount.y; ++y)
+                for (uint32_t x = 0; x < coarseCount.x; ++x)
+                    stack.push_back({ glm::uvec3(x, y, z) * coarseCells, m_settings.levelCount - 1 });
+        while (!stack.empty())
+        {
+            ProbeBrick brick = stack.back();
+            stack.pop_back();
+            uint32_t size = 1u << brick.level;
+            size_t coarseIndex = GetCoarseIndex(volume, brick.cell);
+            bool coarsest = brick.level == m_settings.levelCount - 1;
+            if (brick.level > 0 && occupied(brick.cell, size))
+            {
+                // Bricks are aligned, so every finer brick lies within the subgrid of its coarsest cell.
+                if (coarsest)
+                {
+                    uint32_t subgrid = static_cast<uint32_t>(volume.subgrids.size() / subgridSize);
+                    volume.indirection[coarseIndex] = subgrid | (ProbeVolume::kSubgridLevel << ProbeVolume::kLevelShift);
+                    volume.subgrids.resize(volume.subgrids.size() + subgridSize, ProbeVolume::kNoBrick);
+                }
+                uint32_t half = size / 2;
+                for (uint32_t child = 0; child < 8; ++child)
+                    stack.push_back({ brick.cell + glm::uvec3(child & 1, (child >> 1) & 1, child >> 2) * half, brick.level - 1 });
+                continue;
+            }
+            uint32_t index = static_cast<uint32_t>(volume.bricks.size());
+            volume.bricks.push_back(brick);
+            m_stats.bricksPerLevel[brick.level]++;
+            uint32_t entry = index | (brick.level << ProbeVolume::kLevelShift);
+            if (coarsest)
+            {
+                volume.indirection[coarseIndex] = entry;
+                continue;
+            }
+            uint32_t* cells = &volume.subgrids[(volume.indirection[coarseIndex] & ProbeVolume::kBrickIndexMask) * subgridSize];
+            for (uint32_t z = 0; z < size; ++z)
+                for (uint32_t y = 0; y < size; ++y)
+                    for (uint32_t x = 0; x < size; ++x)
+                        cells[GetSubgridCellIndex(volume, brick.cell + glm::uvec3(x, y, z))] = entry;
+        }
+
+        uint32_t brickCount = static_cast<uint32_t>(volume.bricks.size());
+        uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(brickCount))));
+        volume.atlasBricks = glm::uvec3(side, side, (brickCount + side * side - 1) / (side * side));
+        glm::uvec3 atlasSize = volume.GetAtlasSize();
+        size_t atlasTexels = static_cast<size_t>(atlasSize.x) * atlasSize.y * atlasSize.z;
+        for (auto& channel : volume.atlas)
+            channel.assign(atlasTexels, glm::vec4(0.0f));
+        volume.validity.assign(atlasTexels, 0);
+
+        size_t probeCount = static_cast<size_t>(brickCount) * kProbesPerBrick;
+        float sampleWeight = 4.0f * kPi / std::max(1u, m_settings.samplesPerProbe);
+        bvh::v2::ParallelExecutor executor(threadPool, 16);
+        executor.for_each(0, probeCount, [&](size_t begin, size_t end) {
+            for (size_t probe = begin; probe < end; ++probe)
+            {
+                uint32_t brickIndex = static_cast<uint32_t>(probe / kProbesPerBrick);
+                glm::uvec3 p = GetProbeCoordinate(static_cast<uint32_t>(probe % kProbesPerBrick));
+                const ProbeBrick& brick = volume.bricks[brickIndex];
+                float spacing = static_cast<float>(1u << brick.level) / (ProbeVolume::kBrickProbes - 1);
+                glm::vec3 position = volume.origin + (glm::vec3(brick.cell) + glm::vec3(p) * spacing) * volume.cellSize;
+                size_t atlasIndex = volume.GetAtlasIndex(brickIndex, p.x, p.y, p.z);
+                if (IsInsideGeometry(tracer, position, probe))
+                    continue;
+
+                glm::vec4 sh[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+                for (uint32_t s = 0; s < m_settings.samplesPerProbe; ++s)
+                {
+                    Sampler sampler(m_settings.sampler, probe, s, 0, 0, nullptr);
+                    glm::vec2 u = sampler.Next2D();
+                    glm::vec3 direction = SampleUniformSphere(u.x, u.y);
+                    glm::vec3 radiance = integrator.Radiance(position, direction, direction, m_settings.maxBounces, false, sampler);
+                    glm::vec4 basis = ShBasis(direction) * sampleWeight;
+                    for (int c = 0; c < 3; ++c)
+                        sh[c] += radiance[c] * basis;
+                }
+                // Punctual lights cannot be hit by rays, so they are projected directly.
+                for (uint32_t light = 0; light < integrator.GetLights().GetPunctualCount(); ++light)
+                {
+                    glm::vec3 direction;
+                    glm::vec3 irradiance = integrator.PunctualIrradiance(light, position, direction);
+                    glm::vec4 basis = ShBasis(direction);
+                    for (int c = 0; c < 3; ++c)
+                        sh[c] += irradiance[c] * basis;
+                }
+                // Convolve radiance with the clamped cosine: pi for band 0, 2 pi / 3 for band 1.
+                glm::vec4 convolution(kPi, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f);
+                for (int c = 0; c < 3; ++c)
+                    volume.atlas[c][atlasIndex] = sh[c] * convolution;
+                volume.validity[atlasIndex] = 1;
+            }
+        });
+
+        // Probes inside geometry would leak darkness through trilinear filtering; give them the
+        // average of their brick's valid probes instead.
+        for (uint32_t brick = 0; brick < brickCount; ++brick)
+        {
+            glm::vec4 sum[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+            uint32_t valid = 0;
+            for (uint32_t local = 0; local < kProbesPerBrick; ++local)
+            {
+                glm::uvec3 p = GetProbeCoordinate(local);
+                size_t index = volume.GetAtlasIndex(brick, p.x, p.y, p.z);
+                if (!volume.validity[index])
+                    continue;
+                for (int c = 0; c < 3; ++c)
+                    sum[c] += volume.atlas[c][index];
+                valid++;
+            }
+            m_stats.culledProbes += kProbesPerBrick - valid;
+            if (valid == 0 || valid == kProbesPerBrick)
+                continue;
+            for (uint32_t local = 0; local < kProbesPerBrick; ++local)
+            {
+                glm::uvec3 p = GetProbeCoordinate(local);
+                size_t index = volume.GetAtlasIndex(brick, p.x, p.y, p.z);
+                if (!volume.validity[index])
+                    for (int c = 0; c < 3; ++c)
+                        volume.atlas[c][index] = sum[c] / static_cast<float>(valid);
+            }
+        }
+
+        m_stats.probeCount = probeCount;
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return volume;
+    }
+
+    std::vector<uint8_t> ProbeVolumeBaker::BuildOccupancy(const RayTracer& tracer, const ProbeVolume& volume, std::vector<uint32_t>& coarseSubgrids) const
+    {
+        // Cells overlapping a triangle, dilated by one cell so probes right next to surfaces are fine too.
+        // A coarsest cell only gets a subgrid when its box, dilated the same way, overlaps a triangle.
+        std::vector<uint8_t> occupancy;
+        coarseSubgrids.assign(volume.indirection.size(), ProbeVolume::kNoBrick);
+        size_t subgridSize = GetSubgridSize(volume);
+        float coarseSize = volume.cellSize * volume.coarseCells;
+        glm::vec3 coarseHalfSize(coarseSize * 0.5f + volume.cellSize);
+        glm::vec3 halfSize(volume.cellSize * 1.5f);
+        glm::ivec3 maxCell = glm::ivec3(volume.cellCount) - 1;
+        glm::ivec3 coarseCells(static_cast<int>(volume.coarseCells));
+        for (uint32_t triangle = 0; triangle < tracer.GetTriangleCount(); ++triangle)
+        {
+            glm::vec3 vertices[3] = { tracer.GetVertex(triangle, 0), tracer.GetVertex(triangle, 1), tracer.GetVertex(triangle, 2) };
+            glm::vec3 lo = glm::min(vertices[0], glm::min(vertices[1], vertices[2]));
+            glm::vec3 hi = glm::max(vertices[0], glm::max(vertices[1], vertices[2]));
+            glm::ivec3 first = glm::clamp(glm::ivec3(glm::floor((lo - volume.origin) / volume.cellSize)) - 1, glm::ivec3(0), maxCell);
+            glm::ivec3 last = glm::clamp(glm::ivec3(glm::floor((hi - volume.origin) / volume.cellSize)) + 1, glm::ivec3(0), maxCell);
+            for (int cz = first.z / coarseCells.z; cz <= last.z / coarseCells.z; ++cz)
+            {
+                for (int cy = first.y / coarseCells.y; cy <= last.y / coarseCells.y; ++cy)
+                {
+                    for (int cx = first.x / coarseCells.x; cx <= last.x / coarseCells.x; ++cx)
+                    {
+                        glm::ivec3 coarse(cx, cy, cz);
+                        glm::vec3 coarseCenter = volume.origin + (glm::vec3(coarse) + 0.5f) * coarseSize;
+                        if (!TriangleOverlapsBox(vertices, coarseCenter, coarseHalfSize))
+                            continue;
+                        glm::uvec3 coarseCorner = glm::uvec3(coarse * coarseCells);
+                        uint32_t& subgrid = coarseSubgrids[GetCoarseIndex(volume, coarseCorner)];
+                        if (subgrid == ProbeVolume::kNoBrick)
+                        {
+                            subgrid = static_cast<uint32_t>(occupancy.size() / subgridSize);
+                            occupancy.resize(occupancy.size() + subgridSize, 0);
+                        }
+                        uint8_t* cells = &occupancy[subgrid * subgridSize];
+                        glm::ivec3 cellFirst = glm::max(first, coarse * coarseCells);
+                        glm::ivec3 cellLast = glm::min(last, coarse * coarseCells + coarseCells - 1);
+                        for (int z = cellFirst.z; z <= cellLast.z; ++z)
+                        {
+                            for (int y = cellFirst.y; y <= cellLast.y; ++y)
+                            {
+                                for (int x = cellFirst.x; x <= cellLast.x; ++x)
+                                {
+                                    size_t index = GetSubgridCellIndex(volume, glm::uvec3(x, y, z));
+                                    glm::vec3 center = volume.origin + (glm::vec3(x, y, z) + 0.5f) * volume.cellSize;
+                                    if (!cells[index] && TriangleOverlapsBox(vertices, center, halfSize))
+                                        cells[index] = 1;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return occupancy;
+    }
+
+    bool ProbeVolumeBaker::IsInsideGeometry(const RayTracer& tracer, const glm::vec3& position, size_t probeIndex) const
+    {
+        // Seen from inside a closed mesh, the nearest surfaces are back faces.
+        uint32_t backFaces = 0;
+        for (uint32_t ray = 0; ray < m_settings.validityRays; ++ray)
+        {
+            Sampler sampler(SamplerType::Sobol, probeIndex, ray, 0, 0, nullptr);
+            glm::vec2 u = sampler.Next2D();
+            glm::vec3 direction = SampleUniformSphere(u.x, u.y);
+            RayHit hit;
+            if (!tracer.Intersect(position, direction, std::numeric_limits<float>::max(), hit))
+                continue;
+            glm::vec3 v0 = tracer.GetVertex(hit.triangleId, 0);
+            glm::vec3 faceNormal = glm::cross(tracer.GetVertex(hit.triangleId, 1) - v0, tracer.GetVertex(hit.triangleId, 2) - v0);
+            if (glm::dot(faceNormal, direction) > 0.0f)
+                backFaces++;
+        }
+        return backFaces > m_settings.insideThreshold * m_settings.validityRays;
+    }
+}
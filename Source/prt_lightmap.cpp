@@ -0,0 +1,207 @@
+#include "Bake/prt_lightmap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <bvh/v2/executor.h>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kRussianRouletteDepth = 2;
+        constexpr float kShY0 = 0.282095f;
+        constexpr float kShY1 = 0.488603f;
+        constexpr float kShY2 = 1.092548f;
+        constexpr float kShY20 = 0.315392f;
+        constexpr float kShY22 = 0.546274f;
+
+        uint32_t ClampBands(uint32_t bands)
+        {
+            return std::clamp(bands, 1u, kMaxShBands);
+        }
+    }
+
+    void EvaluateShBasis(const glm::vec3& d, uint32_t bands, float basis[kMaxShCoefficients])
+    {
+        basis[0] = kShY0;
+        if (bands < 2)
+            return;
+        basis[1] = kShY1 * d.y;
+        basis[2] = kShY1 * d.z;
+        basis[3] = kShY1 * d.x;
+        if (bands < 3)
+            return;
+        basis[4] = kShY2 * d.x * d.y;
+        basis[5] = kShY2 * d.y * d.z;
+        basis[6] = kShY20 * (3.0f * d.z * d.z - 1.0f);
+        basis[7] = kShY2 * d.x * d.z;
+        basis[8] = kShY22 * (d.x * d.x - d.y * d.y);
+    }
+
+    ShLighting& ShLighting::operator+=(const ShLighting& other)
+    {
+        bands = std::max(bands, other.bands);
+        for (uint32_t i = 0; i < kMaxShCoefficients; ++i)
+            coefficients[i] += other.coefficients[i];
+        return *this;
+    }
+
+    ShLighting ProjectDirectionalLight(const glm::vec3& direction, const glm::vec3& irradiance, uint32_t bands)
+    {
+        ShLighting lighting;
+        lighting.bands = ClampBands(bands);
+        float basis[kMaxShCoefficients];
+        EvaluateShBasis(glm::normalize(direction), lighting.bands, basis);
+        for (uint32_t i = 0; i < lighting.bands * lighting.bands; ++i)
+            lighting.coefficients[i] = irradiance * basis[i];
+        return lighting;
+    }
+
+    ShLighting ProjectConstantSky(const glm::vec3& radiance, uint32_t bands)
+    {
+        // Every band but the first integrates to zero over the sphere.
+        ShLighting lighting;
+        lighting.bands = ClampBands(bands);
+        lighting.coefficients[0] = radiance * (4.0f * kPi * kShY0);
+        return lighting;
+    }
+
+    ShLighting ProjectEnvironment(const EnvironmentLight& environment, uint32_t sampleCount, uint32_t bands)
+    {
+        ShLighting lighting;
+        lighting.bands = ClampBands(bands);
+        if (!environment.IsValid() || sampleCount == 0)
+            return lighting;
+        uint32_t coefficientCount = lighting.bands * lighting.bands;
+        for (uint32_t s = 0; s < sampleCount; ++s)
+        {
+            Sampler sampler(SamplerType::Sobol, 0, s, 0, 0, nullptr);
+            glm::vec2 u = sampler.Next2D();
+            glm::vec3 direction;
+            float pdf;
+            if (!environment.Sample(u.x, u.y, direction, pdf) || pdf <= 0.0f)
+                continue;
+            float basis[kMaxShCoefficients];
+            EvaluateShBasis(direction, lighting.bands, basis);
+            glm::vec3 radiance = environment.Evaluate(direction) / (pdf * static_cast<float>(sampleCount));
+            for (uint32_t i = 0; i < coefficientCount; ++i)
+                lighting.coefficients[i] += radiance * basis[i];
+        }
+        return lighting;
+    }
+
+    glm::vec3 PrtLightmap::EvaluateIrradiance(size_t texel, const ShLighting& lighting) const
+    {
+        uint32_t count = std::min(GetCoefficientCount(), lighting.bands * lighting.bands);
+        const glm::vec3* t = &transfer[texel * GetCoefficientCount()];
+        glm::vec3 irradiance(0.0f);
+        for (uint32_t i = 0; i < count; ++i)
+            irradiance += t[i] * lighting.coefficients[i];
+        // A truncated projection of a sun rings below zero behind the lit side.
+        return glm::max(irradiance, glm::vec3(0.0f));
+    }
+
+    Lightmap PrtLightmap::Relight(const ShLighting& lighting) const
+    {
+        Lightmap lightmap;
+        lightmap.width = width;
+        lightmap.height = height;
+        lightmap.atlasCount = atlasCount;
+        lightmap.texels.assign(coverage.size(), glm::vec4(0.0f));
+        for (size_t i = 0; i < coverage.size(); ++i)
+        {
+            if (coverage[i])
+                lightmap.texels[i] = glm::vec4(EvaluateIrradiance(i, lighting), 1.0f);
+        }
+        return lightmap;
+    }
+
+    PrtBaker::PrtBaker(const PrtSettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.bands = ClampBands(m_settings.bands);
+        m_settings.samplesPerTexel = std::max(1u, m_settings.samplesPerTexel);
+        // Blue noise needs the engine's tile; the transfer is converged anyway.
+        if (m_settings.sampler == SamplerType::BlueNoise)
+            m_settings.sampler = SamplerType::Sobol;
+    }
+
+    PrtLightmap PrtBaker::Bake(const RayTracer& tracer, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_stats = PrtStats();
+        const Scene& scene = tracer.GetScene();
+        PrtLightmap prt;
+        prt.width = texels.width;
+        prt.height = texels.height;
+        prt.atlasCount = texels.atlasCount;
+        prt.bands = m_settings.bands;
+        uint32_t coefficientCount = prt.GetCoefficientCount();
+        prt.transfer.assign(texels.texels.size() * coefficientCount, glm::vec3(0.0f));
+        prt.coverage.assign(texels.texels.size(), 0);
+
+        // Cosine sampling turns the irradiance integral into pi times the mean radiance.
+        float sampleWeight = kPi / static_cast<float>(m_settings.samplesPerTexel);
+        std::atomic<uint64_t> rays{ 0 };
+        bvh::v2::ParallelExecutor executor(threadPool, 64);
+        executor.for_each(0, texels.texels.size(), [&](size_t begin, size_t end) {
+            uint64_t localRays = 0;
+            for (size_t index = begin; index < end; ++index)
+            {
+                if (!texels.IsCovered(index))
+                    continue;
+                prt.coverage[index] = 1;
+                const TexelRecord& texel = texels.texels[index];
+                std::array<glm::vec3, kMaxShCoefficients> sum{};
+                for (uint32_t s = 0; s < m_settings.samplesPerTexel; ++s)
+                {
+                    Sampler sampler(m_settings.sampler, index, s, 0, 0, nullptr);
+                    glm::vec3 origin = texel.position + texel.normal * tracer.GetEpsilon();
+                    glm::vec2 u = sampler.Next2D();
+                    glm::vec3 direction = SampleCosineHemisphere(texel.normal, u.x, u.y);
+                    glm::vec3 throughput(1.0f);
+                    for (uint32_t bounce = 0;; ++bounce)
+                    {
+                        localRays++;
+                        RayHit hit;
+                        if (!tracer.Intersect(origin, direction, std::numeric_limits<float>::max(), hit))
+                        {
+                            float basis[kMaxShCoefficients];
+                            EvaluateShBasis(direction, m_settings.bands, basis);
+                            for (uint32_t i = 0; i < coefficientCount; ++i)
+                                sum[i] += throughput * basis[i];
+                            break;
+                        }
+                        if (bounce >= m_settings.maxBounces)
+                            break;
+
+                        SurfacePoint surface = tracer.GetSurface(origin, direction, hit);
+                        throughput *= scene.GetMaterial(surface.materialIndex).albedo;
+                        if (bounce >= kRussianRouletteDepth)
+                        {
+                            float survival = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                            if (sampler.Next1D() >= survival)
+                                break;
+                            throughput /= survival;
+                        }
+                        origin = surface.position + surface.normal * tracer.GetEpsilon();
+                        u = sampler.Next2D();
+                        direction = SampleCosineHemisphere(surface.normal, u.x, u.y);
+                    }
+                }
+                for (uint32_t i = 0; i < coefficientCount; ++i)
+                    prt.transfer[index * coefficientCount + i] = sum[i] * sampleWeight;
+            }
+            rays += localRays;
+        });
+
+        for (uint8_t covered : prt.coverage)
+            m_stats.coveredTexels += covered;
+        m_stats.rays = rays;
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return prt;
+    }
+}
@@ -0,0 +1,98 @@
+#include "Bake/radiance_cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Cells probed past the hashed one before a lookup gives up.
+        constexpr uint32_t kMaxProbes = 32;
+        // Normal bins per octahedral axis: 16 bins keep the faces of a corner apart.
+        constexpr uint32_t kNormalBins = 4;
+        constexpr uint64_t kCellCoordinateMask = (1ull << 21) - 1;
+
+        uint32_t GetNormalBin(const glm::vec3& normal)
+        {
+            glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+            glm::vec2 octahedral(n.x, n.y);
+            if (n.z < 0.0f)
+                octahedral = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+            glm::uvec2 bin = glm::min(glm::uvec2((octahedral * 0.5f + 0.5f) * static_cast<float>(kNormalBins)), glm::uvec2(kNormalBins - 1));
+            return bin.y * kNormalBins + bin.x;
+        }
+    }
+
+    RadianceCache::RadianceCache(const RadianceCacheSettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.capacity = std::bit_ceil(std::max(m_settings.capacity, kMaxProbes));
+        m_settings.minSamples = std::max(1u, m_settings.minSamples);
+        m_settings.maxSamples = std::max(m_settings.minSamples, m_settings.maxSamples);
+        m_inverseCellSize = m_settings.cellSize > 0.0f ? 1.0f / m_settings.cellSize : 0.0f;
+        m_mask = m_settings.capacity - 1;
+        m_cells = std::make_unique<Cell[]>(m_settings.capacity);
+    }
+
+    uint32_t RadianceCache::FindCell(const glm::vec3& position, const glm::vec3& normal)
+    {
+        m_queries.fetch_add(1, std::memory_order_relaxed);
+        glm::ivec3 cell(glm::floor(position * m_inverseCellSize));
+        uint64_t packed = (static_cast<uint64_t>(cell.x) & kCellCoordinateMask) << 42 | (static_cast<uint64_t>(cell.y) & kCellCoordinateMask) << 21 |
+                          (static_cast<uint64_t>(cell.z) & kCellCoordinateMask);
+        // The full hash is the key, so 0 (free) must not come up.
+        uint64_t key = std::max<uint64_t>(Random::Mix(Random::Mix(packed) ^ GetNormalBin(normal)), 1);
+        for (uint32_t probe = 0; probe < kMaxProbes; ++probe)
+        {
+            uint32_t index = static_cast<uint32_t>(key + probe) & m_mask;
+            uint64_t expected = 0;
+            if (m_cells[index].key.compare_exchange_strong(expected, key, std::memory_order_relaxed))
+            {
+                m_cellCount.fetch_add(1, std::memory_order_relaxed);
+                return index;
+            }
+            if (expected == key)
+                return index;
+        }
+        m_overflows.fetch_add(1, std::memory_order_relaxed);
+        return kNoCell;
+    }
+
+    bool RadianceCache::Lookup(uint32_t cell, float u, glm::vec3& irradiance)
+    {
+        const Cell& entry = m_cells[cell];
+        uint32_t count = entry.sampleCount.load(std::memory_order_acquire);
+        if (count < m_settings.minSamples)
+            return false;
+        if (count < m_settings.maxSamples && u * static_cast<float>(count) < static_cast<float>(m_settings.minSamples))
+            return false;
+        for (int c = 0; c < 3; ++c)
+            irradiance[c] = entry.irradianceSum[c].load(std::memory_order_relaxed) / static_cast<float>(count);
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void RadianceCache::Add(uint32_t cell, const glm::vec3& irradiance)
+    {
+        Cell& entry = m_cells[cell];
+        for (int c = 0; c < 3; ++c)
+            entry.irradianceSum[c].fetch_add(irradiance[c], std::memory_order_relaxed);
+        // Released after the sums, so a reader that sees the count sees at least those samples.
+        entry.sampleCount.fetch_add(1, std::memory_order_release);
+        m_samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    RadianceCacheStats RadianceCache::GetStats() const
+    {
+        RadianceCacheStats stats;
+        stats.queries = m_queries.load(std::memory_order_relaxed);
+        stats.hits = m_hits.load(std::memory_order_relaxed);
+        stats.samples = m_samples.load(std::memory_order_relaxed);
+        stats.cells = m_cellCount.load(std::memory_order_relaxed);
+        stats.overflows = m_overflows.load(std::memory_order_relaxed);
+        return stats;
+    }
+}
@@ -0,0 +1,250 @@
+#include "Bake/ray_tracer.h"
+
+#include <algorithm>
+#include <limits>
+#include <bvh/v2/default_builder.h>
+#include <bvh/v2/stack.h>
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr size_t kStackSize = 64;
+        constexpr uint32_t kNoHit = std::numeric_limits<uint32_t>::max();
+
+        bvh::v2::Vec<float, 3> ToBvh(const glm::vec3& v)
+        {
+            return bvh::v2::Vec<float, 3>(v.x, v.y, v.z);
+        }
+
+        Float4 Dot(const Float4 a[3], const bvh::v2::Vec<float, 3>& b)
+        {
+            return a[0] * Float4(b[0]) + a[1] * Float4(b[1]) + a[2] * Float4(b[2]);
+        }
+    }
+
+    RayTracer::RayTracer(const Scene& scene, bvh::v2::ThreadPool& threadPool)
+        : m_scene(scene)
+    {
+        using BBox = bvh::v2::BBox<float, 3>;
+        using Vec3 = bvh::v2::Vec<float, 3>;
+
+        for (const Mesh& mesh : scene.meshes)
+        {
+            for (uint32_t index : mesh.indices)
+                m_vertices.push_back(mesh.positions[index]);
+            m_materials.insert(m_materials.end(), mesh.GetTriangleCount(), mesh.materialIndex);
+        }
+
+        size_t triangleCount = m_materials.size();
+        std::vector<BBox> bboxes(triangleCount);
+        std::vector<Vec3> centers(triangleCount);
+        glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            bvh::v2::Tri<float, 3> tri(ToBvh(m_vertices[i * 3]), ToBvh(m_vertices[i * 3 + 1]), ToBvh(m_vertices[i * 3 + 2]));
+            bboxes[i] = tri.get_bbox();
+            centers[i] = tri.get_center();
+            for (int k = 0; k < 3; ++k)
+            {
+                lo = glm::min(lo, m_vertices[i * 3 + k]);
+                hi = glm::max(hi, m_vertices[i * 3 + k]);
+            }
+        }
+        if (triangleCount > 0)
+            m_epsilon = 1e-5f * std::max(1.0f, glm::length(hi - lo));
+
+        bvh::v2::DefaultBuilder<Node>::Config config;
+        config.quality = bvh::v2::DefaultBuilder<Node>::Quality::High;
+        m_bvh = bvh::v2::DefaultBuilder<Node>::build(threadPool, bboxes, centers, config);
+
+        m_triangles.resize(m_bvh.prim_ids.size());
+        m_triangleIds.resize(m_bvh.prim_ids.size());
+        for (size_t i = 0; i < m_bvh.prim_ids.size(); ++i)
+        {
+            size_t id = m_bvh.prim_ids[i];
+            m_triangles[i] = Triangle(ToBvh(m_vertices[id * 3]), ToBvh(m_vertices[id * 3 + 1]), ToBvh(m_vertices[id * 3 + 2]));
+            m_triangleIds[i] = static_cast<uint32_t>(id);
+        }
+    }
+
+    bool RayTracer::Intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+    {
+        if (m_triangles.empty())
+            return false;
+        bvh::v2::Ray<float, 3> ray(ToBvh(origin), ToBvh(direction), 0.0f, maxDistance);
+        bvh::v2::SmallStack<Bvh::Index, kStackSize> stack;
+        uint32_t closest = kNoHit;
+        m_bvh.intersect<false, false>(ray, m_bvh.get_root().index, stack, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                if (m_triangles[i].intersect(ray))
+                    closest = static_cast<uint32_t>(i);
+            return closest != kNoHit;
+        });
+        if (closest == kNoHit)
+            return false;
+        hit.triangleId = m_triangleIds[closest];
+        hit.distance = ray.tmax;
+        return true;
+    }
+
+    bool RayTracer::Occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+    {
+        if (m_triangles.empty())
+            return false;
+        bvh::v2::Ray<float, 3> ray(ToBvh(origin), ToBvh(direction), 0.0f, maxDistance);
+        bvh::v2::SmallStack<Bvh::Index, kStackSize> stack;
+        bool occluded = false;
+        m_bvh.intersect<true, false>(ray, m_bvh.get_root().index, stack, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end && !occluded; ++i)
+                occluded = m_triangles[i].intersect(ray).has_value();
+            return occluded;
+        });
+        return occluded;
+    }
+
+    int RayTracer::Occluded(const RayPacket& packet) const
+    {
+        int pending = packet.activeMask & 0xF;
+        if (m_triangles.empty() || pending == 0)
+            return 0;
+
+        // The slab test of bvh::v2's intersect_fast, one lane per ray: the near plane per axis
+        // comes from the sign of the direction, and NaNs keep the running bounds as they are.
+        Float4 inverse[3];
+        Float4 scaledOrigin[3];
+        Float4 negative[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float lanes[4];
+            packet.direction[axis].Store(lanes);
+            for (float& lane : lanes)
+                lane = bvh::v2::safe_inverse(lane);
+            inverse[axis] = Float4::Load(lanes);
+            scaledOrigin[axis] = Float4(0.0f) - inverse[axis] * packet.origin[axis];
+            negative[axis] = inverse[axis] < Float4(0.0f);
+        }
+        auto intersectsNode = [&](const Node& node) {
+            Float4 entry(0.0f);
+            Float4 exit = packet.maxDistance;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                Float4 t0 = Float4(node.bounds[axis * 2]) * inverse[axis] + scaledOrigin[axis];
+                Float4 t1 = Float4(node.bounds[axis * 2 + 1]) * inverse[axis] + scaledOrigin[axis];
+                Float4 near = Select(negative[axis], t1, t0);
+                Float4 far = Select(negative[axis], t0, t1);
+                entry = Select(near > entry, near, entry);
+                exit = Select(far < exit, far, exit);
+            }
+            return MoveMask(entry <= exit);
+        };
+        // PrecomputedTri::intersect, with the same operations per lane.
+        Float4 tolerance(-std::numeric_limits<float>::epsilon());
+        auto intersectsTriangle = [&](const Triangle& triangle) {
+            Float4 c[3] = { Float4(triangle.p0[0]) - packet.origin[0], Float4(triangle.p0[1]) - packet.origin[1],
+                            Float4(triangle.p0[2]) - packet.origin[2] };
+            const Float4* d = packet.direction;
+            Float4 r[3] = { d[1] * c[2] - d[2] * c[1], d[2] * c[0] - d[0] * c[2], d[0] * c[1] - d[1] * c[0] };
+            Float4 inverseDet = Float4(1.0f) / Dot(d, triangle.n);
+            Float4 u = Dot(r, triangle.e2) * inverseDet;
+            Float4 v = Dot(r, triangle.e1) * inverseDet;
+            Float4 w = Float4(1.0f) - u - v;
+            Float4 t = Dot(c, triangle.n) * inverseDet;
+            return MoveMask((u >= tolerance) & (v >= tolerance) & (w >= tolerance) & (t >= Float4(0.0f)) & (t <= packet.maxDistance));
+        };
+
+        // Each entry keeps the lanes that reached it, so a lane only tests the triangles its own
+        // traversal would: the slab test is tighter than the triangle test's tolerance.
+        struct Entry
+        {
+            Bvh::Index index;
+            int lanes;
+        };
+        int occluded = 0;
+        // Lanes that reached a child the full stack had no room for.
+        int overflow = 0;
+        Entry stack[kStackSize];
+        size_t size = 0;
+        stack[size++] = { m_bvh.get_root().index, pending };
+        while (size > 0)
+        {
+            Entry top = stack[--size];
+            int lanes = top.lanes & pending;
+            if (lanes == 0)
+                continue;
+            if (top.index.prim_count == 0)
+            {
+                for (size_t child = 0; child < 2; ++child)
+                {
+                    const Node& node = m_bvh.nodes[top.index.first_id + child];
+                    int hit = intersectsNode(node) & lanes;
+                    if (hit != 0 && size < kStackSize)
+                        stack[size++] = { node.index, hit };
+                    else
+                        overflow |= hit;
+                }
+                continue;
+            }
+            size_t first = top.index.first_id;
+            for (size_t i = first; i < first + top.index.prim_count && lanes != 0; ++i)
+            {
+                int hit = intersectsTriangle(m_triangles[i]) & lanes;
+                occluded |= hit;
+                lanes &= ~hit;
+            }
+            pending &= ~occluded;
+            if (pending == 0)
+                return occluded;
+        }
+
+        // Lanes the stack overflowed for finish one ray at a time rather than miss an occluder.
+        if (int lanes = overflow & pending)
+        {
+            float origin[3][4];
+            float direction[3][4];
+            float maxDistance[4];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                packet.origin[axis].Store(origin[axis]);
+                packet.direction[axis].Store(direction[axis]);
+            }
+            packet.maxDistance.Store(maxDistance);
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if ((lanes >> lane & 1) &&
+                    Occluded(glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]),
+                             glm::vec3(direction[0][lane], direction[1][lane], direction[2][lane]), maxDistance[lane]))
+                    occluded |= 1 << lane;
+            }
+        }
+        return occluded;
+    }
+
+    std::vector<FlatBvhNode> RayTracer::GetFlatNodes() const
+    {
+        std::vector<FlatBvhNode> nodes(m_bvh.nodes.size());
+        for (size_t i = 0; i < m_bvh.nodes.size(); ++i)
+        {
+            const Node& node = m_bvh.nodes[i];
+            nodes[i].lo = glm::vec3(node.bounds[0], node.bounds[2], node.bounds[4]);
+            nodes[i].hi = glm::vec3(node.bounds[1], node.bounds[3], node.bounds[5]);
+            nodes[i].first = static_cast<uint32_t>(node.index.first_id);
+            nodes[i].count = static_cast<uint32_t>(node.index.prim_count);
+        }
+        return nodes;
+    }
+
+    SurfacePoint RayTracer::GetSurface(const glm::vec3& origin, const glm::vec3& direction, const RayHit& hit) const
+    {
+        SurfacePoint surface;
+        surface.position = origin + direction * hit.distance;
+        const glm::vec3* v = &m_vertices[hit.triangleId * 3];
+        glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : -direction;
+        surface.normal = glm::dot(normal, direction) > 0.0f ? -normal : normal;
+        surface.triangleId = hit.triangleId;
+        surface.materialIndex = m_materials[hit.triangleId];
+        return surface;
+    }
+}
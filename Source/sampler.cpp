@@ -0,0 +1,208 @@
+#include "Bake/sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace LightChef
+{
+    namespace
+    {
+        // Width of the Gaussian that measures clustering in void-and-cluster.
+        constexpr float kBlueNoiseSigma = 1.5f;
+        // Share of the tile set in the initial void-and-cluster pattern.
+        constexpr uint32_t kInitialDensityDivisor = 10;
+        // Scramble seed of the sequence shared by every texel in BlueNoise mode.
+        constexpr uint32_t kSharedSeed = 0x2545F491u;
+
+        uint32_t ReverseBits(uint32_t x)
+        {
+            x = (x << 16) | (x >> 16);
+            x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+            x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+            x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+            x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+            return x;
+        }
+
+        /**
+         * Laine-Karras style hash in which every bit only depends on lower
+         * bits, so on reversed bits it is a nested uniform scramble.
+         */
+        uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed)
+        {
+            x += seed;
+            x ^= x * 0x6C50B47Cu;
+            x ^= x * 0xB82F1E52u;
+            x ^= x * 0xC7AFE638u;
+            x ^= x * 0x8D22F6E6u;
+            return x;
+        }
+
+        uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+        {
+            return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+        }
+
+        uint32_t HashCombine(uint32_t seed, uint32_t value)
+        {
+            return static_cast<uint32_t>(Random::Mix((static_cast<uint64_t>(seed) << 32) | value));
+        }
+
+        // Second Sobol dimension (primitive polynomial x + 1); the first is the bit reversal.
+        uint32_t SobolDimension1(uint32_t index)
+        {
+            uint32_t result = 0;
+            for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+                if (index & 1)
+                    result ^= v;
+            return result;
+        }
+
+        float ToUnitFloat(uint32_t x)
+        {
+            return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+
+    BlueNoiseTile::BlueNoiseTile(uint32_t size, uint64_t seed)
+        : m_size(size)
+        , m_values(static_cast<size_t>(size) * size)
+    {
+        uint32_t n = size * size;
+        std::vector<float> kernel(n);
+        for (uint32_t y = 0; y < size; ++y)
+        {
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                float dx = static_cast<float>(std::min(x, size - x));
+                float dy = static_cast<float>(std::min(y, size - y));
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * kBlueNoiseSigma * kBlueNoiseSigma));
+            }
+        }
+
+        std::vector<uint8_t> pattern(n, 0);
+        std::vector<float> energy(n, 0.0f);
+        auto splat = [&](std::vector<float>& target, uint32_t pixel, float sign) {
+            uint32_t px = pixel % size;
+            uint32_t py = pixel / size;
+            for (uint32_t y = 0; y < size; ++y)
+            {
+                const float* row = &kernel[((y + size - py) % size) * size];
+                for (uint32_t x = 0; x < size; ++x)
+                    target[y * size + x] += sign * row[(x + size - px) % size];
+            }
+        };
+        // Tightest cluster: the set pixel with the most energy; largest void: the empty one with the least.
+        auto find = [&](const std::vector<uint8_t>& bits, const std::vector<float>& values, uint8_t set) {
+            uint32_t best = n;
+            for (uint32_t i = 0; i < n; ++i)
+                if (bits[i] == set && (best == n || (set ? values[i] > values[best] : values[i] < values[best])))
+                    best = i;
+            return best;
+        };
+
+        Random random(seed);
+        uint32_t initialCount = std::max(1u, n / kInitialDensityDivisor);
+        for (uint32_t placed = 0; placed < initialCount;)
+        {
+            uint32_t pixel = random.NextUInt() % n;
+            if (pattern[pixel])
+                continue;
+            pattern[pixel] = 1;
+            splat(energy, pixel, 1.0f);
+            ++placed;
+        }
+
+        // Move points from the tightest cluster to the largest void until that no longer changes anything.
+        for (uint32_t iteration = 0; iteration < n; ++iteration)
+        {
+            uint32_t cluster = find(pattern, energy, 1);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1.0f);
+            uint32_t largestVoid = find(pattern, energy, 0);
+            pattern[largestVoid] = 1;
+            splat(energy, largestVoid, 1.0f);
+            if (largestVoid == cluster)
+                break;
+        }
+
+        std::vector<uint32_t> rank(n);
+        // Rank the initial points by removing tightest clusters, which get the highest ranks.
+        std::vector<uint8_t> remaining = pattern;
+        std::vector<float> remainingEnergy = energy;
+        for (uint32_t r = initialCount; r-- > 0;)
+        {
+            uint32_t cluster = find(remaining, remainingEnergy, 1);
+            remaining[cluster] = 0;
+            splat(remainingEnergy, cluster, -1.0f);
+            rank[cluster] = r;
+        }
+        // Then fill the largest voids; with a toroidal kernel this also covers the
+        // second half, where ranking minority zeros is the same ordering.
+        for (uint32_t r = initialCount; r < n; ++r)
+        {
+            uint32_t largestVoid = find(pattern, energy, 0);
+            pattern[largestVoid] = 1;
+            splat(energy, largestVoid, 1.0f);
+            rank[largestVoid] = r;
+        }
+
+        for (uint32_t i = 0; i < n; ++i)
+            m_values[i] = (rank[i] + 0.5f) / n;
+    }
+
+    Sampler::Sampler(SamplerType type, uint64_t texelIndex, uint32_t sampleIndex, uint32_t x, uint32_t y, const BlueNoiseTile* blueNoise)
+        : m_type(type)
+        , m_random(texelIndex, sampleIndex)
+        , m_seed(type == SamplerType::BlueNoise ? kSharedSeed : static_cast<uint32_t>(Random::Mix(texelIndex)))
+        , m_sampleIndex(sampleIndex)
+        , m_x(x)
+        , m_y(y)
+        , m_blueNoise(blueNoise)
+    {
+        if (m_type == SamplerType::BlueNoise && (!m_blueNoise || m_blueNoise->IsEmpty()))
+            m_type = SamplerType::Sobol;
+    }
+
+    float Sampler::Next1D()
+    {
+        if (m_type == SamplerType::Random)
+            return m_random.NextFloat();
+        return NextSobolPair().x;
+    }
+
+    glm::vec2 Sampler::Next2D()
+    {
+        if (m_type == SamplerType::Random)
+        {
+            float u1 = m_random.NextFloat();
+            return glm::vec2(u1, m_random.NextFloat());
+        }
+        return NextSobolPair();
+    }
+
+    glm::vec2 Sampler::NextSobolPair()
+    {
+        uint32_t pairSeed = HashCombine(m_seed, m_dimension);
+        m_dimension++;
+        // Shuffling the index per pair decorrelates the padded pairs while keeping
+        // every power-of-two prefix stratified.
+        uint32_t index = NestedUniformScramble(m_sampleIndex, pairSeed);
+        uint32_t u = NestedUniformScramble(ReverseBits(index), HashCombine(pairSeed, 0));
+        uint32_t v = NestedUniformScramble(SobolDimension1(index), HashCombine(pairSeed, 1));
+        glm::vec2 sample(ToUnitFloat(u), ToUnitFloat(v));
+        if (m_type == SamplerType::BlueNoise)
+            sample = glm::vec2(Shift(sample.x, 0), Shift(sample.y, 1));
+        return sample;
+    }
+
+    float Sampler::Shift(float u, uint32_t component) const
+    {
+        // Cranley-Patterson rotation by the texel's blue-noise value, read at a
+        // different toroidal offset for every dimension.
+        uint32_t offset = static_cast<uint32_t>(Random::Mix(m_dimension * 2 + component));
+        uint32_t size = m_blueNoise->GetSize();
+        float shifted = u + m_blueNoise->At(m_x + (offset & 0xFFFF) % size, m_y + (offset >> 16) % size);
+        return shifted >= 1.0f ? shifted - 1.0f : shifted;
+    }
+}
@@ -0,0 +1,376 @@
+#include "Bake/seam_stitcher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <bvh/v2/executor.h>
+
+namespace LightChef
+{
+    namespace
+    {
+        // UV difference under which both sides of a mesh edge count as the same lightmap edge.
+        constexpr float kSeamTolerance = 1e-6f;
+        // Data weight of gutter texels, which carry no baked value and may move freely.
+        constexpr float kGutterWeight = 0.05f;
+        constexpr float kSolverTolerance = 1e-10f;
+
+        uint32_t FindRoot(std::vector<uint32_t>& parents, uint32_t i)
+        {
+            while (parents[i] != i)
+            {
+                parents[i] = parents[parents[i]];
+                i = parents[i];
+            }
+            return i;
+        }
+
+        /**
+         * Bilinear footprint of a normalized UV with texel centers at (i + 0.5) / size,
+         * as sampled by the preview.
+         */
+        void BilinearTaps(const Lightmap& lightmap, uint32_t atlas, const glm::vec2& uv, size_t indices[4], float weights[4])
+        {
+            float px = uv.x * lightmap.width - 0.5f;
+            float py = uv.y * lightmap.height - 0.5f;
+            float fx = std::floor(px);
+            float fy = std::floor(py);
+            float tx = px - fx;
+            float ty = py - fy;
+            int maxX = static_cast<int>(lightmap.width) - 1;
+            int maxY = static_cast<int>(lightmap.height) - 1;
+            int x0 = std::clamp(static_cast<int>(fx), 0, maxX);
+            int y0 = std::clamp(static_cast<int>(fy), 0, maxY);
+            int x1 = std::clamp(static_cast<int>(fx) + 1, 0, maxX);
+            int y1 = std::clamp(static_cast<int>(fy) + 1, 0, maxY);
+            indices[0] = lightmap.GetIndex(atlas, x0, y0);
+            indices[1] = lightmap.GetIndex(atlas, x1, y0);
+            indices[2] = lightmap.GetIndex(atlas, x0, y1);
+            indices[3] = lightmap.GetIndex(atlas, x1, y1);
+            weights[0] = (1.0f - tx) * (1.0f - ty);
+            weights[1] = tx * (1.0f - ty);
+            weights[2] = (1.0f - tx) * ty;
+            weights[3] = tx * ty;
+        }
+    }
+
+    SeamStitcher::SeamStitcher(const Scene& scene, const LightmapAtlas& atlas, const SeamSettings& settings)
+        : m_settings(settings)
+    {
+        struct Edge
+        {
+            uint64_t key;
+            uint32_t corner;
+        };
+
+        for (size_t m = 0; m < scene.meshes.size() && m < atlas.meshes.size(); ++m)
+        {
+            const Mesh& mesh = scene.meshes[m];
+            const AtlasMesh& atlasMesh = atlas.meshes[m];
+            if (atlasMesh.indices.size() != mesh.indices.size())
+                continue;
+
+            std::vector<uint32_t> canonical = WeldPositions(mesh.positions);
+            auto next = [](uint32_t corner) { return corner - corner % 3 + (corner + 1) % 3; };
+            std::vector<Edge> edges(mesh.indices.size());
+            for (uint32_t corner = 0; corner < edges.size(); ++corner)
+            {
+                uint64_t a = canonical[mesh.indices[corner]];
+                uint64_t b = canonical[mesh.indices[next(corner)]];
+                edges[corner] = { std::min(a, b) << 32 | std::max(a, b), corner };
+            }
+            std::sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) { return l.key < r.key; });
+
+            for (size_t i = 0; i + 1 < edges.size(); ++i)
+            {
+                // Only manifold edges have a well-defined twin.
+                if (edges[i].key != edges[i + 1].key || (i + 2 < edges.size() && edges[i + 2].key == edges[i].key) ||
+                    (i > 0 && edges[i - 1].key == edges[i].key))
+                    continue;
+
+                uint32_t corners[2] = { edges[i].corner, edges[i + 1].corner };
+                Seam seam;
+                uint32_t first = canonical[mesh.indices[corners[0]]];
+                for (int side = 0; side < 2; ++side)
+                {
+                    uint32_t chart = atlasMesh.triangleCharts[corners[side] / 3];
+                    seam.chart[side] = chart;
+                    seam.atlasIndex[side] = atlas.charts[chart].atlasIndex;
+                    uint32_t a = corners[side];
+                    uint32_t b = next(a);
+                    if (canonical[mesh.indices[a]] != first)
+                        std::swap(a, b);
+                    seam.uv[side][0] = atlasMesh.uvs[atlasMesh.indices[a]];
+                    seam.uv[side][1] = atlasMesh.uvs[atlasMesh.indices[b]];
+                }
+
+                bool split = seam.chart[0] != seam.chart[1];
+                for (int end = 0; end < 2 && !split; ++end)
+                {
+                    glm::vec2 d = glm::abs(seam.uv[0][end] - seam.uv[1][end]);
+                    split = d.x > kSeamTolerance || d.y > kSeamTolerance;
+                }
+                if (split)
+                    m_seams.push_back(seam);
+                ++i;
+            }
+        }
+
+        // Charts joined by seams must be solved together; everything else is independent.
+        std::vector<uint32_t> parents(atlas.charts.size());
+        std::iota(parents.begin(), parents.end(), 0u);
+        for (const Seam& seam : m_seams)
+            parents[FindRoot(parents, seam.chart[0])] = FindRoot(parents, seam.chart[1]);
+
+        std::vector<uint32_t> roots(m_seams.size());
+        for (size_t i = 0; i < m_seams.size(); ++i)
+            roots[i] = FindRoot(parents, m_seams[i].chart[0]);
+        m_seamOrder.resize(m_seams.size());
+        std::iota(m_seamOrder.begin(), m_seamOrder.end(), 0u);
+        std::stable_sort(m_seamOrder.begin(), m_seamOrder.end(), [&](uint32_t l, uint32_t r) { return roots[l] < roots[r]; });
+        for (uint32_t i = 0; i < m_seamOrder.size(); ++i)
+            if (i == 0 || roots[m_seamOrder[i]] != roots[m_seamOrder[i - 1]])
+                m_groupStart.push_back(i);
+        m_groupStart.push_back(static_cast<uint32_t>(m_seamOrder.size()));
+    }
+
+    void SeamStitcher::Dilate(Lightmap& lightmap, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool) const
+    {
+        std::vector<uint32_t> charts[2];
+        charts[0].assign(lightmap.texels.size(), TexelBuffer::kNoChart);
+        for (size_t i = 0; i < lightmap.texels.size(); ++i)
+            if (lightmap.texels[i].w > 0.0f)
+                charts[0][i] = texels.charts[i];
+        charts[1] = charts[0];
+        std::vector<glm::vec3> colors[2];
+        colors[0].resize(lightmap.texels.size());
+        for (size_t i = 0; i < lightmap.texels.size(); ++i)
+            colors[0][i] = glm::vec3(lightmap.texels[i]);
+        colors[1] = colors[0];
+
+        // Each ring reads the previous one, so rows can be filled in any order.
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        size_t rowCount = static_cast<size_t>(lightmap.atlasCount) * lightmap.height;
+        for (uint32_t ring = 0; ring < m_settings.dilationTexels; ++ring)
+        {
+            const std::vector<uint32_t>& sourceCharts = charts[ring & 1];
+            const std::vector<glm::vec3>& sourceColors = colors[ring & 1];
+            std::vector<uint32_t>& targetCharts = charts[(ring + 1) & 1];
+            std::vector<glm::vec3>& targetColors = colors[(ring + 1) & 1];
+            executor.for_each(0, rowCount, [&](size_t begin, size_t end) {
+                static constexpr int kOffsets[8][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+                for (size_t row = begin; row < end; ++row)
+                {
+                    int y = static_cast<int>(row % lightmap.height);
+                    for (int x = 0; x < static_cast<int>(lightmap.width); ++x)
+                    {
+                        size_t index = row * lightmap.width + x;
+                        targetCharts[index] = sourceCharts[index];
+                        targetColors[index] = sourceColors[index];
+                        if (sourceCharts[index] != TexelBuffer::kNoChart)
+                            continue;
+
+                        // Side neighbours pick the chart; diagonals only count at half weight.
+                        uint32_t chart = TexelBuffer::kNoChart;
+                        glm::vec3 sum(0.0f);
+                        float weightSum = 0.0f;
+                        for (int n = 0; n < 8; ++n)
+                        {
+                            int nx = x + kOffsets[n][0];
+                            int ny = y + kOffsets[n][1];
+                            if (nx < 0 || ny < 0 || nx >= static_cast<int>(lightmap.width) || ny >= static_cast<int>(lightmap.height))
+                                continue;
+                            size_t neighbor = index + static_cast<ptrdiff_t>(kOffsets[n][1]) * lightmap.width + kOffsets[n][0];
+                            uint32_t neighborChart = sourceCharts[neighbor];
+                            if (neighborChart == TexelBuffer::kNoChart || (chart != TexelBuffer::kNoChart && neighborChart != chart))
+                                continue;
+                            chart = neighborChart;
+                            float weight = n < 4 ? 1.0f : 0.5f;
+                            sum += sourceColors[neighbor] * weight;
+                            weightSum += weight;
+                        }
+                        if (chart != TexelBuffer::kNoChart)
+                        {
+                            targetCharts[index] = chart;
+                            targetColors[index] = sum / weightSum;
+                        }
+                    }
+                }
+            });
+        }
+
+        const std::vector<glm::vec3>& result = colors[m_settings.dilationTexels & 1];
+        for (size_t i = 0; i < lightmap.texels.size(); ++i)
+            if (lightmap.texels[i].w <= 0.0f)
+                lightmap.texels[i] = glm::vec4(result[i], 0.0f);
+    }
+
+    void SeamStitcher::Stitch(Lightmap& lightmap, bvh::v2::ThreadPool& threadPool) const
+    {
+        struct Constraint
+        {
+            // Local unknowns and bilinear weights; the second side's weights are negated.
+            uint32_t unknowns[8];
+            float weights[8];
+        };
+        // Bilinear taps of both sides of every constraint point, eight per point.
+        struct GroupTaps
+        {
+            std::vector<size_t> texels;
+            std::vector<float> weights;
+        };
+
+        size_t groupCount = m_groupStart.empty() ? 0 : m_groupStart.size() - 1;
+        std::vector<GroupTaps> taps(groupCount);
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        executor.for_each(0, groupCount, [&](size_t begin, size_t end) {
+            for (size_t group = begin; group < end; ++group)
+            {
+                for (uint32_t s = m_groupStart[group]; s < m_groupStart[group + 1]; ++s)
+                {
+                    const Seam& seam = m_seams[m_seamOrder[s]];
+                    glm::vec2 size(lightmap.width, lightmap.height);
+                    float length = std::max(glm::length((seam.uv[0][1] - seam.uv[0][0]) * size),
+                                            glm::length((seam.uv[1][1] - seam.uv[1][0]) * size));
+                    uint32_t count = std::max(2u, static_cast<uint32_t>(std::ceil(length * m_settings.samplesPerTexel)));
+                    for (uint32_t k = 0; k < count; ++k)
+                    {
+                        float t = (k + 0.5f) / count;
+                        for (int side = 0; side < 2; ++side)
+                        {
+                            size_t indices[4];
+                            float weights[4];
+                            glm::vec2 uv = glm::mix(seam.uv[side][0], seam.uv[side][1], t);
+                            BilinearTaps(lightmap, seam.atlasIndex[side], uv, indices, weights);
+                            for (int tap = 0; tap < 4; ++tap)
+                            {
+                                taps[group].texels.push_back(indices[tap]);
+                                taps[group].weights.push_back(side == 0 ? weights[tap] : -weights[tap]);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        // Groups own disjoint charts, but the taps of nearby charts can reach into the same
+        // gutter texels; such groups are coupled and solved as one problem.
+        std::vector<uint32_t> parents(groupCount);
+        std::iota(parents.begin(), parents.end(), 0u);
+        std::vector<std::pair<size_t, uint32_t>> texelGroups;
+        for (uint32_t group = 0; group < groupCount; ++group)
+            for (size_t texel : taps[group].texels)
+                texelGroups.emplace_back(texel, group);
+        std::sort(texelGroups.begin(), texelGroups.end());
+        for (size_t i = 1; i < texelGroups.size(); ++i)
+            if (texelGroups[i].first == texelGroups[i - 1].first)
+                parents[FindRoot(parents, texelGroups[i].second)] = FindRoot(parents, texelGroups[i - 1].second);
+        std::vector<std::vector<uint32_t>> problems;
+        std::vector<uint32_t> problemOf(groupCount, ~0u);
+        for (uint32_t group = 0; group < groupCount; ++group)
+        {
+            uint32_t root = FindRoot(parents, group);
+            if (problemOf[root] == ~0u)
+            {
+                problemOf[root] = static_cast<uint32_t>(problems.size());
+                problems.emplace_back();
+            }
+            problems[problemOf[root]].push_back(group);
+        }
+        std::vector<std::vector<std::pair<size_t, glm::vec3>>> results(problems.size());
+
+        executor.for_each(0, problems.size(), [&](size_t begin, size_t end) {
+            for (size_t problem = begin; problem < end; ++problem)
+            {
+                std::vector<size_t> texelIndices;
+                std::vector<Constraint> constraints;
+                std::vector<size_t> constraintTexels;
+                std::vector<float> constraintWeights;
+                for (uint32_t group : problems[problem])
+                {
+                    constraintTexels.insert(constraintTexels.end(), taps[group].texels.begin(), taps[group].texels.end());
+                    constraintWeights.insert(constraintWeights.end(), taps[group].weights.begin(), taps[group].weights.end());
+                }
+
+                texelIndices = constraintTexels;
+                std::sort(texelIndices.begin(), texelIndices.end());
+                texelIndices.erase(std::unique(texelIndices.begin(), texelIndices.end()), texelIndices.end());
+                constraints.resize(constraintTexels.size() / 8);
+                for (size_t c = 0; c < constraints.size(); ++c)
+                {
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        size_t texel = constraintTexels[c * 8 + k];
+                        constraints[c].unknowns[k] = static_cast<uint32_t>(
+                            std::lower_bound(texelIndices.begin(), texelIndices.end(), texel) - texelIndices.begin());
+                        constraints[c].weights[k] = constraintWeights[c * 8 + k];
+                    }
+                }
+
+                // Minimize sum_i d_i (x_i - x0_i)^2 + seamWeight * sum_c (A_c x)^2 by conjugate
+                // gradients on (D + seamWeight * A^T A) x = D x0, one color channel at a time.
+                size_t n = texelIndices.size();
+                std::vector<float> dataWeights(n);
+                for (size_t i = 0; i < n; ++i)
+                    dataWeights[i] = lightmap.texels[texelIndices[i]].w > 0.0f ? 1.0f : kGutterWeight;
+
+                std::vector<float> x(n), r(n), p(n), ap(n);
+                std::vector<glm::vec3> solved(n);
+                auto apply = [&](const std::vector<float>& in, std::vector<float>& out) {
+                    for (size_t i = 0; i < n; ++i)
+                        out[i] = dataWeights[i] * in[i];
+                    for (const Constraint& constraint : constraints)
+                    {
+                        float residual = 0.0f;
+                        for (int k = 0; k < 8; ++k)
+                            residual += constraint.weights[k] * in[constraint.unknowns[k]];
+                        residual *= m_settings.seamWeight;
+                        for (int k = 0; k < 8; ++k)
+                            out[constraint.unknowns[k]] += constraint.weights[k] * residual;
+                    }
+                };
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    for (size_t i = 0; i < n; ++i)
+                        x[i] = lightmap.texels[texelIndices[i]][channel];
+                    // Starting from x0, the right-hand side minus D x0 leaves only the seam term.
+                    apply(x, ap);
+                    float bNorm = 0.0f;
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        float b = dataWeights[i] * x[i];
+                        r[i] = b - ap[i];
+                        p[i] = r[i];
+                        bNorm += b * b;
+                    }
+                    float rr = std::inner_product(r.begin(), r.end(), r.begin(), 0.0f);
+                    for (uint32_t iteration = 0; iteration < m_settings.maxIterations && rr > kSolverTolerance * bNorm; ++iteration)
+                    {
+                        apply(p, ap);
+                        float alpha = rr / std::inner_product(p.begin(), p.end(), ap.begin(), 0.0f);
+                        for (size_t i = 0; i < n; ++i)
+                        {
+                            x[i] += alpha * p[i];
+                            r[i] -= alpha * ap[i];
+                        }
+                        float rrNext = std::inner_product(r.begin(), r.end(), r.begin(), 0.0f);
+                        for (size_t i = 0; i < n; ++i)
+                            p[i] = r[i] + (rrNext / rr) * p[i];
+                        rr = rrNext;
+                    }
+                    for (size_t i = 0; i < n; ++i)
+                        solved[i][channel] = std::max(0.0f, x[i]);
+                }
+
+                results[problem].reserve(n);
+                for (size_t i = 0; i < n; ++i)
+                    results[problem].emplace_back(texelIndices[i], solved[i]);
+            }
+        });
+
+        // Problems share no texels, so the write-back order does not matter.
+        for (const auto& problemResult : results)
+            for (const auto& [index, color] : problemResult)
+                lightmap.texels[index] = glm::vec4(color, lightmap.texels[index].w);
+    }
+}
@@ -0,0 +1,255 @@
+#include "Bake/texel_rasterizer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <bvh/v2/executor.h>
+#include "Utility/simd.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr int kSubsamples = 4;
+        // Coverage reported for texels touched by a triangle that misses all subsamples.
+        constexpr float kMinCoverage = 0.5f / (kSubsamples * kSubsamples);
+
+        struct TriangleSetup
+        {
+            // Texel-space UVs, counter-clockwise.
+            glm::vec2 uv[3];
+            glm::vec3 position[3];
+            glm::vec3 normal[3];
+            uint32_t atlasIndex;
+            uint32_t chart;
+            uint32_t triangleId;
+            // Edge functions a * x + b * y + c, positive inside.
+            float a[3], b[3], c[3];
+            float invArea;
+        };
+
+        bool Setup(TriangleSetup& tri)
+        {
+            float area = (tri.uv[1].x - tri.uv[0].x) * (tri.uv[2].y - tri.uv[0].y) -
+                         (tri.uv[1].y - tri.uv[0].y) * (tri.uv[2].x - tri.uv[0].x);
+            if (area == 0.0f)
+                return false;
+            if (area < 0.0f)
+            {
+                std::swap(tri.uv[1], tri.uv[2]);
+                std::swap(tri.position[1], tri.position[2]);
+                std::swap(tri.normal[1], tri.normal[2]);
+                area = -area;
+            }
+            for (int e = 0; e < 3; ++e)
+            {
+                const glm::vec2& p = tri.uv[e];
+                const glm::vec2& q = tri.uv[(e + 1) % 3];
+                tri.a[e] = p.y - q.y;
+                tri.b[e] = q.x - p.x;
+                tri.c[e] = -(tri.a[e] * p.x + tri.b[e] * p.y);
+            }
+            tri.invArea = 1.0f / area;
+            return true;
+        }
+
+        glm::vec2 ClosestPointOnTriangle(const TriangleSetup& tri, const glm::vec2& p)
+        {
+            glm::vec2 best = tri.uv[0];
+            float bestDistance = glm::dot(p - best, p - best);
+            for (int e = 0; e < 3; ++e)
+            {
+                glm::vec2 a = tri.uv[e];
+                glm::vec2 ab = tri.uv[(e + 1) % 3] - a;
+                float t = glm::clamp(glm::dot(p - a, ab) / std::max(1e-12f, glm::dot(ab, ab)), 0.0f, 1.0f);
+                glm::vec2 q = a + ab * t;
+                float distance = glm::dot(p - q, p - q);
+                if (distance < bestDistance)
+                {
+                    best = q;
+                    bestDistance = distance;
+                }
+            }
+            return best;
+        }
+
+        void WriteTexel(TexelBuffer& buffer, float* bestCoverage, size_t index, const TriangleSetup& tri,
+                        glm::vec2 sample, float coverage)
+        {
+            TexelRecord& record = buffer.texels[index];
+            record.coverage = std::min(1.0f, record.coverage + coverage);
+            if (coverage <= *bestCoverage)
+                return;
+            *bestCoverage = coverage;
+
+            // Barycentrics of the sample point; edge e is opposite to vertex (e + 2) % 3.
+            float w[3];
+            for (int e = 0; e < 3; ++e)
+                w[(e + 2) % 3] = std::max(0.0f, tri.a[e] * sample.x + tri.b[e] * sample.y + tri.c[e]) * tri.invArea;
+            float sum = w[0] + w[1] + w[2];
+            for (float& weight : w)
+                weight /= sum;
+
+            record.position = tri.position[0] * w[0] + tri.position[1] * w[1] + tri.position[2] * w[2];
+            glm::vec3 normal = tri.normal[0] * w[0] + tri.normal[1] * w[1] + tri.normal[2] * w[2];
+            float length = glm::length(normal);
+            record.normal = length > 0.0f ? normal / length : tri.normal[0];
+            record.triangleId = tri.triangleId;
+            buffer.charts[index] = tri.chart;
+        }
+
+        void RasterizeInTile(TexelBuffer& buffer, std::vector<float>& bestCoverage, const TriangleSetup& tri,
+                             uint32_t tileX, uint32_t tileY, uint32_t tileSize)
+        {
+            glm::vec2 lo = glm::min(tri.uv[0], glm::min(tri.uv[1], tri.uv[2]));
+            glm::vec2 hi = glm::max(tri.uv[0], glm::max(tri.uv[1], tri.uv[2]));
+            int x0 = std::max(static_cast<int>(tileX), static_cast<int>(std::floor(lo.x)));
+            int y0 = std::max(static_cast<int>(tileY), static_cast<int>(std::floor(lo.y)));
+            int x1 = std::min({ static_cast<int>(tileX + tileSize), static_cast<int>(buffer.width), static_cast<int>(std::floor(hi.x)) + 1 });
+            int y1 = std::min({ static_cast<int>(tileY + tileSize), static_cast<int>(buffer.height), static_cast<int>(std::floor(hi.y)) + 1 });
+
+            const Float4 offsets(0.125f, 0.375f, 0.625f, 0.875f);
+            const Float4 zero(0.0f);
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    // Conservative test: the texel square overlaps the triangle if,
+                    // for every edge, its most inward corner is inside.
+                    bool overlaps = true;
+                    for (int e = 0; e < 3 && overlaps; ++e)
+                    {
+                        float cx = x + (tri.a[e] > 0.0f ? 1.0f : 0.0f);
+                        float cy = y + (tri.b[e] > 0.0f ? 1.0f : 0.0f);
+                        overlaps = tri.a[e] * cx + tri.b[e] * cy + tri.c[e] >= 0.0f;
+                    }
+                    if (!overlaps)
+                        continue;
+
+                    Float4 xs = Float4(static_cast<float>(x)) + offsets;
+                    Float4 sumX(0.0f), sumY(0.0f);
+                    int count = 0;
+                    for (int j = 0; j < kSubsamples; ++j)
+                    {
+                        float sy = y + (j + 0.5f) / kSubsamples;
+                        Float4 inside = (MulAdd(Float4(tri.a[0]), xs, Float4(tri.b[0] * sy + tri.c[0])) >= zero) &
+                                        (MulAdd(Float4(tri.a[1]), xs, Float4(tri.b[1] * sy + tri.c[1])) >= zero) &
+                                        (MulAdd(Float4(tri.a[2]), xs, Float4(tri.b[2] * sy + tri.c[2])) >= zero);
+                        count += std::popcount(static_cast<unsigned>(MoveMask(inside)));
+                        sumX = sumX + Select(inside, xs, zero);
+                        sumY = sumY + Select(inside, Float4(sy), zero);
+                    }
+
+                    // Covered subsamples average to a point inside the (convex)
+                    // triangle; otherwise snap the texel center onto it.
+                    glm::vec2 sample;
+                    float coverage;
+                    if (count > 0)
+                    {
+                        sample = glm::vec2(ReduceAdd(sumX), ReduceAdd(sumY)) / static_cast<float>(count);
+                        coverage = static_cast<float>(count) / (kSubsamples * kSubsamples);
+                    }
+                    else
+                    {
+                        sample = ClosestPointOnTriangle(tri, glm::vec2(x + 0.5f, y + 0.5f));
+                        coverage = kMinCoverage;
+                    }
+
+                    size_t local = static_cast<size_t>(y - tileY) * tileSize + (x - tileX);
+                    WriteTexel(buffer, &bestCoverage[local], buffer.GetIndex(tri.atlasIndex, x, y), tri, sample, coverage);
+                }
+            }
+        }
+    }
+
+    TexelRasterizer::TexelRasterizer(uint32_t tileSize)
+        : m_tileSize(std::max(1u, tileSize))
+    {
+    }
+
+    TexelBuffer TexelRasterizer::Rasterize(const Scene& scene, const LightmapAtlas& atlas, bvh::v2::ThreadPool& threadPool) const
+    {
+        TexelBuffer buffer;
+        buffer.width = atlas.width;
+        buffer.height = atlas.height;
+        buffer.atlasCount = atlas.atlasCount;
+        size_t texelCount = static_cast<size_t>(atlas.width) * atlas.height * atlas.atlasCount;
+        buffer.texels.assign(texelCount, TexelRecord{});
+        buffer.charts.assign(texelCount, TexelBuffer::kNoChart);
+
+        std::vector<uint32_t> triangleOffsets = scene.GetTriangleOffsets();
+        std::vector<TriangleSetup> triangles;
+        triangles.reserve(triangleOffsets.back());
+        glm::vec2 size(static_cast<float>(atlas.width), static_cast<float>(atlas.height));
+        for (size_t m = 0; m < scene.meshes.size(); ++m)
+        {
+            const Mesh& mesh = scene.meshes[m];
+            const AtlasMesh& atlasMesh = atlas.meshes[m];
+            for (uint32_t t = 0; t < mesh.GetTriangleCount(); ++t)
+            {
+                TriangleSetup tri;
+                for (int k = 0; k < 3; ++k)
+                {
+                    uint32_t vertex = atlasMesh.indices[t * 3 + k];
+                    uint32_t source = atlasMesh.xref[vertex];
+                    tri.uv[k] = atlasMesh.uvs[vertex] * size;
+                    tri.position[k] = mesh.positions[source];
+                }
+                glm::vec3 faceNormal = glm::cross(tri.position[1] - tri.position[0], tri.position[2] - tri.position[0]);
+                float length = glm::length(faceNormal);
+                faceNormal = length > 0.0f ? faceNormal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                for (int k = 0; k < 3; ++k)
+                    tri.normal[k] = mesh.normals.empty() ? faceNormal : mesh.normals[atlasMesh.xref[atlasMesh.indices[t * 3 + k]]];
+
+                tri.chart = atlasMesh.triangleCharts[t];
+                tri.atlasIndex = atlas.charts[tri.chart].atlasIndex;
+                tri.triangleId = triangleOffsets[m] + t;
+                if (Setup(tri))
+                    triangles.push_back(tri);
+            }
+        }
+
+        // Bin triangles into tiles: count, prefix sum, fill.
+        uint32_t tilesX = (atlas.width + m_tileSize - 1) / m_tileSize;
+        uint32_t tilesY = (atlas.height + m_tileSize - 1) / m_tileSize;
+        size_t tileCount = static_cast<size_t>(tilesX) * tilesY * atlas.atlasCount;
+        auto forEachTile = [&](const TriangleSetup& tri, auto&& visit) {
+            glm::vec2 lo = glm::min(tri.uv[0], glm::min(tri.uv[1], tri.uv[2]));
+            glm::vec2 hi = glm::max(tri.uv[0], glm::max(tri.uv[1], tri.uv[2]));
+            uint32_t tx0 = std::min(tilesX - 1, static_cast<uint32_t>(std::max(0.0f, lo.x)) / m_tileSize);
+            uint32_t ty0 = std::min(tilesY - 1, static_cast<uint32_t>(std::max(0.0f, lo.y)) / m_tileSize);
+            uint32_t tx1 = std::min(tilesX - 1, static_cast<uint32_t>(std::max(0.0f, hi.x)) / m_tileSize);
+            uint32_t ty1 = std::min(tilesY - 1, static_cast<uint32_t>(std::max(0.0f, hi.y)) / m_tileSize);
+            for (uint32_t ty = ty0; ty <= ty1; ++ty)
+                for (uint32_t tx = tx0; tx <= tx1; ++tx)
+                    visit((static_cast<size_t>(tri.atlasIndex) * tilesY + ty) * tilesX + tx);
+        };
+
+        std::vector<uint32_t> binStart(tileCount + 1, 0);
+        for (const TriangleSetup& tri : triangles)
+            forEachTile(tri, [&](size_t tile) { ++binStart[tile + 1]; });
+        for (size_t i = 0; i < tileCount; ++i)
+            binStart[i + 1] += binStart[i];
+        std::vector<uint32_t> binCursor(binStart.begin(), binStart.end() - 1);
+        std::vector<uint32_t> bins(binStart.back());
+        for (uint32_t i = 0; i < triangles.size(); ++i)
+            forEachTile(triangles[i], [&](size_t tile) { bins[binCursor[tile]++] = i; });
+
+        // Tiles own disjoint texels, so they are rasterized without synchronization.
+        bvh::v2::ParallelExecutor executor(threadPool, 1);
+        executor.for_each(0, tileCount, [&](size_t begin, size_t end) {
+            std::vector<float> bestCoverage(static_cast<size_t>(m_tileSize) * m_tileSize);
+            for (size_t tile = begin; tile < end; ++tile)
+            {
+                if (binStart[tile] == binStart[tile + 1])
+                    continue;
+                std::fill(bestCoverage.begin(), bestCoverage.end(), 0.0f);
+                uint32_t tileX = static_cast<uint32_t>(tile % tilesX) * m_tileSize;
+                uint32_t tileY = static_cast<uint32_t>((tile / tilesX) % tilesY) * m_tileSize;
+                for (uint32_t i = binStart[tile]; i < binStart[tile + 1]; ++i)
+                    RasterizeInTile(buffer, bestCoverage, triangles[bins[i]], tileX, tileY, m_tileSize);
+            }
+        });
+        return buffer;
+    }
+}
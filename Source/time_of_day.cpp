@@ -0,0 +1,170 @@
+#include "Bake/time_of_day.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <bvh/v2/executor.h>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        constexpr uint32_t kRussianRouletteDepth = 2;
+        // RGBA16F, as the preview uploads lightmaps.
+        constexpr size_t kBytesPerTexel = 8;
+    }
+
+    void TimeOfDayLightmaps::GetBlend(float hour, uint32_t& first, uint32_t& second, float& weight) const
+    {
+        first = 0;
+        second = 0;
+        weight = 0.0f;
+        if (keyframes.empty() || hour <= keyframes.front().hour)
+            return;
+        uint32_t last = static_cast<uint32_t>(keyframes.size()) - 1;
+        if (hour >= keyframes[last].hour)
+        {
+            first = second = last;
+            return;
+        }
+        while (keyframes[second].hour <= hour)
+            second++;
+        first = second - 1;
+        float span = keyframes[second].hour - keyframes[first].hour;
+        weight = span > 0.0f ? (hour - keyframes[first].hour) / span : 0.0f;
+    }
+
+    Lightmap TimeOfDayLightmaps::Blend(float hour, const glm::vec3& sunIrradiance, const glm::vec3& skyRadiance) const
+    {
+        Lightmap lightmap;
+        lightmap.width = width;
+        lightmap.height = height;
+        lightmap.atlasCount = atlasCount;
+        lightmap.texels.assign(coverage.size(), glm::vec4(0.0f));
+        uint32_t first, second;
+        float weight;
+        GetBlend(hour, first, second, weight);
+        const std::vector<glm::vec3>& sky = bases[GetSkyBasis()];
+        for (size_t i = 0; i < coverage.size(); ++i)
+        {
+            if (!coverage[i])
+                continue;
+            glm::vec3 irradiance = sky[i] * skyRadiance;
+            if (!keyframes.empty())
+                irradiance += glm::mix(bases[first][i], bases[second][i], weight) * sunIrradiance;
+            lightmap.texels[i] = glm::vec4(irradiance, 1.0f);
+        }
+        return lightmap;
+    }
+
+    TimeOfDayBaker::TimeOfDayBaker(const TimeOfDaySettings& settings)
+        : m_settings(settings)
+    {
+        m_settings.samplesPerTexel = std::max(1u, m_settings.samplesPerTexel);
+        for (SunKeyframe& keyframe : m_settings.keyframes)
+            keyframe.direction = glm::normalize(keyframe.direction);
+        std::stable_sort(m_settings.keyframes.begin(), m_settings.keyframes.end(),
+                         [](const SunKeyframe& a, const SunKeyframe& b) { return a.hour < b.hour; });
+        // Blue noise needs the engine's tile; the bases are converged anyway.
+        if (m_settings.sampler == SamplerType::BlueNoise)
+            m_settings.sampler = SamplerType::Sobol;
+    }
+
+    TimeOfDayLightmaps TimeOfDayBaker::Bake(const RayTracer& tracer, const TexelBuffer& texels, bvh::v2::ThreadPool& threadPool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_stats = TimeOfDayStats();
+        const Scene& scene = tracer.GetScene();
+        size_t suns = m_settings.keyframes.size();
+        TimeOfDayLightmaps result;
+        result.width = texels.width;
+        result.height = texels.height;
+        result.atlasCount = texels.atlasCount;
+        result.keyframes = m_settings.keyframes;
+        result.bases.assign(suns + 1, std::vector<glm::vec3>(texels.texels.size(), glm::vec3(0.0f)));
+        result.coverage.assign(texels.texels.size(), 0);
+
+        // Cosine sampling turns the irradiance integral into pi times the mean radiance; a
+        // sun's irradiance is already a cosine, so its samples are only averaged.
+        float sampleWeight = 1.0f / static_cast<float>(m_settings.samplesPerTexel);
+        std::atomic<uint64_t> pathRays{ 0 };
+        std::atomic<uint64_t> shadowRays{ 0 };
+        bvh::v2::ParallelExecutor executor(threadPool, 64);
+        executor.for_each(0, texels.texels.size(), [&](size_t begin, size_t end) {
+            uint64_t localPathRays = 0;
+            uint64_t localShadowRays = 0;
+            std::vector<glm::vec3> sum(suns + 1);
+            for (size_t index = begin; index < end; ++index)
+            {
+                if (!texels.IsCovered(index))
+                    continue;
+                result.coverage[index] = 1;
+                const TexelRecord& texel = texels.texels[index];
+                std::fill(sum.begin(), sum.end(), glm::vec3(0.0f));
+                for (uint32_t s = 0; s < m_settings.samplesPerTexel; ++s)
+                {
+                    Sampler sampler(m_settings.sampler, index, s, 0, 0, nullptr);
+                    glm::vec3 position = texel.position;
+                    glm::vec3 normal = texel.normal;
+                    // Albedos of the vertices before the current one, over the Russian roulette survival.
+                    glm::vec3 throughput(1.0f);
+                    glm::vec3 albedo(1.0f);
+                    for (uint32_t bounce = 0;; ++bounce)
+                    {
+                        glm::vec3 origin = position + normal * tracer.GetEpsilon();
+                        // One shadow ray per sun serves that sun's basis alone.
+                        for (size_t k = 0; k < suns; ++k)
+                        {
+                            const glm::vec3& sun = m_settings.keyframes[k].direction;
+                            float cosine = glm::dot(normal, sun);
+                            if (cosine <= 0.0f)
+                                continue;
+                            localShadowRays++;
+                            if (!tracer.Occluded(origin, sun, std::numeric_limits<float>::max()))
+                                sum[k] += throughput * albedo * cosine;
+                        }
+                        throughput *= albedo;
+                        if (bounce >= kRussianRouletteDepth)
+                        {
+                            float survival = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                            if (sampler.Next1D() >= survival)
+                                break;
+                            throughput /= survival;
+                        }
+                        glm::vec2 u = sampler.Next2D();
+                        glm::vec3 direction = SampleCosineHemisphere(normal, u.x, u.y);
+                        localPathRays++;
+                        RayHit hit;
+                        if (!tracer.Intersect(origin, direction, std::numeric_limits<float>::max(), hit))
+                        {
+                            sum[suns] += throughput * kPi;
+                            break;
+                        }
+                        // As in BakeEngine, the sky through the last bounce counts but its hit is not lit.
+                        if (bounce >= m_settings.maxBounces)
+                            break;
+                        SurfacePoint surface = tracer.GetSurface(origin, direction, hit);
+                        position = surface.position;
+                        normal = surface.normal;
+                        albedo = scene.GetMaterial(surface.materialIndex).albedo;
+                    }
+                }
+                for (size_t b = 0; b <= suns; ++b)
+                    result.bases[b][index] = sum[b] * sampleWeight;
+            }
+            pathRays += localPathRays;
+            shadowRays += localShadowRays;
+        });
+
+        for (uint8_t covered : result.coverage)
+            m_stats.coveredTexels += covered;
+        m_stats.rays = pathRays + shadowRays;
+        m_stats.separateRays = (suns + 1) * pathRays + shadowRays;
+        m_stats.lightmapBytes = texels.texels.size() * kBytesPerTexel;
+        m_stats.basisBytes = (suns + 1) * m_stats.lightmapBytes;
+        m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+}
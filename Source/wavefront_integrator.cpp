@@ -0,0 +1,264 @@
+#include "Bake/wavefront_integrator.h"
+
+#include <algorithm>
+#include <limits>
+#include "Bake/sampling.h"
+
+namespace LightChef
+{
+    namespace
+    {
+        // Must match PathIntegrator::Radiance.
+        constexpr uint32_t kRussianRouletteDepth = 2;
+        constexpr uint32_t kNoHit = ~0u;
+    }
+
+    void WavefrontIntegrator::RayQueue::Clear()
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis].clear();
+            direction[axis].clear();
+        }
+        maxDistance.clear();
+        path.clear();
+    }
+
+    void WavefrontIntegrator::RayQueue::Push(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, float rayMaxDistance, uint32_t pathSlot)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis].push_back(rayOrigin[axis]);
+            direction[axis].push_back(rayDirection[axis]);
+        }
+        maxDistance.push_back(rayMaxDistance);
+        path.push_back(pathSlot);
+    }
+
+    void WavefrontIntegrator::RayQueue::Load(std::span<const uint32_t> order, size_t first, RayPacket& packet) const
+    {
+        alignas(16) float lanes[7][4] = {};
+        packet.activeMask = 0;
+        for (size_t lane = 0; lane < 4 && first + lane < order.size(); ++lane)
+        {
+            uint32_t ray = order[first + lane];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                lanes[axis][lane] = origin[axis][ray];
+                lanes[3 + axis][lane] = direction[axis][ray];
+            }
+            lanes[6][lane] = maxDistance[ray];
+            packet.activeMask |= 1 << lane;
+        }
+        // Inactive lanes get a harmless ray along +x.
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            if (!(packet.activeMask & (1 << lane)))
+                lanes[3][lane] = 1.0f;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            packet.origin[axis] = Float4::Load(lanes[axis]);
+            packet.direction[axis] = Float4::Load(lanes[3 + axis]);
+        }
+        packet.maxDistance = Float4::Load(lanes[6]);
+    }
+
+    WavefrontIntegrator::WavefrontIntegrator(const PathIntegrator& integrator, SamplerType sampler, const BlueNoiseTile* blueNoise, uint32_t maxBounces,
+                                             uint32_t batchSize)
+        : m_integrator(integrator)
+        , m_tracer(integrator.GetRayTracer())
+        , m_lights(integrator.GetLights())
+        , m_samplerType(sampler)
+        , m_blueNoise(blueNoise)
+        , m_maxBounces(maxBounces)
+        , m_batchSize(std::max(batchSize, 1u))
+    {
+    }
+
+    void WavefrontIntegrator::Trace(const TexelBuffer& texels, std::span<const PathRequest> paths, std::span<PathResult> results)
+    {
+        for (size_t first = 0; first < paths.size(); first += m_batchSize)
+        {
+            size_t count = std::min<size_t>(m_batchSize, paths.size() - first);
+            std::span<PathResult> batchResults = results.subspan(first, count);
+            Generate(texels, paths.subspan(first, count), batchResults);
+            TraceShadowRays(batchResults, true);
+            while (m_rays.GetSize() > 0)
+            {
+                Extend();
+                Shade();
+                TraceShadowRays(batchResults, false);
+                std::swap(m_rays, m_nextRays);
+            }
+            for (size_t i = 0; i < count; ++i)
+                batchResults[i].indirect = kPi * m_paths[i].radiance;
+        }
+    }
+
+    void WavefrontIntegrator::Generate(const TexelBuffer& texels, std::span<const PathRequest> paths, std::span<PathResult> results)
+    {
+        m_paths.clear();
+        m_rays.Clear();
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            const PathRequest& request = paths[i];
+            const TexelRecord& texel = texels.texels[request.texelIndex];
+            uint32_t slot = static_cast<uint32_t>(i);
+            PathState& path = m_paths.emplace_back(
+                PathState{ Sampler(m_samplerType, request.texelIndex, request.sampleIndex, request.x, request.y, m_blueNoise) });
+            results[i] = PathResult();
+
+            LightSample sample;
+            if (m_integrator.SampleDirect(texel.position, texel.normal, path.sampler, sample))
+                QueueShadowRay(sample, sample.irradiance, slot);
+            results[i].lightDirection = sample.direction;
+
+            glm::vec3 origin = texel.position + texel.normal * m_tracer.GetEpsilon();
+            glm::vec2 u = path.sampler.Next2D();
+            glm::vec3 direction = SampleCosineHemisphere(texel.normal, u.x, u.y);
+            results[i].direction = direction;
+            path.normal = texel.normal;
+            m_rays.Push(origin, direction, std::numeric_limits<float>::max(), slot);
+        }
+    }
+
+    void WavefrontIntegrator::Extend()
+    {
+        size_t count = m_rays.GetSize();
+        m_hitTriangles.resize(count);
+        m_hitDistances.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            RayHit hit;
+            bool found = m_tracer.Intersect(m_rays.GetOrigin(i), m_rays.GetDirection(i), m_rays.maxDistance[i], hit);
+            m_hitTriangles[i] = found ? hit.triangleId : kNoHit;
+            m_hitDistances[i] = hit.distance;
+        }
+    }
+
+    void WavefrontIntegrator::Shade()
+    {
+        const Scene& scene = m_tracer.GetScene();
+        size_t count = m_rays.GetSize();
+        m_nextRays.Clear();
+
+        // Escaped rays first, then a counting sort of the hits by material, so consecutive
+        // shading reads the same material and the next queue keeps neighbouring paths together.
+        uint32_t defaultMaterial = static_cast<uint32_t>(scene.materials.size());
+        m_materialOffsets.assign(defaultMaterial + 2, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (m_hitTriangles[i] == kNoHit)
+            {
+                PathState& path = m_paths[m_rays.path[i]];
+                glm::vec3 direction = m_rays.GetDirection(i);
+                if (m_lights.HasEnvironment())
+                {
+                    float lightPdf =
+                        m_lights.GetPmf(m_rays.GetOrigin(i), path.normal, LightSet::kEnvironmentLight) * m_lights.GetEnvironment().GetPdf(direction);
+                    float weight = PowerHeuristic(glm::dot(path.normal, direction) * kInvPi, lightPdf);
+                    path.radiance += path.throughput * m_lights.GetEnvironment().Evaluate(direction) * weight;
+                }
+                else
+                {
+                    path.radiance += path.throughput * scene.skyColor;
+                }
+                continue;
+            }
+            m_materialOffsets[std::min(m_tracer.GetMaterialIndex(m_hitTriangles[i]), defaultMaterial) + 1]++;
+        }
+        for (size_t m = 1; m < m_materialOffsets.size(); ++m)
+            m_materialOffsets[m] += m_materialOffsets[m - 1];
+        m_shadeOrder.resize(m_materialOffsets.back());
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (m_hitTriangles[i] != kNoHit)
+                m_shadeOrder[m_materialOffsets[std::min(m_tracer.GetMaterialIndex(m_hitTriangles[i]), defaultMaterial)]++] = static_cast<uint32_t>(i);
+        }
+
+        for (uint32_t ray : m_shadeOrder)
+        {
+            uint32_t slot = m_rays.path[ray];
+            PathState& path = m_paths[slot];
+            glm::vec3 origin = m_rays.GetOrigin(ray);
+            glm::vec3 direction = m_rays.GetDirection(ray);
+            RayHit hit{ m_hitTriangles[ray], m_hitDistances[ray] };
+            SurfacePoint surface = m_tracer.GetSurface(origin, direction, hit);
+            const Material& material = scene.GetMaterial(surface.materialIndex);
+
+            // Every bounce ray was cosine-sampled at a point that also sampled lights.
+            uint32_t light = m_lights.GetEmissiveLight(hit.triangleId);
+            if (light != LightSet::kNoLight)
+            {
+                const EmissiveTriangle& triangle = m_lights.GetEmissiveTriangles()[light - m_lights.GetPunctualCount()];
+                float cosLight = -glm::dot(triangle.normal, direction);
+                if (cosLight > 0.0f)
+                {
+                    float lightPdf = m_lights.GetPmf(origin, path.normal, light) * hit.distance * hit.distance / (triangle.area * cosLight);
+                    float weight = PowerHeuristic(glm::dot(path.normal, direction) * kInvPi, lightPdf);
+                    path.radiance += path.throughput * material.emission * weight;
+                }
+            }
+            if (path.bounce >= m_maxBounces)
+                continue;
+
+            LightSample sample;
+            if (m_integrator.SampleDirect(surface.position, surface.normal, path.sampler, sample))
+                QueueShadowRay(sample, path.throughput * material.albedo * kInvPi * sample.irradiance, slot);
+
+            path.throughput *= material.albedo;
+            if (path.bounce >= kRussianRouletteDepth)
+            {
+                float survival = std::min(0.95f, std::max(path.throughput.x, std::max(path.throughput.y, path.throughput.z)));
+                if (path.sampler.Next1D() >= survival)
+                    continue;
+                path.throughput /= survival;
+            }
+
+            path.normal = surface.normal;
+            path.bounce++;
+            glm::vec2 u = path.sampler.Next2D();
+            m_nextRays.Push(surface.position + surface.normal * m_tracer.GetEpsilon(), SampleCosineHemisphere(surface.normal, u.x, u.y),
+                            std::numeric_limits<float>::max(), slot);
+        }
+    }
+
+    void WavefrontIntegrator::QueueShadowRay(const LightSample& sample, const glm::vec3& contribution, uint32_t pathSlot)
+    {
+        m_shadowKeys.push_back(static_cast<uint64_t>(sample.light) << 32 | m_shadowRays.GetSize());
+        m_shadowRays.Push(sample.origin, sample.direction, sample.maxDistance, pathSlot);
+        m_shadowContributions.push_back(contribution);
+    }
+
+    void WavefrontIntegrator::TraceShadowRays(std::span<PathResult> results, bool direct)
+    {
+        // Rays to one light leave neighbouring points in similar directions, so packets of
+        // them mostly visit the same nodes.
+        std::sort(m_shadowKeys.begin(), m_shadowKeys.end());
+        m_shadowOrder.resize(m_shadowKeys.size());
+        for (size_t i = 0; i < m_shadowKeys.size(); ++i)
+            m_shadowOrder[i] = static_cast<uint32_t>(m_shadowKeys[i]);
+
+        RayPacket packet;
+        for (size_t first = 0; first < m_shadowOrder.size(); first += 4)
+        {
+            m_shadowRays.Load(m_shadowOrder, first, packet);
+            int visible = packet.activeMask & ~m_tracer.Occluded(packet);
+            for (size_t lane = 0; lane < 4; ++lane)
+            {
+                if (!(visible & (1 << lane)))
+                    continue;
+                uint32_t ray = m_shadowOrder[first + lane];
+                uint32_t slot = m_shadowRays.path[ray];
+                if (direct)
+                    results[slot].direct += m_shadowContributions[ray];
+                else
+                    m_paths[slot].radiance += m_shadowContributions[ray];
+            }
+        }
+        m_shadowRays.Clear();
+        m_shadowContributions.clear();
+        m_shadowKeys.clear();
+    }
+}
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Checks the BC6H encoder against Pillow's independent BC6H decoder.
+
+Usage: Bench bc6h 4 <directory> && Tools/check_bc6h.py <directory>
+
+For every bc6h_<quality>.dds that Bench wrote, Pillow decodes the blocks
+to 8-bit RGB, which must match the encoder's own decode (bc6h_<quality>.bin,
+float RGB rows) clamped to [0, 1] within rounding. Install Pillow with
+Tools/install_requirements.sh.
+"""
+import array
+import pathlib
+import sys
+
+from PIL import Image
+
+# Pillow rounds half floats to 8 bits on its own terms; allow one step and a bit.
+TOLERANCE = 1.5
+
+
+def check(dds_path):
+    image = Image.open(dds_path).convert("RGB")
+    decoded = image.tobytes()
+    expected = array.array("f")
+    expected.frombytes(dds_path.with_suffix(".bin").read_bytes())
+    if len(expected) != len(decoded):
+        print(f"{dds_path.name}: {image.size[0]}x{image.size[1]} does not match the encoder's decode")
+        return False
+    worst = 0.0
+    mismatches = 0
+    for value, pixel in zip(expected, decoded):
+        difference = abs(pixel - min(max(value, 0.0), 1.0) * 255.0)
+        worst = max(worst, difference)
+        mismatches += difference > TOLERANCE
+    print(f"{dds_path.name}: {image.size[0]}x{image.size[1]}, largest difference {worst:.2f}/255, {mismatches} mismatches")
+    return mismatches == 0
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+    paths = sorted(pathlib.Path(sys.argv[1]).glob("bc6h_*.dds"))
+    if not paths:
+        print(f"No bc6h_*.dds in {sys.argv[1]}")
+        return 1
+    results = [check(path) for path in paths]
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,3 @@
+#!/usr/bin/env bash
+# Installs the Python packages the scripts in Tools need.
+python3 -m pip install -r "$(dirname "$0")/requirements.txt"